@@ -27,12 +27,27 @@ GraphNode*** initGraph(int dim_x, int dim_y){
     return graph;
 }
 
-bool graphNodeAddNeighbour(GraphNode **first, int z){
+omp_lock_t** initLocks(int dim_x, int dim_y){
+    int i,j;
+    omp_lock_t **graph_lock = malloc(sizeof(omp_lock_t*) * dim_x);
+
+    for (i = 0; i < dim_x; i++){
+        graph_lock[i] = malloc(sizeof(omp_lock_t) * dim_y);
+        for (j = 0; j < dim_y; j++){
+            omp_init_lock(&(graph_lock[i][j]));
+        }
+    }
+    return graph_lock;
+}
+
+bool graphNodeAddNeighbour(GraphNode **first, int z, omp_lock_t *lock_ptr){
     GraphNode *it;
+    omp_set_lock(lock_ptr);
     /* Search for the node */
     for (it = *first; it != NULL; it = it->next){
         if (it->z == z){
             it->neighbours++;
+            omp_unset_lock(lock_ptr);
             return false;
         }
     }
@@ -41,39 +56,61 @@ bool graphNodeAddNeighbour(GraphNode **first, int z){
     GraphNode* new = graphNodeInsert(*first, z, DEAD);
     new->neighbours++;
     *first = new;
+    omp_unset_lock(lock_ptr);
+    return true;
+}
+
+bool graphNodeSetAlive(GraphNode **first, int z, omp_lock_t *lock_ptr){
+    GraphNode *it;
+    omp_set_lock(lock_ptr);
+    /* Search for the node */
+    for (it = *first; it != NULL; it = it->next){
+        if (it->z == z){
+            it->state = ALIVE;
+            omp_unset_lock(lock_ptr);
+            return false;
+        }
+    }
+
+    /* Need to insert the node */
+    *first = graphNodeInsert(*first, z, ALIVE);
+    omp_unset_lock(lock_ptr);
     return true;
 }
 
-void visitInternalNeighbours(GraphNode ***local_graph, int cube_size, int x, int y, int z){
+void visitInternalNeighbours(GraphNode ***local_graph, omp_lock_t **graph_lock, int lo, int hi_z, int x, int y, int z){
 
     /**
      * @attention x+1, x-1, y+1, y-1 are guaranteed to be valid indices,
      * since (x,y,z) is considered to be internal, i.e., not on a border
      */
-    
-    int z1, z2;
-    z1 = (z+1)%cube_size; z2 = (z-1) < 0 ? (cube_size-1) : (z-1);
-    
-    graphNodeAddNeighbour(&(local_graph[x+1][y]), z);
-    graphNodeAddNeighbour(&(local_graph[x-1][y]), z);
-    graphNodeAddNeighbour(&(local_graph[x][y+1]), z);
-    graphNodeAddNeighbour(&(local_graph[x][y-1]), z);
-    graphNodeAddNeighbour(&(local_graph[x][y]), z1);
-    graphNodeAddNeighbour(&(local_graph[x][y]), z2);
+
+    graphNodeAddNeighbour(&(local_graph[x+1][y]), z, &(graph_lock[x+1][y]));
+    graphNodeAddNeighbour(&(local_graph[x-1][y]), z, &(graph_lock[x-1][y]));
+    graphNodeAddNeighbour(&(local_graph[x][y+1]), z, &(graph_lock[x][y+1]));
+    graphNodeAddNeighbour(&(local_graph[x][y-1]), z, &(graph_lock[x][y-1]));
+    if (z+1 < hi_z){ graphNodeAddNeighbour(&(local_graph[x][y]), z+1, &(graph_lock[x][y])); }
+    if (z-1 >= lo){ graphNodeAddNeighbour(&(local_graph[x][y]), z-1, &(graph_lock[x][y])); }
 }
 
-void visitBoundaryNeighbours(GraphNode ***local_graph, int cube_size,
-    int dim_x, int dim_y, int x, int y, int z){
+void visitBoundaryNeighbours(GraphNode ***local_graph, omp_lock_t **graph_lock, int lo, int hi_x, int hi_y, int hi_z,
+    int x, int y, int z){
 
-    int z1, z2;
-    z1 = (z+1)%cube_size; z2 = (z-1) < 0 ? (cube_size-1) : (z-1);
+    /* (x,y,z) itself may lie just outside the box */
+    bool in_x = (x >= lo && x < hi_x), in_y = (y >= lo && y < hi_y), in_z = (z >= lo && z < hi_z);
 
-    if (x+1 < dim_x){ graphNodeAddNeighbour(&(local_graph[x+1][y]), z);}
-    if (x-1 >= 0){ graphNodeAddNeighbour(&(local_graph[x-1][y]), z); }
-    if (y+1 < dim_y){ graphNodeAddNeighbour(&(local_graph[x][y+1]), z);}
-    if (y-1 >= 0){ graphNodeAddNeighbour(&(local_graph[x][y-1]), z); }
-    graphNodeAddNeighbour(&(local_graph[x][y]), z1);
-    graphNodeAddNeighbour(&(local_graph[x][y]), z2);
+    if (in_y && in_z){
+        if (x+1 >= lo && x+1 < hi_x){ graphNodeAddNeighbour(&(local_graph[x+1][y]), z, &(graph_lock[x+1][y]));}
+        if (x-1 >= lo && x-1 < hi_x){ graphNodeAddNeighbour(&(local_graph[x-1][y]), z, &(graph_lock[x-1][y])); }
+    }
+    if (in_x && in_z){
+        if (y+1 >= lo && y+1 < hi_y){ graphNodeAddNeighbour(&(local_graph[x][y+1]), z, &(graph_lock[x][y+1]));}
+        if (y-1 >= lo && y-1 < hi_y){ graphNodeAddNeighbour(&(local_graph[x][y-1]), z, &(graph_lock[x][y-1])); }
+    }
+    if (in_x && in_y){
+        if (z+1 >= lo && z+1 < hi_z){ graphNodeAddNeighbour(&(local_graph[x][y]), z+1, &(graph_lock[x][y])); }
+        if (z-1 >= lo && z-1 < hi_z){ graphNodeAddNeighbour(&(local_graph[x][y]), z-1, &(graph_lock[x][y])); }
+    }
 }
 
 void printAndSortActiveSub(GraphNode ***graph, int offset_x, int offset_y, int dim_x, int dim_y){
@@ -139,6 +176,18 @@ void freeGraph(GraphNode ***graph, int dim_x, int dim_y){
     }
 }
 
+void freeLocks(omp_lock_t **graph_lock, int dim_x, int dim_y){
+
+    int i, j;
+    for (i = 0; i < dim_x; i++){
+        for (j = 0; j < dim_y; j++){
+            omp_destroy_lock(&(graph_lock[i][j]));
+        }
+        free(graph_lock[i]);
+    }
+    free(graph_lock);
+}
+
 void graphNodeDelete(GraphNode *first){
     GraphNode *it, *next;
     for(it = first; it != NULL; it = next){
@@ -172,3 +221,17 @@ void graphListCleanup(GraphNode** head){
         }
     }
 }
+
+void graphListCrop(GraphNode** head, int lo, int hi){
+    GraphNode *it, *next;
+    GraphNode **prev = head;
+    for (it = *head; it != NULL; it = next){
+        next = it->next;
+        if (it->z < lo || it->z >= hi){
+            *prev = next;
+            free(it);
+        } else {
+            prev = &(it->next);
+        }
+    }
+}
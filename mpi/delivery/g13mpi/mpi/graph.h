@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <omp.h>
 
 /* Macros */
 
@@ -41,15 +42,9 @@ typedef struct _Node{
     uint16_t z;  /**< z coordinate */
 }Node;
 
-/** @brief Reduced node structure for sending borders over MPI */
-typedef struct _RNode{
-    uint16_t a;  /**< x or y relative coordinate */
-    uint16_t z;  /**< z coordinate */
-}RNode;
-
 /** @brief Structure for storing a node of the graph */
 typedef struct _GraphNode{
-    uint16_t z;                 /**< z coordinate, x and y are implicitly mapped */
+    uint16_t z;                 /**< z local coordinate, x and y are implicitly mapped */
     uint8_t state;              /**< State of a node cell (DEAD or ALIVE) */
     uint8_t neighbours;         /**< Neighbour counter */
     struct _GraphNode *next;    /**< Pointer to the next entry in the list */
@@ -76,41 +71,72 @@ GraphNode *graphNodeInsert(GraphNode *first, int z, int state);
  */
 GraphNode ***initGraph(int dim_x, int dim_y);
 
+/** 
+ * @brief Initialises one lock per (x,y) list of a graph
+ *  
+ * @param dim_x The graph size in dimension x
+ * @param dim_y The graph size in dimension y
+ * @return The initialised locks
+ */
+omp_lock_t **initLocks(int dim_x, int dim_y);
+
 /**
  * @brief Inserts a cell if not yet present and increments its number of live nighbours
  * 
+ * @param first A pointer to the first node of the list
+ * @param z z local coordinate
+ * @param lock_ptr The lock of the list
  * @return Whether the cell was inserted in the graph or not
  */
-bool graphNodeAddNeighbour(GraphNode **first, int z);
+bool graphNodeAddNeighbour(GraphNode **first, int z, omp_lock_t *lock_ptr);
+
+/**
+ * @brief Makes a cell alive, inserting it if not yet present
+ * 
+ * @details Keeps the live neighbours it may have already been notified of
+ * 
+ * @param first A pointer to the first node of the list
+ * @param z z local coordinate
+ * @param lock_ptr The lock of the list
+ * @return Whether the cell was inserted in the graph or not
+ */
+bool graphNodeSetAlive(GraphNode **first, int z, omp_lock_t *lock_ptr);
 
 /**
  * @brief Visits neighbours that are not in the boundaries
  * 
  * @attention x+1, x-1, y+1, y-1 are guaranteed to be valid indices,
- * since (x,y,z) is considered to be internal, i.e., not on a border
+ * since (x,y,z) is considered to be internal, i.e., inside the box being
+ * computed and not on its x or y borders. Only z is checked against it
  * 
  * @param local_graph The local graph representation, subspace of the global cubic space
- * @param cube_size The side of the cube that represents 3D space
+ * @param graph_lock The locks of the local graph lists
+ * @param lo The lowest coordinate of the box in every dimension
+ * @param hi_z One past the highest z of the box
  * @param x x local coordinate
  * @param y y local coordinate
- * @param z z global coordinate
+ * @param z z local coordinate
  */
-void visitInternalNeighbours(GraphNode ***local_graph, int cube_size, int x, int y, int z);
+void visitInternalNeighbours(GraphNode ***local_graph, omp_lock_t **graph_lock, int lo, int hi_z, int x, int y, int z);
 
 /**
- * @brief Visits neighbours on the local graph boundaries
+ * @brief Visits neighbours on the boundaries of the box being computed
  * 
  * @details  Notifies the neighbours of (x,y,z) of its aliveness
+ * that lie inside the box [lo, hi_x) x [lo, hi_y) x [lo, hi_z).
+ * (x,y,z) itself may be outside the box
  * 
  * @param local_graph The local graph representation, subspace of the global cubic space
- * @param cube_size The side of the cube that represents 3D space
- * @param dim_x The graph size in dimension x
- * @param dim_y The graph size in dimension y
+ * @param graph_lock The locks of the local graph lists
+ * @param lo The lowest coordinate of the box in every dimension
+ * @param hi_x One past the highest x of the box
+ * @param hi_y One past the highest y of the box
+ * @param hi_z One past the highest z of the box
  * @param x x local coordinate
  * @param y y local coordinate
- * @param z z global coordinate
+ * @param z z local coordinate
  */
-void visitBoundaryNeighbours(GraphNode ***local_graph, int cube_size, int dim_x, int dim_y, int x, int y, int z);
+void visitBoundaryNeighbours(GraphNode ***local_graph, omp_lock_t **graph_lock, int lo, int hi_x, int hi_y, int hi_z, int x, int y, int z);
 
 /**
  * @brief Prints the graph, and sorts each of the lists
@@ -137,6 +163,15 @@ void graphNodeSort(GraphNode **first_ptr);
  */
 void freeGraph(GraphNode*** graph, int dim_x, int dim_y);
 
+/**
+ * @brief Destroys and frees the locks of a graph
+ *
+ * @param graph_lock The locks
+ * @param dim_x The graph size in dimension x
+ * @param dim_y The graph size in dimension y
+ */
+void freeLocks(omp_lock_t **graph_lock, int dim_x, int dim_y);
+
 /** 
  * @brief Deletes a list of GraphNodes
  *
@@ -150,4 +185,12 @@ void graphNodeDelete(GraphNode* first);
  */
 void graphListCleanup(GraphNode** head);
 
+/** @brief Removes the nodes of a graph list outside a range of z
+ *
+ *  @param head A pointer to the pointer of the graph list to be cropped
+ *  @param lo The lowest z to keep
+ *  @param hi One past the highest z to keep
+ */
+void graphListCrop(GraphNode** head, int lo, int hi);
+
 #endif
\ No newline at end of file
@@ -20,28 +20,33 @@ int main(int argc, char **argv) {
     int nprocs = 0, rank = 0; //Number of processes and rank of the process
     int size = 0; /**< Cube size */
     int x, y, z, i, j; /**< Generic iterators */
-    int cells_receive;  /**< Cells that are announced that the process will receive */
+    int n_read; /**< Cells read from this rank's share of the input file */
+    int cells_receive;  /**< Cells that the process receives */
     int generations; /**< Generations */
-    int* sendcounts, *displs = NULL; /**< sendcounts - number of elements to send to each rank. displs - offset regarding the start of the array in terms of number of elements */
 
     /*Communication buffers*/
     node *receivebuffer, *sendbuffer;
 
     /*Frontiers*/
-    int low_number_amount, high_number_amount;
-    int low_frontier_count=0, high_frontier_count=0;
-    int low_frontier_size=0, high_frontier_size=0;
-    neighbour_node* sending_low_frontier; /**< Buffer for sending your side of the low frontier */
-    neighbour_node* sending_high_frontier; /**< Buffer for sending your side of the high frontier */
-    neighbour_node* receiving_low_frontier; /**< Buffer to receive the other side of the low frontier */
-    neighbour_node* receiving_high_frontier; /**< Buffer to receive the other side of the high frontier */
+    halo sending_low_frontier; /**< Channel for sending your side of the low frontier */
+    halo sending_high_frontier; /**< Channel for sending your side of the high frontier */
+    halo receiving_low_frontier; /**< Channel to receive the other side of the low frontier */
+    halo receiving_high_frontier; /**< Channel to receive the other side of the high frontier */
 
-    int alive_nodes = 0;
-    FILE* fp; char* file;   /**< Input data file and file name */
+    char* file;   /**< Input data file name */
+    char* output; /**< Output file name, NULL to print the final cells on stdout */
 
     int local_graph_length, total_length;
     int* lg_lengths, *lg_displs;
     node* all_lg, *lg_send;
+    int* slab_of; /**< Rank that writes each x slice of the output */
+
+    /*Rebalancing*/
+    int* cuts; /**< Block boundaries, rank r owns the rows [cuts[r], cuts[r+1]) */
+    int* row_load; /**< Live cells per row of the cube */
+    int* rank_load; /**< Live cells per rank */
+    int* migrate_counts, *migrate_displs; /**< Cells sent to each rank when reading the input or moving the boundaries */
+    int* migrated_counts, *migrated_displs; /**< Cells received from each rank when reading the input or moving the boundaries */
 
     MPI_Init(&argc, &argv);
     /*MPI PREAMBLE*/
@@ -72,266 +77,290 @@ int main(int argc, char **argv) {
     double starttime, endtime;
     starttime = MPI_Wtime();
 
-    char buffer[BUFFER_SIZE] = {0};
-    if(rank == ROOT){
-        /***************************************************** RAN BY ROOT **************************************************************************/
-        /***************************************************** PARSE COMMAND LINE ARGUMENTS *********************************************************/
-        parseArgs(argc, argv, &file, &generations);
-        /***************************************************** OPEN FILE AND READ FIRST LINE *********************************************************/
-        fp = fopen(file, "r");
-        //free(file); //Free filename we no longer need it
-        if(fp == NULL){
-            fprintf(stderr, "Please input a valid file name\n" );
-            exit(EXIT_FAILURE);
-        }
-
-        fgets(buffer,BUFFER_SIZE,fp);
-        sscanf(buffer,"%d", &size);
-    }
-
-    /************************************************** BROADCAST_SIZE *************************************************************************/
-    MPI_Bcast(&size, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
-    rank_print(rank); debug_print("Received size: %d\n", size);
+    /***************************************************** PARSE COMMAND LINE ARGUMENTS *********************************************************/
+    parseArgs(argc, argv, &file, &generations, &output);
+    /***************************************************** READ THE INPUT IN PARALLEL *********************************************************/
+    //Every rank reads its own share of the file, the cells are then sent to the ranks owning their rows
+    n_read = readCells(file, MPI_CELL, &size, &sendbuffer);
+    rank_print(rank); debug_print("Read size: %d cells: %d\n", size, n_read);
     if(nprocs > size){
         err_print("Number of processors is higher than cube side size - Not possible in this row-wise/column-wise implementation");
         exit(EXIT_FAILURE);
     }
-    /************************************************** BROADCAST_GENERATIONS *************************************************************************/
-    MPI_Bcast(&generations, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
-    rank_print(rank); debug_print("Received generations: %d\n", generations);
-
-    if(rank == ROOT){
-        /************************************************** CALCULATE SENDCOUNTS AND DISPLS *************************************************************************/
-        sendcounts = (int *) calloc(nprocs, sizeof(int));
-        //Read the number of alive nodes and the sendcount value
-
-        while(fgets(buffer, BUFFER_SIZE, fp)){
-            if(sscanf(buffer, "%d %d %d\n", &x, &y, &z) == 3){
-                alive_nodes++;
-                if(ROW_WISE)
-                    sendcounts[BLOCK_OWNER(x,nprocs,size)]++;
-                if(COLUMN_WISE)
-                    sendcounts[BLOCK_OWNER(y,nprocs,size)]++;
-            }
-        }
-        displs = (int *) calloc(nprocs, sizeof(int));
 
-        debug_print("Alive nodes: %d\n", alive_nodes);
-        for(i = 0; i < nprocs; i++){
-            displs[i+1] = displs[i] + sendcounts[i];
-        }
-    }
-    /************************************************** SCATTER SENDCOUNTS FROM ROOT TO ALL *************************************************************************/
-    MPI_Scatter(sendcounts, 1, MPI_INT, &cells_receive, 1, MPI_INT, ROOT, MPI_COMM_WORLD); //Tell all other procs how many cells they are going to receive
-    if(rank == ROOT){
-        cells_receive = sendcounts[ROOT]; //ROOT gets the first set of cells
-    }
-    rank_print(rank);debug_print("Received their sendcount: %d\n", cells_receive);
-
-    if(rank == ROOT){
+    if(nprocs == 1){
         /************************************************** CREATE GLOBAL GRAPH *************************************************************************/
-        //Create the global graph
         initial_global_graph = initGraph(size);
-        fclose(fp);fp = fopen(file, "r"); //Close and reopen file to reset fp
-        while(fgets(buffer, BUFFER_SIZE, fp)){
-            if(sscanf(buffer, "%d %d %d\n", &x, &y, &z) == 3){
-                if(nprocs != 1){
-			if(ROW_WISE){
-                    		initial_global_graph[x][y] = graphNodeInsert(initial_global_graph[x][y], z, ALIVE); /* Insert live nodes in the graph*/
-                	}
-                	if(COLUMN_WISE){
-                    		initial_global_graph[y][x] = graphNodeInsert(initial_global_graph[y][x], z, ALIVE); /* Insert live nodes in the graph*/
-                	}
-		}else{
-			 initial_global_graph[x][y] = graphNodeInsert(initial_global_graph[x][y], z, ALIVE); /* Insert live nodes in the graph*/
-		}
-            }
+        for(i = 0; i < n_read; i++){
+            initial_global_graph[sendbuffer[i].x][sendbuffer[i].y] = graphNodeInsert(initial_global_graph[sendbuffer[i].x][sendbuffer[i].y], sendbuffer[i].z, ALIVE); /* Insert live nodes in the graph*/
         }
-        if(nprocs == 1){
-            int g;
-            for(g = 1; g <= generations; g++){
-                for(i = 0; i < size; i++){ /* First passage in the graph - notify neighbours */
-                    for(j = 0; j < size; j++){
-                        for(it = initial_global_graph[i][j]; it != NULL; it = it->next){
-                            if(it->state == ALIVE)
-                                visitNeighbours(initial_global_graph, size, i, j, it->z);
+        free(sendbuffer);
+        int g;
+        for(g = 1; g <= generations; g++){
+            for(i = 0; i < size; i++){ /* First passage in the graph - notify neighbours */
+                for(j = 0; j < size; j++){
+                    for(it = initial_global_graph[i][j]; it != NULL; it = it->next){
+                        if(it->state == ALIVE)
+                            visitNeighbours(initial_global_graph, size, i, j, it->z);
+                    }
+                }
+            }
+            /* Second passage in the graph - decide next state */
+            for(i = 0; i < size; i++){
+                for(j = 0; j < size; j++){
+                    for (it = initial_global_graph[i][j]; it != NULL; it = it->next){
+                        int live_neighbours = it->neighbours;
+                        it->neighbours = 0;
+                        if(it->state == ALIVE){
+                            if(live_neighbours < 2 || live_neighbours > 4){
+                                it->state = DEAD;
+                            }
+                        }else{
+                            if(live_neighbours == 2 || live_neighbours == 3){
+                                it->state = ALIVE;
+                            }
                         }
                     }
                 }
-                /* Second passage in the graph - decide next state */
+            }
+            /* Remove dead nodes from the graph every REMOVAL_PERIOD generations */
+            if(g % REMOVAL_PERIOD == 0){
                 for(i = 0; i < size; i++){
                     for(j = 0; j < size; j++){
-                        for (it = initial_global_graph[i][j]; it != NULL; it = it->next){
-                            int live_neighbours = it->neighbours;
-                            it->neighbours = 0;
-                            if(it->state == ALIVE){
-                                if(live_neighbours < 2 || live_neighbours > 4){
-                                    it->state = DEAD;
-                                }
-                            }else{
-                                if(live_neighbours == 2 || live_neighbours == 3){
-                                    it->state = ALIVE;
-                                }
-                            }
-                        }
+                        graph_node ** list = &initial_global_graph[i][j];
+                        graphListCleanup(list);
                     }
                 }
-                /* Remove dead nodes from the graph every REMOVAL_PERIOD generations */
-                if(g % REMOVAL_PERIOD == 0){
-                    for(i = 0; i < size; i++){
-                        for(j = 0; j < size; j++){
-                            graph_node ** list = &initial_global_graph[i][j];
-                            graphListCleanup(list);
+            }
+        }
+        /* Write or print the final set of live cells */
+        if(output != NULL){
+            local_graph_length = 0;
+            for(i = 0; i < size; i++){
+                for(j = 0; j < size; j++){
+                    for(it = initial_global_graph[i][j]; it != NULL; it = it->next){
+                        if(it->state == ALIVE){
+                            local_graph_length++;
                         }
                     }
                 }
             }
-            /* Print the final set of live cells */
-            printAndSortActive(initial_global_graph, size);
-            //Free graph
-            freeGraph(initial_global_graph, size);
-
-            endtime = MPI_Wtime();
-            time_print(rank, endtime - starttime);
-            /*Barrier at the end to make sure all procs sync here before finalizing*/
-            MPI_Barrier(MPI_COMM_WORLD);
-            MPI_Finalize(); //Finalize
-            exit(EXIT_SUCCESS);
-        }
-        /************************************************** COPY GLOBAL GRAPH TO SENDBUFFER *************************************************************************/
-        //Allocate an array with all the alive nodes
-        sendbuffer = (node*) malloc(alive_nodes*sizeof(node));
-        //From the global graph fill sendbuffer
-        i=0;
-        for(x=0; x < size; x++){
-            for(y=0; y < size; y++){
-                for(it = initial_global_graph[x][y]; it != NULL; it = it->next){
-                    if(it->state == ALIVE){
-                        //printf("%d %d %d\n", x, y, it->z);
-                        //sendbuffer[count] = (node) malloc(sizeof(node));
-                        sendbuffer[i].x = x;
-                        sendbuffer[i].y = y;
-                        sendbuffer[i].z = it->z;
-                        i++;
+            lg_send = (node*) malloc(sizeof(node) * (local_graph_length + 1));
+            local_graph_length = 0;
+            for(i = 0; i < size; i++){
+                for(j = 0; j < size; j++){
+                    for(it = initial_global_graph[i][j]; it != NULL; it = it->next){
+                        if(it->state == ALIVE){
+                            lg_send[local_graph_length].x = i;
+                            lg_send[local_graph_length].y = j;
+                            lg_send[local_graph_length].z = it->z;
+                            local_graph_length++;
+                        }
                     }
                 }
             }
+            writeCells(output, MPI_CELL, size, lg_send, local_graph_length);
+            free(lg_send);
+            free(output);
+        }else{
+            printAndSortActive(initial_global_graph, size);
         }
+        //Free graph
+        freeGraph(initial_global_graph, size);
+
+        endtime = MPI_Wtime();
+        time_print(rank, endtime - starttime);
+        /*Barrier at the end to make sure all procs sync here before finalizing*/
+        MPI_Barrier(MPI_COMM_WORLD);
+        MPI_Finalize(); //Finalize
+        exit(EXIT_SUCCESS);
     }
-    /* Convert the coordinates read into an array for sending */
-    receivebuffer = (node *) calloc(cells_receive, sizeof(node));
-    /************************************************** SCATTER SENDBUFFER *************************************************************************/
-    MPI_Scatterv(sendbuffer, sendcounts, displs, MPI_CELL, receivebuffer, cells_receive, MPI_CELL, ROOT, MPI_COMM_WORLD);
-    /*ROOT has the first set of sendbuffer - it's own cells_receive*/
-    rank_print(rank);debug_print("BLOCK_LOW: %d, BLOCK_HIGH: %d, BLOCK_SIZE: %d\n", BLOCK_LOW(rank,nprocs,size), BLOCK_HIGH(rank,nprocs,size), BLOCK_SIZE(rank,nprocs,size));
-    if(rank == ROOT){
-        for(i=0; i<cells_receive; i++){
-            receivebuffer[i].y = sendbuffer[i].y;
-            receivebuffer[i].z = sendbuffer[i].z;
-            receivebuffer[i].x = sendbuffer[i].x;
+
+    //The local graph is split along its first dimension, so columns are stored transposed
+    if(COLUMN_WISE){
+        for(i = 0; i < n_read; i++){
+            uint16_t t = sendbuffer[i].x;
+            sendbuffer[i].x = sendbuffer[i].y;
+            sendbuffer[i].y = t;
         }
     }
+    /************************************************** SEND THE CELLS TO THEIR OWNERS *************************************************************************/
+    migrate_counts = (int*) calloc(nprocs, sizeof(int));
+    migrate_displs = (int*) malloc(sizeof(int) * nprocs);
+    migrated_counts = (int*) malloc(sizeof(int) * nprocs);
+    migrated_displs = (int*) malloc(sizeof(int) * nprocs);
+    for(i = 0; i < n_read; i++){
+        migrate_counts[BLOCK_OWNER(sendbuffer[i].x, nprocs, size)]++;
+    }
+    migrate_displs[0] = 0;
+    for(i = 0; i < nprocs - 1; i++){
+        migrate_displs[i + 1] = migrate_displs[i] + migrate_counts[i];
+    }
+    //Group the cells by owner, reusing migrated_displs as the fill pointer of each group
+    node* grouped = (node*) malloc(sizeof(node) * (n_read + 1));
+    memcpy(migrated_displs, migrate_displs, sizeof(int) * nprocs);
+    for(i = 0; i < n_read; i++){
+        grouped[migrated_displs[BLOCK_OWNER(sendbuffer[i].x, nprocs, size)]++] = sendbuffer[i];
+    }
+    free(sendbuffer);
+    MPI_Alltoall(migrate_counts, 1, MPI_INT, migrated_counts, 1, MPI_INT, MPI_COMM_WORLD);
+    migrated_displs[0] = 0;
+    for(i = 0; i < nprocs - 1; i++){
+        migrated_displs[i + 1] = migrated_displs[i] + migrated_counts[i];
+    }
+    cells_receive = migrated_displs[nprocs - 1] + migrated_counts[nprocs - 1];
+    receivebuffer = (node*) malloc(sizeof(node) * (cells_receive + 1));
+    MPI_Alltoallv(grouped, migrate_counts, migrate_displs, MPI_CELL,
+        receivebuffer, migrated_counts, migrated_displs, MPI_CELL, MPI_COMM_WORLD);
+    free(grouped);
+    rank_print(rank);debug_print("Received their cells: %d\n", cells_receive);
+    rank_print(rank);debug_print("BLOCK_LOW: %d, BLOCK_HIGH: %d, BLOCK_SIZE: %d\n", BLOCK_LOW(rank,nprocs,size), BLOCK_HIGH(rank,nprocs,size), BLOCK_SIZE(rank,nprocs,size));
 
     /************************************************** ALLOCATE LOCAL GRAPH *************************************************************************/
-    local_graph = initLocalGraph(BLOCK_SIZE(rank,nprocs,size), size); //Allocate local graph
+    //The block starts even and its boundaries are moved later to follow the live cells
+    int block_low = BLOCK_LOW(rank, nprocs, size);
+    int block_size = BLOCK_SIZE(rank, nprocs, size);
+    local_graph = initLocalGraph(block_size, size); //Allocate local graph
 
     rank_print(rank); debug_print("Created local graph.\n");
     for(i=0; i<cells_receive; i++){
-        int x = (int)receivebuffer[i].x - BLOCK_LOW(rank, nprocs, size);
+        int x = (int)receivebuffer[i].x - block_low;
         int y = (int)receivebuffer[i].y;
         local_graph[x][y] = graphNodeInsert(local_graph[x][y], receivebuffer[i].z, ALIVE);
     }
+    cuts = (int*) malloc(sizeof(int) * (nprocs + 1));
+    row_load = (int*) malloc(sizeof(int) * size);
+    rank_load = (int*) malloc(sizeof(int) * nprocs);
+    free(receivebuffer);
+    /************************************************** CREATE FRONTIER CHANNELS *************************************************************************/
+    //Our low frontier is the high frontier of the low rank, so it is received there with the same tag
+    haloCreate(&sending_low_frontier, MPI_NEIGHBOUR_CELL, low_rank, TAG_LOW, true);
+    haloCreate(&sending_high_frontier, MPI_NEIGHBOUR_CELL, high_rank, TAG_HIGH, true);
+    haloCreate(&receiving_low_frontier, MPI_NEIGHBOUR_CELL, low_rank, TAG_HIGH, false);
+    haloCreate(&receiving_high_frontier, MPI_NEIGHBOUR_CELL, high_rank, TAG_LOW, false);
     /****************************************************** GENERATION LOOP  *************************************************************************/
     int g;
     for(g=1; g<=generations; g++){
-        /************************************************** COUNT/ALLOCATE FRONTIER SIZES  *************************************************************************/
-        low_frontier_count=0; high_frontier_count=0;
-        for(y=0; y<size; y++){
-            for(it = local_graph[0][y]; it != NULL; it = it->next){
-                if(it->state == ALIVE){
-                    low_frontier_count++;
+        /************************************************** REBALANCE BLOCKS *************************************************************************/
+        //Every REBALANCE_PERIOD generations check how the live cells are spread, and move the block boundaries if some rank holds too many
+        if((g - 1) % REBALANCE_PERIOD == 0){
+            int local_load = 0, total_load = 0, max_load = 0, max_predicted = 0;
+            memset(row_load, 0, sizeof(int) * size);
+            for(x = 0; x < block_size; x++){
+                for(y = 0; y < size; y++){
+                    for(it = local_graph[x][y]; it != NULL; it = it->next){
+                        if(it->state == ALIVE){
+                            row_load[x + block_low]++;
+                            local_load++;
+                        }
+                    }
                 }
             }
-
-            for(it = local_graph[BLOCK_SIZE(rank,nprocs,size)-1][y]; it != NULL; it = it->next){
-                if(it->state == ALIVE){
-                    high_frontier_count++;
+            MPI_Allgather(&local_load, 1, MPI_INT, rank_load, 1, MPI_INT, MPI_COMM_WORLD);
+            for(i = 0; i < nprocs; i++){
+                total_load += rank_load[i];
+                max_load = rank_load[i] > max_load ? rank_load[i] : max_load;
+            }
+            if(total_load > 0 && (double)max_load * nprocs > IMBALANCE_THRESHOLD * total_load){
+                //Every rank computes the same cuts from the global row counts, which also give the new loads
+                MPI_Allreduce(MPI_IN_PLACE, row_load, size, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+                balanceRows(cuts, nprocs, row_load, size);
+                for(i = 0; i < nprocs; i++){
+                    int predicted = 0;
+                    for(x = cuts[i]; x < cuts[i + 1]; x++){
+                        predicted += row_load[x];
+                    }
+                    max_predicted = predicted > max_predicted ? predicted : max_predicted;
+                }
+                if(max_predicted < max_load){
+                    rank_print(rank); debug_print("Generation %d: largest block from %d to %d live cells\n", g, max_load, max_predicted);
+                    //Send every live cell to the rank that now owns its row
+                    memset(migrate_counts, 0, sizeof(int) * nprocs);
+                    for(x = 0, j = 0; x < block_size; x++){
+                        while(cuts[j + 1] <= x + block_low){
+                            j++;
+                        }
+                        for(y = 0; y < size; y++){
+                            for(it = local_graph[x][y]; it != NULL; it = it->next){
+                                if(it->state == ALIVE){
+                                    migrate_counts[j]++;
+                                }
+                            }
+                        }
+                    }
+                    migrate_displs[0] = 0;
+                    for(i = 0; i < nprocs - 1; i++){
+                        migrate_displs[i + 1] = migrate_displs[i] + migrate_counts[i];
+                    }
+                    //Cells are packed in row order, so each rank's share is already contiguous
+                    sendbuffer = (node*) malloc(sizeof(node) * local_load);
+                    for(x = 0, i = 0; x < block_size; x++){
+                        for(y = 0; y < size; y++){
+                            for(it = local_graph[x][y]; it != NULL; it = it->next){
+                                if(it->state == ALIVE){
+                                    sendbuffer[i].x = x + block_low;
+                                    sendbuffer[i].y = y;
+                                    sendbuffer[i].z = it->z;
+                                    i++;
+                                }
+                            }
+                        }
+                    }
+                    MPI_Alltoall(migrate_counts, 1, MPI_INT, migrated_counts, 1, MPI_INT, MPI_COMM_WORLD);
+                    migrated_displs[0] = 0;
+                    for(i = 0; i < nprocs - 1; i++){
+                        migrated_displs[i + 1] = migrated_displs[i] + migrated_counts[i];
+                    }
+                    cells_receive = migrated_displs[nprocs - 1] + migrated_counts[nprocs - 1];
+                    receivebuffer = (node*) malloc(sizeof(node) * cells_receive);
+                    MPI_Alltoallv(sendbuffer, migrate_counts, migrate_displs, MPI_CELL,
+                        receivebuffer, migrated_counts, migrated_displs, MPI_CELL, MPI_COMM_WORLD);
+
+                    //Rebuild the local graph around the new block
+                    freeLocalGraph(local_graph, block_size, size);
+                    block_low = cuts[rank];
+                    block_size = cuts[rank + 1] - cuts[rank];
+                    local_graph = initLocalGraph(block_size, size);
+                    for(i = 0; i < cells_receive; i++){
+                        x = receivebuffer[i].x - block_low;
+                        local_graph[x][receivebuffer[i].y] = graphNodeInsert(local_graph[x][receivebuffer[i].y], receivebuffer[i].z, ALIVE);
+                    }
+                    free(sendbuffer);
+                    free(receivebuffer);
                 }
             }
         }
 
-        rank_print(rank); debug_print("LOW FRONTIER COUNT: %d, HIGH FRONTIER COUNT: %d\n", low_frontier_count, high_frontier_count);
-        //Alloc frontiers and copy nodes to it
-        sending_low_frontier = (neighbour_node *) calloc(low_frontier_count, sizeof(neighbour_node));
-        sending_high_frontier = (neighbour_node *) calloc(high_frontier_count, sizeof(neighbour_node));
+        /************************************************** POST FRONTIER RECEIVES *************************************************************************/
+        haloStart(&receiving_low_frontier);
+        haloStart(&receiving_high_frontier);
 
         /************************************************** PUT NODES FROM OUR FRONTIERS IN BUFFERS *************************************************************************/
         //Add our nodes to our frontiers
-        low_frontier_size=0,high_frontier_size=0;
+        sending_low_frontier.count = 0; sending_high_frontier.count = 0;
         for(y=0; y<size; y++){
             for(it = local_graph[0][y]; it !=NULL; it = it->next){
                 if(it->state == ALIVE){
-                    sending_low_frontier[low_frontier_size].y = y;
-                    sending_low_frontier[low_frontier_size].z = it->z;
-                    low_frontier_size++;
+                    haloPush(&sending_low_frontier, y, it->z);
                 }
             }
-            for(it = local_graph[(BLOCK_SIZE(rank, nprocs, size) - 1)][y]; it !=NULL; it = it->next){
+            for(it = local_graph[(block_size - 1)][y]; it !=NULL; it = it->next){
                 if(it->state == ALIVE){
-                    sending_high_frontier[high_frontier_size].y = y;
-                    sending_high_frontier[high_frontier_size].z = it->z;
-                    high_frontier_size++;
+                    haloPush(&sending_high_frontier, y, it->z);
                 }
             }
         }
+        rank_print(rank); debug_print("LOW FRONTIER COUNT: %d, HIGH FRONTIER COUNT: %d\n", sending_low_frontier.count, sending_high_frontier.count);
 
-        if(rank == ROOT){
-            /************************************************** COMPUTE WHICH RANKS TO SEND/RECEIVE FROM *************************************************************************/
-            rank_print(rank);debug_print("Sending %d to rank %d\n", low_frontier_size, low_rank);
-            MPI_Send(sending_low_frontier, low_frontier_size, MPI_NEIGHBOUR_CELL, low_rank, 0, MPI_COMM_WORLD);
-            rank_print(rank);debug_print("Receiving from rank %d\n", low_rank);
-            MPI_Status s1;
-            MPI_Probe(low_rank, 0, MPI_COMM_WORLD, &s1);
-            MPI_Get_count(&s1, MPI_NEIGHBOUR_CELL, &low_number_amount);
-            receiving_low_frontier = (neighbour_node*)malloc(sizeof(neighbour_node) * low_number_amount);
-            MPI_Recv(receiving_low_frontier, low_number_amount, MPI_NEIGHBOUR_CELL, low_rank, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-            rank_print(rank);debug_print("Receiving from rank %d\n", high_rank);
-            MPI_Status s2;
-            MPI_Probe(high_rank, 0, MPI_COMM_WORLD, &s2);
-            MPI_Get_count(&s2, MPI_NEIGHBOUR_CELL, &high_number_amount);
-            receiving_high_frontier = (neighbour_node*)malloc(sizeof(neighbour_node) * high_number_amount);
-            MPI_Recv(receiving_high_frontier, high_number_amount, MPI_NEIGHBOUR_CELL, high_rank, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            rank_print(rank);debug_print("Sending %d to rank %d\n", low_frontier_size, low_rank);
-            MPI_Send(sending_high_frontier, high_frontier_size, MPI_NEIGHBOUR_CELL, high_rank, 0, MPI_COMM_WORLD);
-        }else{
-            rank_print(rank);debug_print("Receiving from rank %d...\n", high_rank);
-            MPI_Status s1;
-            MPI_Probe(high_rank, 0, MPI_COMM_WORLD, &s1);
-            MPI_Get_count(&s1, MPI_NEIGHBOUR_CELL, &high_number_amount);
-            receiving_high_frontier = (neighbour_node*)malloc(sizeof(neighbour_node) * high_number_amount);
-            MPI_Recv(receiving_high_frontier, high_number_amount, MPI_NEIGHBOUR_CELL, high_rank, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            rank_print(rank);debug_print("Received from rank %d...\n", high_rank);
-            rank_print(rank);debug_print("Sending %d to rank %d\n", high_frontier_size, high_rank);
-            MPI_Send(sending_high_frontier, high_frontier_size, MPI_NEIGHBOUR_CELL, high_rank, 0, MPI_COMM_WORLD);
-
-            rank_print(rank);debug_print("Sending %d to rank %d\n", low_frontier_size, low_rank);
-            MPI_Send(sending_low_frontier, low_frontier_size, MPI_NEIGHBOUR_CELL, low_rank, 0, MPI_COMM_WORLD);
-            rank_print(rank);debug_print("Receiving from rank %d...\n", low_rank);
-            MPI_Status s2;
-            MPI_Probe(low_rank, 0, MPI_COMM_WORLD, &s2);
-            MPI_Get_count(&s2, MPI_NEIGHBOUR_CELL, &low_number_amount);
-            receiving_low_frontier = (neighbour_node*)malloc(sizeof(neighbour_node) * low_number_amount);
-            MPI_Recv(receiving_low_frontier, low_number_amount, MPI_NEIGHBOUR_CELL, low_rank, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            rank_print(rank);debug_print("Received from rank %d\n", low_rank);
-        }
-
-        rank_print(rank);debug_print("Frontiers done! \n");
+        /************************************************** SEND FRONTIERS *************************************************************************/
+        //Both exchanges proceed while we compute everything that does not depend on the other side
+        haloStart(&sending_low_frontier);
+        haloStart(&sending_high_frontier);
 
         /************************************************** COMPUTE THE NEIGHBOURS *************************************************************************/
         /************************************************** COMPUTE ALL NEIGHBOURS THAT ARE NOT ON OUR FRONTIERS *************************************************************************/
         //Use the frontiers received AND OUR OWN to finish count (Go over frontiers received and update)
-        for(x = 1; x < (BLOCK_SIZE(rank, nprocs, size) - 1); x++){
+        for(x = 1; x < (block_size - 1); x++){
             for(y = 0; y < size; y++){
                 for(it = local_graph[x][y]; it != NULL; it = it->next){
                     if(it->state == ALIVE){
@@ -342,13 +371,13 @@ int main(int argc, char **argv) {
         }
         /************************************************** COMPUTE ALL NEIGHBOURS THAT ARE ON OUR FRONTIERS WITHOUT PROCESSING THE OTHER SIDE *************************************************************************/
         for(y=0; y < size; y++){
-            if(BLOCK_SIZE(rank,nprocs,size) != 1){
-                for(it=local_graph[(BLOCK_SIZE(rank, nprocs, size) - 1)][y]; it!=NULL; it=it->next){
+            if(block_size != 1){
+                for(it=local_graph[(block_size - 1)][y]; it!=NULL; it=it->next){
                     if(it->state == ALIVE){
                         //Check the 5 possible neighbours on our side of the frontier
                         int x2, y1, y2, z1, z2;
                         int z = it->z;
-                        int x=(BLOCK_SIZE(rank, nprocs, size) - 1);
+                        int x=(block_size - 1);
                         x2 = (x-1);
                         y1 = (y+1)%size; y2 = (y-1) < 0 ? (size-1) : (y-1);
                         z1 = (z+1)%size; z2 = (z-1) < 0 ? (size-1) : (z-1);
@@ -397,26 +426,28 @@ int main(int argc, char **argv) {
         }
 
         /*********************************HIGH FRONTIER PROCESSING***********************************/
-        for(i=0; i<high_number_amount; i++){ //This means we found an adjacent node on the other side of the frontier
-            y = receiving_high_frontier[i].y;
-            z = receiving_high_frontier[i].z;
-            graphNodeAddNeighbour(&(local_graph[(BLOCK_SIZE(rank, nprocs, size) - 1)][y]),z);
+        haloWait(&receiving_high_frontier);
+        for(i=1; i<=receiving_high_frontier.count; i++){ //This means we found an adjacent node on the other side of the frontier
+            y = receiving_high_frontier.cells[i].y;
+            z = receiving_high_frontier.cells[i].z;
+            graphNodeAddNeighbour(&(local_graph[(block_size - 1)][y]),z);
         }
 
         /*********************************LOW FRONTIER PROCESSING***********************************/
-        for(i=0; i<low_number_amount; i++){ //This means we found an adjacent node on the other side of the frontier
-            y = receiving_low_frontier[i].y;
-            z = receiving_low_frontier[i].z;
+        haloWait(&receiving_low_frontier);
+        for(i=1; i<=receiving_low_frontier.count; i++){ //This means we found an adjacent node on the other side of the frontier
+            y = receiving_low_frontier.cells[i].y;
+            z = receiving_low_frontier.cells[i].z;
             graphNodeAddNeighbour(&(local_graph[0][y]),z);
         }
+        rank_print(rank);debug_print("Frontiers done! \n");
 
-        free(sending_low_frontier);
-        free(sending_high_frontier);
-        free(receiving_low_frontier);
-        free(receiving_high_frontier);
+        //The send buffers are refilled next generation
+        haloWait(&sending_low_frontier);
+        haloWait(&sending_high_frontier);
 
         /************************************************** COMPUTE THE NEXT STATE OF ALL NODES (FRONTIER + OTHERS) *************************************************************************/
-        for(x = 0; x < BLOCK_SIZE(rank,nprocs,size); x++){
+        for(x = 0; x < block_size; x++){
             for(y = 0; y < size; y++){
                 for (it = local_graph[x][y]; it != NULL; it = it->next){
                     int live_neighbours = it->neighbours;
@@ -437,7 +468,7 @@ int main(int argc, char **argv) {
 
         /* Remove dead nodes from the graph every REMOVAL_PERIOD generations */
         if(g % REMOVAL_PERIOD == 0){
-            for(x = 0; x < BLOCK_SIZE(rank, nprocs, size); x++){
+            for(x = 0; x < block_size; x++){
                 for(y = 0; y < size; y++){
                     graph_node** list = &local_graph[x][y];
                     graphListCleanup(list);
@@ -446,10 +477,14 @@ int main(int argc, char **argv) {
         }
 
     }//Generations loop end
-    /********************************************POS-GENERATION-PROCESSING BY ROOT**************************************************/
+    haloFree(&sending_low_frontier);
+    haloFree(&sending_high_frontier);
+    haloFree(&receiving_low_frontier);
+    haloFree(&receiving_high_frontier);
+    /********************************************COLLECT THE FINAL CELLS**************************************************/
     local_graph_length=0;
     //Generations ended. Copy your local_graph to an array
-    for(x = 0; x < BLOCK_SIZE(rank, nprocs, size); x++){
+    for(x = 0; x < block_size; x++){
         for(y = 0; y < size; y++){
             for(it = local_graph[x][y]; it != NULL; it = it->next){
                 if(it->state == ALIVE){
@@ -459,67 +494,99 @@ int main(int argc, char **argv) {
         }
     }
     rank_print(rank);debug_print("LOCAL GRAPH LENGTH: %d\n", local_graph_length);
-    if(rank == ROOT){
-        lg_lengths = (int*)malloc(sizeof(int)*nprocs);
-        lg_lengths[ROOT] = local_graph_length; //lc_length of root was already computed
-    }
-    MPI_Gather(&local_graph_length, 1, MPI_INT, lg_lengths, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
-    if(rank == ROOT){
-        //We should have lc lengths here (from each proc)
-        for(i=0; i<nprocs; i++){
-            rank_print(rank);debug_print("Got local graph length %d from rank %d\n", lg_lengths[i], i);
-        }
-
-        lg_displs = (int*)malloc(sizeof(int)*nprocs);
-        total_length = 0;
-        for(i=0; i<nprocs; i++){
-            lg_displs[i] = total_length;
-            total_length += lg_lengths[i];
-        }
-        //printf("LOCAL GRAPH LENGTH OF ROOT: %d\n",local_graph_length);
-        all_lg = (node*)malloc(sizeof(node) * total_length);
-    }
-
-    lg_send = (node*)malloc(sizeof(node) * local_graph_length);
+    lg_send = (node*)malloc(sizeof(node) * (local_graph_length + 1));
     local_graph_length=0;
-    for(x = 0; x < BLOCK_SIZE(rank, nprocs, size); x++){
+    for(x = 0; x < block_size; x++){
         for(y = 0; y < size; y++){
             for(it = local_graph[x][y]; it != NULL; it = it->next){
                 if(it->state == ALIVE){
-                    lg_send[local_graph_length].x = x + BLOCK_LOW(rank, nprocs, size); //add the offset so the x value is the real value (not the local)
-                    lg_send[local_graph_length].y = y;
+                    //Add the offset so the row is the global one, and undo the transposition of COLUMN_WISE
+                    lg_send[local_graph_length].x = COLUMN_WISE ? y : x + block_low;
+                    lg_send[local_graph_length].y = COLUMN_WISE ? x + block_low : y;
                     lg_send[local_graph_length].z = it->z;
                     local_graph_length++;
                 }
             }
         }
     }
-
-    MPI_Gatherv(lg_send, local_graph_length, MPI_CELL, all_lg, lg_lengths, lg_displs, MPI_CELL, ROOT, MPI_COMM_WORLD);
-    if(rank == ROOT){
-        /***************ROOT SHOULD HAVE ALL ARRAYS HERE***********************/
-        //Transform all_lg to final global graph
-        final_global_graph = initGraph(size);
-        for(i=0; i<total_length; i++){
-            x = all_lg[i].x;
-            y = all_lg[i].y;
-            z = all_lg[i].z;
-            if(ROW_WISE){
-                final_global_graph[x][y] = graphNodeInsert(final_global_graph[x][y], z, ALIVE);
+    freeLocalGraph(local_graph, block_size, size);
+
+    if(output != NULL){
+        /********************************************WRITE THE FINAL CELLS IN PARALLEL**************************************************/
+        //Blocks do not follow x when COLUMN_WISE, so the cells are first sent to slabs of whole x slices holding
+        //about the same number of live cells, one per rank in order. Each slab is then a contiguous part of the output
+        memset(row_load, 0, sizeof(int) * size);
+        for(i = 0; i < local_graph_length; i++){
+            row_load[lg_send[i].x]++;
+        }
+        MPI_Allreduce(MPI_IN_PLACE, row_load, size, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        balanceRows(cuts, nprocs, row_load, size);
+        slab_of = (int*) malloc(sizeof(int) * size);
+        for(i = 0; i < nprocs; i++){
+            for(x = cuts[i]; x < cuts[i + 1]; x++){
+                slab_of[x] = i;
             }
-            if(COLUMN_WISE){
-                final_global_graph[y][x] = graphNodeInsert(final_global_graph[y][x], z, ALIVE);
+        }
+        memset(migrate_counts, 0, sizeof(int) * nprocs);
+        for(i = 0; i < local_graph_length; i++){
+            migrate_counts[slab_of[lg_send[i].x]]++;
+        }
+        migrate_displs[0] = 0;
+        for(i = 0; i < nprocs - 1; i++){
+            migrate_displs[i + 1] = migrate_displs[i] + migrate_counts[i];
+        }
+        //Group the cells by slab, reusing migrated_displs as the fill pointer of each group
+        sendbuffer = (node*) malloc(sizeof(node) * (local_graph_length + 1));
+        memcpy(migrated_displs, migrate_displs, sizeof(int) * nprocs);
+        for(i = 0; i < local_graph_length; i++){
+            sendbuffer[migrated_displs[slab_of[lg_send[i].x]]++] = lg_send[i];
+        }
+        MPI_Alltoall(migrate_counts, 1, MPI_INT, migrated_counts, 1, MPI_INT, MPI_COMM_WORLD);
+        migrated_displs[0] = 0;
+        for(i = 0; i < nprocs - 1; i++){
+            migrated_displs[i + 1] = migrated_displs[i] + migrated_counts[i];
+        }
+        cells_receive = migrated_displs[nprocs - 1] + migrated_counts[nprocs - 1];
+        receivebuffer = (node*) malloc(sizeof(node) * (cells_receive + 1));
+        MPI_Alltoallv(sendbuffer, migrate_counts, migrate_displs, MPI_CELL,
+            receivebuffer, migrated_counts, migrated_displs, MPI_CELL, MPI_COMM_WORLD);
+        writeCells(output, MPI_CELL, size, receivebuffer, cells_receive);
+        free(sendbuffer);
+        free(receivebuffer);
+        free(slab_of);
+        free(output);
+    }else{
+        /********************************************PRINT THE FINAL CELLS FROM ROOT**************************************************/
+        if(rank == ROOT){
+            lg_lengths = (int*)malloc(sizeof(int)*nprocs);
+        }
+        MPI_Gather(&local_graph_length, 1, MPI_INT, lg_lengths, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
+        if(rank == ROOT){
+            lg_displs = (int*)malloc(sizeof(int)*nprocs);
+            total_length = 0;
+            for(i=0; i<nprocs; i++){
+                lg_displs[i] = total_length;
+                total_length += lg_lengths[i];
             }
+            all_lg = (node*)malloc(sizeof(node) * (total_length + 1));
+        }
+        MPI_Gatherv(lg_send, local_graph_length, MPI_CELL, all_lg, lg_lengths, lg_displs, MPI_CELL, ROOT, MPI_COMM_WORLD);
+        if(rank == ROOT){
+            final_global_graph = initGraph(size);
+            for(i=0; i<total_length; i++){
+                x = all_lg[i].x;
+                y = all_lg[i].y;
+                final_global_graph[x][y] = graphNodeInsert(final_global_graph[x][y], all_lg[i].z, ALIVE);
+            }
+            /* Print the final set of live cells */
+            printAndSortActive(final_global_graph, size);fflush(stdout);
+            freeGraph(final_global_graph, size);
+            free(lg_lengths); free(lg_displs); free(all_lg);
         }
-        /* Print the final set of live cells */
-        printAndSortActive(final_global_graph, size);fflush(stdout);
-
-        //Free graphs
-        freeGraph(final_global_graph, size);
-        freeGraph(initial_global_graph, size);
-
     }
-    //TODO - Free the temporary arrays used to send the local_graph
+    free(lg_send);
+    free(cuts); free(row_load); free(rank_load);
+    free(migrate_counts); free(migrate_displs); free(migrated_counts); free(migrated_displs);
 
     endtime = MPI_Wtime();
     time_print(rank, endtime - starttime);
@@ -529,16 +596,294 @@ int main(int argc, char **argv) {
     exit(EXIT_SUCCESS);
 }
 
-void parseArgs(int argc, char* argv[], char** file, int* generations){
-    if (argc == 3){
+void parseArgs(int argc, char* argv[], char** file, int* generations, char** output){
+    if (argc == 3 || argc == 4){
         char* file_name = malloc(sizeof(char) * (strlen(argv[1]) + 1));
         strcpy(file_name, argv[1]);
         *file = file_name;
 
         *generations = atoi(argv[2]);
+        *output = NULL;
+        if (argc == 4){
+            *output = malloc(sizeof(char) * (strlen(argv[3]) + 1));
+            strcpy(*output, argv[3]);
+        }
         if (*generations > 0 && file_name != NULL)
         return;
     }
-    printf("Usage: %s [data_file.in] [number_generations]", argv[0]);
+    printf("Usage: %s [data_file.in] [number_generations] [output_file]", argv[0]);
     exit(EXIT_FAILURE);
 }
+
+int readCells(char* file, MPI_Datatype datatype, int* size, node** cells){
+    MPI_File fh;
+    MPI_Offset file_size, data_start, lo, hi, read_lo, total;
+    char header[BUFFER_SIZE + 1];
+    char* chunk, *line, *end, *next;
+    int nprocs, rank, length, n_cells, capacity, cell_size;
+    int32_t cube_size;
+    long x, y, z;
+
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if(MPI_File_open(MPI_COMM_WORLD, file, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS){
+        fprintf(stderr, "Please input a valid file name\n" );
+        exit(EXIT_FAILURE);
+    }
+    MPI_File_get_size(fh, &file_size);
+
+    //Every rank reads the header
+    length = (file_size < BUFFER_SIZE) ? (int) file_size : BUFFER_SIZE;
+    MPI_File_read_at_all(fh, 0, header, length, MPI_CHAR, MPI_STATUS_IGNORE);
+    header[length] = '\0';
+
+    if(length >= BINARY_HEADER_SIZE && memcmp(header, BINARY_MAGIC, BINARY_MAGIC_SIZE) == 0){
+        //Binary cells are read straight into place, an even share of them each
+        memcpy(&cube_size, header + BINARY_MAGIC_SIZE, sizeof(int32_t));
+        *size = cube_size;
+        MPI_Type_size(datatype, &cell_size);
+        total = (file_size - BINARY_HEADER_SIZE) / cell_size;
+        lo = total * rank / nprocs;
+        hi = total * (rank + 1) / nprocs;
+        n_cells = (int) (hi - lo);
+        *cells = (node*) malloc(sizeof(node) * (n_cells + 1));
+        MPI_File_read_at_all(fh, BINARY_HEADER_SIZE + lo * cell_size, *cells, n_cells, datatype, MPI_STATUS_IGNORE);
+        MPI_File_close(&fh);
+        return n_cells;
+    }
+
+    //The first line of a text file holds the size of the cube
+    sscanf(header, "%d", size);
+    line = strchr(header, '\n');
+    data_start = (line == NULL) ? file_size : (line - header) + 1;
+
+    //Each rank parses the lines starting in an even share of the bytes. Lines are shorter than
+    //BUFFER_SIZE, so reading that much further completes the last one, and the byte before the
+    //share tells whether its first line started in the previous one
+    lo = data_start + (file_size - data_start) * rank / nprocs;
+    hi = data_start + (file_size - data_start) * (rank + 1) / nprocs;
+    read_lo = (lo > data_start) ? lo - 1 : lo;
+    length = (int) (((hi + BUFFER_SIZE < file_size) ? hi + BUFFER_SIZE : file_size) - read_lo);
+    chunk = (char*) malloc(length + 1);
+    MPI_File_read_at_all(fh, read_lo, chunk, length, MPI_CHAR, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    chunk[length] = '\0';
+
+    line = chunk;
+    if(lo > data_start){
+        while(*line != '\0' && *line != '\n')
+            line++;
+        if(*line == '\n')
+            line++;
+    }
+    end = chunk + (hi - read_lo);
+
+    //A line holds at least "x y z\n"
+    capacity = (int) ((hi - lo) / 6) + 1;
+    *cells = (node*) malloc(sizeof(node) * capacity);
+    n_cells = 0;
+    while(line < end && *line != '\0'){
+        if(*line != '\n'){
+            x = strtol(line, &next, 10);
+            if(next != line){
+                line = next;
+                y = strtol(line, &next, 10);
+                if(next != line){
+                    line = next;
+                    z = strtol(line, &next, 10);
+                    if(next != line){
+                        if(n_cells == capacity){
+                            capacity *= 2;
+                            *cells = (node*) realloc(*cells, sizeof(node) * capacity);
+                        }
+                        (*cells)[n_cells].x = x;
+                        (*cells)[n_cells].y = y;
+                        (*cells)[n_cells].z = z;
+                        n_cells++;
+                    }
+                }
+            }
+            line = next;
+        }
+        //Move on to the next line
+        while(*line != '\0' && *line != '\n')
+            line++;
+        if(*line == '\n')
+            line++;
+    }
+    free(chunk);
+    return n_cells;
+}
+
+int compareCells(const void* a, const void* b){
+    const node* u = a, *v = b;
+    if(u->x != v->x)
+        return u->x - v->x;
+    if(u->y != v->y)
+        return u->y - v->y;
+    return u->z - v->z;
+}
+
+void writeCells(char* file, MPI_Datatype datatype, int size, node* cells, int n_cells){
+    MPI_File fh;
+    MPI_Offset length, offset, count, prefix;
+    char header[BINARY_HEADER_SIZE];
+    char* text;
+    int rank, cell_size, i;
+    int32_t cube_size;
+    size_t name_length = strlen(file);
+    bool binary = name_length >= strlen(BINARY_SUFFIX)
+        && strcmp(file + name_length - strlen(BINARY_SUFFIX), BINARY_SUFFIX) == 0;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    qsort(cells, n_cells, sizeof(node), compareCells);
+
+    if(MPI_File_open(MPI_COMM_WORLD, file, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS){
+        err_print("Could not open the output file");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    MPI_File_set_size(fh, 0);
+
+    if(binary){
+        //The header goes first, then the cells of every rank in order
+        if(rank == ROOT){
+            cube_size = size;
+            memcpy(header, BINARY_MAGIC, BINARY_MAGIC_SIZE);
+            memcpy(header + BINARY_MAGIC_SIZE, &cube_size, sizeof(int32_t));
+            MPI_File_write_at(fh, 0, header, BINARY_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+        MPI_Type_size(datatype, &cell_size);
+        count = n_cells;
+        prefix = 0;
+        MPI_Exscan(&count, &prefix, 1, MPI_OFFSET, MPI_SUM, MPI_COMM_WORLD);
+        if(rank == ROOT)
+            prefix = 0;
+        MPI_File_write_at_all(fh, BINARY_HEADER_SIZE + prefix * cell_size, cells, n_cells, datatype, MPI_STATUS_IGNORE);
+    }else{
+        //Lines vary in length, so each rank starts where the previous ones end
+        text = (char*) malloc((size_t) n_cells * OUTPUT_LINE_SIZE + 1);
+        length = 0;
+        for(i = 0; i < n_cells; i++){
+            length += sprintf(text + length, "%d %d %d\n", cells[i].x, cells[i].y, cells[i].z);
+        }
+        offset = 0;
+        MPI_Exscan(&length, &offset, 1, MPI_OFFSET, MPI_SUM, MPI_COMM_WORLD);
+        if(rank == ROOT)
+            offset = 0;
+        MPI_File_write_at_all(fh, offset, text, (int) length, MPI_CHAR, MPI_STATUS_IGNORE);
+        free(text);
+    }
+    MPI_File_close(&fh);
+}
+
+void balanceRows(int* cuts, int nprocs, int* load, int size){
+    long total = 0, prefix = 0, target;
+    int r, x;
+    for(x = 0; x < size; x++){
+        total += load[x];
+    }
+    cuts[0] = 0;
+    for(r = 1, x = 0; r < nprocs; r++){
+        //Every block keeps at least one row
+        while(x < cuts[r - 1] + 1){
+            prefix += load[x++];
+        }
+        //Take a row while most of it falls short of an equal share
+        target = total * r / nprocs;
+        while(x < size - (nprocs - r) && 2 * prefix + load[x] < 2 * target){
+            prefix += load[x++];
+        }
+        cuts[r] = x;
+    }
+    cuts[nprocs] = size;
+}
+
+void haloCreate(halo* h, MPI_Datatype datatype, int nbr_rank, int tag, bool send){
+    h->datatype = datatype;
+    h->nbr_rank = nbr_rank;
+    h->tag = tag;
+    h->send = send;
+    h->count = 0;
+    h->capacity = HALO_MIN_CAPACITY;
+    h->length = 0;
+    h->cells = NULL;
+    h->req = MPI_REQUEST_NULL;
+    h->overflow_req = MPI_REQUEST_NULL;
+    haloReserve(h, h->capacity);
+}
+
+void haloReserve(halo* h, int count){
+    /* One extra entry for the header */
+    if(count + 1 > h->length){
+        h->length = 2 * (count + 1);
+        h->cells = (neighbour_node*) realloc(h->cells, sizeof(neighbour_node) * h->length);
+        if(h->cells == NULL){
+            err_print("Realloc failed. Memory full");
+            exit(EXIT_FAILURE);
+        }
+        /* The persistent request is bound to the old buffer */
+        if(h->req != MPI_REQUEST_NULL){
+            MPI_Request_free(&(h->req));
+        }
+    }
+}
+
+void haloPush(halo* h, int y, int z){
+    haloReserve(h, h->count + 1);
+    h->count++;
+    h->cells[h->count].y = y;
+    h->cells[h->count].z = z;
+}
+
+void haloStart(halo* h){
+    if(h->req == MPI_REQUEST_NULL){
+        if(h->send){
+            MPI_Send_init(h->cells, h->capacity + 1, h->datatype, h->nbr_rank, h->tag, MPI_COMM_WORLD, &(h->req));
+        }else{
+            MPI_Recv_init(h->cells, h->capacity + 1, h->datatype, h->nbr_rank, h->tag, MPI_COMM_WORLD, &(h->req));
+        }
+    }
+    if(h->send){
+        /* The header carries the full count, the cells beyond capacity follow in a second message */
+        h->cells[0].y = h->count & 0xFFFF;
+        h->cells[0].z = h->count >> 16;
+        MPI_Start(&(h->req));
+        if(h->count > h->capacity){
+            MPI_Isend(&(h->cells[h->capacity + 1]), h->count - h->capacity, h->datatype,
+                h->nbr_rank, h->tag + TAG_OVERFLOW, MPI_COMM_WORLD, &(h->overflow_req));
+        }
+    }else{
+        MPI_Start(&(h->req));
+    }
+}
+
+void haloWait(halo* h){
+    MPI_Wait(&(h->req), MPI_STATUS_IGNORE);
+    if(!h->send){
+        h->count = h->cells[0].y | (h->cells[0].z << 16);
+        if(h->count > h->capacity){
+            haloReserve(h, h->count);
+            MPI_Recv(&(h->cells[h->capacity + 1]), h->count - h->capacity, h->datatype,
+                h->nbr_rank, h->tag + TAG_OVERFLOW, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+    }else if(h->count > h->capacity){
+        MPI_Wait(&(h->overflow_req), MPI_STATUS_IGNORE);
+    }
+    /* Both ends saw the same count, so they grow the persistent message alike */
+    if(h->count > h->capacity){
+        while(h->capacity < h->count){
+            h->capacity *= 2;
+        }
+        haloReserve(h, h->capacity);
+        if(h->req != MPI_REQUEST_NULL){
+            MPI_Request_free(&(h->req));
+        }
+    }
+}
+
+void haloFree(halo* h){
+    if(h->req != MPI_REQUEST_NULL){
+        MPI_Request_free(&(h->req));
+    }
+    free(h->cells);
+}
@@ -12,6 +12,18 @@
 
 #define ROOT 0 /**< Macro for representing the root process in MPI */
 
+#define TAG_LOW 100 /**< Tag of the frontier sent to the low rank */
+#define TAG_HIGH 200 /**< Tag of the frontier sent to the high rank */
+#define TAG_OVERFLOW 1 /**< Added to a frontier tag for the cells that do not fit the persistent message */
+#define HALO_MIN_CAPACITY 256 /**< Initial number of cells carried by a persistent frontier message */
+#define REBALANCE_PERIOD 50 /**< Generations between checks of the spread of live cells across ranks */
+#define IMBALANCE_THRESHOLD 1.2 /**< Blocks are moved when the busiest rank holds this many times the average live cells */
+#define BINARY_MAGIC "L3DB" /**< First bytes of a binary cell file, in the L3DB format described in README.md */
+#define BINARY_MAGIC_SIZE 4 /**< Length of BINARY_MAGIC */
+#define BINARY_HEADER_SIZE 8 /**< Bytes before the first cell of a binary input file */
+#define BINARY_SUFFIX ".l3db" /**< Output files whose name ends in this are written in the binary format */
+#define OUTPUT_LINE_SIZE 18 /**< Longest line of a text output file, "65535 65535 65535\n" */
+
 /** @brief Structure for sending over MPI */
 typedef struct _neighbour_node{
     uint16_t z;
@@ -25,12 +37,131 @@ typedef struct _node{
     uint16_t x;
 }node;
 
+/** @brief A persistent channel for the frontier exchanged with one neighbour
+ *
+ *  Buffers and requests live for the whole run. Each message carries a
+ *  header with the number of cells, then up to capacity cells. When a
+ *  frontier does not fit, the remainder follows in an overflow message and
+ *  both ends grow the capacity alike.
+ */
+typedef struct _halo{
+    neighbour_node* cells; /**< Header, then the cells from index 1 */
+    int count; /**< Number of cells */
+    int capacity; /**< Cells carried by the persistent message */
+    int length; /**< Allocated entries, header included */
+    bool send; /**< Whether the channel sends or receives */
+    MPI_Request req; /**< Persistent request, MPI_REQUEST_NULL until (re)bound to the buffer */
+    MPI_Request overflow_req; /**< Request for the cells beyond capacity */
+    MPI_Datatype datatype; /**< Datatype of a cell */
+    int nbr_rank; /**< Neighbour process rank */
+    int tag; /**< Tag of the persistent message */
+}halo;
+
 /** @brief Parse command line arguments
  *
  *  @param argc Number of arguments
  *  @param argv Argument string
  *  @param file Output
+ *  @param generations Output, the number of generations
+ *  @param output Output, the output file name, NULL if none is given
+ */
+void parseArgs(int argc, char* argv[], char** file, int* generations, char** output);
+
+/** @brief Reads this rank's share of the input file with MPI-IO
+ *
+ *  Text files are split in even byte ranges, each rank parsing the lines
+ *  that start in its range. Binary files are split in even cell counts.
+ *  Collective over MPI_COMM_WORLD.
+ *
+ *  @param file The input file name
+ *  @param datatype MPI Datatype of a cell
+ *  @param size Output, the cube size
+ *  @param cells Output, the cells read, in global coordinates
+ *  @return The number of cells read
+ */
+int readCells(char* file, MPI_Datatype datatype, int* size, node** cells);
+
+/** @brief Orders cells by x, then y, then z, for qsort
+ *
+ *  @param a The first cell
+ *  @param b The second cell
+ *  @return Negative, zero or positive as a comes before, with or after b
+ */
+int compareCells(const void* a, const void* b);
+
+/** @brief Writes the cells of every rank to a file with MPI-IO
+ *
+ *  The cells are sorted first, and written as "x y z" lines, or in the
+ *  binary input format if the file name ends in BINARY_SUFFIX. Each rank
+ *  writes after the ranks below it, so it must hold cells that come after
+ *  theirs. Collective over MPI_COMM_WORLD.
+ *
+ *  @param file The output file name
+ *  @param datatype MPI Datatype of a cell
+ *  @param size The cube size
+ *  @param cells The cells of this rank, in global coordinates
+ *  @param n_cells The number of cells
+ */
+void writeCells(char* file, MPI_Datatype datatype, int size, node* cells, int n_cells);
+
+/** @brief Splits the rows of the cube into blocks of about the same number of live cells
+ *
+ *  Places each boundary where the prefix sum of the row counts is closest
+ *  to an equal share, while keeping every block at least one row wide.
+ *
+ *  @param cuts Output, rank r owns the rows [cuts[r], cuts[r+1])
+ *  @param nprocs Number of processes
+ *  @param load Live cells of each row
+ *  @param size Cube size
+ */
+void balanceRows(int* cuts, int nprocs, int* load, int size);
+
+/** @brief Creates a frontier channel on MPI_COMM_WORLD
+ *
+ *  @param h The channel
+ *  @param datatype MPI Datatype of a cell
+ *  @param nbr_rank The neighbour process rank
+ *  @param tag The tag of the persistent message
+ *  @param send Whether the channel sends or receives
+ */
+void haloCreate(halo* h, MPI_Datatype datatype, int nbr_rank, int tag, bool send);
+
+/** @brief Grows the buffer of a channel to hold count cells
+ *
+ *  Frees the persistent request if the buffer moves, so that the next
+ *  haloStart binds a new one.
+ *
+ *  @param h The channel
+ *  @param count The number of cells
+ */
+void haloReserve(halo* h, int count);
+
+/** @brief Appends a cell to the frontier to be sent
+ *
+ *  @param h The channel
+ *  @param y y coordinate
+ *  @param z z coordinate
+ */
+void haloPush(halo* h, int y, int z);
+
+/** @brief Starts the persistent send or receive of a channel
+ *
+ *  @param h The channel
+ */
+void haloStart(halo* h);
+
+/** @brief Completes the exchange of a channel
+ *
+ *  On the receiving end, sets count and receives the overflow, if any.
+ *
+ *  @param h The channel
+ */
+void haloWait(halo* h);
+
+/** @brief Frees the buffer and request of a channel
+ *
+ *  @param h The channel
  */
-void parseArgs(int argc, char* argv[], char** file, int* generations);
+void haloFree(halo* h);
 
 #endif
@@ -119,6 +119,20 @@ void freeGraph(graph_node*** graph, int size){
     }
 }
 
+void freeLocalGraph(graph_node*** graph, int bsize, int size){
+
+    int i, j;
+    if (graph != NULL){
+        for (i = 0; i < bsize; i++){
+            for (j = 0; j < size; j++){
+                graphNodeDelete(graph[i][j]);
+            }
+            free(graph[i]);
+        }
+        free(graph);
+    }
+}
+
 void graphNodeDelete(graph_node* first){
     graph_node* it, *next;
     for(it = first; it != NULL; it = next){
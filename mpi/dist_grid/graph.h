@@ -55,6 +55,14 @@ graph_node*** initGraph(int size);
  */
 graph_node*** initLocalGraph(int bsize, int size);
 
+/** @brief Frees a graph created by initLocalGraph
+ *
+ *  @param graph The graph
+ *  @param bsize The number of rows of the block
+ *  @param size The size of each row
+ */
+void freeLocalGraph(graph_node*** graph, int bsize, int size);
+
 /** @brief Inserts a cell if not yet present and increments its number of live nighbours
  *
  *  @return Whether the cell was inserted in the graph or not
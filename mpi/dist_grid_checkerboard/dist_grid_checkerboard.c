@@ -2,12 +2,18 @@
  * @file dist_grid_checkerboard.c
  * @brief Game Of Life 3D MPI Implementation
  * 
- * @details Uses checkerboard decomposition to scatter the 
- * 3D graph across several processes.
+ * @details Uses a 3D block decomposition to scatter the 
+ * 3D graph across several processes. Each block is surrounded by a
+ * ghost shell of configurable depth k, exchanged once every k generations.
+ * Block boundaries are periodically moved so that every process holds
+ * about the same number of live cells.
+ * The final cells are written by all processes together, each one the
+ * part of the output for a slab of the cube along x.
  * If an invalid configuration is provided the program will not attempt
  * to run, and will notify the user instead.
  * 
- * @attention Each process is assumed to have access to the input file!
+ * @attention Each process is assumed to have access to the input file,
+ * which all of them read together, a share each.
  *  
  * @author João Borrego
  * @author Pedro Abreu
@@ -21,10 +27,10 @@ int main (int argc, char **argv) {
 
     /* Main program variables */
 
-    /** Global graph representation */
-    GraphNode ***global_graph;
     /** Local graph representation */
     GraphNode ***local_graph;
+    /** One lock per (x,y) list of the local graph */
+    omp_lock_t **graph_lock;
 
     /* Local graph dimensions */
     int local_x, local_y;
@@ -36,6 +42,10 @@ int main (int argc, char **argv) {
     int cube_size;
     /** Number of generations to be computed */
     int generations;
+    /** Number of OpenMP threads per process */
+    int n_threads;
+    /** Depth of the ghost shell, which is exchanged once every halo_depth generations */
+    int halo_depth;
 
     /* Auxiliary variables */
 
@@ -49,37 +59,45 @@ int main (int argc, char **argv) {
     /* Iterative variables*/
     int x, y, z;
     int i, j;
-    int snd_i, snd_j, snd_k, snd_l;
     GraphNode *it;
 
-    /* Function return values, status codes and request identifiers */
+    /* Function return values */
     int mpi_rv;
-    MPI_Status mpi_status_prb, mpi_status_snd, mpi_status_rcv;
-    MPI_Request snd_req[4], rcv_req[4];
 
-    /* Buffers */
-    char buffer[BUFFER_SIZE] = {0};
-
-    /* Number of live cells to be sent to each neighbour */
-    int snd_count_low_x, snd_count_high_x, snd_count_low_y, snd_count_high_y;
-
-    /* Frontier buffers to be sent to each neighbour */
-    RNode *snd_low_x, *snd_high_x, *snd_low_y, *snd_high_y;
-
-    /* Number of live cells to be received from each neighbour */
-    int rcv_count_low_x, rcv_count_high_x, rcv_count_low_y, rcv_count_high_y;
-
-    /* Frontier buffers to be received from each neighbour */
-    RNode *rcv_low_x, *rcv_high_x, *rcv_low_y, *rcv_high_y;
-
-    /* Final gather variables */
+    /* Persistent border channels to and from each neighbour, indexed by LOW_X, HIGH_X, LOW_Y, HIGH_Y, LOW_Z and HIGH_Z */
+    Halo snd[N_HALOS], rcv[N_HALOS];
+    int halo_tags[N_HALOS] = {TAG_LOW_X, TAG_HIGH_X, TAG_LOW_Y, TAG_HIGH_Y, TAG_LOW_Z, TAG_HIGH_Z};
+
+    /* Output variables */
+    /** Output file name, NULL if the final cells are not written */
+    char* output_name;
+    /** Slab boundaries along x, process p writes the cells in [slab_cuts[p], slab_cuts[p + 1]) */
+    int* slab_cuts;
+    /** Process writing each slice along x */
+    int* slab_of;
     int local_graph_length;
-    int* lg_lengths;
-    int* lg_displs;
-    int total_length;
-    Node* all_lg;
     Node* lg_send;
 
+    /* Rebalancing variables */
+    /** Generation at which the block boundaries are next checked */
+    int next_balance = 1;
+    /** Live cells per slice of the cube along x, then y, then z */
+    int* slice_load;
+    /** Owner block of each slice along every dimension, under the new boundaries */
+    int* part_of[N_DIMS];
+    /** Rank of each block of the cartesian grid */
+    int* block_rank;
+    int* rank_load;
+    int* predicted_load;
+    int* migrate_counts;
+    /** Live cells of the block, and the process each of them goes to */
+    Node* migrate_send;
+    int* migrate_owner;
+    /** Live cells received from every process */
+    Node* migrate_recv;
+    int n_migrated;
+    int local_load, total_load, max_load, max_predicted;
+
     /* Other */
     int mapped_x, mapped_y;
 
@@ -87,7 +105,13 @@ int main (int argc, char **argv) {
     double global_start_t, global_end_t;
     
     /* MPI */
-    MPI_Init(&argc, &argv);
+    /* Threads never call MPI, only the master thread between parallel regions */
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    if (provided < MPI_THREAD_FUNNELED){
+        errPrint("The MPI library does not support MPI_THREAD_FUNNELED");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
 
     /* MPI Preamble */
     MPI_Comm_size(MPI_COMM_WORLD, &n_processes);
@@ -113,24 +137,14 @@ int main (int argc, char **argv) {
     MPI_Type_create_resized(MPI_NEIGHBOUR_CELL_t, -struct_lb, struct_extent, &MPI_NEIGHBOUR_CELL);
     MPI_Type_commit(&MPI_NEIGHBOUR_CELL);
 
-    /* MPI Create a structure to send reduced (2 coordinates) cells across processes */
-    MPI_Datatype MPI_R_NEIGHBOUR_CELL, MPI_R_NEIGHBOUR_CELL_t,
-        r_struct_type[2] = {MPI_UNSIGNED_SHORT, MPI_UNSIGNED_SHORT};
-    int r_struct_b_len[2] = {1, 1};
-    MPI_Aint r_struct_extent, r_struct_lb, r_struct_displs[2] = {offsetof(RNode, a), offsetof(RNode, z)};
-    MPI_Type_create_struct(2, r_struct_b_len, r_struct_displs, r_struct_type, &MPI_R_NEIGHBOUR_CELL_t);
-    MPI_Type_get_extent(MPI_R_NEIGHBOUR_CELL_t, &r_struct_lb, &r_struct_extent);
-    MPI_Type_create_resized(MPI_R_NEIGHBOUR_CELL_t, -r_struct_lb, r_struct_extent, &MPI_R_NEIGHBOUR_CELL);
-    MPI_Type_commit(&MPI_R_NEIGHBOUR_CELL);
-
     /* MPI Configure Cartesian Communicator */
 
-    /**< Cartesian 2D grid dimensions */
+    /**< Cartesian 3D grid dimensions */
     int dims[N_DIMS] = {0};
     /**< Allow process reordering for optimal performance */
     int reorder = 1;
     /**< Allow wrap-around */
-    int wrap_around[N_DIMS] = {1, 1};
+    int wrap_around[N_DIMS] = {1, 1, 1};
     /**< Cartesian communicator */
     MPI_Comm grid_comm;
 
@@ -147,6 +161,13 @@ int main (int argc, char **argv) {
     int cart_rank;
     MPI_Cart_rank(grid_comm, coord, &cart_rank);
 
+    /* Rank of every block, to send migrating cells to their new owner */
+    block_rank = malloc(sizeof(int) * n_processes);
+    for (i = 0; i < n_processes; i++){
+        int block_coord[N_DIMS] = {i / (dims[1] * dims[2]), (i / dims[2]) % dims[1], i % dims[2]};
+        MPI_Cart_rank(grid_comm, block_coord, &block_rank[i]);
+    }
+
     /*
     if (rank == ROOT){
         for (i = 0; i < N_DIMS; i++) {
@@ -158,9 +179,17 @@ int main (int argc, char **argv) {
     /* Get neighbours */
     /* axis = 0 (X) p[row-1] : curr_p : p[row+1] */
     /* axis = 1 (Y) p[col-1] : curr_p : p[col+1] */
-    int nbr_low_x, nbr_high_x, nbr_low_y, nbr_high_y;
-    MPI_Cart_shift(grid_comm, SHIFT_ROW, DISP, &nbr_low_x, &nbr_high_x);
-    MPI_Cart_shift(grid_comm, SHIFT_COL, DISP, &nbr_low_y, &nbr_high_y);
+    /* axis = 2 (Z) p[z-1] : curr_p : p[z+1] */
+    int nbr[N_HALOS];
+    MPI_Cart_shift(grid_comm, SHIFT_ROW, DISP, &nbr[LOW_X], &nbr[HIGH_X]);
+    MPI_Cart_shift(grid_comm, SHIFT_COL, DISP, &nbr[LOW_Y], &nbr[HIGH_Y]);
+    MPI_Cart_shift(grid_comm, SHIFT_Z, DISP, &nbr[LOW_Z], &nbr[HIGH_Z]);
+
+    /* A border sent to the low neighbour arrives there as its high halo, so the tag names the sender's side */
+    for (i = 0; i < N_HALOS; i++){
+        haloCreate(&snd[i], grid_comm, nbr[i], halo_tags[i], true);
+        haloCreate(&rcv[i], grid_comm, nbr[i], halo_tags[i ^ 1], false);
+    }
 
     /*
     MPI_Barrier(grid_comm);
@@ -172,41 +201,47 @@ int main (int argc, char **argv) {
 
     /* Parse arguments */
 
-    /**< Input data file and file name */
-    FILE* fp; char* file_name;
+    /**< Input data file name */
+    char* file_name;
 
-    parseArgs(argc, argv, &file_name, &generations);
-    fp = fopen(file_name, "r");
-    if (fp == NULL){
-        fprintf(stderr, "Please input a valid file name\n" );
-        exit(EXIT_FAILURE);
-    }
+    parseArgs(argc, argv, &file_name, &generations, &n_threads, &halo_depth, &output_name);
+    omp_set_num_threads(n_threads);
 
-    fgets(buffer,BUFFER_SIZE,fp);
-    sscanf(buffer,"%d", &cube_size);
+    /* Each process reads its share of the file, whatever blocks the cells are in */
+    migrate_send = NULL;
+    local_load = readCells(file_name, grid_comm, MPI_NEIGHBOUR_CELL, &cube_size, &migrate_send);
 
     /***********************************************************************************/
 
     /* Calculate block dimensions and offsets */
 
-    int other_x = cube_size / dims[0];
-    /* The first block gets the excess cells */
-    int first_x = cube_size - (other_x * (dims[0] - 1));
-    int other_y = cube_size / dims[1];
-    int first_y = cube_size - (other_y * (dims[1] - 1));
+    /* Block boundaries along each dimension: block c spans [cuts[d][c], cuts[d][c + 1]).
+       They start even, and are moved while running to follow the live cells */
+    int *cuts[N_DIMS], *new_cuts[N_DIMS];
+    for (i = 0; i < N_DIMS; i++){
+        cuts[i] = malloc(sizeof(int) * (dims[i] + 1));
+        new_cuts[i] = malloc(sizeof(int) * (dims[i] + 1));
+        blockCuts(cuts[i], dims[i], cube_size);
+    }
+
+    slice_load = malloc(sizeof(int) * N_DIMS * cube_size);
+    for (i = 0; i < N_DIMS; i++){
+        part_of[i] = malloc(sizeof(int) * cube_size);
+    }
+    rank_load = malloc(sizeof(int) * n_processes);
+    predicted_load = malloc(sizeof(int) * n_processes);
+    migrate_counts = malloc(sizeof(int) * n_processes);
 
     /* Block offsets */
-    int offset_x = (coord[0] == 0) ? 0 : first_x + (coord[0] - 1) * other_x;
-    int offset_y = (coord[1] == 0) ? 0 : first_y + (coord[1] - 1) * other_y;
+    int offset_x = cuts[0][coord[0]];
+    int offset_y = cuts[1][coord[1]];
+    int offset_z = cuts[2][coord[2]];
     /* Block dimensions */
-    int dim_x = (coord[0] == 0) ? first_x : other_x;
-    int dim_y = (coord[1] == 0) ? first_y : other_y;
-    /* Maximum value of a coordinate (absolute index in local graph <= MAX) */
-    int max_x = offset_x + dim_x - 1;
-    int max_y = offset_y + dim_y - 1;
-
+    int dim_x = cuts[0][coord[0] + 1] - offset_x;
+    int dim_y = cuts[1][coord[1] + 1] - offset_y;
+    int dim_z = cuts[2][coord[2] + 1] - offset_z;
     /* Graciously exit if an incompatible setup is provided */
-    if (dim_x == 0 || dim_y == 0){
+    if (dim_x == 0 || dim_y == 0 || dim_z == 0){
         errPrint("Incompatible number of processes and problem size");
         exit(EXIT_FAILURE);
     }
@@ -219,440 +254,1168 @@ int main (int argc, char **argv) {
 
     //MPI_Barrier(grid_comm);
 
+    /* Each block is surrounded by a ghost shell of depth k, so the local graph spans
+       [0, dim + 2k) in every dimension, and the block itself [k, k + dim) */
+    int k = halo_depth;
+    if (k > dim_x || k > dim_y || k > dim_z){
+        errPrint("Halo depth %d is larger than the block of rank %d", k, rank);
+        exit(EXIT_FAILURE);
+    }
+    int block[N_DIMS] = {dim_x, dim_y, dim_z};
+    int ext[N_DIMS] = {dim_x + 2 * k, dim_y + 2 * k, dim_z + 2 * k};
+
+    /* Boxes each border is packed from and received into */
+    int snd_lo[N_HALOS][N_DIMS], snd_hi[N_HALOS][N_DIMS], rcv_lo[N_HALOS][N_DIMS];
+    int d;
+    haloBoxes(k, block, ext, snd_lo, snd_hi, rcv_lo);
+    for (i = 0; i < N_HALOS; i++){
+        haloSetBox(&snd[i], snd_lo[i], snd_hi[i]);
+    }
+
     /* Fill local graph structure */
-    local_graph = initGraph(dim_x, dim_y);
-
-    /* Read file and fill with the nodes that belong to the current process */
-    while (fgets(buffer, BUFFER_SIZE, fp)){
-        if (sscanf(buffer, "%d %d %d\n", &x, &y, &z) == 3){
-            /* If I am the owner of the block the read data point is in */
-            if ((offset_x <= x && x <= max_x) && (offset_y <= y && y <= max_y)){
-                mapped_x = x - offset_x; mapped_y = y - offset_y;
-                local_graph[mapped_x][mapped_y] = graphNodeInsert(local_graph[mapped_x][mapped_y], z, ALIVE);
-                //debugPrint("(%d,%d) Rank %d - Inserting (%d,%d,%d)", coord[0], coord[1], cart_rank, x, y, z);
-            }
-        }
+    local_graph = initGraph(ext[0], ext[1]);
+    graph_lock = initLocks(ext[0], ext[1]);
+
+    /* Send the cells read to the owners of their blocks, and fill with those received */
+    for (d = 0; d < N_DIMS; d++){
+        sliceOwners(part_of[d], cuts[d], dims[d]);
     }
+    migrate_owner = malloc(sizeof(int) * (local_load + 1));
+    for (i = 0; i < local_load; i++){
+        migrate_owner[i] = block_rank[(part_of[0][migrate_send[i].x] * dims[1] + part_of[1][migrate_send[i].y]) * dims[2]
+            + part_of[2][migrate_send[i].z]];
+    }
+    n_migrated = routeCells(migrate_send, local_load, migrate_owner, grid_comm, MPI_NEIGHBOUR_CELL, &migrate_recv);
+    for (i = 0; i < n_migrated; i++){
+        mapped_x = migrate_recv[i].x - offset_x + k; mapped_y = migrate_recv[i].y - offset_y + k;
+        local_graph[mapped_x][mapped_y] = graphNodeInsert(local_graph[mapped_x][mapped_y], migrate_recv[i].z - offset_z + k, ALIVE);
+    }
+    free(migrate_send);
+    free(migrate_owner);
+    free(migrate_recv);
     //debugPrint("(%d,%d) Rank %d - Finished inserting nodes", coord[0], coord[1], cart_rank);
 
     //MPI_Barrier(grid_comm);
 
+    /* The block part of the z shells is packed while deciding the generation before each
+       exchange, so the initial one is packed here */
+    haloPackBlockZ(snd, local_graph, k, block, snd_lo, snd_hi);
+
     /***********************************************************************************/
 
     for (g = 1; g <= generations; g++){
 
-        /* Count number of live cells in each own frontier so they can be sent */
-        snd_count_low_x = 0; snd_count_high_x = 0;
-        snd_count_low_y = 0; snd_count_high_y = 0;
-
-        for (i = 0; i < dim_y; i++){
-            for (it = local_graph[0][i]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    snd_count_low_x++;
+        /* Every REBALANCE_PERIOD generations, right before an exchange, check how the live
+           cells are spread, and move the block boundaries if some process holds too many */
+        if ((g - 1) % k == 0 && g >= next_balance && n_processes > 1){
+            next_balance = g + REBALANCE_PERIOD;
+
+            /* Count the live cells of the block per slice of the cube. The block columns were
+               already cropped to the block, and the ghosts are dropped by the exchange anyway */
+            memset(slice_load, 0, sizeof(int) * N_DIMS * cube_size);
+            local_load = 0;
+            for (x = k; x < k + dim_x; x++){
+                for (y = k; y < k + dim_y; y++){
+                    for (it = local_graph[x][y]; it != NULL; it = it->next){
+                        if (it->state == ALIVE){
+                            slice_load[x - k + offset_x]++;
+                            slice_load[cube_size + y - k + offset_y]++;
+                            slice_load[2 * cube_size + it->z - k + offset_z]++;
+                            local_load++;
+                        }
+                    }
                 }
             }
-            for (it = local_graph[dim_x - 1][i]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    snd_count_high_x++;
-                }
+            MPI_Allgather(&local_load, 1, MPI_INT, rank_load, 1, MPI_INT, grid_comm);
+            total_load = 0; max_load = 0;
+            for (i = 0; i < n_processes; i++){
+                total_load += rank_load[i];
+                max_load = (rank_load[i] > max_load) ? rank_load[i] : max_load;
             }
-        }
-        for (i = 0; i < dim_x; i++){
-            for (it = local_graph[i][0]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    snd_count_low_y++;
+
+            if (total_load > 0 && (double) max_load * n_processes > IMBALANCE_THRESHOLD * total_load){
+
+                /* Every process computes the same boundaries from the global slice counts */
+                MPI_Allreduce(MPI_IN_PLACE, slice_load, N_DIMS * cube_size, MPI_INT, MPI_SUM, grid_comm);
+                for (d = 0; d < N_DIMS; d++){
+                    balanceCuts(new_cuts[d], dims[d], &slice_load[d * cube_size], cube_size, k);
+                    sliceOwners(part_of[d], new_cuts[d], dims[d]);
                 }
-            }
-            for (it = local_graph[i][dim_y - 1]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    snd_count_high_y++;
+
+                /* Blocks are cut one dimension at a time, so the new loads are only known once
+                   each process finds where its cells would go, in global coordinates */
+                memset(migrate_counts, 0, sizeof(int) * n_processes);
+                migrate_send = malloc(sizeof(Node) * (local_load + 1));
+                migrate_owner = malloc(sizeof(int) * (local_load + 1));
+                n_migrated = 0;
+                for (x = k; x < k + dim_x; x++){
+                    for (y = k; y < k + dim_y; y++){
+                        j = (part_of[0][x - k + offset_x] * dims[1] + part_of[1][y - k + offset_y]) * dims[2];
+                        for (it = local_graph[x][y]; it != NULL; it = it->next){
+                            if (it->state == ALIVE){
+                                z = it->z - k + offset_z;
+                                migrate_send[n_migrated].x = x - k + offset_x;
+                                migrate_send[n_migrated].y = y - k + offset_y;
+                                migrate_send[n_migrated].z = z;
+                                migrate_owner[n_migrated] = block_rank[j + part_of[2][z]];
+                                migrate_counts[migrate_owner[n_migrated]]++;
+                                n_migrated++;
+                            }
+                        }
+                    }
+                }
+                MPI_Allreduce(migrate_counts, predicted_load, n_processes, MPI_INT, MPI_SUM, grid_comm);
+                max_predicted = 0;
+                for (i = 0; i < n_processes; i++){
+                    max_predicted = (predicted_load[i] > max_predicted) ? predicted_load[i] : max_predicted;
                 }
-            }
-        }
 
-    /***********************************************************************************/
+                if (max_predicted < max_load){
 
-        /* Allocate buffers to be sent */
-        snd_low_x = malloc(sizeof(RNode) * snd_count_low_x);
-        snd_high_x = malloc(sizeof(RNode) * snd_count_high_x);
-        snd_low_y = malloc(sizeof(RNode) * snd_count_low_y);
-        snd_high_y = malloc(sizeof(RNode) * snd_count_high_y);
+                    //if (cart_rank == ROOT) debugPrint("Generation %d: largest block from %d to %d live cells", g, max_load, max_predicted);
 
-        snd_i = 0; snd_j = 0; snd_k = 0; snd_l = 0;
+                    /* Send every live cell of the block to its new owner */
+                    n_migrated = routeCells(migrate_send, n_migrated, migrate_owner, grid_comm, MPI_NEIGHBOUR_CELL, &migrate_recv);
 
-        /* Fill buffers */
-        for (y = 0; y < dim_y; y++){
-            for (it = local_graph[0][y]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    addToSndArray(snd_low_x, snd_i, y, it->z);
-                    snd_i++;
-                }
-            }
-            for (it = local_graph[dim_x - 1][y]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    addToSndArray(snd_high_x, snd_j, y, it->z);
-                    snd_j++;
+                    /* Rebuild the local graph around the new block */
+                    freeGraph(local_graph, ext[0], ext[1]);
+                    freeLocks(graph_lock, ext[0], ext[1]);
+                    for (d = 0; d < N_DIMS; d++){
+                        int *swap = cuts[d];
+                        cuts[d] = new_cuts[d];
+                        new_cuts[d] = swap;
+                    }
+                    offset_x = cuts[0][coord[0]];
+                    offset_y = cuts[1][coord[1]];
+                    offset_z = cuts[2][coord[2]];
+                    dim_x = cuts[0][coord[0] + 1] - offset_x;
+                    dim_y = cuts[1][coord[1] + 1] - offset_y;
+                    dim_z = cuts[2][coord[2] + 1] - offset_z;
+                    block[0] = dim_x; block[1] = dim_y; block[2] = dim_z;
+                    for (d = 0; d < N_DIMS; d++){
+                        ext[d] = block[d] + 2 * k;
+                    }
+                    haloBoxes(k, block, ext, snd_lo, snd_hi, rcv_lo);
+                    for (i = 0; i < N_HALOS; i++){
+                        haloSetBox(&snd[i], snd_lo[i], snd_hi[i]);
+                    }
+
+                    local_graph = initGraph(ext[0], ext[1]);
+                    graph_lock = initLocks(ext[0], ext[1]);
+                    for (i = 0; i < n_migrated; i++){
+                        mapped_x = migrate_recv[i].x - offset_x + k; mapped_y = migrate_recv[i].y - offset_y + k;
+                        local_graph[mapped_x][mapped_y] = graphNodeInsert(local_graph[mapped_x][mapped_y],
+                            migrate_recv[i].z - offset_z + k, ALIVE);
+                    }
+                    haloPackBlockZ(snd, local_graph, k, block, snd_lo, snd_hi);
+
+                    free(migrate_recv);
                 }
+                free(migrate_send);
+                free(migrate_owner);
             }
         }
-        for (x = 0; x < dim_x; x++){
-            for (it = local_graph[x][0]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    addToSndArray(snd_low_y, snd_k, x, it->z);
-                    snd_k++;
+
+        /* Generations since the last exchange. Layer m is the outermost one still valid:
+           its cells notify their neighbours, but only the box [m + 1, ext - m - 1) inside
+           it can be computed, and shrinks by one layer each generation */
+        int m = (g - 1) % k;
+        int lo = m + 1, hi_x = ext[0] - m - 1, hi_y = ext[1] - m - 1, hi_z = ext[2] - m - 1;
+
+        if (m == 0){
+
+            /* Drop the ghost columns of the previous exchange, the block columns were
+               already cropped to the block while deciding */
+            #pragma omp parallel for private(y) schedule(static)
+            for (x = 0; x < ext[0]; x++){
+                for (y = 0; y < ext[1]; y++){
+                    if (x < k || x >= k + dim_x || y < k || y >= k + dim_y){
+                        graphNodeDelete(local_graph[x][y]);
+                        local_graph[x][y] = NULL;
+                    }
                 }
             }
-            for (it = local_graph[x][dim_y - 1]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    addToSndArray(snd_high_y, snd_l, x, it->z);
-                    snd_l++;
+
+            /* Exchange the shells one dimension at a time. Only the master thread calls MPI,
+               and the cells already in place notify their neighbours while the next
+               dimension is in flight */
+            for (d = 0; d < N_DIMS; d++){
+                int lo_halo = 2 * d, hi_halo = 2 * d + 1;
+
+                haloStart(&rcv[lo_halo]);
+                haloStart(&rcv[hi_halo]);
+
+                if (d < N_DIMS - 1){
+                    #pragma omp parallel sections
+                    {
+                        #pragma omp section
+                        haloPackBox(&snd[lo_halo], local_graph, snd_lo[lo_halo], snd_hi[lo_halo]);
+                        #pragma omp section
+                        haloPackBox(&snd[hi_halo], local_graph, snd_lo[hi_halo], snd_hi[hi_halo]);
+                    }
+                } else {
+                    /* Only the ghost columns are left to add to the z shells */
+                    for (x = 0; x < ext[0]; x++){
+                        for (y = 0; y < ext[1]; y++){
+                            if (x >= k && x < k + dim_x && y >= k && y < k + dim_y){
+                                continue;
+                            }
+                            for (it = local_graph[x][y]; it != NULL; it = it->next){
+                                for (i = LOW_Z; i <= HIGH_Z; i++){
+                                    if (it->state == ALIVE && it->z >= snd_lo[i][2] && it->z < snd_hi[i][2]){
+                                        haloPush(&snd[i], x, y, it->z - snd_lo[i][2]);
+                                    }
+                                }
+                            }
+                        }
+                    }
                 }
-            }
-        }
 
-    /***********************************************************************************/
+                haloStart(&snd[lo_halo]);
+                haloStart(&snd[hi_halo]);
+
+                if (d == 0){
+                    /* Notify the neighbours of the block cells */
+                    #pragma omp parallel for private(y, it) schedule(dynamic)
+                    for (x = k; x < k + dim_x; x++){
+                        for (y = k; y < k + dim_y; y++){
+                            bool internal = (x > lo && x < hi_x - 1 && y > lo && y < hi_y - 1);
+                            for (it = local_graph[x][y]; it != NULL; it = it->next){
+                                if (it->state == ALIVE){
+                                    if (internal){
+                                        visitInternalNeighbours(local_graph, graph_lock, lo, hi_z, x, y, it->z);
+                                    } else {
+                                        visitBoundaryNeighbours(local_graph, graph_lock, lo, hi_x, hi_y, hi_z, x, y, it->z);
+                                    }
+                                }
+                            }
+                        }
+                    }
+                } else {
+                    /* Notify the neighbours of the ghosts received in the previous dimension */
+                    for (i = 2 * (d - 1); i <= 2 * (d - 1) + 1; i++){
+                        #pragma omp parallel for schedule(static)
+                        for (j = 0; j < rcv[i].count; j++){
+                            visitBoundaryNeighbours(local_graph, graph_lock, lo, hi_x, hi_y, hi_z,
+                                rcv[i].cells[j].x + rcv_lo[i][0], rcv[i].cells[j].y + rcv_lo[i][1], rcv[i].cells[j].z + rcv_lo[i][2]);
+                        }
+                    }
+                }
 
-        //MPI_Barrier(grid_comm);
-        //debugPrint("Finished adding boundary to send arrays");
+                /* Insert the ghosts, which the next dimension passes along. Nothing notifies the
+                   outermost layer, so its cells cannot be in the graph yet */
+                for (i = lo_halo; i <= hi_halo; i++){
+                    haloWait(&rcv[i]);
+                    #pragma omp parallel for private(x, y, z) schedule(static)
+                    for (j = 0; j < rcv[i].count; j++){
+                        x = rcv[i].cells[j].x + rcv_lo[i][0];
+                        y = rcv[i].cells[j].y + rcv_lo[i][1];
+                        z = rcv[i].cells[j].z + rcv_lo[i][2];
+                        if (x == 0 || x == ext[0] - 1 || y == 0 || y == ext[1] - 1 || z == 0 || z == ext[2] - 1){
+                            omp_set_lock(&(graph_lock[x][y]));
+                            local_graph[x][y] = graphNodeInsert(local_graph[x][y], z, ALIVE);
+                            omp_unset_lock(&(graph_lock[x][y]));
+                        } else {
+                            graphNodeSetAlive(&(local_graph[x][y]), z, &(graph_lock[x][y]));
+                        }
+                    }
+                }
 
-        /* Reset the counters of live neighbour cells to be received by each neighbour */
-        rcv_count_low_x = 0; rcv_count_high_x = 0; rcv_count_low_y = 0; rcv_count_high_y = 0;
+                haloWait(&snd[lo_halo]);
+                haloWait(&snd[hi_halo]);
+            }
 
-    /***********************************************************************************/
+            /* Notify the neighbours of the ghosts received in the last dimension */
+            for (i = LOW_Z; i <= HIGH_Z; i++){
+                #pragma omp parallel for schedule(static)
+                for (j = 0; j < rcv[i].count; j++){
+                    visitBoundaryNeighbours(local_graph, graph_lock, lo, hi_x, hi_y, hi_z,
+                        rcv[i].cells[j].x + rcv_lo[i][0], rcv[i].cells[j].y + rcv_lo[i][1], rcv[i].cells[j].z + rcv_lo[i][2]);
+                }
+            }
 
-        /* Send and receive borders to/from neighbours */
-        
-        /* Communicate with lower x neighbour */
-        sendBorder(grid_comm, TAG_LOW_X, cart_rank, nbr_low_x,
-            &(snd_req[0]), MPI_R_NEIGHBOUR_CELL, snd_low_x, snd_count_low_x);
-        rcv_count_high_x = receiveBorder(grid_comm, TAG_LOW_X, cart_rank, nbr_high_x,
-            &(rcv_req[1]), &mpi_status_prb, MPI_R_NEIGHBOUR_CELL, &rcv_high_x);
-
-        /* Communicate with higher x neighbour */
-        sendBorder(grid_comm, TAG_HIGH_X, cart_rank, nbr_high_x,
-            &(snd_req[1]), MPI_R_NEIGHBOUR_CELL, snd_high_x, snd_count_high_x);
-        rcv_count_low_x = receiveBorder(grid_comm, TAG_HIGH_X, cart_rank, nbr_low_x,
-            &(rcv_req[0]), &mpi_status_prb, MPI_R_NEIGHBOUR_CELL, &rcv_low_x);
-        
-        /* Communicate with lower y neighbour */
-        sendBorder(grid_comm, TAG_LOW_Y, cart_rank, nbr_low_y,
-            &(snd_req[2]), MPI_R_NEIGHBOUR_CELL, snd_low_y, snd_count_low_y);
-        rcv_count_high_y = receiveBorder(grid_comm, TAG_LOW_Y, cart_rank, nbr_high_y,
-            &(rcv_req[3]), &mpi_status_prb, MPI_R_NEIGHBOUR_CELL, &rcv_high_y);
-
-        /* Communicate with lower x neighbour */
-        sendBorder(grid_comm, TAG_HIGH_Y, cart_rank, nbr_high_y,
-            &(snd_req[3]), MPI_R_NEIGHBOUR_CELL, snd_high_y, snd_count_high_y);
-        rcv_count_low_y = receiveBorder(grid_comm, TAG_HIGH_Y, cart_rank, nbr_low_y,
-            &(rcv_req[2]), &mpi_status_prb, MPI_R_NEIGHBOUR_CELL, &rcv_low_y);
+        } else {
+
+            /* Notify the neighbours of every cell still valid, i.e. inside [m, ext - m) */
+            #pragma omp parallel for private(y, it) schedule(dynamic)
+            for (x = m; x < ext[0] - m; x++){
+                for (y = m; y < ext[1] - m; y++){
+                    bool internal = (x > lo && x < hi_x - 1 && y > lo && y < hi_y - 1);
+                    for (it = local_graph[x][y]; it != NULL; it = it->next){
+                        if (it->state == ALIVE && it->z >= m && it->z < ext[2] - m){
+                            if (internal && it->z >= lo && it->z < hi_z){
+                                visitInternalNeighbours(local_graph, graph_lock, lo, hi_z, x, y, it->z);
+                            } else {
+                                visitBoundaryNeighbours(local_graph, graph_lock, lo, hi_x, hi_y, hi_z, x, y, it->z);
+                            }
+                        }
+                    }
+                }
+            }
+        }
 
     /***********************************************************************************/
 
-        //MPI_Barrier(grid_comm);
-        //debugPrint("Rank %d Finished exchanging boundaries", cart_rank);
-
-    /***********************************************************************************/
+        /* Before an exchange the box is the block itself: its columns are cropped to it, and
+           its part of the z shells is packed. Each column has at most k cells in a z shell,
+           and the shells were reserved for all of them, so threads only need to claim a slot */
+        bool last = (m == k - 1);
+        if (last){
+            for (i = LOW_Z; i <= HIGH_Z; i++){
+                snd[i].count = 0;
+                haloReserve(&snd[i], dim_x * dim_y * k);
+            }
+        }
 
-        /* Process internal nodes, i.e. not on the boundary of the local graph */
-        for (x = 1; x < dim_x - 1; x++){
-            for (y = 1; y < dim_y - 1; y++){
+        /* Determine next state of each cell in the box */
+        #pragma omp parallel for private(y, it, live_neighbours, i, j) schedule(dynamic)
+        for (x = lo; x < hi_x; x++){
+            for (y = lo; y < hi_y; y++){
+                if (last){
+                    graphListCrop(&(local_graph[x][y]), lo, hi_z);
+                }
                 for (it = local_graph[x][y]; it != NULL; it = it->next){
-                    if (it->state == ALIVE){
-                        visitInternalNeighbours(local_graph, cube_size, x, y, it->z);
+                    if (it->z < lo || it->z >= hi_z){
+                        continue;
                     }
+                    live_neighbours = it->neighbours;
+                    it->neighbours = 0;
+                    if(it->state == ALIVE){
+                        if(live_neighbours < 2 || live_neighbours > 4){
+                            it->state = DEAD;
+                        }
+                    }else{
+                        if(live_neighbours == 2 || live_neighbours == 3){
+                            it->state = ALIVE;
+                        }
+                    }
+                    if (last && it->state == ALIVE){
+                        for (i = LOW_Z; i <= HIGH_Z; i++){
+                            if (it->z >= snd_lo[i][2] && it->z < snd_hi[i][2]){
+                                #pragma omp atomic capture
+                                j = snd[i].count++;
+                                snd[i].cells[j].x = x;
+                                snd[i].cells[j].y = y;
+                                snd[i].cells[j].z = it->z - snd_lo[i][2];
+                            }
+                        }
+                    }
+                }
+                /* Remove dead nodes from the graph every REMOVAL_PERIOD generations */
+                if (g % REMOVAL_PERIOD == 0){
+                    graphListCleanup(&(local_graph[x][y]));
                 }
             }
         }
 
-        //MPI_Barrier(grid_comm);
-        //debugPrint("Rank %d Finished visiting internal cells", cart_rank);
+    /***********************************************************************************/
+
+    } // END MAIN FOR LOOP
 
     /***********************************************************************************/
+    
+    /* Write the final set of live cells */
 
-        /* Process nodes on the boundaries */
+    if (output_name != NULL){
 
-        /* Process first row */
-        for (y = 0; y < dim_y; y++){
-            for (it = local_graph[0][y]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    visitBoundaryNeighbours(local_graph, cube_size, dim_x, dim_y, 0, y, it->z);
+        /* Collect the live cells of the block, in global coordinates */
+        local_graph_length = 0;
+        for (x = k; x < k + dim_x; x++){
+            for (y = k; y < k + dim_y; y++){
+                for (it = local_graph[x][y]; it != NULL; it = it->next){
+                    if (it->state == ALIVE && it->z >= k && it->z < k + dim_z){
+                        local_graph_length++;
+                    }
                 }
             }
         }
-
-        /* If block has a single row, then the upper row and last coincide, and its nodes
-            have already been processed */
-        if (dim_x > 1){
-            /* Process last row */
-            for (y = 0; y < dim_y; y++){
-                for (it = local_graph[dim_x - 1][y]; it != NULL; it = it->next){
-                    if (it->state == ALIVE){
-                        visitBoundaryNeighbours(local_graph, cube_size, dim_x, dim_y, dim_x - 1, y, it->z);
+        lg_send = malloc(sizeof(Node) * (local_graph_length + 1));
+        local_graph_length = 0;
+        for (x = k; x < k + dim_x; x++){
+            for (y = k; y < k + dim_y; y++){
+                for (it = local_graph[x][y]; it != NULL; it = it->next){
+                    if (it->state == ALIVE && it->z >= k && it->z < k + dim_z){
+                        lg_send[local_graph_length].x = x - k + offset_x;
+                        lg_send[local_graph_length].y = y - k + offset_y;
+                        lg_send[local_graph_length].z = it->z - k + offset_z;
+                        local_graph_length++;
                     }
                 }
             }
         }
 
-        /* Process first column */
-        for (x = 1; x < dim_x - 1; x++){
-            for (it = local_graph[x][0]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    visitBoundaryNeighbours(local_graph, cube_size, dim_x, dim_y, x, 0, it->z);
-                }
-            }
+        /* Blocks interleave along x, so the cells are first sent to slabs of whole x slices holding
+           about the same number of live cells, one per process in rank order. Each slab is then a
+           contiguous part of the output */
+        memset(slice_load, 0, sizeof(int) * cube_size);
+        for (i = 0; i < local_graph_length; i++){
+            slice_load[lg_send[i].x]++;
         }
-
-        /* If block has a single column, then the upper column and last coincide, and its nodes
-            have already been processed */
-        if (dim_y > 1){
-            for (x = 1; x < dim_x - 1; x++){
-                for (it = local_graph[x][dim_y - 1]; it != NULL; it = it->next){
-                    if (it->state == ALIVE){
-                        visitBoundaryNeighbours(local_graph, cube_size, dim_x, dim_y, x, dim_y - 1, it->z);
-                    }
-                }
-            }
+        MPI_Allreduce(MPI_IN_PLACE, slice_load, cube_size, MPI_INT, MPI_SUM, grid_comm);
+        slab_cuts = malloc(sizeof(int) * (n_processes + 1));
+        slab_of = malloc(sizeof(int) * cube_size);
+        balanceCuts(slab_cuts, n_processes, slice_load, cube_size, 0);
+        sliceOwners(slab_of, slab_cuts, n_processes);
+
+        migrate_owner = malloc(sizeof(int) * (local_graph_length + 1));
+        for (i = 0; i < local_graph_length; i++){
+            migrate_owner[i] = slab_of[lg_send[i].x];
         }
+        n_migrated = routeCells(lg_send, local_graph_length, migrate_owner, grid_comm, MPI_NEIGHBOUR_CELL, &migrate_recv);
+        writeCells(output_name, grid_comm, MPI_NEIGHBOUR_CELL, cube_size, migrate_recv, n_migrated);
+
+        free(lg_send);
+        free(migrate_owner);
+        free(migrate_recv);
+        free(slab_cuts);
+        free(slab_of);
+        free(output_name);
+    }
 
-        // MPI_Barrier(grid_comm);
-        // debugPrint("Rank %d Finished visiting boundary cells", cart_rank);
+    /***********************************************************************************/
+
+    /* Stop Timer */
+    global_end_t = MPI_Wtime();
+
+    /* Print global execution time */
+    if (rank == ROOT){
+        timePrint(global_end_t - global_start_t);
+    }
 
     /***********************************************************************************/
 
-        /* Process neighbour nodes */
+    /* Clean up */
+    for (i = 0; i < N_HALOS; i++){
+        haloFree(&snd[i]);
+        haloFree(&rcv[i]);
+    }
+    freeGraph(local_graph, ext[0], ext[1]);
+    freeLocks(graph_lock, ext[0], ext[1]);
+    for (i = 0; i < N_DIMS; i++){
+        free(cuts[i]);
+        free(new_cuts[i]);
+        free(part_of[i]);
+    }
+    free(slice_load);
+    free(block_rank);
+    free(rank_load);
+    free(predicted_load);
+    free(migrate_counts);
+    free(file_name);
+
+    /* Force a synchronisation point and exit */
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Finalize();
+}
+
+void parseArgs(int argc, char* argv[], char** file, int* generations, int* n_threads, int* halo_depth, char** output){
+    if (argc >= 3 && argc <= 6){
+        char* file_name = malloc(sizeof(char) * (strlen(argv[1]) + 1));
+        strcpy(file_name, argv[1]);
+        *file = file_name;
 
-        MPI_Wait(&(rcv_req[0]), &(mpi_status_rcv));
-        
-        /* Process lower x row */
-        for (i = 0; i < rcv_count_low_x; i++){
-            y = rcv_low_x[i].a;
-            z = rcv_low_x[i].z;
-            graphNodeAddNeighbour(&(local_graph[0][y]), z);
+        *generations = atoi(argv[2]);
+        *n_threads = (argc >= 4) ? atoi(argv[3]) : omp_get_max_threads();
+        *halo_depth = (argc >= 5) ? atoi(argv[4]) : DEFAULT_HALO_DEPTH;
+        *output = NULL;
+        if (argc == 6){
+            *output = malloc(sizeof(char) * (strlen(argv[5]) + 1));
+            strcpy(*output, argv[5]);
         }
+        if (*generations > 0 && *n_threads > 0 && *halo_depth > 0 && file_name != NULL)
+            return;
+    }
+    printf("Usage: %s [data_file.in] [number_generations] [threads_per_process] [halo_depth] [output_file]", argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+int haloCapacity(int n_bytes){
+
+    int capacity = HALO_MIN_CAPACITY;
+    while (capacity < n_bytes){
+        capacity *= 2;
+    }
+    return capacity;
+}
 
-        MPI_Wait(&(rcv_req[1]), &(mpi_status_rcv));
-        
-        /* Process higher x row */
-        for (i = 0; i < rcv_count_high_x; i++){
-            y = rcv_high_x[i].a;
-            z = rcv_high_x[i].z;
-            graphNodeAddNeighbour(&(local_graph[dim_x - 1][y]), z);
+void haloCreate(Halo *halo, MPI_Comm comm, int nbr_rank, int tag, bool send){
+
+    int d;
+
+    halo->comm = comm;
+    halo->nbr_rank = nbr_rank;
+    halo->tag = tag;
+    halo->send = send;
+    halo->cells = NULL;
+    halo->count = 0;
+    halo->length = 0;
+    halo->keys = NULL;
+    halo->next = NULL;
+    halo->changes = NULL;
+    halo->n_keys = 0;
+    halo->keys_length = 0;
+    for (d = 0; d < N_DIMS; d++){
+        halo->box[d] = 0;
+        halo->keys_box[d] = 0;
+    }
+    halo->bytes = NULL;
+    halo->n_bytes = 0;
+    halo->bytes_length = 0;
+    halo->capacity = HALO_MIN_CAPACITY;
+    halo->req = MPI_REQUEST_NULL;
+    halo->overflow_req = MPI_REQUEST_NULL;
+    haloReserveBytes(halo, halo->capacity);
+}
+
+void haloSetBox(Halo *halo, int lo[N_DIMS], int hi[N_DIMS]){
+
+    int d;
+    for (d = 0; d < N_DIMS; d++){
+        halo->box[d] = hi[d] - lo[d];
+    }
+}
+
+void haloReserve(Halo *halo, int count){
+
+    if (count > halo->length){
+        halo->length = 2 * count;
+        halo->cells = realloc(halo->cells, sizeof(Node) * halo->length);
+        if (halo->cells == NULL){
+            errPrint("Realloc failed. Memory full");
+            exit(EXIT_FAILURE);
         }
+    }
+}
 
-        MPI_Wait(&(rcv_req[2]), &(mpi_status_rcv));
+void haloReserveKeys(Halo *halo, int count){
 
-        /* Process lower y column */
-        for (i = 0; i < rcv_count_low_y; i++){
-            x = rcv_low_y[i].a;
-            z = rcv_low_y[i].z;
-            graphNodeAddNeighbour(&(local_graph[x][0]), z);
+    if (count > halo->keys_length){
+        halo->keys_length = 2 * count;
+        halo->keys = realloc(halo->keys, sizeof(uint64_t) * halo->keys_length);
+        halo->next = realloc(halo->next, sizeof(uint64_t) * halo->keys_length);
+        halo->changes = realloc(halo->changes, sizeof(uint64_t) * halo->keys_length);
+        if (halo->keys == NULL || halo->next == NULL || halo->changes == NULL){
+            errPrint("Realloc failed. Memory full");
+            exit(EXIT_FAILURE);
         }
+    }
+}
 
-        MPI_Wait(&(rcv_req[3]), &(mpi_status_rcv));        
+void haloReserveBytes(Halo *halo, int n_bytes){
 
-        /* Process higher y column */
-        for (i = 0; i < rcv_count_high_y; i++){
-            x = rcv_high_y[i].a;
-            z = rcv_high_y[i].z;
-            graphNodeAddNeighbour(&(local_graph[x][dim_y - 1]), z);
+    if (n_bytes > halo->bytes_length){
+        halo->bytes_length = 2 * n_bytes;
+        halo->bytes = realloc(halo->bytes, halo->bytes_length);
+        if (halo->bytes == NULL){
+            errPrint("Realloc failed. Memory full");
+            exit(EXIT_FAILURE);
+        }
+        /* The persistent receive is bound to the old buffer */
+        if (!halo->send && halo->req != MPI_REQUEST_NULL){
+            MPI_Request_free(&(halo->req));
         }
+    }
+}
 
-        // MPI_Barrier(grid_comm);
-        // debugPrint("Rank %d Finished processing neighbour cells", cart_rank);
+void haloPush(Halo *halo, int x, int y, int z){
 
-    /***********************************************************************************/
+    haloReserve(halo, halo->count + 1);
+    halo->cells[halo->count].x = x;
+    halo->cells[halo->count].y = y;
+    halo->cells[halo->count].z = z;
+    halo->count++;
+}
 
-        /* Determine next state of each cell */
-        for (x = 0; x < dim_x; x++){
-            for (y = 0; y < dim_y; y++){
-                for (it = local_graph[x][y]; it != NULL; it = it->next){
-                    live_neighbours = it->neighbours;
-                    it->neighbours = 0;
-                    if(it->state == ALIVE){
-                        if(live_neighbours < 2 || live_neighbours > 4){
-                            it->state = DEAD;
-                        }
-                    }else{
-                        if(live_neighbours == 2 || live_neighbours == 3){
-                            it->state = ALIVE;
-                        }
-                    }
+void haloPackBox(Halo *halo, GraphNode ***graph, int lo[N_DIMS], int hi[N_DIMS]){
+
+    int x, y;
+    GraphNode *it;
+
+    halo->count = 0;
+    for (x = lo[0]; x < hi[0]; x++){
+        for (y = lo[1]; y < hi[1]; y++){
+            for (it = graph[x][y]; it != NULL; it = it->next){
+                if (it->state == ALIVE && it->z >= lo[2] && it->z < hi[2]){
+                    haloPush(halo, x - lo[0], y - lo[1], it->z - lo[2]);
                 }
             }
         }
+    }
+}
 
-        /* Remove dead nodes from the graph every REMOVAL_PERIOD generations */
-        if (g % REMOVAL_PERIOD == 0){
-            for (x = 0; x < dim_x; x++){
-                for (y = 0; y < dim_y; y++){
-                    graphListCleanup(&(local_graph[x][y]));
-                }
-            }
+int compareKeys(const void *a, const void *b){
+
+    uint64_t u = *(const uint64_t *) a, v = *(const uint64_t *) b;
+    return (u > v) - (u < v);
+}
+
+int putVarint(unsigned char *buffer, uint64_t value){
+
+    int length = 0;
+    while (value >= 0x80){
+        if (buffer != NULL){
+            buffer[length] = (value & 0x7F) | 0x80;
         }
+        value >>= 7;
+        length++;
+    }
+    if (buffer != NULL){
+        buffer[length] = value;
+    }
+    return length + 1;
+}
+
+uint64_t getVarint(unsigned char **buffer){
+
+    uint64_t value = 0;
+    int shift = 0;
+    unsigned char byte;
+    do {
+        byte = *(*buffer)++;
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+int encodeKeys(unsigned char *buffer, uint64_t *keys, int n_keys){
+
+    int length, i;
+
+    /* The count, then the gap before each position. Positions are distinct, so the
+       gap from the previous one is at least one, and one less is stored */
+    length = putVarint(buffer, n_keys);
+    for (i = 0; i < n_keys; i++){
+        length += putVarint((buffer != NULL) ? buffer + length : NULL, (i == 0) ? keys[0] : keys[i] - keys[i - 1] - 1);
+    }
+    return length;
+}
 
-        for (i = 0; i < 4; i++){
-            MPI_Wait(&(snd_req[i]), &(mpi_status_snd));
+unsigned char *decodeKeys(unsigned char *buffer, uint64_t *keys, int n_keys){
+
+    int i;
+    for (i = 0; i < n_keys; i++){
+        keys[i] = getVarint(&buffer) + ((i == 0) ? 0 : keys[i - 1] + 1);
+    }
+    return buffer;
+}
+
+int mergeKeys(uint64_t *merged, uint64_t *a, int n_a, uint64_t *b, int n_b){
+
+    int i = 0, j = 0, n = 0;
+    while (i < n_a && j < n_b){
+        if (a[i] < b[j]){
+            merged[n++] = a[i++];
+        } else if (b[j] < a[i]){
+            merged[n++] = b[j++];
+        } else {
+            i++; j++;
         }
+    }
+    while (i < n_a){
+        merged[n++] = a[i++];
+    }
+    while (j < n_b){
+        merged[n++] = b[j++];
+    }
+    return n;
+}
 
-    /***********************************************************************************/
+void haloEncode(Halo *halo){
 
-        /* Cleanup sending buffers */
-        free(snd_low_x); free(snd_high_x);
-        free(snd_low_y); free(snd_high_y);
+    uint64_t volume = (uint64_t) halo->box[0] * halo->box[1] * halo->box[2];
+    uint64_t *swap;
+    unsigned char *payload;
+    uint32_t n_bytes;
+    uint16_t side;
+    int i, d, mode, length, n_changes = 0;
+    bool same_box = true;
 
-    /***********************************************************************************/
+    for (d = 0; d < N_DIMS; d++){
+        same_box = same_box && (halo->box[d] == halo->keys_box[d]);
+    }
 
-    } // END MAIN FOR LOOP
+    /* Number the cells by their position in the box, row after row */
+    haloReserveKeys(halo, halo->count + halo->n_keys);
+    for (i = 0; i < halo->count; i++){
+        halo->next[i] = ((uint64_t) halo->cells[i].x * halo->box[1] + halo->cells[i].y) * halo->box[2] + halo->cells[i].z;
+    }
+    qsort(halo->next, halo->count, sizeof(uint64_t), compareKeys);
+
+    /* Take the shortest encoding. The changes only make sense to the receiver while the
+       box is the one it holds the previous cells for */
+    mode = HALO_SPARSE;
+    length = encodeKeys(NULL, halo->next, halo->count);
+    if ((volume + 7) / 8 < (uint64_t) length){
+        mode = HALO_BITMAP;
+        length = (volume + 7) / 8;
+    }
+    if (same_box){
+        n_changes = mergeKeys(halo->changes, halo->keys, halo->n_keys, halo->next, halo->count);
+        if (encodeKeys(NULL, halo->changes, n_changes) < length){
+            mode = HALO_CHANGES;
+            length = encodeKeys(NULL, halo->changes, n_changes);
+        }
+    }
 
-    /***********************************************************************************/
-    
-    /* Compute local graph size*/
-    
-    local_graph_length = 0;
-    for (x = 0; x < dim_x; x++){
-        for (y = 0; y < dim_y; y++){
-            for (it = local_graph[x][y]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    local_graph_length++;
-                }
+    /* Header */
+    halo->n_bytes = HALO_HEADER_SIZE + length;
+    haloReserveBytes(halo, halo->n_bytes);
+    n_bytes = halo->n_bytes;
+    memcpy(halo->bytes, &n_bytes, sizeof(uint32_t));
+    halo->bytes[sizeof(uint32_t)] = mode;
+    for (d = 0; d < N_DIMS; d++){
+        side = halo->box[d];
+        memcpy(halo->bytes + sizeof(uint32_t) + 1 + d * sizeof(uint16_t), &side, sizeof(uint16_t));
+    }
+
+    payload = halo->bytes + HALO_HEADER_SIZE;
+    if (mode == HALO_SPARSE){
+        encodeKeys(payload, halo->next, halo->count);
+    } else if (mode == HALO_BITMAP){
+        memset(payload, 0, length);
+        for (i = 0; i < halo->count; i++){
+            payload[halo->next[i] >> 3] |= 1 << (halo->next[i] & 7);
+        }
+    } else {
+        encodeKeys(payload, halo->changes, n_changes);
+    }
+
+    /* The receiver now holds these cells */
+    swap = halo->keys; halo->keys = halo->next; halo->next = swap;
+    halo->n_keys = halo->count;
+    memcpy(halo->keys_box, halo->box, sizeof(int) * N_DIMS);
+}
+
+void haloDecode(Halo *halo){
+
+    unsigned char *payload = halo->bytes + HALO_HEADER_SIZE;
+    int mode = halo->bytes[sizeof(uint32_t)];
+    uint64_t volume, key, *swap;
+    uint16_t side;
+    int n, n_changes, i, d;
+
+    for (d = 0; d < N_DIMS; d++){
+        memcpy(&side, halo->bytes + sizeof(uint32_t) + 1 + d * sizeof(uint16_t), sizeof(uint16_t));
+        halo->box[d] = side;
+    }
+
+    if (mode == HALO_SPARSE){
+        n = getVarint(&payload);
+        haloReserveKeys(halo, n);
+        decodeKeys(payload, halo->next, n);
+    } else if (mode == HALO_BITMAP){
+        volume = (uint64_t) halo->box[0] * halo->box[1] * halo->box[2];
+        n = 0;
+        for (key = 0; key < (volume + 7) / 8; key++){
+            n += __builtin_popcount(payload[key]);
+        }
+        haloReserveKeys(halo, n);
+        n = 0;
+        for (key = 0; key < volume; key++){
+            if (payload[key >> 3] == 0){
+                key |= 7;
+            } else if (payload[key >> 3] & (1 << (key & 7))){
+                halo->next[n++] = key;
             }
         }
+    } else {
+        n_changes = getVarint(&payload);
+        haloReserveKeys(halo, halo->n_keys + n_changes);
+        decodeKeys(payload, halo->changes, n_changes);
+        n = mergeKeys(halo->next, halo->keys, halo->n_keys, halo->changes, n_changes);
     }
 
-    if (rank == ROOT) {
-        lg_lengths = malloc(sizeof(int) * n_processes);
-        /* lc_length of root was already computed */
-        lg_lengths[ROOT] = local_graph_length;
+    /* Back to coordinates relative to the corner of the box */
+    haloReserve(halo, n);
+    for (i = 0; i < n; i++){
+        key = halo->next[i];
+        halo->cells[i].z = key % halo->box[2];
+        key /= halo->box[2];
+        halo->cells[i].y = key % halo->box[1];
+        halo->cells[i].x = key / halo->box[1];
     }
+    halo->count = n;
 
-    /***********************************************************************************/
-    
-    /* Announce local graph size to root */
-    
-    MPI_Gather(&local_graph_length, 1, MPI_INT, lg_lengths, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
-    
-    if (rank == ROOT){
-        
-        /*
-        for (i = 0; i < n_processes; i++){
-            debugPrint("ROOT got local graph length %d from rank %d", lg_lengths[i], i);
+    swap = halo->keys; halo->keys = halo->next; halo->next = swap;
+    halo->n_keys = n;
+    memcpy(halo->keys_box, halo->box, sizeof(int) * N_DIMS);
+}
+
+void haloStart(Halo *halo){
+
+    if (halo->send){
+        /* Only the encoded bytes go out, the rest in an overflow message if they do not fit */
+        haloEncode(halo);
+        MPI_Isend(halo->bytes, (halo->n_bytes < halo->capacity) ? halo->n_bytes : halo->capacity, MPI_BYTE,
+            halo->nbr_rank, halo->tag, halo->comm, &(halo->req));
+        if (halo->n_bytes > halo->capacity){
+            MPI_Isend(halo->bytes + halo->capacity, halo->n_bytes - halo->capacity, MPI_BYTE,
+                halo->nbr_rank, halo->tag + TAG_OVERFLOW, halo->comm, &(halo->overflow_req));
         }
-        */
-        
-        /* Displacements */
-        lg_displs = malloc( sizeof(int) * n_processes);
-        total_length = 0;
-        for (i = 0; i < n_processes; i++){
-            lg_displs[i] = total_length;
-            total_length += lg_lengths[i];
+    } else {
+        if (halo->req == MPI_REQUEST_NULL){
+            MPI_Recv_init(halo->bytes, halo->capacity, MPI_BYTE, halo->nbr_rank, halo->tag, halo->comm, &(halo->req));
         }
+        MPI_Start(&(halo->req));
+    }
+}
+
+void haloWait(Halo *halo){
+
+    uint32_t n_bytes;
+
+    MPI_Wait(&(halo->req), MPI_STATUS_IGNORE);
 
-        /* Buffer to receive all local graphs */
-        all_lg = malloc(sizeof(Node) * total_length);
+    if (!halo->send){
+        memcpy(&n_bytes, halo->bytes, sizeof(uint32_t));
+        halo->n_bytes = n_bytes;
+        if (halo->n_bytes > halo->capacity){
+            haloReserveBytes(halo, halo->n_bytes);
+            MPI_Recv(halo->bytes + halo->capacity, halo->n_bytes - halo->capacity, MPI_BYTE,
+                halo->nbr_rank, halo->tag + TAG_OVERFLOW, halo->comm, MPI_STATUS_IGNORE);
+        }
+        haloDecode(halo);
+    } else if (halo->n_bytes > halo->capacity){
+        MPI_Wait(&(halo->overflow_req), MPI_STATUS_IGNORE);
     }
 
-    /***********************************************************************************/
-    
-    /* Fill buffer to send to ROOT from local graph */
-    lg_send = malloc(sizeof(Node) * local_graph_length);
-    local_graph_length = 0;
-    for (x = 0; x < dim_x; x++){
-        for (y = 0; y < dim_y; y++){
-            for (it = local_graph[x][y]; it != NULL; it = it->next){
-                if (it->state == ALIVE){
-                    // Add offsets to obtain global coordinates, instead of local
-                    lg_send[local_graph_length].x = x + offset_x;
-                    lg_send[local_graph_length].y = y + offset_y;
-                    lg_send[local_graph_length].z = it->z;
-                    local_graph_length++;
-                }
-            }
+    /* Both ends saw the same length, so they grow the capacity alike */
+    if (halo->n_bytes > halo->capacity){
+        halo->capacity = haloCapacity(halo->n_bytes);
+        haloReserveBytes(halo, halo->capacity);
+        if (!halo->send && halo->req != MPI_REQUEST_NULL){
+            MPI_Request_free(&(halo->req));
         }
     }
+}
 
-    /* Gather global graph in ROOT process */
-    MPI_Gatherv(lg_send, local_graph_length, MPI_NEIGHBOUR_CELL, all_lg, lg_lengths,
-        lg_displs, MPI_NEIGHBOUR_CELL, ROOT, MPI_COMM_WORLD);
-    
-    /***********************************************************************************/
+void haloFree(Halo *halo){
 
-    /* Stop Timer */
-    global_end_t = MPI_Wtime();
+    if (halo->req != MPI_REQUEST_NULL){
+        MPI_Request_free(&(halo->req));
+    }
+    free(halo->cells);
+    free(halo->keys);
+    free(halo->next);
+    free(halo->changes);
+    free(halo->bytes);
+}
 
-    /***********************************************************************************/
+int readCells(char *file_name, MPI_Comm comm, MPI_Datatype datatype, int *cube_size, Node **cells){
+
+    MPI_File fh;
+    MPI_Offset file_size, data_start, lo, hi, read_lo, total;
+    char header[BUFFER_SIZE + 1];
+    char *chunk, *line, *end, *next;
+    int rank, n_processes, length, n_cells, capacity, cell_size;
+    int32_t size;
+    long x, y, z;
 
-    if(rank == ROOT){
-        
-        /* Convert array of final alive nodes into a global graph */
-        global_graph = initGraph(cube_size,cube_size);
-        for (i = 0; i < total_length; i++){
-            x = all_lg[i].x; y = all_lg[i].y; z = all_lg[i].z;
-            global_graph[x][y] = graphNodeInsert(global_graph[x][y], z, ALIVE);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &n_processes);
+
+    if (MPI_File_open(comm, file_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS){
+        fprintf(stderr, "Please input a valid file name\n" );
+        exit(EXIT_FAILURE);
+    }
+    MPI_File_get_size(fh, &file_size);
+
+    /* Every process reads the header */
+    length = (file_size < BUFFER_SIZE) ? (int) file_size : BUFFER_SIZE;
+    MPI_File_read_at_all(fh, 0, header, length, MPI_CHAR, MPI_STATUS_IGNORE);
+    header[length] = '\0';
+
+    if (length >= BINARY_HEADER_SIZE && memcmp(header, BINARY_MAGIC, BINARY_MAGIC_SIZE) == 0){
+
+        /* Binary cells are read straight into place, an even share of them each */
+        memcpy(&size, header + BINARY_MAGIC_SIZE, sizeof(int32_t));
+        *cube_size = size;
+        MPI_Type_size(datatype, &cell_size);
+        total = (file_size - BINARY_HEADER_SIZE) / cell_size;
+        lo = total * rank / n_processes;
+        hi = total * (rank + 1) / n_processes;
+        n_cells = (int) (hi - lo);
+        *cells = malloc(sizeof(Node) * (n_cells + 1));
+        MPI_File_read_at_all(fh, BINARY_HEADER_SIZE + lo * cell_size, *cells, n_cells, datatype, MPI_STATUS_IGNORE);
+        MPI_File_close(&fh);
+        return n_cells;
+    }
+
+    /* The first line of a text file holds the size of the cube */
+    sscanf(header, "%d", cube_size);
+    line = strchr(header, '\n');
+    data_start = (line == NULL) ? file_size : (line - header) + 1;
+
+    /* Each process parses the lines starting in an even share of the bytes. Lines are shorter
+       than BUFFER_SIZE, so reading that much further completes the last one, and the byte
+       before the share tells whether its first line started in the previous one */
+    lo = data_start + (file_size - data_start) * rank / n_processes;
+    hi = data_start + (file_size - data_start) * (rank + 1) / n_processes;
+    read_lo = (lo > data_start) ? lo - 1 : lo;
+    length = (int) (((hi + BUFFER_SIZE < file_size) ? hi + BUFFER_SIZE : file_size) - read_lo);
+    chunk = malloc(length + 1);
+    MPI_File_read_at_all(fh, read_lo, chunk, length, MPI_CHAR, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    chunk[length] = '\0';
+
+    line = chunk;
+    if (lo > data_start){
+        while (*line != '\0' && *line != '\n'){
+            line++;
+        }
+        if (*line == '\n'){
+            line++;
         }
+    }
+    end = chunk + (hi - read_lo);
+
+    /* A line holds at least "x y z\n" */
+    capacity = (int) ((hi - lo) / 6) + 1;
+    *cells = malloc(sizeof(Node) * capacity);
+    n_cells = 0;
+    while (line < end && *line != '\0'){
+        if (*line != '\n'){
+            x = strtol(line, &next, 10);
+            if (next != line){
+                line = next;
+                y = strtol(line, &next, 10);
+                if (next != line){
+                    line = next;
+                    z = strtol(line, &next, 10);
+                    if (next != line){
+                        if (n_cells == capacity){
+                            capacity *= 2;
+                            *cells = realloc(*cells, sizeof(Node) * capacity);
+                        }
+                        (*cells)[n_cells].x = x;
+                        (*cells)[n_cells].y = y;
+                        (*cells)[n_cells].z = z;
+                        n_cells++;
+                    }
+                }
+            }
+            line = next;
+        }
+        /* Move on to the next line */
+        while (*line != '\0' && *line != '\n'){
+            line++;
+        }
+        if (*line == '\n'){
+            line++;
+        }
+    }
+
+    free(chunk);
+    return n_cells;
+}
 
-        /* Print the final set of live cells */
-        //printAndSortActive(global_graph, cube_size); fflush(stdout);
+int routeCells(Node *cells, int n_cells, int *owner, MPI_Comm comm, MPI_Datatype datatype, Node **routed){
 
-        /* Free global graph */
-        freeGraph(global_graph, cube_size, cube_size);
+    int n_processes, i, n_routed;
+    int *send_counts, *send_displs, *recv_counts, *recv_displs, *fill;
+    Node *sorted;
 
-        /* Print global execution time */
-        timePrint(global_end_t - global_start_t);
+    MPI_Comm_size(comm, &n_processes);
+    send_counts = calloc(n_processes, sizeof(int));
+    send_displs = malloc(sizeof(int) * n_processes);
+    recv_counts = malloc(sizeof(int) * n_processes);
+    recv_displs = malloc(sizeof(int) * n_processes);
+    fill = malloc(sizeof(int) * n_processes);
+
+    /* Group the cells by owner */
+    for (i = 0; i < n_cells; i++){
+        send_counts[owner[i]]++;
+    }
+    send_displs[0] = 0;
+    for (i = 1; i < n_processes; i++){
+        send_displs[i] = send_displs[i - 1] + send_counts[i - 1];
+    }
+    memcpy(fill, send_displs, sizeof(int) * n_processes);
+    sorted = malloc(sizeof(Node) * (n_cells + 1));
+    for (i = 0; i < n_cells; i++){
+        sorted[fill[owner[i]]++] = cells[i];
     }
 
-    /***********************************************************************************/
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, comm);
+    n_routed = 0;
+    for (i = 0; i < n_processes; i++){
+        recv_displs[i] = n_routed;
+        n_routed += recv_counts[i];
+    }
+    *routed = malloc(sizeof(Node) * (n_routed + 1));
+    MPI_Alltoallv(sorted, send_counts, send_displs, datatype, *routed, recv_counts, recv_displs, datatype, comm);
+
+    free(send_counts);
+    free(send_displs);
+    free(recv_counts);
+    free(recv_displs);
+    free(fill);
+    free(sorted);
+    return n_routed;
+}
 
-    /* Clean up */
-    freeGraph(local_graph, dim_x, dim_y);
-    free(file_name);
+int compareCells(const void *a, const void *b){
 
-    /* Force a synchronisation point and exit */
-    MPI_Barrier(MPI_COMM_WORLD);
-    MPI_Finalize();
+    const Node *u = a, *v = b;
+    if (u->x != v->x){
+        return u->x - v->x;
+    }
+    if (u->y != v->y){
+        return u->y - v->y;
+    }
+    return u->z - v->z;
 }
 
-void parseArgs(int argc, char* argv[], char** file, int* generations){
-    if (argc == 3){
-        char* file_name = malloc(sizeof(char) * (strlen(argv[1]) + 1));
-        strcpy(file_name, argv[1]);
-        *file = file_name;
+void writeCells(char *file_name, MPI_Comm comm, MPI_Datatype datatype, int cube_size, Node *cells, int n_cells){
 
-        *generations = atoi(argv[2]);
-        if (*generations > 0 && file_name != NULL)
-            return;
+    MPI_File fh;
+    MPI_Offset length, offset, count, prefix;
+    char header[BINARY_HEADER_SIZE];
+    char *text;
+    int rank, cell_size, i;
+    int32_t size;
+    size_t name_length = strlen(file_name);
+    bool binary = name_length >= strlen(BINARY_SUFFIX)
+        && strcmp(file_name + name_length - strlen(BINARY_SUFFIX), BINARY_SUFFIX) == 0;
+
+    MPI_Comm_rank(comm, &rank);
+    qsort(cells, n_cells, sizeof(Node), compareCells);
+
+    if (MPI_File_open(comm, file_name, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS){
+        fprintf(stderr, "Could not open the output file\n" );
+        MPI_Abort(comm, EXIT_FAILURE);
     }
-    printf("Usage: %s [data_file.in] [number_generations]", argv[0]);
-    exit(EXIT_FAILURE);
+    MPI_File_set_size(fh, 0);
+
+    if (binary){
+
+        /* The header goes first, then the cells of every process in rank order */
+        if (rank == ROOT){
+            size = cube_size;
+            memcpy(header, BINARY_MAGIC, BINARY_MAGIC_SIZE);
+            memcpy(header + BINARY_MAGIC_SIZE, &size, sizeof(int32_t));
+            MPI_File_write_at(fh, 0, header, BINARY_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+        MPI_Type_size(datatype, &cell_size);
+        count = n_cells;
+        prefix = 0;
+        MPI_Exscan(&count, &prefix, 1, MPI_OFFSET, MPI_SUM, comm);
+        if (rank == ROOT){
+            prefix = 0;
+        }
+        MPI_File_write_at_all(fh, BINARY_HEADER_SIZE + prefix * cell_size, cells, n_cells, datatype, MPI_STATUS_IGNORE);
+
+    } else {
+
+        /* Lines vary in length, so each process starts where the previous ones end */
+        text = malloc((size_t) n_cells * OUTPUT_LINE_SIZE + 1);
+        length = 0;
+        for (i = 0; i < n_cells; i++){
+            length += sprintf(text + length, "%d %d %d\n", cells[i].x, cells[i].y, cells[i].z);
+        }
+        offset = 0;
+        MPI_Exscan(&length, &offset, 1, MPI_OFFSET, MPI_SUM, comm);
+        if (rank == ROOT){
+            offset = 0;
+        }
+        MPI_File_write_at_all(fh, offset, text, (int) length, MPI_CHAR, MPI_STATUS_IGNORE);
+        free(text);
+    }
+
+    MPI_File_close(&fh);
 }
 
-void addToSndArray(RNode *array, int index, int a, int z){
+void sliceOwners(int *owner, int *cuts, int parts){
 
-    array[index].a = a;
-    array[index].z = z;
+    int p, c;
+    for (p = 0; p < parts; p++){
+        for (c = cuts[p]; c < cuts[p + 1]; c++){
+            owner[c] = p;
+        }
+    }
 }
 
-void sendBorder(MPI_Comm mpi_comm, int mpi_tag, int my_rank, int nbr_rank,
-               MPI_Request *req, MPI_Datatype mpi_datatype,
-                RNode *snd, int snd_size){
+void blockCuts(int *cuts, int parts, int size){
 
-    MPI_Isend(snd, snd_size, mpi_datatype, nbr_rank, mpi_tag, mpi_comm, req);
-    //debugPrint("Rank %d <-> %d - sent %d (TAG %d)", my_rank, nbr_rank, snd_size, mpi_tag);
+    int other = size / parts;
+    /* The first block gets the excess cells */
+    int first = size - (other * (parts - 1));
+    int p;
+
+    cuts[0] = 0;
+    for (p = 1; p <= parts; p++){
+        cuts[p] = first + (p - 1) * other;
+    }
 }
 
-int receiveBorder(MPI_Comm mpi_comm, int mpi_tag, int my_rank, int nbr_rank,
-                    MPI_Request *req, MPI_Status *status_prb,
-                    MPI_Datatype mpi_datatype, RNode **rcv){
+void balanceCuts(int *cuts, int parts, int *load, int size, int min_width){
 
-    int rcv_size = 0;
+    long total = 0, prefix = 0, target;
+    int p, c;
+
+    for (c = 0; c < size; c++){
+        total += load[c];
+    }
 
-    MPI_Probe(nbr_rank, mpi_tag, mpi_comm, status_prb);
-    MPI_Get_count(status_prb, mpi_datatype, &rcv_size);
+    cuts[0] = 0;
+    c = 0;
+    for (p = 1; p < parts; p++){
+        /* Leave room for this block and every following one */
+        while (c < cuts[p - 1] + min_width){
+            prefix += load[c++];
+        }
+        /* Take a slice while most of it falls short of an equal share */
+        target = total * p / parts;
+        while (c < size - (parts - p) * min_width && 2 * prefix + load[c] < 2 * target){
+            prefix += load[c++];
+        }
+        cuts[p] = c;
+    }
+    cuts[parts] = size;
+}
 
-    if (rcv_size > 0){
-        *rcv = malloc(sizeof(Node) * rcv_size);
+void haloBoxes(int k, int block[N_DIMS], int ext[N_DIMS],
+    int snd_lo[N_HALOS][N_DIMS], int snd_hi[N_HALOS][N_DIMS], int rcv_lo[N_HALOS][N_DIMS]){
+
+    int i, d, a, side;
+
+    /* The exchange goes one dimension at a time, and includes the ghosts of the previous
+       dimensions, so that edges and corners are passed along as well */
+    for (i = 0; i < N_HALOS; i++){
+        d = i / 2; side = i % 2;
+        for (a = 0; a < N_DIMS; a++){
+            if (a < d){
+                snd_lo[i][a] = 0; snd_hi[i][a] = ext[a]; rcv_lo[i][a] = 0;
+            } else if (a > d){
+                snd_lo[i][a] = k; snd_hi[i][a] = k + block[a]; rcv_lo[i][a] = k;
+            } else if (side == 0){
+                /* Our lowest k layers, received into the low ghost layers of the low neighbour */
+                snd_lo[i][a] = k; snd_hi[i][a] = 2 * k; rcv_lo[i][a] = 0;
+            } else {
+                snd_lo[i][a] = block[a]; snd_hi[i][a] = block[a] + k; rcv_lo[i][a] = k + block[a];
+            }
+        }
     }
+}
+
+void haloPackBlockZ(Halo snd[N_HALOS], GraphNode ***graph, int k, int block[N_DIMS],
+    int snd_lo[N_HALOS][N_DIMS], int snd_hi[N_HALOS][N_DIMS]){
+
+    int x, y, i;
+    GraphNode *it;
 
-    MPI_Irecv(*rcv, rcv_size, mpi_datatype, nbr_rank, mpi_tag, mpi_comm, req);
-    //debugPrint("Rank %d <-> %d - received %d (TAG %d)", my_rank, nbr_rank, rcv_size, mpi_tag);
-    return rcv_size;
+    snd[LOW_Z].count = 0;
+    snd[HIGH_Z].count = 0;
+    for (x = k; x < k + block[0]; x++){
+        for (y = k; y < k + block[1]; y++){
+            for (it = graph[x][y]; it != NULL; it = it->next){
+                for (i = LOW_Z; i <= HIGH_Z; i++){
+                    if (it->state == ALIVE && it->z >= snd_lo[i][2] && it->z < snd_hi[i][2]){
+                        haloPush(&snd[i], x, y, it->z - snd_lo[i][2]);
+                    }
+                }
+            }
+        }
+    }
 }
@@ -2,12 +2,18 @@
  * @file dist_grid_checkerboard.c
  * @brief Game Of Life 3D MPI Implementation
  * 
- * @details Uses checkerboard decomposition to scatter the 
- * 3D graph across several processes.
+ * @details Uses a 3D block decomposition to scatter the 
+ * 3D graph across several processes. Each block is surrounded by a
+ * ghost shell of configurable depth k, exchanged once every k generations.
+ * Block boundaries are periodically moved so that every process holds
+ * about the same number of live cells.
+ * The final cells are written by all processes together, each one the
+ * part of the output for a slab of the cube along x.
  * If an invalid configuration is provided the program will not attempt
  * to run, and will notify the user instead.
  * 
- * @attention Each process is assumed to have access to the input file!
+ * @attention Each process is assumed to have access to the input file,
+ * which all of them read together, a share each.
  *  
  * @author João Borrego
  * @author Pedro Abreu
@@ -23,6 +29,7 @@
 #include <string.h>
 #include <mpi.h>
 #include <math.h>
+#include <omp.h>
 
 #include "graph.h"
 #include "debug.h"
@@ -30,11 +37,13 @@
 /* MPI Cartesian Mapping Definitions */
 
 /**< MPI Cartesian Grid Dimensionality */
-#define N_DIMS 2
+#define N_DIMS 3
 /**< MPI_Cart_Shift along rows */
 #define SHIFT_ROW 0
 /**< MPI_Cart_Shift along columns */
 #define SHIFT_COL 1
+/**< MPI_Cart_Shift along z */
+#define SHIFT_Z 2
 /**< Displacement - Upwards shift */
 #define DISP 1
 
@@ -53,15 +62,110 @@
 #define TAG_LOW_Y 300
 /**< Macro for identifying communication between current process and higher y neighbour */
 #define TAG_HIGH_Y 400
+/**< Macro for identifying communication between current process and lower z neighbour */
+#define TAG_LOW_Z 500
+/**< Macro for identifying communication between current process and higher z neighbour */
+#define TAG_HIGH_Z 600
+/**< Added to a border tag for the cells that do not fit the persistent message */
+#define TAG_OVERFLOW 1
+
+/* Halo exchange */
+
+/**< Number of neighbours a process exchanges borders with */
+#define N_HALOS 6
+/**< Index of the lower x neighbour, the higher one is LOW_X ^ 1 */
+#define LOW_X 0
+/**< Index of the higher x neighbour */
+#define HIGH_X 1
+/**< Index of the lower y neighbour, the higher one is LOW_Y ^ 1 */
+#define LOW_Y 2
+/**< Index of the higher y neighbour */
+#define HIGH_Y 3
+/**< Index of the lower z neighbour, the higher one is LOW_Z ^ 1 */
+#define LOW_Z 4
+/**< Index of the higher z neighbour */
+#define HIGH_Z 5
+/**< Initial number of bytes carried by a persistent border receive */
+#define HALO_MIN_CAPACITY 1024
+/**< Bytes before the encoded cells of a border message: its length, encoding and box dimensions */
+#define HALO_HEADER_SIZE 11
+/**< Default depth of the ghost shell around each block, in cells */
+#define DEFAULT_HALO_DEPTH 1
+
+/* Border encodings */
+
+/**< The positions of the cells in the box, as varint gaps */
+#define HALO_SPARSE 0
+/**< A bit per position of the box */
+#define HALO_BITMAP 1
+/**< The positions that changed since the previous exchange, as varint gaps */
+#define HALO_CHANGES 2
 
 /* General Macros */
 
 /**< Dead node removal period */
 #define REMOVAL_PERIOD 5 
 
-/**< Buffer Size */
+/**< Generations between checks of the spread of live cells across processes */
+#define REBALANCE_PERIOD 50
+/**< Block boundaries are moved when the busiest process holds this many times the average live cells */
+#define IMBALANCE_THRESHOLD 1.2
+
+/**< Buffer Size, also the longest line of a text input file */
 #define BUFFER_SIZE 200 
 
+/* Binary input */
+
+/**< First bytes of a binary cell file, in the L3DB format described in README.md */
+#define BINARY_MAGIC "L3DB"
+/**< Length of the magic */
+#define BINARY_MAGIC_SIZE 4
+/**< Bytes before the first cell of a binary input file */
+#define BINARY_HEADER_SIZE 8
+/**< Output files whose name ends in this are written in the binary format */
+#define BINARY_SUFFIX ".l3db"
+/**< Longest line of a text output file, "65535 65535 65535\n" */
+#define OUTPUT_LINE_SIZE 18
+
+/* Structures */
+
+/**
+ * @brief A channel for the border exchanged with one neighbour
+ *
+ * @details Buffers live for the whole run. The cells are given relative
+ * to the corner of the box they were packed from, and numbered by their
+ * position in the box, row after row. Each message carries a header, then
+ * the sorted positions in whichever encoding is shortest: varint gaps, a
+ * bitmap of the box, or the gaps between the positions that changed since
+ * the previous exchange, which the receiver applies to the ones it kept.
+ * Sends carry only the encoded bytes, and receives are persistent. Both
+ * ends of a channel agree on the capacity of the receive: when a message
+ * does not fit, the remainder follows in an overflow message and both
+ * ends grow it alike.
+ */
+typedef struct _Halo{
+    Node *cells;                /**< The cells */
+    int count;                  /**< Number of cells */
+    int length;                 /**< Allocated cells */
+    int box[N_DIMS];            /**< Dimensions of the box the cells are in */
+    uint64_t *keys;             /**< Positions of the cells last exchanged, sorted */
+    uint64_t *next;             /**< Positions of the cells being exchanged */
+    uint64_t *changes;          /**< Positions that differ between the two */
+    int n_keys;                 /**< Number of cells last exchanged */
+    int keys_length;            /**< Allocated entries of each array of positions */
+    int keys_box[N_DIMS];       /**< Dimensions of the box of the cells last exchanged */
+    unsigned char *bytes;       /**< The encoded message */
+    int n_bytes;                /**< Length of the encoded message */
+    int capacity;               /**< Bytes carried by the persistent receive */
+    int bytes_length;           /**< Allocated bytes */
+    bool send;                  /**< Whether the channel sends or receives */
+    MPI_Request req;            /**< Send request, or persistent receive, MPI_REQUEST_NULL until (re)bound to the buffer */
+    MPI_Request overflow_req;   /**< Request for the bytes beyond capacity */
+    MPI_Comm comm;              /**< Communicator */
+    int nbr_rank;               /**< Neighbour process rank */
+    int tag;                    /**< Tag of the message */
+}Halo;
+
 /* Function headers */
 
 /**
@@ -71,8 +175,11 @@
  * @param argv Argument values
  * @param file The input file name
  * @param generations The number of generations
+ * @param n_threads The number of OpenMP threads per process, all available by default
+ * @param halo_depth The depth of the ghost shell, DEFAULT_HALO_DEPTH by default
+ * @param output The output file name, NULL if none is given
  */
-void parseArgs(int argc, char *argv[], char **file, int *generations);
+void parseArgs(int argc, char *argv[], char **file, int *generations, int *n_threads, int *halo_depth, char **output);
 
 /**
  * @brief Inserts a node in the local graph
@@ -87,46 +194,292 @@ void parseArgs(int argc, char *argv[], char **file, int *generations);
 void insertLocalGraph(GraphNode ***graph, int offset_x, int offset_y, int x, int y, int z);
 
 /**
- * @brief Adds a reduced node to the boundary array to be sent
- * 
- * @param array The array of boundary reduced nodes
- * @param index The index to insert reduced object in
- * @param a x or y local coordinate
- * @param z z global coordinate
+ * @brief Reads an even share of the input file
+ *
+ * @details All processes of the communicator read at once with MPI-IO.
+ * A text file has the cube size in its first line, then a cell "x y z" per
+ * line, and each process parses the lines that start in its share of the
+ * bytes. A binary file starts with BINARY_MAGIC, and its cells are read
+ * straight into place.
+ *
+ * @param file_name The input file name
+ * @param comm The MPI Communicator object
+ * @param datatype MPI Datatype of a cell
+ * @param cube_size The size of the side of the cube
+ * @param cells The cells read, in global coordinates
+ * @return The number of cells read
+ */
+int readCells(char *file_name, MPI_Comm comm, MPI_Datatype datatype, int *cube_size, Node **cells);
+
+/**
+ * @brief Sends each cell to its owner
+ *
+ * @param cells The cells
+ * @param n_cells The number of cells
+ * @param owner The rank in `comm` each cell goes to
+ * @param comm The MPI Communicator object
+ * @param datatype MPI Datatype of a cell
+ * @param routed The cells received from all processes
+ * @return The number of cells received
+ */
+int routeCells(Node *cells, int n_cells, int *owner, MPI_Comm comm, MPI_Datatype datatype, Node **routed);
+
+/**
+ * @brief Orders cells by x, then y, then z, for qsort
+ *
+ * @param a The first cell
+ * @param b The second cell
+ * @return Negative, zero or positive as a comes before, with or after b
+ */
+int compareCells(const void *a, const void *b);
+
+/**
+ * @brief Writes the cells of every process to a file
+ *
+ * @details All processes of the communicator write at once with MPI-IO,
+ * each one after the processes of lower rank, so every process must hold
+ * cells that come after those of the previous ones.
+ * The cells are sorted first, and written as "x y z" lines, or in the
+ * binary input format if the file name ends in BINARY_SUFFIX.
+ *
+ * @param file_name The output file name
+ * @param comm The MPI Communicator object
+ * @param datatype MPI Datatype of a cell
+ * @param cube_size The size of the side of the cube
+ * @param cells The cells of this process, in global coordinates
+ * @param n_cells The number of cells
+ */
+void writeCells(char *file_name, MPI_Comm comm, MPI_Datatype datatype, int cube_size, Node *cells, int n_cells);
+
+/**
+ * @brief Finds the block each slice of one dimension belongs to
+ *
+ * @param owner The block of each slice
+ * @param cuts The block boundaries, block p spans [cuts[p], cuts[p + 1])
+ * @param parts The number of blocks
+ */
+void sliceOwners(int *owner, int *cuts, int parts);
+
+/**
+ * @brief Splits one dimension of the cube into blocks of even size
+ *
+ * @param cuts The block boundaries, block p spans [cuts[p], cuts[p + 1])
+ * @param parts The number of blocks
+ * @param size The size of the side of the cube
+ */
+void blockCuts(int *cuts, int parts, int size);
+
+/**
+ * @brief Splits one dimension of the cube into blocks of about the same load
+ *
+ * @details Places each boundary where the prefix sum of the load is
+ * closest to an equal share, while keeping every block at least
+ * `min_width` slices wide.
+ *
+ * @param cuts The block boundaries, block p spans [cuts[p], cuts[p + 1])
+ * @param parts The number of blocks
+ * @param load The load of each slice, i.e. its live cells
+ * @param size The size of the side of the cube
+ * @param min_width The minimum width of a block
+ */
+void balanceCuts(int *cuts, int parts, int *load, int size, int min_width);
+
+/**
+ * @brief Computes the boxes each border is packed from and received into
+ *
+ * @param k The depth of the ghost shell
+ * @param block The block dimensions
+ * @param ext The local graph dimensions, i.e. the block and its ghost shell
+ * @param snd_lo The lowest coordinates of each box sent
+ * @param snd_hi One past the highest coordinates of each box sent
+ * @param rcv_lo The lowest coordinates of each box received, which are added to the cells
  */
-void addToSndArray(RNode *array, int index, int a, int z);
+void haloBoxes(int k, int block[N_DIMS], int ext[N_DIMS],
+    int snd_lo[N_HALOS][N_DIMS], int snd_hi[N_HALOS][N_DIMS], int rcv_lo[N_HALOS][N_DIMS]);
 
 /**
- * @brief Sends a border to a neighbour process
+ * @brief Packs the live cells of the block into the z borders to be sent
+ *
+ * @details The ghost columns are added right before the exchange.
+ *
+ * @param snd The channels to each neighbour
+ * @param graph The local graph representation
+ * @param k The depth of the ghost shell
+ * @param block The block dimensions
+ * @param snd_lo The lowest coordinates of each box sent
+ * @param snd_hi One past the highest coordinates of each box sent
+ */
+void haloPackBlockZ(Halo snd[N_HALOS], GraphNode ***graph, int k, int block[N_DIMS],
+    int snd_lo[N_HALOS][N_DIMS], int snd_hi[N_HALOS][N_DIMS]);
+
+/**
+ * @brief Returns the persistent receive capacity for a message length
+ *
+ * @param n_bytes The length of the message
+ * @return The smallest power of two times HALO_MIN_CAPACITY that holds it
+ */
+int haloCapacity(int n_bytes);
+
+/**
+ * @brief Creates a border channel
+ *
+ * @param halo The channel
+ * @param comm The MPI Communicator object
+ * @param nbr_rank The neighbour process rank
+ * @param tag The tag of the message
+ * @param send Whether the channel sends or receives
+ */
+void haloCreate(Halo *halo, MPI_Comm comm, int nbr_rank, int tag, bool send);
+
+/**
+ * @brief Sets the box the cells to be sent are packed from
+ *
+ * @param halo The channel
+ * @param lo The lowest coordinates of the box
+ * @param hi One past the highest coordinates of the box
+ */
+void haloSetBox(Halo *halo, int lo[N_DIMS], int hi[N_DIMS]);
+
+/**
+ * @brief Grows the cells of a channel to hold `count` of them
+ *
+ * @param halo The channel
+ * @param count The number of cells
+ */
+void haloReserve(Halo *halo, int count);
+
+/**
+ * @brief Grows the arrays of positions of a channel to hold `count` of them
+ *
+ * @param halo The channel
+ * @param count The number of positions
+ */
+void haloReserveKeys(Halo *halo, int count);
+
+/**
+ * @brief Grows the message buffer of a channel to hold `n_bytes`
+ *
+ * @details Frees the persistent receive if the buffer moves, so that
+ * the next haloStart binds a new one.
+ *
+ * @param halo The channel
+ * @param n_bytes The length of the message
+ */
+void haloReserveBytes(Halo *halo, int n_bytes);
+
+/**
+ * @brief Appends a cell to the border to be sent
+ *
+ * @param halo The channel
+ * @param x x coordinate
+ * @param y y coordinate
+ * @param z z coordinate
+ */
+void haloPush(Halo *halo, int x, int y, int z);
+
+/**
+ * @brief Appends the live cells inside a box of the local graph to the border to be sent
+ *
+ * @param halo The channel
+ * @param graph The local graph representation
+ * @param lo The lowest coordinates of the box, which are subtracted from the cells
+ * @param hi One past the highest coordinates of the box
+ */
+void haloPackBox(Halo *halo, GraphNode ***graph, int lo[N_DIMS], int hi[N_DIMS]);
+
+/**
+ * @brief Orders positions in a box, for qsort
+ *
+ * @param a The first position
+ * @param b The second position
+ * @return Negative, zero or positive as a is lower than, equal to or higher than b
+ */
+int compareKeys(const void *a, const void *b);
+
+/**
+ * @brief Writes a value in as many bytes as needed, 7 bits each
+ *
+ * @param buffer Where to write, or NULL to only measure
+ * @param value The value
+ * @return The number of bytes
+ */
+int putVarint(unsigned char *buffer, uint64_t value);
+
+/**
+ * @brief Reads a value written by putVarint
+ *
+ * @param buffer Where to read, moved past the value
+ * @return The value
+ */
+uint64_t getVarint(unsigned char **buffer);
+
+/**
+ * @brief Writes sorted positions as their count, then the gaps between them
+ *
+ * @param buffer Where to write, or NULL to only measure
+ * @param keys The positions, sorted
+ * @param n_keys The number of positions
+ * @return The number of bytes
+ */
+int encodeKeys(unsigned char *buffer, uint64_t *keys, int n_keys);
+
+/**
+ * @brief Reads the gaps written by encodeKeys, once past the count
+ *
+ * @param buffer Where to read
+ * @param keys The positions
+ * @param n_keys The number of positions
+ * @return Where the positions end
+ */
+unsigned char *decodeKeys(unsigned char *buffer, uint64_t *keys, int n_keys);
+
+/**
+ * @brief Merges sorted positions, dropping those in both
+ *
+ * @param merged The positions in only one of the two, sorted
+ * @param a The first positions
+ * @param n_a The number of first positions
+ * @param b The second positions
+ * @param n_b The number of second positions
+ * @return The number of merged positions
+ */
+int mergeKeys(uint64_t *merged, uint64_t *a, int n_a, uint64_t *b, int n_b);
+
+/**
+ * @brief Encodes the cells to be sent in the shortest encoding
+ *
+ * @param halo The channel
+ */
+void haloEncode(Halo *halo);
+
+/**
+ * @brief Decodes the cells received
+ *
+ * @param halo The channel
+ */
+void haloDecode(Halo *halo);
+
+/**
+ * @brief Starts the send or persistent receive of a channel
+ *
+ * @param halo The channel
+ */
+void haloStart(Halo *halo);
+
+/**
+ * @brief Completes the exchange of a channel
+ *
+ * @details On the receiving end, receives the overflow, if any, and decodes the cells.
  *
- * @param mpi_comm The MPI Communicator object
- * @param mpi_tag The monitored MPI tag
- * @param my_rank Origin process rank
- * @param nbr_rank Destination process rank
- * @param status_snd MPI Status object for sending
- * @param mpi_datatype MPI Datatype of object to be sent
- * @param snd The array to be sent
- * @param snd_size The size of the array to be sent
+ * @param halo The channel
  */
-void sendBorder(MPI_Comm mpi_comm, int mpi_tag, int my_rank, int nbr_rank,
-            	MPI_Request *req, MPI_Datatype mpi_datatype,
-                RNode *snd, int snd_size);
+void haloWait(Halo *halo);
 
 /**
- * @brief Sends a border from a neighbour process
+ * @brief Frees the buffers and request of a channel
  *
- * @param mpi_comm The MPI Communicator object
- * @param mpi_tag The monitored MPI tag
- * @param my_rank Destination process rank
- * @param nbr_rank Origin process rank
- * @param status_prb MPI Status object for probing to obtain size
- * @param status_rcv MPI Status object for receiving
- * @param mpi_datatype  MPI Datatype of object to be received
- * @param rcv The array to be received
- * @return The size of the array to be received
+ * @param halo The channel
  */
-int receiveBorder(MPI_Comm mpi_comm, int mpi_tag, int my_rank, int nbr_rank,
-                    MPI_Request *req, MPI_Status *status_prb,
-                    MPI_Datatype mpi_datatype, RNode **rcv);
+void haloFree(Halo *halo);
 
 #endif
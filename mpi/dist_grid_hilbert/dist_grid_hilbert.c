@@ -0,0 +1,1036 @@
+/**
+ * @file dist_grid_hilbert.c
+ * @brief Game Of Life 3D MPI Implementation
+ *
+ * @details Orders the (x,y) columns of the cube along a Hilbert curve,
+ * and gives each process a contiguous segment of the curve holding about
+ * the same number of live cells. Neighbouring columns are close along the
+ * curve, so most of them stay in the same process, and the borders are
+ * exchanged with whichever processes own the others. The curve is split
+ * again every REBALANCE_PERIOD generations if the load drifts apart.
+ * The final cells are written by all processes together, each one the
+ * part of the output for a slab of the cube along x.
+ *
+ * @attention Each process is assumed to have access to the input file,
+ * which all of them read together, a share each.
+ *
+ * @author João Borrego
+ * @author Pedro Abreu
+ * @author Miguel Cardoso
+ * @bug No known bugs.
+ */
+
+#include "dist_grid_hilbert.h"
+
+int main (int argc, char **argv) {
+
+    /* Main program variables */
+
+    /** Columns of the segment of the curve owned by this process */
+    Column *columns;
+    /** Number of columns in the segment */
+    long n_columns;
+
+    int n_processes, rank;
+
+    /** Size of the side of the cube space */
+    int cube_size;
+    /** Side of the square filled by the curve, the smallest power of two that fits the cube */
+    int order;
+    /** Number of positions along the curve */
+    long n_keys;
+    /** Number of generations to be computed */
+    int generations;
+
+    /* Segments of the curve */
+
+    /** Segment boundaries, process p owns the columns in [splits[p], splits[p + 1]) */
+    long *splits, *new_splits;
+    /** Segment of this process */
+    long key_lo, key_hi;
+
+    /* Neighbour processes, and the columns of the segment each of them borders */
+    int n_nbrs;
+    int *nbr_ranks, *border_displs, *border;
+    /* Persistent border channels to and from each neighbour process */
+    Halo *snd, *rcv;
+
+    /* Auxiliary variables */
+
+    /* Main program execution */
+
+    /** Live neighbours counter */
+    int live_neighbours;
+    /** Generations counter */
+    int g;
+
+    /* Iterative variables*/
+    int x, y, z, nx, ny;
+    int i, j, l;
+    long c, key;
+    GraphNode *it;
+
+    /* Lateral neighbours of a column */
+    int dx[N_LATERAL] = {-1, 1, 0, 0}, dy[N_LATERAL] = {0, 0, -1, 1};
+
+    /* Rebalancing variables */
+    long* rank_load;
+    long* segment_load;
+    Node* migrate_send;
+    int* migrate_owner;
+    Node* migrate_recv;
+    long local_load, prefix_load, total_load, max_load, max_predicted, load;
+    int segment, n_migrated;
+
+    /* Final output variables */
+    int local_graph_length;
+    Node* lg_send;
+    /** Output file name, NULL if the final cells are not written */
+    char* output_name;
+    /** Slab boundaries along x, process p writes the cells in [slab_cuts[p], slab_cuts[p + 1]) */
+    int* slab_cuts;
+    /** Slab of each x slice */
+    int* slab_of;
+    /** Live cells in each x slice */
+    int* slice_load;
+
+    /* Timing */
+    double global_start_t, global_end_t;
+
+    /* MPI */
+    MPI_Init(&argc, &argv);
+
+    /* MPI Preamble */
+    MPI_Comm_size(MPI_COMM_WORLD, &n_processes);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /***********************************************************************************/
+
+    /* Start Timer */
+    MPI_Barrier(MPI_COMM_WORLD);
+    global_start_t = MPI_Wtime();
+
+    /***********************************************************************************/
+
+    /* MPI Create a structure to send cells across processes */
+    MPI_Datatype MPI_NEIGHBOUR_CELL, MPI_NEIGHBOUR_CELL_t,
+        struct_type[3] = {MPI_UNSIGNED_SHORT, MPI_UNSIGNED_SHORT, MPI_UNSIGNED_SHORT};
+    int struct_b_len[3] = {1, 1, 1};
+    MPI_Aint struct_extent, struct_lb, struct_displs[3] = {offsetof(Node, x), offsetof(Node, y), offsetof(Node, z)};
+    MPI_Type_create_struct(3, struct_b_len, struct_displs, struct_type, &MPI_NEIGHBOUR_CELL_t);
+    MPI_Type_get_extent(MPI_NEIGHBOUR_CELL_t, &struct_lb, &struct_extent);
+    MPI_Type_create_resized(MPI_NEIGHBOUR_CELL_t, -struct_lb, struct_extent, &MPI_NEIGHBOUR_CELL);
+    MPI_Type_commit(&MPI_NEIGHBOUR_CELL);
+
+    /***********************************************************************************/
+
+    /* Parse arguments */
+
+    /**< Input data file name */
+    char* file_name;
+
+    parseArgs(argc, argv, &file_name, &generations, &output_name);
+
+    /* Every process reads a share of the file, and the cells are then sent to their owners */
+    migrate_send = NULL;
+    local_load = readCells(file_name, MPI_COMM_WORLD, MPI_NEIGHBOUR_CELL, &cube_size, &migrate_send);
+
+    /***********************************************************************************/
+
+    /* The curve starts split evenly, and is split again by live cells on the first generation */
+
+    order = 1;
+    while (order < cube_size){
+        order *= 2;
+    }
+    n_keys = (long) order * order;
+
+    splits = malloc(sizeof(long) * (n_processes + 1));
+    new_splits = malloc(sizeof(long) * (n_processes + 1));
+    for (i = 0; i <= n_processes; i++){
+        splits[i] = n_keys * i / n_processes;
+    }
+    key_lo = splits[rank];
+    key_hi = splits[rank + 1];
+    n_columns = key_hi - key_lo;
+
+    rank_load = malloc(sizeof(long) * n_processes);
+    segment_load = malloc(sizeof(long) * n_processes);
+
+    /* Fill local graph structure */
+    columns = initColumns(order, cube_size, key_lo, key_hi);
+
+    /* Fill with the nodes of the columns of the current process */
+    migrate_owner = malloc(sizeof(int) * (local_load + 1));
+    for (i = 0; i < local_load; i++){
+        migrate_owner[i] = keyOwner(splits, n_processes, hilbertKey(order, migrate_send[i].x, migrate_send[i].y));
+    }
+    n_migrated = routeCells(migrate_send, local_load, migrate_owner, MPI_COMM_WORLD, MPI_NEIGHBOUR_CELL, &migrate_recv);
+    for (i = 0; i < n_migrated; i++){
+        c = hilbertKey(order, migrate_recv[i].x, migrate_recv[i].y) - key_lo;
+        columns[c].cells = graphNodeInsert(columns[c].cells, migrate_recv[i].z, ALIVE);
+    }
+    free(migrate_send);
+    free(migrate_owner);
+    free(migrate_recv);
+
+    n_nbrs = buildNeighbours(columns, n_columns, order, cube_size, splits, n_processes, &nbr_ranks, &border_displs, &border);
+    snd = malloc(sizeof(Halo) * n_nbrs);
+    rcv = malloc(sizeof(Halo) * n_nbrs);
+    for (i = 0; i < n_nbrs; i++){
+        haloCreate(&snd[i], MPI_COMM_WORLD, MPI_NEIGHBOUR_CELL, nbr_ranks[i], TAG_BORDER, true);
+        haloCreate(&rcv[i], MPI_COMM_WORLD, MPI_NEIGHBOUR_CELL, nbr_ranks[i], TAG_BORDER, false);
+    }
+
+    /***********************************************************************************/
+
+    for (g = 1; g <= generations; g++){
+
+        /* Every REBALANCE_PERIOD generations, check how the live cells are spread, and split
+           the curve again if some process holds too many */
+        if ((g - 1) % REBALANCE_PERIOD == 0 && n_processes > 1){
+
+            local_load = 0;
+            for (c = 0; c < n_columns; c++){
+                for (it = columns[c].cells; it != NULL; it = it->next){
+                    if (it->state == ALIVE){
+                        local_load++;
+                    }
+                }
+            }
+            MPI_Allgather(&local_load, 1, MPI_LONG, rank_load, 1, MPI_LONG, MPI_COMM_WORLD);
+            total_load = 0; max_load = 0;
+            for (i = 0; i < n_processes; i++){
+                total_load += rank_load[i];
+                max_load = (rank_load[i] > max_load) ? rank_load[i] : max_load;
+            }
+
+            if (total_load > 0 && (double) max_load * n_processes > IMBALANCE_THRESHOLD * total_load){
+
+                /* The segments follow each other along the curve, so the live cells before a
+                   column are those before the segment plus those before it in the segment */
+                MPI_Exscan(&local_load, &prefix_load, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+                if (rank == ROOT){
+                    prefix_load = 0;
+                }
+
+                /* Each populated column goes to the segment its middle cell falls in, and each
+                   segment starts at its first column. Segments no column falls in are left empty */
+                for (i = 0; i <= n_processes; i++){
+                    new_splits[i] = n_keys;
+                }
+                memset(segment_load, 0, sizeof(long) * n_processes);
+                segment = 0;
+                for (c = 0; c < n_columns; c++){
+                    load = 0;
+                    for (it = columns[c].cells; it != NULL; it = it->next){
+                        if (it->state == ALIVE){
+                            load++;
+                        }
+                    }
+                    if (load == 0){
+                        continue;
+                    }
+                    i = (int) ((2 * prefix_load + load) * n_processes / (2 * total_load));
+                    i = (i < n_processes) ? i : n_processes - 1;
+                    for (; segment < i; segment++){
+                        new_splits[segment + 1] = key_lo + c;
+                    }
+                    segment_load[i] += load;
+                    prefix_load += load;
+                }
+                MPI_Allreduce(MPI_IN_PLACE, new_splits, n_processes + 1, MPI_LONG, MPI_MIN, MPI_COMM_WORLD);
+                MPI_Allreduce(MPI_IN_PLACE, segment_load, n_processes, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+                new_splits[0] = 0;
+                new_splits[n_processes] = n_keys;
+                max_predicted = 0;
+                for (i = 0; i < n_processes; i++){
+                    max_predicted = (segment_load[i] > max_predicted) ? segment_load[i] : max_predicted;
+                }
+
+                if (max_predicted < max_load){
+
+                    //if (rank == ROOT) debugPrint("Generation %d: largest segment from %ld to %ld live cells", g, max_load, max_predicted);
+
+                    /* Send every live cell to the owner of its column */
+                    migrate_send = malloc(sizeof(Node) * (local_load + 1));
+                    migrate_owner = malloc(sizeof(int) * (local_load + 1));
+                    n_migrated = 0;
+                    for (c = 0; c < n_columns; c++){
+                        if (columns[c].cells != NULL){
+                            j = keyOwner(new_splits, n_processes, key_lo + c);
+                            for (it = columns[c].cells; it != NULL; it = it->next){
+                                if (it->state == ALIVE){
+                                    migrate_send[n_migrated].x = columns[c].x;
+                                    migrate_send[n_migrated].y = columns[c].y;
+                                    migrate_send[n_migrated].z = it->z;
+                                    migrate_owner[n_migrated] = j;
+                                    n_migrated++;
+                                }
+                            }
+                        }
+                    }
+                    n_migrated = routeCells(migrate_send, n_migrated, migrate_owner, MPI_COMM_WORLD, MPI_NEIGHBOUR_CELL, &migrate_recv);
+
+                    /* Rebuild the local graph and the neighbour lists around the new segment */
+                    for (i = 0; i < n_nbrs; i++){
+                        haloFree(&snd[i]);
+                        haloFree(&rcv[i]);
+                    }
+                    free(snd); free(rcv);
+                    free(nbr_ranks); free(border_displs); free(border);
+                    freeColumns(columns, n_columns);
+
+                    memcpy(splits, new_splits, sizeof(long) * (n_processes + 1));
+                    key_lo = splits[rank];
+                    key_hi = splits[rank + 1];
+                    n_columns = key_hi - key_lo;
+                    columns = initColumns(order, cube_size, key_lo, key_hi);
+                    for (i = 0; i < n_migrated; i++){
+                        c = hilbertKey(order, migrate_recv[i].x, migrate_recv[i].y) - key_lo;
+                        columns[c].cells = graphNodeInsert(columns[c].cells, migrate_recv[i].z, ALIVE);
+                    }
+
+                    n_nbrs = buildNeighbours(columns, n_columns, order, cube_size, splits, n_processes, &nbr_ranks, &border_displs, &border);
+                    snd = malloc(sizeof(Halo) * n_nbrs);
+                    rcv = malloc(sizeof(Halo) * n_nbrs);
+                    for (i = 0; i < n_nbrs; i++){
+                        haloCreate(&snd[i], MPI_COMM_WORLD, MPI_NEIGHBOUR_CELL, nbr_ranks[i], TAG_BORDER, true);
+                        haloCreate(&rcv[i], MPI_COMM_WORLD, MPI_NEIGHBOUR_CELL, nbr_ranks[i], TAG_BORDER, false);
+                    }
+
+                    free(migrate_send);
+                    free(migrate_owner);
+                    free(migrate_recv);
+                }
+            }
+        }
+
+    /***********************************************************************************/
+
+        /* Send each neighbour the live cells of the columns it borders */
+        for (i = 0; i < n_nbrs; i++){
+            haloStart(&rcv[i]);
+        }
+        for (i = 0; i < n_nbrs; i++){
+            snd[i].count = 0;
+            for (j = border_displs[i]; j < border_displs[i + 1]; j++){
+                c = border[j];
+                for (it = columns[c].cells; it != NULL; it = it->next){
+                    if (it->state == ALIVE){
+                        haloPush(&snd[i], columns[c].x, columns[c].y, it->z);
+                    }
+                }
+            }
+            haloStart(&snd[i]);
+        }
+
+        /* Notify the neighbours of the cells of the segment while the borders are in flight */
+        for (c = 0; c < n_columns; c++){
+            for (it = columns[c].cells; it != NULL; it = it->next){
+                if (it->state == ALIVE){
+                    z = it->z;
+                    graphNodeAddNeighbour(&(columns[c].cells), (z + 1) % cube_size);
+                    graphNodeAddNeighbour(&(columns[c].cells), (z - 1 + cube_size) % cube_size);
+                    for (l = 0; l < N_LATERAL; l++){
+                        if (columns[c].nbr[l] >= 0){
+                            graphNodeAddNeighbour(&(columns[columns[c].nbr[l]].cells), z);
+                        }
+                    }
+                }
+            }
+        }
+
+        /* Each cell received notifies the columns of the segment next to it */
+        for (i = 0; i < n_nbrs; i++){
+            haloWait(&rcv[i]);
+            for (j = 1; j <= rcv[i].count; j++){
+                x = rcv[i].cells[j].x; y = rcv[i].cells[j].y;
+                for (l = 0; l < N_LATERAL; l++){
+                    nx = (x + dx[l] + cube_size) % cube_size;
+                    ny = (y + dy[l] + cube_size) % cube_size;
+                    key = hilbertKey(order, nx, ny);
+                    if (key >= key_lo && key < key_hi){
+                        graphNodeAddNeighbour(&(columns[key - key_lo].cells), rcv[i].cells[j].z);
+                    }
+                }
+            }
+        }
+        for (i = 0; i < n_nbrs; i++){
+            haloWait(&snd[i]);
+        }
+
+    /***********************************************************************************/
+
+        /* Determine next state of each cell of the segment */
+        for (c = 0; c < n_columns; c++){
+            for (it = columns[c].cells; it != NULL; it = it->next){
+                live_neighbours = it->neighbours;
+                it->neighbours = 0;
+                if(it->state == ALIVE){
+                    if(live_neighbours < 2 || live_neighbours > 4){
+                        it->state = DEAD;
+                    }
+                }else{
+                    if(live_neighbours == 2 || live_neighbours == 3){
+                        it->state = ALIVE;
+                    }
+                }
+            }
+            /* Remove dead nodes from the graph every REMOVAL_PERIOD generations */
+            if (g % REMOVAL_PERIOD == 0){
+                graphListCleanup(&(columns[c].cells));
+            }
+        }
+
+    /***********************************************************************************/
+
+    } // END MAIN FOR LOOP
+
+    /***********************************************************************************/
+
+    /* Write the final set of live cells */
+
+    if (output_name != NULL){
+
+        /* Collect the live cells of the segment */
+        local_graph_length = 0;
+        for (c = 0; c < n_columns; c++){
+            for (it = columns[c].cells; it != NULL; it = it->next){
+                if (it->state == ALIVE){
+                    local_graph_length++;
+                }
+            }
+        }
+        lg_send = malloc(sizeof(Node) * (local_graph_length + 1));
+        local_graph_length = 0;
+        for (c = 0; c < n_columns; c++){
+            for (it = columns[c].cells; it != NULL; it = it->next){
+                if (it->state == ALIVE){
+                    lg_send[local_graph_length].x = columns[c].x;
+                    lg_send[local_graph_length].y = columns[c].y;
+                    lg_send[local_graph_length].z = it->z;
+                    local_graph_length++;
+                }
+            }
+        }
+
+        /* Segments wind across x, so the cells are first sent to slabs of whole x slices holding
+           about the same number of live cells, one per process in rank order. Each slab is then a
+           contiguous part of the output */
+        slice_load = calloc(cube_size, sizeof(int));
+        for (i = 0; i < local_graph_length; i++){
+            slice_load[lg_send[i].x]++;
+        }
+        MPI_Allreduce(MPI_IN_PLACE, slice_load, cube_size, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        slab_cuts = malloc(sizeof(int) * (n_processes + 1));
+        slab_of = malloc(sizeof(int) * cube_size);
+        balanceCuts(slab_cuts, n_processes, slice_load, cube_size, 0);
+        sliceOwners(slab_of, slab_cuts, n_processes);
+
+        migrate_owner = malloc(sizeof(int) * (local_graph_length + 1));
+        for (i = 0; i < local_graph_length; i++){
+            migrate_owner[i] = slab_of[lg_send[i].x];
+        }
+        n_migrated = routeCells(lg_send, local_graph_length, migrate_owner, MPI_COMM_WORLD, MPI_NEIGHBOUR_CELL, &migrate_recv);
+        writeCells(output_name, MPI_COMM_WORLD, MPI_NEIGHBOUR_CELL, cube_size, migrate_recv, n_migrated);
+
+        free(lg_send);
+        free(migrate_owner);
+        free(migrate_recv);
+        free(slice_load);
+        free(slab_cuts);
+        free(slab_of);
+        free(output_name);
+    }
+
+    /***********************************************************************************/
+
+    /* Stop Timer */
+    global_end_t = MPI_Wtime();
+
+    /* Print global execution time */
+    if (rank == ROOT){
+        timePrint(global_end_t - global_start_t);
+    }
+
+    /***********************************************************************************/
+
+    /* Clean up */
+    for (i = 0; i < n_nbrs; i++){
+        haloFree(&snd[i]);
+        haloFree(&rcv[i]);
+    }
+    free(snd); free(rcv);
+    free(nbr_ranks); free(border_displs); free(border);
+    freeColumns(columns, n_columns);
+    free(splits);
+    free(new_splits);
+    free(rank_load);
+    free(segment_load);
+    free(file_name);
+
+    /* Force a synchronisation point and exit */
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Finalize();
+}
+
+void parseArgs(int argc, char* argv[], char** file, int* generations, char** output){
+    if (argc == 3 || argc == 4){
+        char* file_name = malloc(sizeof(char) * (strlen(argv[1]) + 1));
+        strcpy(file_name, argv[1]);
+        *file = file_name;
+
+        *generations = atoi(argv[2]);
+        *output = NULL;
+        if (argc == 4){
+            *output = malloc(sizeof(char) * (strlen(argv[3]) + 1));
+            strcpy(*output, argv[3]);
+        }
+        if (*generations > 0 && file_name != NULL)
+            return;
+    }
+    printf("Usage: %s [data_file.in] [number_generations] [output_file]", argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+int readCells(char *file_name, MPI_Comm comm, MPI_Datatype datatype, int *cube_size, Node **cells){
+
+    MPI_File fh;
+    MPI_Offset file_size, data_start, lo, hi, read_lo, total;
+    char header[BUFFER_SIZE + 1];
+    char *chunk, *line, *end, *next;
+    int rank, n_processes, length, n_cells, capacity, cell_size;
+    int32_t size;
+    long x, y, z;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &n_processes);
+
+    if (MPI_File_open(comm, file_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS){
+        fprintf(stderr, "Please input a valid file name\n" );
+        exit(EXIT_FAILURE);
+    }
+    MPI_File_get_size(fh, &file_size);
+
+    /* Every process reads the header */
+    length = (file_size < BUFFER_SIZE) ? (int) file_size : BUFFER_SIZE;
+    MPI_File_read_at_all(fh, 0, header, length, MPI_CHAR, MPI_STATUS_IGNORE);
+    header[length] = '\0';
+
+    if (length >= BINARY_HEADER_SIZE && memcmp(header, BINARY_MAGIC, BINARY_MAGIC_SIZE) == 0){
+
+        /* Binary cells are read straight into place, an even share of them each */
+        memcpy(&size, header + BINARY_MAGIC_SIZE, sizeof(int32_t));
+        *cube_size = size;
+        MPI_Type_size(datatype, &cell_size);
+        total = (file_size - BINARY_HEADER_SIZE) / cell_size;
+        lo = total * rank / n_processes;
+        hi = total * (rank + 1) / n_processes;
+        n_cells = (int) (hi - lo);
+        *cells = malloc(sizeof(Node) * (n_cells + 1));
+        MPI_File_read_at_all(fh, BINARY_HEADER_SIZE + lo * cell_size, *cells, n_cells, datatype, MPI_STATUS_IGNORE);
+        MPI_File_close(&fh);
+        return n_cells;
+    }
+
+    /* The first line of a text file holds the size of the cube */
+    sscanf(header, "%d", cube_size);
+    line = strchr(header, '\n');
+    data_start = (line == NULL) ? file_size : (line - header) + 1;
+
+    /* Each process parses the lines starting in an even share of the bytes. Lines are shorter
+       than BUFFER_SIZE, so reading that much further completes the last one, and the byte
+       before the share tells whether its first line started in the previous one */
+    lo = data_start + (file_size - data_start) * rank / n_processes;
+    hi = data_start + (file_size - data_start) * (rank + 1) / n_processes;
+    read_lo = (lo > data_start) ? lo - 1 : lo;
+    length = (int) (((hi + BUFFER_SIZE < file_size) ? hi + BUFFER_SIZE : file_size) - read_lo);
+    chunk = malloc(length + 1);
+    MPI_File_read_at_all(fh, read_lo, chunk, length, MPI_CHAR, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    chunk[length] = '\0';
+
+    line = chunk;
+    if (lo > data_start){
+        while (*line != '\0' && *line != '\n'){
+            line++;
+        }
+        if (*line == '\n'){
+            line++;
+        }
+    }
+    end = chunk + (hi - read_lo);
+
+    /* A line holds at least "x y z\n" */
+    capacity = (int) ((hi - lo) / 6) + 1;
+    *cells = malloc(sizeof(Node) * capacity);
+    n_cells = 0;
+    while (line < end && *line != '\0'){
+        if (*line != '\n'){
+            x = strtol(line, &next, 10);
+            if (next != line){
+                line = next;
+                y = strtol(line, &next, 10);
+                if (next != line){
+                    line = next;
+                    z = strtol(line, &next, 10);
+                    if (next != line){
+                        if (n_cells == capacity){
+                            capacity *= 2;
+                            *cells = realloc(*cells, sizeof(Node) * capacity);
+                        }
+                        (*cells)[n_cells].x = x;
+                        (*cells)[n_cells].y = y;
+                        (*cells)[n_cells].z = z;
+                        n_cells++;
+                    }
+                }
+            }
+            line = next;
+        }
+        /* Move on to the next line */
+        while (*line != '\0' && *line != '\n'){
+            line++;
+        }
+        if (*line == '\n'){
+            line++;
+        }
+    }
+
+    free(chunk);
+    return n_cells;
+}
+
+int routeCells(Node *cells, int n_cells, int *owner, MPI_Comm comm, MPI_Datatype datatype, Node **routed){
+
+    int n_processes, i, n_routed;
+    int *send_counts, *send_displs, *recv_counts, *recv_displs, *fill;
+    Node *sorted;
+
+    MPI_Comm_size(comm, &n_processes);
+    send_counts = calloc(n_processes, sizeof(int));
+    send_displs = malloc(sizeof(int) * n_processes);
+    recv_counts = malloc(sizeof(int) * n_processes);
+    recv_displs = malloc(sizeof(int) * n_processes);
+    fill = malloc(sizeof(int) * n_processes);
+
+    /* Group the cells by owner */
+    for (i = 0; i < n_cells; i++){
+        send_counts[owner[i]]++;
+    }
+    send_displs[0] = 0;
+    for (i = 1; i < n_processes; i++){
+        send_displs[i] = send_displs[i - 1] + send_counts[i - 1];
+    }
+    memcpy(fill, send_displs, sizeof(int) * n_processes);
+    sorted = malloc(sizeof(Node) * (n_cells + 1));
+    for (i = 0; i < n_cells; i++){
+        sorted[fill[owner[i]]++] = cells[i];
+    }
+
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, comm);
+    n_routed = 0;
+    for (i = 0; i < n_processes; i++){
+        recv_displs[i] = n_routed;
+        n_routed += recv_counts[i];
+    }
+    *routed = malloc(sizeof(Node) * (n_routed + 1));
+    MPI_Alltoallv(sorted, send_counts, send_displs, datatype, *routed, recv_counts, recv_displs, datatype, comm);
+
+    free(send_counts);
+    free(send_displs);
+    free(recv_counts);
+    free(recv_displs);
+    free(fill);
+    free(sorted);
+    return n_routed;
+}
+
+int compareCells(const void *a, const void *b){
+
+    const Node *u = a, *v = b;
+    if (u->x != v->x){
+        return u->x - v->x;
+    }
+    if (u->y != v->y){
+        return u->y - v->y;
+    }
+    return u->z - v->z;
+}
+
+void writeCells(char *file_name, MPI_Comm comm, MPI_Datatype datatype, int cube_size, Node *cells, int n_cells){
+
+    MPI_File fh;
+    MPI_Offset length, offset, count, prefix;
+    char header[BINARY_HEADER_SIZE];
+    char *text;
+    int rank, cell_size, i;
+    int32_t size;
+    size_t name_length = strlen(file_name);
+    bool binary = name_length >= strlen(BINARY_SUFFIX)
+        && strcmp(file_name + name_length - strlen(BINARY_SUFFIX), BINARY_SUFFIX) == 0;
+
+    MPI_Comm_rank(comm, &rank);
+    qsort(cells, n_cells, sizeof(Node), compareCells);
+
+    if (MPI_File_open(comm, file_name, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS){
+        fprintf(stderr, "Could not open the output file\n" );
+        MPI_Abort(comm, EXIT_FAILURE);
+    }
+    MPI_File_set_size(fh, 0);
+
+    if (binary){
+
+        /* The header goes first, then the cells of every process in rank order */
+        if (rank == ROOT){
+            size = cube_size;
+            memcpy(header, BINARY_MAGIC, BINARY_MAGIC_SIZE);
+            memcpy(header + BINARY_MAGIC_SIZE, &size, sizeof(int32_t));
+            MPI_File_write_at(fh, 0, header, BINARY_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+        MPI_Type_size(datatype, &cell_size);
+        count = n_cells;
+        prefix = 0;
+        MPI_Exscan(&count, &prefix, 1, MPI_OFFSET, MPI_SUM, comm);
+        if (rank == ROOT){
+            prefix = 0;
+        }
+        MPI_File_write_at_all(fh, BINARY_HEADER_SIZE + prefix * cell_size, cells, n_cells, datatype, MPI_STATUS_IGNORE);
+
+    } else {
+
+        /* Lines vary in length, so each process starts where the previous ones end */
+        text = malloc((size_t) n_cells * OUTPUT_LINE_SIZE + 1);
+        length = 0;
+        for (i = 0; i < n_cells; i++){
+            length += sprintf(text + length, "%d %d %d\n", cells[i].x, cells[i].y, cells[i].z);
+        }
+        offset = 0;
+        MPI_Exscan(&length, &offset, 1, MPI_OFFSET, MPI_SUM, comm);
+        if (rank == ROOT){
+            offset = 0;
+        }
+        MPI_File_write_at_all(fh, offset, text, (int) length, MPI_CHAR, MPI_STATUS_IGNORE);
+        free(text);
+    }
+
+    MPI_File_close(&fh);
+}
+
+void sliceOwners(int *owner, int *cuts, int parts){
+
+    int p, c;
+    for (p = 0; p < parts; p++){
+        for (c = cuts[p]; c < cuts[p + 1]; c++){
+            owner[c] = p;
+        }
+    }
+}
+
+void balanceCuts(int *cuts, int parts, int *load, int size, int min_width){
+
+    long total = 0, prefix = 0, target;
+    int p, c;
+
+    for (c = 0; c < size; c++){
+        total += load[c];
+    }
+
+    cuts[0] = 0;
+    c = 0;
+    for (p = 1; p < parts; p++){
+        /* Leave room for this block and every following one */
+        while (c < cuts[p - 1] + min_width){
+            prefix += load[c++];
+        }
+        /* Take a slice while most of it falls short of an equal share */
+        target = total * p / parts;
+        while (c < size - (parts - p) * min_width && 2 * prefix + load[c] < 2 * target){
+            prefix += load[c++];
+        }
+        cuts[p] = c;
+    }
+    cuts[parts] = size;
+}
+
+void hilbertRotate(int n, int *x, int *y, int rx, int ry){
+
+    int t;
+    if (ry == 0){
+        if (rx == 1){
+            *x = n - 1 - *x;
+            *y = n - 1 - *y;
+        }
+        t = *x; *x = *y; *y = t;
+    }
+}
+
+long hilbertKey(int order, int x, int y){
+
+    long key = 0;
+    int s, rx, ry;
+
+    for (s = order / 2; s > 0; s /= 2){
+        rx = (x & s) > 0;
+        ry = (y & s) > 0;
+        key += (long) s * s * ((3 * rx) ^ ry);
+        hilbertRotate(order, &x, &y, rx, ry);
+    }
+    return key;
+}
+
+void hilbertPoint(int order, long key, int *x, int *y){
+
+    int s, rx, ry;
+
+    *x = 0; *y = 0;
+    for (s = 1; s < order; s *= 2){
+        rx = 1 & (key / 2);
+        ry = 1 & (key ^ rx);
+        hilbertRotate(s, x, y, rx, ry);
+        *x += s * rx;
+        *y += s * ry;
+        key /= 4;
+    }
+}
+
+int keyOwner(long *splits, int n_processes, long key){
+
+    /* The last process whose segment starts at or before the key, which skips empty segments */
+    int lo = 0, hi = n_processes, mid;
+    while (hi - lo > 1){
+        mid = (lo + hi) / 2;
+        if (splits[mid] <= key){
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+Column *initColumns(int order, int cube_size, long key_lo, long key_hi){
+
+    int dx[N_LATERAL] = {-1, 1, 0, 0}, dy[N_LATERAL] = {0, 0, -1, 1};
+    int x, y, l;
+    long c, key;
+
+    Column *columns = malloc(sizeof(Column) * (key_hi - key_lo + 1));
+    if (columns == NULL){
+        errPrint("Malloc failed. Memory full");
+        exit(EXIT_FAILURE);
+    }
+
+    for (c = 0; c < key_hi - key_lo; c++){
+        hilbertPoint(order, key_lo + c, &x, &y);
+        columns[c].cells = NULL;
+        /* The curve fills a power of two square, which may overhang the cube */
+        if (x >= cube_size || y >= cube_size){
+            columns[c].x = -1; columns[c].y = -1;
+            for (l = 0; l < N_LATERAL; l++){
+                columns[c].nbr[l] = -1;
+            }
+            continue;
+        }
+        columns[c].x = x; columns[c].y = y;
+        for (l = 0; l < N_LATERAL; l++){
+            key = hilbertKey(order, (x + dx[l] + cube_size) % cube_size, (y + dy[l] + cube_size) % cube_size);
+            columns[c].nbr[l] = (key >= key_lo && key < key_hi) ? key - key_lo : -1;
+        }
+    }
+    return columns;
+}
+
+void freeColumns(Column *columns, long n_columns){
+
+    long c;
+    for (c = 0; c < n_columns; c++){
+        graphNodeDelete(columns[c].cells);
+    }
+    free(columns);
+}
+
+int buildNeighbours(Column *columns, long n_columns, int order, int cube_size, long *splits, int n_processes,
+    int **nbr_ranks, int **border_displs, int **border){
+
+    int dx[N_LATERAL] = {-1, 1, 0, 0}, dy[N_LATERAL] = {0, 0, -1, 1};
+    int *count = calloc(n_processes, sizeof(int));
+    int *index = malloc(sizeof(int) * n_processes);
+    long *last = malloc(sizeof(long) * n_processes);
+    int *owner = malloc(sizeof(int) * (n_columns * N_LATERAL + 1));
+    int p, l, n_nbrs, total;
+    long c, key;
+
+    /* Owner of every lateral neighbour held by another process. A column is listed once
+       per process, even if it borders several of its columns */
+    for (p = 0; p < n_processes; p++){
+        last[p] = -1;
+    }
+    for (c = 0; c < n_columns; c++){
+        for (l = 0; l < N_LATERAL; l++){
+            owner[c * N_LATERAL + l] = -1;
+            if (columns[c].x < 0 || columns[c].nbr[l] >= 0){
+                continue;
+            }
+            key = hilbertKey(order, (columns[c].x + dx[l] + cube_size) % cube_size,
+                (columns[c].y + dy[l] + cube_size) % cube_size);
+            p = keyOwner(splits, n_processes, key);
+            owner[c * N_LATERAL + l] = p;
+            if (last[p] != c){
+                last[p] = c;
+                count[p]++;
+            }
+        }
+    }
+
+    n_nbrs = 0;
+    for (p = 0; p < n_processes; p++){
+        if (count[p] > 0){
+            index[p] = n_nbrs++;
+        }
+    }
+    *nbr_ranks = malloc(sizeof(int) * (n_nbrs + 1));
+    *border_displs = malloc(sizeof(int) * (n_nbrs + 1));
+    total = 0;
+    for (p = 0; p < n_processes; p++){
+        if (count[p] > 0){
+            (*nbr_ranks)[index[p]] = p;
+            (*border_displs)[index[p]] = total;
+            total += count[p];
+        }
+    }
+    (*border_displs)[n_nbrs] = total;
+
+    /* Fill the lists, reusing count as the next free entry of each */
+    *border = malloc(sizeof(int) * (total + 1));
+    for (p = 0; p < n_processes; p++){
+        last[p] = -1;
+        if (count[p] > 0){
+            count[p] = (*border_displs)[index[p]];
+        }
+    }
+    for (c = 0; c < n_columns; c++){
+        for (l = 0; l < N_LATERAL; l++){
+            p = owner[c * N_LATERAL + l];
+            if (p >= 0 && last[p] != c){
+                last[p] = c;
+                (*border)[count[p]++] = c;
+            }
+        }
+    }
+
+    free(count);
+    free(index);
+    free(last);
+    free(owner);
+    return n_nbrs;
+}
+
+int haloCapacity(int count){
+
+    int capacity = HALO_MIN_CAPACITY;
+    while (capacity < count){
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+void haloCreate(Halo *halo, MPI_Comm comm, MPI_Datatype datatype, int nbr_rank, int tag, bool send){
+
+    halo->comm = comm;
+    halo->datatype = datatype;
+    halo->nbr_rank = nbr_rank;
+    halo->tag = tag;
+    halo->send = send;
+    halo->count = 0;
+    halo->capacity = HALO_MIN_CAPACITY;
+    halo->length = 0;
+    halo->cells = NULL;
+    halo->req = MPI_REQUEST_NULL;
+    halo->overflow_req = MPI_REQUEST_NULL;
+    haloReserve(halo, halo->capacity);
+}
+
+void haloReserve(Halo *halo, int count){
+
+    /* One extra entry for the header */
+    if (count + 1 > halo->length){
+        halo->length = 2 * (count + 1);
+        halo->cells = realloc(halo->cells, sizeof(Node) * halo->length);
+        if (halo->cells == NULL){
+            errPrint("Realloc failed. Memory full");
+            exit(EXIT_FAILURE);
+        }
+        /* The persistent request is bound to the old buffer */
+        if (halo->req != MPI_REQUEST_NULL){
+            MPI_Request_free(&(halo->req));
+        }
+    }
+}
+
+void haloPush(Halo *halo, int x, int y, int z){
+
+    haloReserve(halo, halo->count + 1);
+    halo->count++;
+    halo->cells[halo->count].x = x;
+    halo->cells[halo->count].y = y;
+    halo->cells[halo->count].z = z;
+}
+
+void haloStart(Halo *halo){
+
+    if (halo->req == MPI_REQUEST_NULL){
+        if (halo->send){
+            MPI_Send_init(halo->cells, halo->capacity + 1, halo->datatype, halo->nbr_rank, halo->tag, halo->comm, &(halo->req));
+        } else {
+            MPI_Recv_init(halo->cells, halo->capacity + 1, halo->datatype, halo->nbr_rank, halo->tag, halo->comm, &(halo->req));
+        }
+    }
+
+    if (halo->send){
+        /* The header carries the full count, the cells beyond capacity follow in a second message */
+        halo->cells[0].x = halo->count & 0xFFFF;
+        halo->cells[0].y = halo->count >> 16;
+        MPI_Start(&(halo->req));
+        if (halo->count > halo->capacity){
+            MPI_Isend(&(halo->cells[halo->capacity + 1]), halo->count - halo->capacity, halo->datatype,
+                halo->nbr_rank, halo->tag + TAG_OVERFLOW, halo->comm, &(halo->overflow_req));
+        }
+    } else {
+        MPI_Start(&(halo->req));
+    }
+}
+
+void haloWait(Halo *halo){
+
+    MPI_Wait(&(halo->req), MPI_STATUS_IGNORE);
+
+    if (!halo->send){
+        halo->count = halo->cells[0].x | (halo->cells[0].y << 16);
+        if (halo->count > halo->capacity){
+            haloReserve(halo, halo->count);
+            MPI_Recv(&(halo->cells[halo->capacity + 1]), halo->count - halo->capacity, halo->datatype,
+                halo->nbr_rank, halo->tag + TAG_OVERFLOW, halo->comm, MPI_STATUS_IGNORE);
+        }
+    } else if (halo->count > halo->capacity){
+        MPI_Wait(&(halo->overflow_req), MPI_STATUS_IGNORE);
+    }
+
+    /* Both ends saw the same count, so they grow the persistent message alike */
+    if (halo->count > halo->capacity){
+        halo->capacity = haloCapacity(halo->count);
+        haloReserve(halo, halo->capacity);
+        if (halo->req != MPI_REQUEST_NULL){
+            MPI_Request_free(&(halo->req));
+        }
+    }
+}
+
+void haloFree(Halo *halo){
+
+    if (halo->req != MPI_REQUEST_NULL){
+        MPI_Request_free(&(halo->req));
+    }
+    free(halo->cells);
+}
@@ -0,0 +1,352 @@
+/**
+ * @file dist_grid_hilbert.h
+ * @brief Game Of Life 3D MPI Implementation
+ *
+ * @details Orders the (x,y) columns of the cube along a Hilbert curve,
+ * and gives each process a contiguous segment of the curve holding about
+ * the same number of live cells. Borders are exchanged with whichever
+ * processes own the neighbouring columns.
+ * The final cells are written by all processes together, each one the
+ * part of the output for a slab of the cube along x.
+ *
+ * @attention Each process is assumed to have access to the input file,
+ * which all of them read together, a share each.
+ *
+ * @author João Borrego
+ * @author Pedro Abreu
+ * @author Miguel Cardoso
+ * @bug No known bugs.
+ */
+
+#ifndef DIST_GRID_HILBERT_H
+#define DIST_GRID_HILBERT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <mpi.h>
+
+#include "graph.h"
+#include "debug.h"
+
+/* MPI Generic definitions */
+
+/**< Macro for representing the root process in MPI */
+#define ROOT 0
+
+/* Communication tags */
+
+/**< Macro for identifying the border exchanged between two processes */
+#define TAG_BORDER 100
+/**< Added to a border tag for the cells that do not fit the persistent message */
+#define TAG_OVERFLOW 1
+
+/* Halo exchange */
+
+/**< Number of lateral neighbours of a column, i.e. x - 1, x + 1, y - 1 and y + 1 */
+#define N_LATERAL 4
+/**< Initial number of cells carried by a persistent border message */
+#define HALO_MIN_CAPACITY 256
+
+/* General Macros */
+
+/**< Dead node removal period */
+#define REMOVAL_PERIOD 5
+
+/**< Generations between checks of the spread of live cells across processes */
+#define REBALANCE_PERIOD 50
+/**< The curve is split again when the busiest process holds this many times the average live cells */
+#define IMBALANCE_THRESHOLD 1.2
+
+/**< Buffer Size, also the longest line of a text input file */
+#define BUFFER_SIZE 200
+
+/* Binary input */
+
+/**< First bytes of a binary cell file, in the L3DB format described in README.md */
+#define BINARY_MAGIC "L3DB"
+/**< Length of the magic */
+#define BINARY_MAGIC_SIZE 4
+/**< Bytes before the first cell of a binary input file */
+#define BINARY_HEADER_SIZE 8
+/**< Output files whose name ends in this are written in the binary format */
+#define BINARY_SUFFIX ".l3db"
+/**< Longest line of a text output file, "65535 65535 65535\n" */
+#define OUTPUT_LINE_SIZE 18
+
+/* Structures */
+
+/**
+ * @brief A column of the local graph
+ *
+ * @details Columns are indexed by their position along the curve,
+ * relative to the start of the segment of the process.
+ */
+typedef struct _Column{
+    GraphNode *cells;           /**< The cells of the column */
+    int x;                      /**< x coordinate, negative if the curve point lies outside the cube */
+    int y;                      /**< y coordinate */
+    int nbr[N_LATERAL];         /**< Local index of each lateral neighbour, -1 if another process owns it */
+}Column;
+
+/**
+ * @brief A persistent channel for the border exchanged with one neighbour
+ *
+ * @details Buffers and requests live until the curve is split again.
+ * Each message carries a header with the number of cells, then up to
+ * `capacity` cells, in global coordinates.
+ * Both ends of a channel agree on the capacity: when a border does not fit,
+ * the remainder follows in an overflow message and both ends grow it alike.
+ */
+typedef struct _Halo{
+    Node *cells;                /**< Header, then the cells from index 1 */
+    int count;                  /**< Number of cells */
+    int capacity;               /**< Cells carried by the persistent message */
+    int length;                 /**< Allocated entries, header included */
+    bool send;                  /**< Whether the channel sends or receives */
+    MPI_Request req;            /**< Persistent request, MPI_REQUEST_NULL until (re)bound to the buffer */
+    MPI_Request overflow_req;   /**< Request for the cells beyond capacity */
+    MPI_Comm comm;              /**< Communicator */
+    MPI_Datatype datatype;      /**< Datatype of a cell */
+    int nbr_rank;               /**< Neighbour process rank */
+    int tag;                    /**< Tag of the persistent message */
+}Halo;
+
+/* Function headers */
+
+/**
+ * @brief Parse command line arguments
+ *
+ * @param argc Argument count
+ * @param argv Argument values
+ * @param file The input file name
+ * @param generations The number of generations
+ * @param output The output file name, NULL if none is given
+ */
+void parseArgs(int argc, char *argv[], char **file, int *generations, char **output);
+
+/**
+ * @brief Reads an even share of the input file
+ *
+ * @details All processes of the communicator read at once with MPI-IO.
+ * A text file has the cube size in its first line, then a cell "x y z" per
+ * line, and each process parses the lines that start in its share of the
+ * bytes. A binary file starts with BINARY_MAGIC, and its cells are read
+ * straight into place.
+ *
+ * @param file_name The input file name
+ * @param comm The MPI Communicator object
+ * @param datatype MPI Datatype of a cell
+ * @param cube_size The size of the side of the cube
+ * @param cells The cells read, in global coordinates
+ * @return The number of cells read
+ */
+int readCells(char *file_name, MPI_Comm comm, MPI_Datatype datatype, int *cube_size, Node **cells);
+
+/**
+ * @brief Sends each cell to its owner
+ *
+ * @param cells The cells
+ * @param n_cells The number of cells
+ * @param owner The rank in `comm` each cell goes to
+ * @param comm The MPI Communicator object
+ * @param datatype MPI Datatype of a cell
+ * @param routed The cells received from all processes
+ * @return The number of cells received
+ */
+int routeCells(Node *cells, int n_cells, int *owner, MPI_Comm comm, MPI_Datatype datatype, Node **routed);
+
+/**
+ * @brief Orders cells by x, then y, then z, for qsort
+ *
+ * @param a The first cell
+ * @param b The second cell
+ * @return Negative, zero or positive as a comes before, with or after b
+ */
+int compareCells(const void *a, const void *b);
+
+/**
+ * @brief Writes the cells of every process to a file
+ *
+ * @details All processes of the communicator write at once with MPI-IO,
+ * each one after the processes of lower rank, so every process must hold
+ * cells that come after those of the previous ones.
+ * The cells are sorted first, and written as "x y z" lines, or in the
+ * binary input format if the file name ends in BINARY_SUFFIX.
+ *
+ * @param file_name The output file name
+ * @param comm The MPI Communicator object
+ * @param datatype MPI Datatype of a cell
+ * @param cube_size The size of the side of the cube
+ * @param cells The cells of this process, in global coordinates
+ * @param n_cells The number of cells
+ */
+void writeCells(char *file_name, MPI_Comm comm, MPI_Datatype datatype, int cube_size, Node *cells, int n_cells);
+
+/**
+ * @brief Finds the block each slice of one dimension belongs to
+ *
+ * @param owner The block of each slice
+ * @param cuts The block boundaries, block p spans [cuts[p], cuts[p + 1])
+ * @param parts The number of blocks
+ */
+void sliceOwners(int *owner, int *cuts, int parts);
+
+/**
+ * @brief Splits one dimension of the cube into blocks of about the same load
+ *
+ * @details Places each boundary where the prefix sum of the load is
+ * closest to an equal share, while keeping every block at least
+ * `min_width` slices wide.
+ *
+ * @param cuts The block boundaries, block p spans [cuts[p], cuts[p + 1])
+ * @param parts The number of blocks
+ * @param load The load of each slice, i.e. its live cells
+ * @param size The size of the side of the cube
+ * @param min_width The minimum width of a block
+ */
+void balanceCuts(int *cuts, int parts, int *load, int size, int min_width);
+
+/**
+ * @brief Rotates a quadrant of the Hilbert curve
+ *
+ * @param n The side of the quadrant
+ * @param x x coordinate
+ * @param y y coordinate
+ * @param rx Whether the point is in the right half
+ * @param ry Whether the point is in the upper half
+ */
+void hilbertRotate(int n, int *x, int *y, int rx, int ry);
+
+/**
+ * @brief Returns the position of a point along the Hilbert curve
+ *
+ * @param order The side of the square the curve fills, a power of two
+ * @param x x coordinate
+ * @param y y coordinate
+ * @return The position along the curve, in [0, order * order)
+ */
+long hilbertKey(int order, int x, int y);
+
+/**
+ * @brief Returns the point at a position along the Hilbert curve
+ *
+ * @param order The side of the square the curve fills, a power of two
+ * @param key The position along the curve
+ * @param x x coordinate
+ * @param y y coordinate
+ */
+void hilbertPoint(int order, long key, int *x, int *y);
+
+/**
+ * @brief Returns the process that owns a position along the curve
+ *
+ * @param splits The segment boundaries, process p owns [splits[p], splits[p + 1])
+ * @param n_processes The number of processes
+ * @param key The position along the curve
+ * @return The owner process
+ */
+int keyOwner(long *splits, int n_processes, long key);
+
+/**
+ * @brief Creates the columns of a segment of the curve
+ *
+ * @param order The side of the square the curve fills
+ * @param cube_size The size of the side of the cube
+ * @param key_lo The first position of the segment
+ * @param key_hi One past the last position of the segment
+ * @return The columns, without any cells
+ */
+Column *initColumns(int order, int cube_size, long key_lo, long key_hi);
+
+/**
+ * @brief Frees the columns of a segment and their cells
+ *
+ * @param columns The columns
+ * @param n_columns The number of columns
+ */
+void freeColumns(Column *columns, long n_columns);
+
+/**
+ * @brief Lists the processes a segment borders, and which columns each one needs
+ *
+ * @param columns The columns of the segment
+ * @param n_columns The number of columns
+ * @param order The side of the square the curve fills
+ * @param cube_size The size of the side of the cube
+ * @param splits The segment boundaries of every process
+ * @param n_processes The number of processes
+ * @param nbr_ranks The neighbour processes, in ascending order
+ * @param border_displs Where the columns of each neighbour start in `border`, with a final entry
+ * @param border The columns each neighbour needs, by local index
+ * @return The number of neighbour processes
+ */
+int buildNeighbours(Column *columns, long n_columns, int order, int cube_size, long *splits, int n_processes,
+    int **nbr_ranks, int **border_displs, int **border);
+
+/**
+ * @brief Returns the persistent message capacity for a number of cells
+ *
+ * @param count The number of cells
+ * @return The smallest power of two times HALO_MIN_CAPACITY that holds them
+ */
+int haloCapacity(int count);
+
+/**
+ * @brief Creates a border channel
+ *
+ * @param halo The channel
+ * @param comm The MPI Communicator object
+ * @param datatype MPI Datatype of a cell
+ * @param nbr_rank The neighbour process rank
+ * @param tag The tag of the persistent message
+ * @param send Whether the channel sends or receives
+ */
+void haloCreate(Halo *halo, MPI_Comm comm, MPI_Datatype datatype, int nbr_rank, int tag, bool send);
+
+/**
+ * @brief Grows the buffer of a channel to hold `count` cells
+ *
+ * @details Frees the persistent request if the buffer moves, so that
+ * the next haloStart binds a new one.
+ *
+ * @param halo The channel
+ * @param count The number of cells
+ */
+void haloReserve(Halo *halo, int count);
+
+/**
+ * @brief Appends a cell to the border to be sent
+ *
+ * @param halo The channel
+ * @param x x coordinate
+ * @param y y coordinate
+ * @param z z coordinate
+ */
+void haloPush(Halo *halo, int x, int y, int z);
+
+/**
+ * @brief Starts the persistent send or receive of a channel
+ *
+ * @param halo The channel
+ */
+void haloStart(Halo *halo);
+
+/**
+ * @brief Completes the exchange of a channel
+ *
+ * @details On the receiving end, sets `count` and receives the overflow, if any.
+ *
+ * @param halo The channel
+ */
+void haloWait(Halo *halo);
+
+/**
+ * @brief Frees the buffer and request of a channel
+ *
+ * @param halo The channel
+ */
+void haloFree(Halo *halo);
+
+#endif
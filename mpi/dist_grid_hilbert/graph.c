@@ -0,0 +1,124 @@
+#include "graph.h"
+
+GraphNode* graphNodeInsert(GraphNode *first, int z, int state){
+
+    GraphNode *new = malloc(sizeof(GraphNode));
+    if (new == NULL){
+        fprintf(stderr, "Malloc failed. Memory full");
+        exit(EXIT_FAILURE);
+    }
+    new->z = z;
+    new->state = state;
+    new->neighbours = 0;
+    new->next = first;
+    return new;
+}
+
+GraphNode*** initGraph(int dim_x, int dim_y){
+    int i,j;
+    GraphNode ***graph = malloc(sizeof(GraphNode**) * dim_x);
+
+    for (i = 0; i < dim_x; i++){
+        graph[i] = malloc(sizeof(GraphNode*) * dim_y);
+        for (j = 0; j < dim_y; j++){
+            graph[i][j] = NULL;
+        }
+    }
+    return graph;
+}
+
+bool graphNodeAddNeighbour(GraphNode **first, int z){
+    GraphNode *it;
+    /* Search for the node */
+    for (it = *first; it != NULL; it = it->next){
+        if (it->z == z){
+            it->neighbours++;
+            return false;
+        }
+    }
+
+    /* Need to insert the node */
+    GraphNode* new = graphNodeInsert(*first, z, DEAD);
+    new->neighbours++;
+    *first = new;
+    return true;
+}
+
+void printAndSortActive(GraphNode ***graph, int size){
+    int x,y;
+    GraphNode *it;
+    for (x = 0; x < size; ++x){
+        for (y = 0; y < size; ++y){
+            /* Sort the list by ascending coordinate z */
+            graphNodeSort(&(graph[x][y]));
+            for (it = graph[x][y]; it != NULL; it = it->next){
+                if (it->state == ALIVE)
+                    printf("%d %d %d\n", x, y, it->z);
+            }
+        }
+    }
+}
+
+void graphNodeSort(GraphNode **first_ptr){
+    GraphNode *i, *j;
+    int tmp_z; bool tmp_state;
+    if (*first_ptr != NULL){
+        for (i = *first_ptr; i->next != NULL; i = i->next){
+            for (j = i->next; j != NULL; j = j->next){
+                if (i->z > j->z){
+                    tmp_z = i->z; tmp_state = i->state;
+                    i->z = j->z; i->state = j->state;
+                    j->z = tmp_z; j->state = tmp_state;
+                }
+            }
+        }
+    }
+}
+
+void freeGraph(GraphNode ***graph, int dim_x, int dim_y){
+
+    int i, j;
+    if (graph != NULL){
+        for (i = 0; i < dim_x; i++){
+            for (j = 0; j < dim_y; j++){
+                graphNodeDelete(graph[i][j]);
+            }
+            free(graph[i]);
+        }
+        free(graph);
+    }
+}
+
+void graphNodeDelete(GraphNode *first){
+    GraphNode *it, *next;
+    for(it = first; it != NULL; it = next){
+        next = it->next;
+        free(it);
+    }
+}
+
+void graphListCleanup(GraphNode** head){
+    GraphNode *temp, *prev;
+    if(*head != NULL){
+        temp = *head;
+        /* Delete from the beginning */
+        while(temp != NULL && temp->state == DEAD){
+            *head = temp->next;
+            free(temp);
+            temp = *head;
+        }
+        /*Delete from the middle*/
+        while(temp != NULL){
+            while (temp != NULL && temp->state != DEAD){
+                prev = temp;
+                temp = temp->next;
+            }
+            if(temp == NULL)
+                return;
+
+            prev->next = temp->next;
+            free(temp);
+            temp = prev->next;
+        }
+    }
+}
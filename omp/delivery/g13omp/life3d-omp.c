@@ -1,5 +1,6 @@
 #include "life3d-omp.h"
 
+#ifndef LIFE3D_ENGINE
 int main(int argc, char* argv[]){
 
     char* file;             /**< Input data file name */
@@ -11,97 +12,323 @@ int main(int argc, char* argv[]){
     /* Lock variables */
     omp_lock_t** graph_lock;
 
-    int g, i, j;
-    GraphNode* it;
-    int live_neighbours;
+    /* Load balancing */
+    long* row_live;         /**< Live cells in each row x, updated by the second passage */
 
     parseArgs(argc, argv, &file, &generations);
     debug_print("ARGS: file: %s generations: %d.", file, generations);
 
     graph = parseFile(file, &cube_size);
 
-    /* Initialize lock variables */
-    graph_lock = (omp_lock_t**)malloc(cube_size * sizeof(omp_lock_t*));
-    for(i = 0; i < cube_size; i++){
-        graph_lock[i] = (omp_lock_t*) malloc(cube_size * sizeof(omp_lock_t));
-        for(j = 0; j < cube_size; j++){
-            omp_init_lock(&(graph_lock[i][j]));
-        }
-    }
+    graph_lock = initLocks(cube_size);
+    row_live = (long*) calloc(cube_size, sizeof(long));
+    countRows(graph, cube_size, row_live);
     double start = omp_get_wtime();  // Start Timer
-    for(g = 1; g <= generations; g++){
-        
-        #pragma omp parallel
-        {
-            /* First passage in the graph - notify neighbours */
-            #pragma omp for private(i, j, it)   
-            for(i = 0; i < cube_size; i++){
-                for(j = 0; j < cube_size; j++){
-                    for(it = graph[i][j]; it != NULL; it = it->next){
-                        if(it->state == ALIVE)
-                            visitNeighbours(graph, graph_lock, cube_size, i, j, it->z);
-                    }
-                }
+
+    runGenerations(graph, graph_lock, cube_size, row_live, generations);
+
+    double end = omp_get_wtime();   // Stop Timer
+
+    /* Print the final set of live cells */
+    printAndSortActive(graph, cube_size);
+
+    time_print("%f\n", end - start);
+
+    freeLocks(graph_lock, cube_size);
+    free(row_live);
+    freeGraph(graph, cube_size);
+    free(file);
+    return(EXIT_SUCCESS);
+}
+#endif
+
+long g13ompRun(int cube_size, const int* cells, long n_cells, int generations, int** live){
+
+    long c, n_live;
+    coordinate x, y;
+    GraphNode*** graph = initGraph(cube_size);
+    omp_lock_t** graph_lock = initLocks(cube_size);
+    long* row_live = (long*) calloc(cube_size, sizeof(long));
+
+    for(c = 0; c < n_cells; c++){
+        x = cells[3 * c];
+        y = cells[3 * c + 1];
+        graph[x][y] = graphNodeInsert(graph[x][y], cells[3 * c + 2], ALIVE);
+    }
+    countRows(graph, cube_size, row_live);
+
+    runGenerations(graph, graph_lock, cube_size, row_live, generations);
+
+    n_live = countRows(graph, cube_size, row_live);
+    *live = (int*) malloc(3 * n_live * sizeof(int));
+    collectActive(graph, cube_size, *live);
+
+    freeLocks(graph_lock, cube_size);
+    free(row_live);
+    freeGraph(graph, cube_size);
+    return n_live;
+}
+
+void runGenerations(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, long* row_live, int generations){
+
+    int g, i, j;
+    GraphNode* it;
+    int live_neighbours;
+    long row;
+
+    /* Parallelism controller, the team asked for may be larger or smaller than what the runtime gives */
+    int max_threads = omp_get_max_threads();
+    if(max_threads > omp_get_num_procs())
+        fprintf(stderr, "WARNING: %d threads requested on %d processors\n", max_threads, omp_get_num_procs());
+    int team = max_threads;                 /**< Threads actually in the team, set inside the region */
+    int notify_threads, decide_threads;     /**< Active threads in each phase of the current generation */
+    double notify_cost = DEFAULT_CELL_COST; /**< Estimated thread-seconds per live cell in the first passage */
+    double decide_cost = DEFAULT_CELL_COST; /**< Estimated thread-seconds per node in the second passage */
+    double phase_start, decide_start = 0;
+    long visited = 0;                       /**< Nodes decided in the last generation */
+
+    /* Load balancing */
+    int* notify_bounds = (int*) malloc((max_threads + 1) * sizeof(int));
+    int* decide_bounds = (int*) malloc((max_threads + 1) * sizeof(int));
+    bool balanced;                          /**< Whether the row ranges of the first passage are even enough */
+    long next_column;                       /**< Next chunk of columns to be taken, when not balanced */
+
+    /* Power-of-two cubes wrap with a bitmask, other sizes split interior and boundary cells */
+    int mask = IS_POWER_OF_TWO(cube_size) ? cube_size - 1 : 0;
+    long live = 0;                          /**< Live cells in the current generation */
+    for(i = 0; i < cube_size; i++)
+        live += row_live[i];
+
+    /* A single team runs every generation, and only the first threads of it work on small populations */
+    #pragma omp parallel num_threads(max_threads) private(g, i, j, it, live_neighbours, row)
+    {
+        int tid = omp_get_thread_num();
+        long my_live, my_visited, column;
+
+        /* OMP_DYNAMIC, thread_limit or nesting may shrink the team, so rows are only given to threads that exist */
+        #pragma omp single
+        team = omp_get_num_threads();
+
+        for(g = 1; g <= generations; g++){
+
+            #pragma omp single
+            {
+                if(g > 1)
+                    decide_cost = updateCost(decide_cost, omp_get_wtime() - decide_start, decide_threads, visited);
+                notify_threads = chooseThreads(live, notify_cost, team);
+                balanced = partitionRows(row_live, cube_size, notify_threads, notify_bounds) <= IMBALANCE_LIMIT;
+                next_column = 0;
+                debug_print("Generation %d: %ld live cells, %d threads, %s", g, live, notify_threads, balanced ? "balanced" : "dynamic");
+                phase_start = omp_get_wtime();
             }
-            /* Second passage in the graph - decide next state */
-            #pragma omp for private(i, j, it, live_neighbours)
-            for(i = 0; i < cube_size; i++){
-                for(j = 0; j < cube_size; j++){
-                    for (it = graph[i][j]; it != NULL; it = it->next){
-                        live_neighbours = it->neighbours;
-                        it->neighbours = 0;
-                        if(it->state == ALIVE){
-                            if(live_neighbours < 2 || live_neighbours > 4){
-                                it->state = DEAD;
-                            }  
-                        }else{
-                            if(live_neighbours == 2 || live_neighbours == 3){
-                                it->state = ALIVE; 
-                            }
+
+            /* First passage in the graph - notify neighbours, over equal-work row ranges or chunks of columns */
+            if(tid < notify_threads){
+                if(balanced){
+                    for(i = notify_bounds[tid]; i < notify_bounds[tid + 1]; i++){
+                        for(j = 0; j < cube_size; j++){
+                            visitColumn(graph, graph_lock, cube_size, mask, i, j);
+                        }
+                    }
+                }else{
+                    while(1){
+                        #pragma omp atomic capture
+                        { column = next_column; next_column += COLUMN_CHUNK; }
+                        if(column >= (long) cube_size * cube_size)
+                            break;
+                        long last = column + COLUMN_CHUNK;
+                        if(last > (long) cube_size * cube_size)
+                            last = (long) cube_size * cube_size;
+                        for(; column < last; column++){
+                            visitColumn(graph, graph_lock, cube_size, mask, column / cube_size, column % cube_size);
                         }
                     }
                 }
             }
-            /* Remove dead nodes from the graph every REMOVAL_PERIOD generations */
-            if(g % REMOVAL_PERIOD == 0){
-                #pragma omp for private(i, j)
-                for(i = 0; i < cube_size; i++){
+            #pragma omp barrier
+
+            #pragma omp single
+            {
+                notify_cost = updateCost(notify_cost, omp_get_wtime() - phase_start, notify_threads, live);
+                decide_threads = chooseThreads(visited > live ? visited : live, decide_cost, team);
+                partitionRows(row_live, cube_size, decide_threads, decide_bounds);
+                live = 0;
+                visited = 0;
+                decide_start = omp_get_wtime();
+            }
+
+            /* Second passage in the graph - decide next state, and remove dead nodes every REMOVAL_PERIOD generations */
+            if(tid < decide_threads){
+                my_live = 0;
+                my_visited = 0;
+                for(i = decide_bounds[tid]; i < decide_bounds[tid + 1]; i++){
+                    row = 0;
                     for(j = 0; j < cube_size; j++){
-                        GraphNode ** list = &graph[i][j];
-                        graphListCleanup(list);
+                        for (it = graph[i][j]; it != NULL; it = it->next){
+                            live_neighbours = it->neighbours;
+                            it->neighbours = 0;
+                            if(it->state == ALIVE){
+                                if(live_neighbours < 2 || live_neighbours > 4){
+                                    it->state = DEAD;
+                                }
+                            }else{
+                                if(live_neighbours == 2 || live_neighbours == 3){
+                                    it->state = ALIVE;
+                                }
+                            }
+                            row += (it->state == ALIVE);
+                            my_visited++;
+                        }
+                        if(g % REMOVAL_PERIOD == 0){
+                            graphListCleanup(&graph[i][j]);
+                        }
                     }
+                    row_live[i] = row;
+                    my_live += row;
                 }
+                #pragma omp atomic
+                live += my_live;
+                #pragma omp atomic
+                visited += my_visited;
             }
-        }/*pragma end*/
-    } /*generations loop end*/
+            #pragma omp barrier
+        } /*generations loop end*/
+    }/*pragma end*/
 
-    double end = omp_get_wtime();   // Stop Timer
-
-    /* Print the final set of live cells */
-    printAndSortActive(graph, cube_size);
+    free(notify_bounds);
+    free(decide_bounds);
+}
 
-    time_print("%f\n", end - start);
+long countRows(GraphNode*** graph, int cube_size, long* row_live){
 
+    int i, j;
+    long live = 0;
+    GraphNode* it;
     for(i = 0; i < cube_size; i++){
-        for(j = 0; j<cube_size; j++){
+        row_live[i] = 0;
+        for(j = 0; j < cube_size; j++){
+            for(it = graph[i][j]; it != NULL; it = it->next)
+                row_live[i] += (it->state == ALIVE);
+        }
+        live += row_live[i];
+    }
+    return live;
+}
+
+omp_lock_t** initLocks(int size){
+
+    int i, j;
+    omp_lock_t** graph_lock = (omp_lock_t**) malloc(size * sizeof(omp_lock_t*));
+    for(i = 0; i < size; i++){
+        graph_lock[i] = (omp_lock_t*) malloc(size * sizeof(omp_lock_t));
+        for(j = 0; j < size; j++){
+            omp_init_lock(&(graph_lock[i][j]));
+        }
+    }
+    return graph_lock;
+}
+
+void freeLocks(omp_lock_t** graph_lock, int size){
+
+    int i, j;
+    for(i = 0; i < size; i++){
+        for(j = 0; j < size; j++){
             omp_destroy_lock(&(graph_lock[i][j]));
         }
         free(graph_lock[i]);
     }
     free(graph_lock);
-    freeGraph(graph, cube_size);
-    free(file);
-    return(EXIT_SUCCESS);
 }
 
-void visitNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, coordinate x, coordinate y, coordinate z){
+int chooseThreads(long work, double cost, int max_threads){
+    double threads = work * cost / PHASE_GRAIN;
+    if(threads < 1)
+        return 1;
+    return (threads > max_threads) ? max_threads : (int) threads;
+}
+
+double updateCost(double cost, double elapsed, int threads, long work){
+    if(work == 0)
+        return cost;
+    return COST_SMOOTHING * cost + (1 - COST_SMOOTHING) * (elapsed * threads / work);
+}
+
+double partitionRows(const long* weight, int n_rows, int n_parts, int* bounds){
+
+    int i, part = 1;
+    long total = 0, acc = 0, heaviest = 0;
+
+    for(i = 0; i < n_rows; i++)
+        total += weight[i];
+
+    /* Part p ends after the first row where the prefix sum reaches p/n_parts of the total */
+    bounds[0] = 0;
+    for(i = 0; i < n_rows && part < n_parts; i++){
+        acc += weight[i];
+        while(part < n_parts && acc * n_parts >= total * part)
+            bounds[part++] = i + 1;
+    }
+    while(part <= n_parts)
+        bounds[part++] = n_rows;
+
+    if(total == 0)
+        return 1.0;
+    for(part = 0; part < n_parts; part++){
+        acc = 0;
+        for(i = bounds[part]; i < bounds[part + 1]; i++)
+            acc += weight[i];
+        if(acc > heaviest)
+            heaviest = acc;
+    }
+    return (double) heaviest * n_parts / total;
+}
+
+void visitColumn(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, int mask, coordinate x, coordinate y){
+
+    GraphNode* it;
+    bool interior = (x > 0 && x < cube_size - 1 && y > 0 && y < cube_size - 1);
+    for(it = graph[x][y]; it != NULL; it = it->next){
+        if(it->state == ALIVE){
+            if(mask)
+                visitMaskedNeighbours(graph, graph_lock, mask, x, y, it->z);
+            else if(interior && it->z > 0 && it->z < cube_size - 1)
+                visitInternalNeighbours(graph, graph_lock, x, y, it->z);
+            else
+                visitBoundaryNeighbours(graph, graph_lock, cube_size, x, y, it->z);
+        }
+    }
+}
+
+void visitInternalNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, coordinate x, coordinate y, coordinate z){
+
+    graphNodeAddNeighbour(&(graph[x+1][y]), z, &(graph_lock[x+1][y]));
+    graphNodeAddNeighbour(&(graph[x-1][y]), z, &(graph_lock[x-1][y]));
+    graphNodeAddNeighbour(&(graph[x][y+1]), z, &(graph_lock[x][y+1]));
+    graphNodeAddNeighbour(&(graph[x][y-1]), z, &(graph_lock[x][y-1]));
+    graphNodeAddNeighbour(&(graph[x][y]), z+1, &(graph_lock[x][y]));
+    graphNodeAddNeighbour(&(graph[x][y]), z-1, &(graph_lock[x][y]));
+}
+
+void visitMaskedNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, int mask, coordinate x, coordinate y, coordinate z){
+
+    coordinate x1, x2, y1, y2, z1, z2;
+    x1 = (x+1) & mask; x2 = (x-1) & mask;
+    y1 = (y+1) & mask; y2 = (y-1) & mask;
+    z1 = (z+1) & mask; z2 = (z-1) & mask;
+    graphNodeAddNeighbour(&(graph[x1][y]), z, &(graph_lock[x1][y]));
+    graphNodeAddNeighbour(&(graph[x2][y]), z, &(graph_lock[x2][y]));
+    graphNodeAddNeighbour(&(graph[x][y1]), z, &(graph_lock[x][y1]));
+    graphNodeAddNeighbour(&(graph[x][y2]), z, &(graph_lock[x][y2]));
+    graphNodeAddNeighbour(&(graph[x][y]), z1, &(graph_lock[x][y]));
+    graphNodeAddNeighbour(&(graph[x][y]), z2, &(graph_lock[x][y]));
+}
+
+void visitBoundaryNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, coordinate x, coordinate y, coordinate z){
 
-    GraphNode* ptr;
     coordinate x1, x2, y1, y2, z1, z2;
-    x1 = (x+1)%cube_size; x2 = (x-1) < 0 ? (cube_size-1) : (x-1);
-    y1 = (y+1)%cube_size; y2 = (y-1) < 0 ? (cube_size-1) : (y-1);
-    z1 = (z+1)%cube_size; z2 = (z-1) < 0 ? (cube_size-1) : (z-1);
-    /* If a cell is visited for the first time, add it to the update list, for fast access */
+    x1 = (x+1 == cube_size) ? 0 : (x+1); x2 = (x == 0) ? (cube_size-1) : (x-1);
+    y1 = (y+1 == cube_size) ? 0 : (y+1); y2 = (y == 0) ? (cube_size-1) : (y-1);
+    z1 = (z+1 == cube_size) ? 0 : (z+1); z2 = (z == 0) ? (cube_size-1) : (z-1);
     graphNodeAddNeighbour(&(graph[x1][y]), z, &(graph_lock[x1][y]));
     graphNodeAddNeighbour(&(graph[x2][y]), z, &(graph_lock[x2][y]));
     graphNodeAddNeighbour(&(graph[x][y1]), z, &(graph_lock[x][y1]));
@@ -153,6 +380,25 @@ void printAndSortActive(GraphNode*** graph, int cube_size){
     }
 }
 
+void collectActive(GraphNode*** graph, int cube_size, int* live){
+    int x,y;
+    long n_live = 0;
+    GraphNode* it;
+    for (x = 0; x < cube_size; ++x){
+        for (y = 0; y < cube_size; ++y){
+            graphNodeSort(&(graph[x][y]));
+            for (it = graph[x][y]; it != NULL; it = it->next){
+                if (it->state == ALIVE){
+                    live[3 * n_live] = x;
+                    live[3 * n_live + 1] = y;
+                    live[3 * n_live + 2] = it->z;
+                    n_live++;
+                }
+            }
+        }
+    }
+}
+
 void parseArgs(int argc, char* argv[], char** file, int* generations){
     if (argc == 3){
         char* file_name = malloc(sizeof(char) * (strlen(argv[1]) + 1));
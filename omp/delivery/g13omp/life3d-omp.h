@@ -20,25 +20,175 @@
 #include "lists-omp.h"
 #include "debug.h"
 
+/* g13omp prefix: omp/life3d links this engine together with par_grid and its variants */
+#define chooseThreads g13omp_chooseThreads
+#define updateCost g13omp_updateCost
+#define partitionRows g13omp_partitionRows
+#define visitColumn g13omp_visitColumn
+#define visitInternalNeighbours g13omp_visitInternalNeighbours
+#define visitMaskedNeighbours g13omp_visitMaskedNeighbours
+#define visitBoundaryNeighbours g13omp_visitBoundaryNeighbours
+#define runGenerations g13omp_runGenerations
+#define countRows g13omp_countRows
+#define initLocks g13omp_initLocks
+#define freeLocks g13omp_freeLocks
+#define initGraph g13omp_initGraph
+#define freeGraph g13omp_freeGraph
+#define printAndSortActive g13omp_printAndSortActive
+#define collectActive g13omp_collectActive
+#define parseArgs g13omp_parseArgs
+#define parseFile g13omp_parseFile
+
 #define ALIVE 1             /**< Macro for representing a live cell */
 #define DEAD 0              /**< Macro for representing a dead cell */
 
 #define REMOVAL_PERIOD 5    /**< Number of generations between graph cleanup calls (removal of dead nodes) */
 #define BUFFER_SIZE 100     /**< Maximum length for a single infile line */
 
+#define PHASE_GRAIN 20e-6       /**< Least work, in seconds, worth giving a thread in a phase */
+#define DEFAULT_CELL_COST 1e-7  /**< Initial estimate of the seconds spent per cell in a phase */
+#define COST_SMOOTHING 0.5      /**< Weight of the previous estimate when a new cost is measured */
+
+#define IMBALANCE_LIMIT 1.25    /**< Heaviest row range over the fair share above which columns are dealt dynamically */
+#define COLUMN_CHUNK 16         /**< Columns taken at a time when dealt dynamically */
+
+#define IS_POWER_OF_TWO(n) ((n) > 0 && ((n) & ((n) - 1)) == 0)  /**< Whether the cube can wrap with a bitmask */
+
 typedef unsigned char bool;
 
-/** @brief Notifies the neighbours of (x,y,z) of its aliveness and adds them to list
+/** @brief Picks the number of threads for a phase
+ *
+ *  Enough threads for each to get PHASE_GRAIN seconds of work, from one
+ *  (serial execution) up to the whole team.
+ *
+ *  @param work Number of cells the phase will go through
+ *  @param cost Estimated thread-seconds per cell
+ *  @param max_threads Size of the team
+ *  @return The number of threads that should work in the phase.
+ */
+int chooseThreads(long work, double cost, int max_threads);
+
+/** @brief Updates the cost estimate of a phase with a new measurement
+ *
+ *  @param cost The previous estimate
+ *  @param elapsed Wall time of the phase
+ *  @param threads Number of threads that worked in the phase
+ *  @param work Number of cells the phase went through
+ *  @return The new estimate.
+ */
+double updateCost(double cost, double elapsed, int threads, long work);
+
+/** @brief Splits rows into ranges of about the same total weight
+ *
+ *  Part p gets rows bounds[p] to bounds[p+1]-1. The weights are the live
+ *  cells of each row, so the split follows from their prefix sum.
+ *
+ *  @param weight The weight of each row
+ *  @param n_rows Number of rows
+ *  @param n_parts Number of ranges
+ *  @param bounds Filled with the n_parts + 1 range bounds
+ *  @return The weight of the heaviest range over the fair share (1 is perfect balance).
+ */
+double partitionRows(const long* weight, int n_rows, int n_parts, int* bounds);
+
+/** @brief Notifies the neighbours of every live cell of the (x,y) column
  *
  *  @param graph The graph representation
+ *  @param graph_lock The per-list locks
  *  @param cube_size The size of the side of the cube that represents the 3D space
- *  @param list The list for keeping track of live cells and respective neighbours
+ *  @param mask cube_size - 1 if cube_size is a power of two, 0 otherwise
+ *  @param x X coordinate
+ *  @param y Y coordinate
+ *  @return Void.
+ */
+void visitColumn(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, int mask, coordinate x, coordinate y);
+
+/** @brief Notifies the neighbours of an interior cell of its aliveness
+ *
+ *  @attention x, y and z must all be in [1, cube_size-2], so that no
+ *  neighbour coordinate needs wrapping
+ *
+ *  @param graph The graph representation
+ *  @param graph_lock The per-list locks
+ *  @param x X coordinate
+ *  @param y Y coordinate
+ *  @param z Z coordinate
+ *  @return Void.
+ */
+void visitInternalNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, coordinate x, coordinate y, coordinate z);
+
+/** @brief Notifies the neighbours of (x,y,z) of its aliveness, in a power-of-two cube
+ *
+ *  @param graph The graph representation
+ *  @param graph_lock The per-list locks
+ *  @param mask The size of the side of the cube minus one
  *  @param x X coordinate
  *  @param y Y coordinate
  *  @param z Z coordinate
  *  @return Void.
  */
-void visitNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, coordinate x, coordinate y, coordinate z);
+void visitMaskedNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, int mask, coordinate x, coordinate y, coordinate z);
+
+/** @brief Notifies the neighbours of a cell on the boundary of the cube of its aliveness
+ *
+ *  @param graph The graph representation
+ *  @param graph_lock The per-list locks
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param x X coordinate
+ *  @param y Y coordinate
+ *  @param z Z coordinate
+ *  @return Void.
+ */
+void visitBoundaryNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, coordinate x, coordinate y, coordinate z);
+
+/** @brief Processes generations on the graph
+ *
+ *  @param graph The graph representation
+ *  @param graph_lock The per-list locks
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param row_live The live cells of each row, updated every generation
+ *  @param generations Number of generations to process
+ *  @return Void.
+ */
+void runGenerations(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, long* row_live, int generations);
+
+/** @brief Runs the engine from a list of cells, for omp/life3d
+ *
+ *  Building with -DLIFE3D_ENGINE leaves out main(), so that omp/life3d can
+ *  link the engine and select it with --engine.
+ *
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param cells The live cells, as x y z triples, without repetitions
+ *  @param n_cells The number of live cells
+ *  @param generations Number of generations to process
+ *  @param live Set to the final live cells, as x y z triples in ascending order, to be freed by the caller
+ *  @return The number of final live cells.
+ */
+long g13ompRun(int cube_size, const int* cells, long n_cells, int generations, int** live);
+
+/** @brief Counts the live cells of each row of the graph
+ *
+ *  @param graph The graph representation
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param row_live Filled with the live cells of each row
+ *  @return The number of live cells.
+ */
+long countRows(GraphNode*** graph, int cube_size, long* row_live);
+
+/** @brief Creates a lock for each list of the graph
+ *
+ *  @param size The size of the side of the cube that represents the 3D space
+ *  @return The initialized locks.
+ */
+omp_lock_t** initLocks(int size);
+
+/** @brief Destroys and frees the locks of the lists
+ *
+ *  @param graph_lock The per-list locks
+ *  @param size The size of the side of the cube that represents the 3D space
+ *  @return Void.
+ */
+void freeLocks(omp_lock_t** graph_lock, int size);
 
 /** @brief Initializes the graph representation structure
  *  
@@ -61,6 +211,15 @@ void freeGraph(GraphNode*** graph, int cube_size);
  */
 void printAndSortActive(GraphNode*** graph, int cube_size);
 
+/** @brief Copies the live cells of the graph, and sorts each of the lists
+ *
+ *  @param graph The graph representation
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param live Filled with the live cells, as x y z triples in ascending order
+ *  @return Void.
+ */
+void collectActive(GraphNode*** graph, int cube_size, int* live);
+
 /** @brief Parse command line arguments
  *
  *  @attention `input_name` will be dynamically allocated inside and must be freed 
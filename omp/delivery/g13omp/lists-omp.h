@@ -16,6 +16,14 @@
 #include <string.h>
 #include <omp.h>
 
+/* Prefixed with the engine name, see life3d-omp.h */
+#define graphNodeInsert g13omp_graphNodeInsert
+#define graphNodeRemove g13omp_graphNodeRemove
+#define graphNodeDelete g13omp_graphNodeDelete
+#define graphNodeAddNeighbour g13omp_graphNodeAddNeighbour
+#define graphNodeSort g13omp_graphNodeSort
+#define graphListCleanup g13omp_graphListCleanup
+
 #define true 1
 #define false 0
 
@@ -0,0 +1,145 @@
+/** @file autotune.cpp
+ *  @brief Picks the fastest engine, thread count and schedule for an input
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+
+#include "autotune.hpp"
+#include "io.hpp"
+
+/** @brief floor(log2(v)) for v >= 1 */
+static int floorLog2(double v){
+    return (int) std::floor(std::log2(v));
+}
+
+TuneKey tuneKey(int cube_size, std::size_t population, int max_threads,
+                const RuntimeRule& rule, const std::string& neighbourhood){
+    TuneKey key;
+    double volume = (double) cube_size * cube_size * cube_size;
+    key.size_bucket = (int) std::ceil(std::log2((double) cube_size));
+    key.population_bucket = floorLog2(population + 1.0);
+    key.density_bucket = (population == 0) ? -64 : floorLog2(population / volume);
+    key.max_threads = max_threads;
+    key.rule = rule.table;
+    key.neighbourhood = neighbourhood;
+    return key;
+}
+
+/** @brief Whether two keys name the same class of inputs */
+static bool sameKey(const TuneKey& a, const TuneKey& b){
+    return a.size_bucket == b.size_bucket && a.population_bucket == b.population_bucket &&
+           a.density_bucket == b.density_bucket && a.max_threads == b.max_threads &&
+           a.rule == b.rule && a.neighbourhood == b.neighbourhood;
+}
+
+bool lookupTuneCache(const std::string& cache, const TuneKey& key, TuneConfig& config){
+
+    char line[BUFFER_SIZE * 4], neighbourhood[BUFFER_SIZE], engine[BUFFER_SIZE], schedule[BUFFER_SIZE];
+    FILE* fp = fopen(cache.c_str(), "r");
+    if (fp == NULL)
+        return false;
+
+    /* Later lines override earlier ones */
+    bool found = false;
+    while (fgets(line, sizeof(line), fp)){
+        TuneKey entry;
+        TuneConfig candidate;
+        if (sscanf(line, "%d %d %d %d %" SCNx64 " %99s %99s %d %99s", &entry.size_bucket, &entry.population_bucket,
+                   &entry.density_bucket, &entry.max_threads, &entry.rule, neighbourhood, engine, &candidate.n_threads, schedule) != 9)
+            continue;
+        entry.neighbourhood = neighbourhood;
+        candidate.engine = engine;
+        if (sameKey(entry, key) && parseSchedule(schedule, candidate.schedule)){
+            config = candidate;
+            found = true;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+void storeTuneCache(const std::string& cache, const TuneKey& key, const TuneConfig& config){
+    FILE* fp = fopen(cache.c_str(), "a");
+    if (fp == NULL){
+        err_print("Could not write the tuning cache %s", cache.c_str());
+        return;
+    }
+    fprintf(fp, "%d %d %d %d %" PRIx64 " %s %s %d %s\n", key.size_bucket, key.population_bucket, key.density_bucket,
+            key.max_threads, key.rule, key.neighbourhood.c_str(), config.engine.c_str(),
+            config.n_threads, scheduleName(config.schedule).c_str());
+    fclose(fp);
+}
+
+/** @brief Runs one candidate on the input and returns its time */
+static double measure(const TuneConfig& config, int cube_size, const std::vector<CellKey>& cells,
+                      int generations, const RuntimeRule& rule, const std::string& neighbourhood){
+    omp_set_num_threads(config.n_threads);
+    std::unique_ptr<Engine> engine = createEngine(config.engine, config.n_threads, rule, neighbourhood);
+    engine->setSchedule(config.schedule);
+    engine->load(cube_size, cells);
+
+    double start = omp_get_wtime();
+    engine->step(generations);
+    double elapsed = omp_get_wtime() - start;
+
+    debug_print("TUNE: %s threads %d schedule %s: %f", config.engine.c_str(), config.n_threads,
+                scheduleName(config.schedule).c_str(), elapsed);
+    return elapsed;
+}
+
+TuneConfig calibrate(int cube_size, const std::vector<CellKey>& cells, int generations, int max_threads,
+                     const RuntimeRule& rule, const std::string& neighbourhood){
+
+    TuneConfig best;
+    double best_time = HUGE_VAL;
+
+    /* Engine, with all the threads it can use */
+    for (const EngineInfo& info : engineRegistry()){
+        if (!engineSupports(info, cube_size, rule, neighbourhood))
+            continue;
+        TuneConfig candidate;
+        candidate.engine = info.name;
+        candidate.n_threads = info.parallel ? max_threads : 1;
+        double time = measure(candidate, cube_size, cells, generations, rule, neighbourhood);
+        if (time < best_time){
+            best = candidate;
+            best_time = time;
+        }
+    }
+    if (best.n_threads == 1)
+        return best;
+
+    /* Thread count, by powers of two */
+    int all_threads = best.n_threads;
+    for (int n_threads = 1; n_threads < all_threads; n_threads *= 2){
+        TuneConfig candidate = best;
+        candidate.n_threads = n_threads;
+        double time = measure(candidate, cube_size, cells, generations, rule, neighbourhood);
+        if (time < best_time){
+            best = candidate;
+            best_time = time;
+        }
+    }
+    if (best.n_threads == 1)
+        return best;
+
+    /* Schedule of the main loop */
+    static const char* schedules[] = {"static,1", "dynamic,1", "dynamic,16", "guided"};
+    TuneConfig base = best;
+    for (const char* spec : schedules){
+        TuneConfig candidate = base;
+        parseSchedule(spec, candidate.schedule);
+        double time = measure(candidate, cube_size, cells, generations, rule, neighbourhood);
+        if (time < best_time){
+            best = candidate;
+            best_time = time;
+        }
+    }
+    return best;
+}
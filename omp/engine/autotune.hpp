@@ -0,0 +1,74 @@
+/** @file autotune.hpp
+ *  @brief Picks the fastest engine, thread count and schedule for an input
+ *
+ *  Candidates are timed on a few generations of the real input, one
+ *  dimension at a time: first the engine (all threads, static schedule),
+ *  then the thread count for that engine, then its schedule. The decision
+ *  is cached under the features of the input, so that later runs on
+ *  similar inputs skip calibration.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef AUTOTUNE_HPP
+#define AUTOTUNE_HPP
+
+#include <string>
+#include <vector>
+
+#include "registry.hpp"
+#include "schedule.hpp"
+
+#define CALIBRATION_GENERATIONS 5       /**< Generations timed per candidate */
+#define DEFAULT_TUNE_CACHE "life3d.tune" /**< File with the cached decisions */
+
+/** @brief A configuration: what the tuner decides */
+struct TuneConfig{
+    std::string engine = DEFAULT_ENGINE;    /**< Engine name */
+    int n_threads = 1;                      /**< Number of threads */
+    Schedule schedule;                      /**< Schedule of the main loop */
+};
+
+/** @brief Everything a decision depends on
+ *
+ *  Cube size, population and density are bucketed by powers of two,
+ *  so that close inputs share a decision.
+ */
+struct TuneKey{
+    int size_bucket;            /**< ceil(log2(cube size)) */
+    int population_bucket;      /**< floor(log2(live cells + 1)) */
+    int density_bucket;         /**< floor(log2(live cells / cube size^3)) */
+    int max_threads;            /**< Threads available on this machine */
+    uint64_t rule;              /**< Rule table */
+    std::string neighbourhood;  /**< Neighbourhood name */
+};
+
+/** @brief Computes the key of an input */
+TuneKey tuneKey(int cube_size, std::size_t population, int max_threads,
+                const RuntimeRule& rule, const std::string& neighbourhood);
+
+/** @brief Looks a key up in the cache file
+ *
+ *  @return Whether a decision was found.
+ */
+bool lookupTuneCache(const std::string& cache, const TuneKey& key, TuneConfig& config);
+
+/** @brief Appends a decision to the cache file */
+void storeTuneCache(const std::string& cache, const TuneKey& key, const TuneConfig& config);
+
+/** @brief Times the candidate configurations on the input and returns the fastest
+ *
+ *  @param cube_size The size of the side of the cube
+ *  @param cells The initial live cells
+ *  @param generations The number of generations to time per candidate
+ *  @param max_threads The largest thread count to try
+ *  @param rule The rule
+ *  @param neighbourhood The neighbourhood name
+ *  @return The fastest configuration.
+ */
+TuneConfig calibrate(int cube_size, const std::vector<CellKey>& cells, int generations, int max_threads,
+                     const RuntimeRule& rule, const std::string& neighbourhood);
+
+#endif
@@ -0,0 +1,99 @@
+/** @file c_engine.hpp
+ *  @brief The C engines, behind the Engine interface
+ *
+ *  par_grid, par_grid_list, par_grid_hash and delivery/g13omp are compiled
+ *  with -DLIFE3D_ENGINE, which leaves out their main(). Each one exposes a
+ *  single entry point that runs it from a list of cells.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef C_ENGINE_HPP
+#define C_ENGINE_HPP
+
+#include <cstdlib>
+#include <vector>
+
+#include "engine.hpp"
+
+#define C_ENGINE_MAX_CUBE_SIZE 65536    /**< Largest cube par_grid and par_grid_hash store, with their default COORD_BITS */
+
+extern "C" {
+
+/** @brief Entry point of a C engine
+ *
+ *  @param cube_size The size of the side of the cube
+ *  @param cells The live cells, as x y z triples, without repetitions
+ *  @param n_cells The number of live cells
+ *  @param generations Number of generations to process
+ *  @param live Set to the final live cells, as x y z triples in ascending order, to be freed by the caller
+ *  @return The number of final live cells.
+ */
+typedef long (*CEngineRun)(int cube_size, const int* cells, long n_cells, int generations, int** live);
+
+long parGridRun(int cube_size, const int* cells, long n_cells, int generations, int** live);
+long parGridListRun(int cube_size, const int* cells, long n_cells, int generations, int** live);
+long parGridHashRun(int cube_size, const int* cells, long n_cells, int generations, int** live);
+long g13ompRun(int cube_size, const int* cells, long n_cells, int generations, int** live);
+
+}
+
+/** @brief Whether a C engine can run a rule and neighbourhood
+ *
+ *  The C engines hardcode the project rule on the von Neumann neighbourhood.
+ */
+inline bool cEngineSupports(const RuntimeRule& rule, const std::string& neighbourhood){
+    return rule.table == DefaultRule::table && neighbourhood == VonNeumann::name;
+}
+
+/** @brief Exposes the C engine `Run` through the Engine interface
+ *
+ *  The C engines keep no state between calls, so every step() builds
+ *  the graph of the engine from the cells and tears it down again.
+ */
+template <CEngineRun Run>
+class CEngineAdapter : public Engine{
+    public:
+        CEngineAdapter(const RuntimeRule& rule, const std::string& neighbourhood){
+            if (!cEngineSupports(rule, neighbourhood)){
+                err_print("The C engines only run rule %s with the %s neighbourhood", DEFAULT_RULE, VonNeumann::name);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        void load(int cube_size, const std::vector<CellKey>& cells) override {
+            cube_size_ = cube_size;
+            cells_.clear();
+            cells_.reserve(3 * cells.size());
+            for (CellKey key : cells){
+                cells_.push_back(cellX(key));
+                cells_.push_back(cellY(key));
+                cells_.push_back(cellZ(key));
+            }
+        }
+
+        void step(int generations) override {
+            int* live;
+            long n_live = Run(cube_size_, cells_.data(), cells_.size() / 3, generations, &live);
+            cells_.assign(live, live + 3 * n_live);
+            free(live);
+        }
+
+        std::size_t population() const override { return cells_.size() / 3; }
+
+        std::vector<CellKey> cells() const override {
+            std::vector<CellKey> keys;
+            keys.reserve(cells_.size() / 3);
+            for (std::size_t i = 0; i < cells_.size(); i += 3)
+                keys.push_back(packCell(cells_[i], cells_[i + 1], cells_[i + 2]));
+            return keys;
+        }
+
+    private:
+        int cube_size_ = 0;         /**< The size of the side of the cube */
+        std::vector<int> cells_;    /**< Live cells, as x y z triples in ascending order */
+};
+
+#endif
@@ -0,0 +1,200 @@
+/** @file cell_set.hpp
+ *  @brief Flat open-addressing containers for packed cells
+ *
+ *  Cells are packed into a single 64-bit key (21 bits per coordinate) and
+ *  stored in power-of-two tables with linear probing. Clearing a table keeps
+ *  its capacity, so buffers are reused from one generation to the next.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef CELL_SET_HPP
+#define CELL_SET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+typedef uint64_t CellKey;
+
+#define COORD_BITS 21                               /**< Bits per packed coordinate */
+#define COORD_MASK ((CellKey(1) << COORD_BITS) - 1) /**< Mask for a single packed coordinate */
+#define EMPTY_KEY (~CellKey(0))                     /**< Marks a free slot, never a valid cell */
+#define MIN_CAPACITY 16                             /**< Smallest table size */
+
+/** @brief Packs (x,y,z) into a key whose natural order is (x,y,z) ascending */
+constexpr CellKey packCell(int x, int y, int z){
+    return (CellKey(x) << (2 * COORD_BITS)) | (CellKey(y) << COORD_BITS) | CellKey(z);
+}
+
+constexpr int cellX(CellKey key){ return int((key >> (2 * COORD_BITS)) & COORD_MASK); }
+constexpr int cellY(CellKey key){ return int((key >> COORD_BITS) & COORD_MASK); }
+constexpr int cellZ(CellKey key){ return int(key & COORD_MASK); }
+
+/** @brief Difference between the keys of a cell and its (dx,dy,dz) neighbour
+ *
+ *  Adding it to a key is exact as long as no coordinate wraps around.
+ */
+constexpr CellKey cellDelta(int dx, int dy, int dz){
+    return (CellKey(int64_t(dx)) << (2 * COORD_BITS)) + (CellKey(int64_t(dy)) << COORD_BITS) + CellKey(int64_t(dz));
+}
+
+/** @brief Scrambles a key so that neighbouring cells spread over the table */
+inline uint64_t hashCell(CellKey key){
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+/** @brief Rounds a requested number of elements up to a table capacity
+ *
+ *  Tables are kept at most half full.
+ */
+inline std::size_t tableCapacity(std::size_t elements){
+    std::size_t capacity = MIN_CAPACITY;
+    while (capacity < 2 * elements)
+        capacity <<= 1;
+    return capacity;
+}
+
+/** @brief Set of cells */
+class CellSet{
+    public:
+        explicit CellSet(std::size_t expected = 0) : size_(0) { keys_.assign(tableCapacity(expected), EMPTY_KEY); }
+
+        std::size_t size() const { return size_; }
+
+        /** @brief Grows the table, if needed, to hold `expected` elements */
+        void reserve(std::size_t expected){
+            if (tableCapacity(expected) > keys_.size())
+                rehash(tableCapacity(expected));
+        }
+
+        /** @brief Removes every element, keeping the allocated table */
+        void clear(){
+            if (size_ > 0)
+                std::fill(keys_.begin(), keys_.end(), EMPTY_KEY);
+            size_ = 0;
+        }
+
+        /** @brief Inserts a key
+         *  @return Whether the key was not yet present.
+         */
+        bool insert(CellKey key){
+            if (2 * (size_ + 1) > keys_.size())
+                rehash(keys_.size() * 2);
+            std::size_t mask = keys_.size() - 1;
+            for (std::size_t i = hashCell(key) & mask; ; i = (i + 1) & mask){
+                if (keys_[i] == key)
+                    return false;
+                if (keys_[i] == EMPTY_KEY){
+                    keys_[i] = key;
+                    size_++;
+                    return true;
+                }
+            }
+        }
+
+        bool contains(CellKey key) const {
+            std::size_t mask = keys_.size() - 1;
+            for (std::size_t i = hashCell(key) & mask; ; i = (i + 1) & mask){
+                if (keys_[i] == key)
+                    return true;
+                if (keys_[i] == EMPTY_KEY)
+                    return false;
+            }
+        }
+
+    private:
+        void rehash(std::size_t capacity){
+            std::vector<CellKey> old(capacity, EMPTY_KEY);
+            old.swap(keys_);
+            size_ = 0;
+            for (CellKey key : old){
+                if (key != EMPTY_KEY)
+                    insert(key);
+            }
+        }
+
+        std::size_t size_;              /**< Number of stored keys */
+        std::vector<CellKey> keys_;     /**< Slots, EMPTY_KEY when free */
+};
+
+/** @brief Map from cell to its number of live neighbours */
+class CountMap{
+    public:
+        explicit CountMap(std::size_t expected = 0) : size_(0) {
+            keys_.assign(tableCapacity(expected), EMPTY_KEY);
+            counts_.assign(keys_.size(), 0);
+        }
+
+        std::size_t size() const { return size_; }
+
+        /** @brief Grows the table, if needed, to hold `expected` elements */
+        void reserve(std::size_t expected){
+            if (tableCapacity(expected) > keys_.size())
+                rehash(tableCapacity(expected));
+        }
+
+        /** @brief Removes every element, keeping the allocated table */
+        void clear(){
+            if (size_ > 0){
+                std::fill(keys_.begin(), keys_.end(), EMPTY_KEY);
+                std::fill(counts_.begin(), counts_.end(), 0);
+            }
+            size_ = 0;
+        }
+
+        /** @brief Adds `count` to the counter of `key`, inserting it if needed */
+        void add(CellKey key, uint8_t count = 1){
+            if (2 * (size_ + 1) > keys_.size())
+                rehash(keys_.size() * 2);
+            std::size_t mask = keys_.size() - 1;
+            for (std::size_t i = hashCell(key) & mask; ; i = (i + 1) & mask){
+                if (keys_[i] == key){
+                    counts_[i] += count;
+                    return;
+                }
+                if (keys_[i] == EMPTY_KEY){
+                    keys_[i] = key;
+                    counts_[i] = count;
+                    size_++;
+                    return;
+                }
+            }
+        }
+
+        /** @brief Calls f(key, count) for every stored cell */
+        template <typename F>
+        void forEach(F f) const {
+            for (std::size_t i = 0; i < keys_.size(); i++){
+                if (keys_[i] != EMPTY_KEY)
+                    f(keys_[i], counts_[i]);
+            }
+        }
+
+    private:
+        void rehash(std::size_t capacity){
+            std::vector<CellKey> old_keys(capacity, EMPTY_KEY);
+            std::vector<uint8_t> old_counts(capacity, 0);
+            old_keys.swap(keys_);
+            old_counts.swap(counts_);
+            size_ = 0;
+            for (std::size_t i = 0; i < old_keys.size(); i++){
+                if (old_keys[i] != EMPTY_KEY)
+                    add(old_keys[i], old_counts[i]);
+            }
+        }
+
+        std::size_t size_;              /**< Number of stored keys */
+        std::vector<CellKey> keys_;     /**< Slots, EMPTY_KEY when free */
+        std::vector<uint8_t> counts_;   /**< Live neighbour counter of each slot */
+};
+
+#endif
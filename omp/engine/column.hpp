@@ -0,0 +1,271 @@
+/** @file column.hpp
+ *  @brief z-column that adapts its representation to its occupancy
+ *
+ *  Most columns are empty or hold a couple of cells, while clustered
+ *  regions fill whole columns. Each column therefore keeps its cells in
+ *  one of three forms, converting on growth and shrink:
+ *  - SMALL:  up to SMALL_CAPACITY entries inside the header, no allocation
+ *  - VECTOR: a sorted heap array of entries, binary searched
+ *  - BITMAP: a cube_size bit live map and a byte counter per z, O(1) access
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef COLUMN_HPP
+#define COLUMN_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <sched.h>
+
+#include "grid.hpp"
+
+#define SMALL_CAPACITY 4        /**< Entries kept inside the column header */
+#define DENSE_DIVISOR 8         /**< A column becomes a bitmap once it holds cube_size / DENSE_DIVISOR entries */
+#define SPARSE_DIVISOR 16       /**< and goes back to a vector once it has fewer than cube_size / SPARSE_DIVISOR live cells */
+#define COLUMN_SPIN_LIMIT 64    /**< Failed attempts at a column lock before yielding the processor */
+
+/** @brief The cells of an (x,y) column that are alive or have live neighbours */
+class AdaptiveColumn{
+    public:
+        enum Kind : uint8_t { SMALL, VECTOR, BITMAP };
+
+        AdaptiveColumn() = default;
+        AdaptiveColumn(const AdaptiveColumn&) = delete;
+        AdaptiveColumn& operator=(const AdaptiveColumn&) = delete;
+
+        ~AdaptiveColumn(){ release(); }
+
+        Kind kind() const { return kind_; }
+
+        /** @brief Live cells, as of the last call to decide() */
+        unsigned live() const { return live_; }
+
+        void lock(){
+            int spins = 0;
+            while (lock_.test_and_set(std::memory_order_acquire)){
+                if (++spins == COLUMN_SPIN_LIMIT){
+                    sched_yield();
+                    spins = 0;
+                }
+            }
+        }
+
+        void unlock(){ lock_.clear(std::memory_order_release); }
+
+        /** @brief Makes z alive, when loading a generation */
+        void setAlive(int z, int cube_size){
+            if (kind_ == BITMAP){
+                live_ += !testBit(z);
+                setBit(z);
+                return;
+            }
+            Entry* entry = find(z, cube_size);
+            if (entry != NULL){
+                live_ += (entry->state != ALIVE);
+                entry->state = ALIVE;
+            }else{
+                setAlive(z, cube_size);
+            }
+        }
+
+        /** @brief Increments the counter of z, inserting it if needed */
+        void addNeighbour(int z, int cube_size){
+            if (kind_ == BITMAP){
+                bitmap_.counts[z]++;
+                return;
+            }
+            Entry* entry = find(z, cube_size);
+            if (entry != NULL)
+                entry->neighbours++;
+            else
+                addNeighbour(z, cube_size);
+        }
+
+        /** @brief Calls f(z) for every live cell, in ascending order of z */
+        template <class F>
+        void forEachAlive(F f) const {
+            if (kind_ == BITMAP){
+                for (std::size_t w = 0; w < words_; w++){
+                    for (uint64_t bits = bitmap_.bits[w]; bits != 0; bits &= bits - 1)
+                        f(int(w * 64 + __builtin_ctzll(bits)));
+                }
+                return;
+            }
+            const Entry* entries = data();
+            for (uint32_t i = 0; i < size_; i++){
+                if (entries[i].state == ALIVE)
+                    f(entries[i].z);
+            }
+        }
+
+        /** @brief Applies the rule to every cell, clears the counters and drops the dead cells
+         *
+         *  The representation is then shrunk if the column emptied enough.
+         *
+         *  @return The number of live cells.
+         */
+        template <class R>
+        unsigned decide(const R& rule, int cube_size){
+            live_ = 0;
+            if (kind_ == BITMAP){
+                for (int z = 0; z < cube_size; z++){
+                    uint8_t alive = testBit(z);
+                    if (!alive && bitmap_.counts[z] == 0)
+                        continue;
+                    if (rule.next(alive, bitmap_.counts[z])){
+                        setBit(z);
+                        live_++;
+                    }else{
+                        clearBit(z);
+                    }
+                    bitmap_.counts[z] = 0;
+                }
+                if (live_ < unsigned(cube_size / SPARSE_DIVISOR))
+                    toVector();
+                return live_;
+            }
+            Entry* entries = data();
+            for (uint32_t i = 0; i < size_; i++){
+                if (rule.next(entries[i].state, entries[i].neighbours))
+                    entries[live_++] = Entry{entries[i].z, ALIVE, 0};
+            }
+            size_ = live_;
+            /* Only shrink well below the inline capacity, so that columns around it do not reallocate every generation */
+            if (kind_ == VECTOR && size_ <= SMALL_CAPACITY / 2)
+                toSmall();
+            return live_;
+        }
+
+    private:
+        /** @brief A cell of a SMALL or VECTOR column */
+        struct Entry{
+            int32_t z;              /**< Coordinate z */
+            uint8_t state;          /**< Current state */
+            uint8_t neighbours;     /**< Live neighbour counter */
+        };
+
+        Entry* data(){ return kind_ == SMALL ? small_ : vector_.data; }
+        const Entry* data() const { return kind_ == SMALL ? small_ : vector_.data; }
+
+        uint8_t testBit(int z) const { return (bitmap_.bits[z >> 6] >> (z & 63)) & 1; }
+        void setBit(int z){ bitmap_.bits[z >> 6] |= uint64_t(1) << (z & 63); }
+        void clearBit(int z){ bitmap_.bits[z >> 6] &= ~(uint64_t(1) << (z & 63)); }
+
+        /** @brief Looks z up in a SMALL or VECTOR column
+         *
+         *  If z is missing, a DEAD entry is inserted unless the column first
+         *  had to become a bitmap, in which case NULL is returned.
+         */
+        Entry* find(int z, int cube_size){
+            Entry* entries = data();
+            uint32_t lo = 0, hi = size_;
+            while (lo < hi){
+                uint32_t mid = (lo + hi) / 2;
+                if (entries[mid].z < z)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo < size_ && entries[lo].z == z)
+                return &entries[lo];
+
+            if (size_ == capacity()){
+                if (size_ >= SMALL_CAPACITY && size_ + 1 >= uint32_t(cube_size / DENSE_DIVISOR)){
+                    toBitmap(cube_size);
+                    return NULL;
+                }
+                grow();
+                entries = data();
+            }
+            std::memmove(&entries[lo + 1], &entries[lo], (size_ - lo) * sizeof(Entry));
+            entries[lo] = Entry{z, DEAD, 0};
+            size_++;
+            return &entries[lo];
+        }
+
+        uint32_t capacity() const { return kind_ == SMALL ? SMALL_CAPACITY : vector_.capacity; }
+
+        /** @brief Doubles the capacity of the entry array, leaving SMALL if needed */
+        void grow(){
+            uint32_t capacity = 2 * this->capacity();
+            Entry* entries = new Entry[capacity];
+            std::memcpy(entries, data(), size_ * sizeof(Entry));
+            if (kind_ == VECTOR)
+                delete[] vector_.data;
+            kind_ = VECTOR;
+            vector_.data = entries;
+            vector_.capacity = capacity;
+        }
+
+        void toBitmap(int cube_size){
+            words_ = (cube_size + 63) / 64;
+            uint64_t* bits = new uint64_t[words_]();
+            uint8_t* counts = new uint8_t[cube_size]();
+            const Entry* entries = data();
+            for (uint32_t i = 0; i < size_; i++){
+                if (entries[i].state == ALIVE)
+                    bits[entries[i].z >> 6] |= uint64_t(1) << (entries[i].z & 63);
+                counts[entries[i].z] = entries[i].neighbours;
+            }
+            release();
+            kind_ = BITMAP;
+            bitmap_.bits = bits;
+            bitmap_.counts = counts;
+            size_ = 0;
+        }
+
+        void toVector(){
+            uint32_t capacity = SMALL_CAPACITY;
+            while (capacity < 2 * live_)
+                capacity *= 2;
+            Entry* entries = new Entry[capacity];
+            uint32_t size = 0;
+            forEachAlive([&](int z){ entries[size++] = Entry{z, ALIVE, 0}; });
+            release();
+            kind_ = VECTOR;
+            vector_.data = entries;
+            vector_.capacity = capacity;
+            size_ = size;
+        }
+
+        void toSmall(){
+            Entry* entries = vector_.data;
+            std::memcpy(small_, entries, size_ * sizeof(Entry));
+            delete[] entries;
+            kind_ = SMALL;
+        }
+
+        void release(){
+            if (kind_ == VECTOR){
+                delete[] vector_.data;
+            }else if (kind_ == BITMAP){
+                delete[] bitmap_.bits;
+                delete[] bitmap_.counts;
+            }
+            kind_ = SMALL;
+            size_ = 0;
+        }
+
+        Kind kind_ = SMALL;                         /**< Current representation */
+        std::atomic_flag lock_ = ATOMIC_FLAG_INIT;  /**< Guards insertions during the notify pass */
+        uint32_t size_ = 0;                         /**< Entries of a SMALL or VECTOR column */
+        uint32_t live_ = 0;                         /**< Live cells */
+        uint32_t words_ = 0;                        /**< 64-bit words of a BITMAP column */
+        union{
+            Entry small_[SMALL_CAPACITY];           /**< SMALL: the entries, sorted by z */
+            struct{
+                Entry* data;                        /**< The entries, sorted by z */
+                uint32_t capacity;                  /**< Allocated entries */
+            } vector_;                              /**< VECTOR */
+            struct{
+                uint64_t* bits;                     /**< Bit z is set if z is alive */
+                uint8_t* counts;                    /**< Live neighbour counter of each z */
+            } bitmap_;                              /**< BITMAP */
+        };
+};
+
+#endif
@@ -0,0 +1,107 @@
+/** @file column_grid.hpp
+ *  @brief 2D grid of adaptive z-columns engine, templated on rule and neighbourhood
+ *
+ *  Same passes as the grid engine, over AdaptiveColumn instead of linked
+ *  z-lists: tiny columns never allocate, and dense ones are bitmaps with
+ *  O(1) insertion and lookup. Dead cells are dropped while deciding, so no
+ *  periodic cleanup is needed.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef COLUMN_GRID_HPP
+#define COLUMN_GRID_HPP
+
+#include <memory>
+#include <vector>
+#include <omp.h>
+
+#include "cell_set.hpp"
+#include "column.hpp"
+#include "neighbourhood.hpp"
+#include "wrap.hpp"
+
+/** @brief Engine over a 2D grid of adaptive z-columns */
+class ColumnGridEngine{
+    public:
+        void load(int cube_size, const std::vector<CellKey>& cells){
+            cube_size_ = cube_size;
+            n_columns_ = static_cast<std::size_t>(cube_size) * cube_size;
+            columns_.reset(new AdaptiveColumn[n_columns_]);
+            for (CellKey key : cells)
+                column(cellX(key), cellY(key)).setAlive(cellZ(key), cube_size);
+        }
+
+        int cubeSize() const { return cube_size_; }
+
+        template <class N, class W, class R>
+        void run(int generations, const R& rule, const W& wrap){
+            const int size = cube_size_;
+
+            #pragma omp parallel
+            {
+                std::vector<int> alive;     /**< Live cells of the column being notified */
+
+                for (int g = 1; g <= generations; g++){
+
+                    /* First passage - notify neighbours.
+                     * The live cells are copied out first, since notifications may reshape the column */
+                    #pragma omp for collapse(2) schedule(runtime)
+                    for (int x = 0; x < size; x++){
+                        for (int y = 0; y < size; y++){
+                            AdaptiveColumn& own = column(x, y);
+                            if (own.live() == 0)
+                                continue;
+                            alive.clear();
+                            own.lock();
+                            own.forEachAlive([&](int z){ alive.push_back(z); });
+                            own.unlock();
+                            for (int z : alive){
+                                for (const Offset& o : N::offsets){
+                                    AdaptiveColumn& target = column(wrap(x + o.dx), wrap(y + o.dy));
+                                    target.lock();
+                                    target.addNeighbour(wrap(z + o.dz), size);
+                                    target.unlock();
+                                }
+                            }
+                        }
+                    }
+
+                    /* Second passage - decide next state */
+                    #pragma omp for schedule(static)
+                    for (std::size_t c = 0; c < n_columns_; c++)
+                        columns_[c].decide(rule, size);
+                }
+            }
+        }
+
+        std::size_t population() const {
+            std::size_t population = 0;
+            for (std::size_t c = 0; c < n_columns_; c++)
+                population += columns_[c].live();
+            return population;
+        }
+
+        /** @brief Live cells, in ascending (x,y,z) order */
+        std::vector<CellKey> cells() const {
+            std::vector<CellKey> cells;
+            cells.reserve(population());
+            for (int x = 0; x < cube_size_; x++){
+                for (int y = 0; y < cube_size_; y++)
+                    columns_[index(x, y)].forEachAlive([&](int z){ cells.push_back(packCell(x, y, z)); });
+            }
+            return cells;
+        }
+
+    private:
+        std::size_t index(int x, int y) const { return static_cast<std::size_t>(x) * cube_size_ + y; }
+        AdaptiveColumn& column(int x, int y){ return columns_[index(x, y)]; }
+
+        int cube_size_ = 0;                             /**< Size of the side of the cube */
+        std::size_t n_columns_ = 0;                     /**< cube_size^2 */
+        std::unique_ptr<AdaptiveColumn[]> columns_;     /**< The (x,y) columns */
+};
+
+#endif
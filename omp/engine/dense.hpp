@@ -0,0 +1,111 @@
+/** @file dense.hpp
+ *  @brief Dense engine, templated on rule and neighbourhood
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef DENSE_HPP
+#define DENSE_HPP
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+#include "cell_set.hpp"
+#include "grid.hpp"
+#include "neighbourhood.hpp"
+#include "wrap.hpp"
+
+/** @brief Computes the next generation of `current` into `next`
+ *
+ *  For each (x,y) column, the live neighbour counters of the whole column
+ *  are accumulated one offset at a time, and then looked up in the rule.
+ *  Along z only the two end cells of a column need wrapping, so they are
+ *  handled apart from the interior loop.
+ *  Columns are independent, so the sweep is split across threads.
+ *
+ *  @param current The current generation (read only)
+ *  @param next The buffer to be filled with the next generation
+ *  @param rule The rule
+ *  @param wrap The wrap policy for the cube size
+ */
+template <class N, class W, class R>
+void denseStep(const Grid& current, Grid& next, const R& rule, const W& wrap){
+
+    const int size = current.size();
+
+    #pragma omp parallel
+    {
+        std::vector<uint8_t> counts(size);
+
+        #pragma omp for collapse(2) schedule(runtime)
+        for (int x = 0; x < size; ++x){
+            for (int y = 0; y < size; ++y){
+                std::fill(counts.begin(), counts.end(), 0);
+                for (const Offset& o : N::offsets){
+                    const uint8_t* column = current.column(wrap(x + o.dx), wrap(y + o.dy));
+                    const int lo = (o.dz < 0) ? 1 : 0;
+                    const int hi = (o.dz > 0) ? size - 1 : size;
+                    for (int z = lo; z < hi; ++z){
+                        counts[z] += column[z + o.dz];
+                    }
+                    if (o.dz < 0) counts[0] += column[wrap(-1)];
+                    if (o.dz > 0) counts[size - 1] += column[wrap(size)];
+                }
+                const uint8_t* self = current.column(x, y);
+                uint8_t* out = next.column(x, y);
+                for (int z = 0; z < size; ++z){
+                    out[z] = rule.next(self[z], counts[z]);
+                }
+            }
+        }
+    }
+}
+
+/** @brief Engine over a dense cube, with double buffering */
+class DenseEngine{
+    public:
+        void load(int cube_size, const std::vector<CellKey>& cells){
+            graph_ = Grid(cube_size);
+            next_ = Grid(cube_size);
+            for (CellKey key : cells)
+                graph_.set(cellX(key), cellY(key), cellZ(key), ALIVE);
+        }
+
+        int cubeSize() const { return graph_.size(); }
+
+        template <class N, class W, class R>
+        void run(int generations, const R& rule, const W& wrap){
+            for (int g = 1; g <= generations; g++){
+                denseStep<N>(graph_, next_, rule, wrap);
+                std::swap(graph_, next_);
+            }
+        }
+
+        std::size_t population() const { return graph_.population(); }
+
+        /** @brief Live cells, in ascending (x,y,z) order */
+        std::vector<CellKey> cells() const {
+            std::vector<CellKey> cells;
+            const int size = graph_.size();
+            for (int x = 0; x < size; ++x){
+                for (int y = 0; y < size; ++y){
+                    const uint8_t* column = graph_.column(x, y);
+                    for (int z = 0; z < size; ++z){
+                        if (column[z] == ALIVE)
+                            cells.push_back(packCell(x, y, z));
+                    }
+                }
+            }
+            return cells;
+        }
+
+    private:
+        Grid graph_;    /**< The current generation */
+        Grid next_;     /**< Buffer for the next generation */
+};
+
+#endif
@@ -0,0 +1,91 @@
+/** @file dispatch.hpp
+ *  @brief Selection of a kernel instantiation from rule and neighbourhood names
+ *
+ *  Every engine is instantiated for each neighbourhood with the runtime rule,
+ *  and for the preset rules below with their compile-time tables, each one
+ *  for both wrap policies. Adding a preset is one line in selectRunner().
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef DISPATCH_HPP
+#define DISPATCH_HPP
+
+#include <string>
+
+#include "debug.h"
+#include "neighbourhood.hpp"
+#include "rule.hpp"
+#include "wrap.hpp"
+
+#define DEFAULT_RULE "B2-3/S2-4"        /**< The project rule */
+#define DEFAULT_NEIGHBOURHOOD "vn6"     /**< The project neighbourhood */
+
+/** @brief Runs `generations` generations of an engine under a rule */
+template <class E>
+using Runner = void (*)(E& engine, int generations, const RuntimeRule& rule);
+
+template <class E, class N, class W, class R>
+void runPreset(E& engine, int generations, const RuntimeRule&){
+    engine.template run<N>(generations, R(), W(engine.cubeSize()));
+}
+
+template <class E, class N, class W>
+void runRuntime(E& engine, int generations, const RuntimeRule& rule){
+    engine.template run<N>(generations, rule, W(engine.cubeSize()));
+}
+
+/** @brief Picks the instantiation of engine `E` for a rule and neighbourhood */
+template <class E, class W>
+Runner<E> selectRunner(const RuntimeRule& rule, const std::string& neighbourhood){
+    if (neighbourhood == VonNeumann::name){
+        if (rule.table == DefaultRule::table) return runPreset<E, VonNeumann, W, DefaultRule>;
+        return runRuntime<E, VonNeumann, W>;
+    }
+    if (neighbourhood == Moore::name){
+        if (rule.table == Bays4555Rule::table) return runPreset<E, Moore, W, Bays4555Rule>;
+        if (rule.table == Bays5766Rule::table) return runPreset<E, Moore, W, Bays5766Rule>;
+        return runRuntime<E, Moore, W>;
+    }
+    return NULL;
+}
+
+/** @brief Picks the instantiation of engine `E` for a rule, neighbourhood and cube size
+ *
+ *  @param rule The parsed rule
+ *  @param neighbourhood The neighbourhood name
+ *  @param cube_size The size of the side of the cube
+ *  @return The runner, or NULL if the neighbourhood is unknown.
+ */
+template <class E>
+Runner<E> selectRunner(const RuntimeRule& rule, const std::string& neighbourhood, int cube_size){
+    if (isPowerOfTwo(cube_size))
+        return selectRunner<E, MaskWrap>(rule, neighbourhood);
+    return selectRunner<E, CompareWrap>(rule, neighbourhood);
+}
+
+/** @brief Parses rule and neighbourhood, exiting on invalid input
+ *
+ *  @param rule_spec The rule string
+ *  @param neighbourhood The neighbourhood name
+ *  @param cube_size The size of the side of the cube
+ *  @param rule The parsed rule
+ *  @return The runner for engine `E`.
+ */
+template <class E>
+Runner<E> selectRunnerOrExit(const std::string& rule_spec, const std::string& neighbourhood, int cube_size, RuntimeRule& rule){
+    if (!parseRule(rule_spec, rule)){
+        err_print("Invalid rule %s, expected e.g. %s, without 0 in B or S", rule_spec.c_str(), DEFAULT_RULE);
+        exit(EXIT_FAILURE);
+    }
+    Runner<E> runner = selectRunner<E>(rule, neighbourhood, cube_size);
+    if (runner == NULL){
+        err_print("Unknown neighbourhood %s, expected %s or %s", neighbourhood.c_str(), VonNeumann::name, Moore::name);
+        exit(EXIT_FAILURE);
+    }
+    return runner;
+}
+
+#endif
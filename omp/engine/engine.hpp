@@ -0,0 +1,85 @@
+/** @file engine.hpp
+ *  @brief Common interface over all the engines
+ *
+ *  The engines themselves are plain classes with templated kernels; an
+ *  EngineAdapter binds one of them to a rule and neighbourhood, so that
+ *  drivers can pick the engine at run time.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef ENGINE_HPP
+#define ENGINE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "cell_set.hpp"
+#include "dispatch.hpp"
+#include "schedule.hpp"
+
+/** @brief An engine, bound to a rule and neighbourhood */
+class Engine{
+    public:
+        virtual ~Engine() {}
+
+        /** @brief Replaces the current generation
+         *
+         *  @param cube_size The size of the side of the cube
+         *  @param cells The live cells, without repetitions
+         */
+        virtual void load(int cube_size, const std::vector<CellKey>& cells) = 0;
+
+        /** @brief Advances `generations` generations */
+        virtual void step(int generations) = 0;
+
+        /** @brief Number of live cells */
+        virtual std::size_t population() const = 0;
+
+        /** @brief Live cells, in ascending (x,y,z) order */
+        virtual std::vector<CellKey> cells() const = 0;
+
+        /** @brief Sets the schedule of the main loop of each generation */
+        void setSchedule(const Schedule& schedule){ schedule_ = schedule; }
+
+    protected:
+        Schedule schedule_;     /**< Schedule of the schedule(runtime) loops */
+};
+
+/** @brief Exposes engine `E` through the Engine interface */
+template <class E>
+class EngineAdapter : public Engine{
+    public:
+        template <class... Args>
+        EngineAdapter(const RuntimeRule& rule, const std::string& neighbourhood, Args... args)
+            : rule_(rule), neighbourhood_(neighbourhood), engine_(args...) {}
+
+        void load(int cube_size, const std::vector<CellKey>& cells) override {
+            engine_.load(cube_size, cells);
+            runner_ = selectRunner<E>(rule_, neighbourhood_, cube_size);
+            if (runner_ == NULL){
+                err_print("Unknown neighbourhood %s, expected %s or %s", neighbourhood_.c_str(), VonNeumann::name, Moore::name);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        void step(int generations) override {
+            ::setSchedule(schedule_);
+            runner_(engine_, generations, rule_);
+        }
+
+        std::size_t population() const override { return engine_.population(); }
+
+        std::vector<CellKey> cells() const override { return engine_.cells(); }
+
+    private:
+        RuntimeRule rule_;              /**< The rule */
+        std::string neighbourhood_;     /**< The neighbourhood name */
+        E engine_;                      /**< The wrapped engine */
+        Runner<E> runner_ = NULL;       /**< Kernel instantiation for the loaded cube */
+};
+
+#endif
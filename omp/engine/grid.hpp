@@ -0,0 +1,62 @@
+/** @file grid.hpp
+ *  @brief Dense cube of cells stored in a single contiguous buffer
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef GRID_HPP
+#define GRID_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define ALIVE 1             /**< Macro for representing a live cell */
+#define DEAD 0              /**< Macro for representing a dead cell */
+
+/** @brief Maps (x,y,z) to its offset in a flat cube buffer
+ *
+ *  @param size The size of the side of the cube
+ *  @param x X coordinate
+ *  @param y Y coordinate
+ *  @param z Z coordinate
+ *  @return The offset of the cell in a row-major x,y,z buffer.
+ */
+constexpr std::size_t cellIndex(int size, int x, int y, int z){
+    return (static_cast<std::size_t>(x) * size + y) * size + z;
+}
+
+/** @brief Dense cube of cells
+ *
+ *  Move-only, so that swapping two grids never copies the cube.
+ */
+class Grid{
+    public:
+        explicit Grid(int size = 0) : size_(size), cells_(static_cast<std::size_t>(size) * size * size, DEAD) {}
+
+        Grid(const Grid&) = delete;
+        Grid& operator=(const Grid&) = delete;
+        Grid(Grid&&) noexcept = default;
+        Grid& operator=(Grid&&) noexcept = default;
+
+        int size() const { return size_; }
+
+        uint8_t get(int x, int y, int z) const { return cells_[cellIndex(size_, x, y, z)]; }
+        void set(int x, int y, int z, uint8_t state){ cells_[cellIndex(size_, x, y, z)] = state; }
+
+        /** @brief Raw pointer to the start of the (x,y) column */
+        const uint8_t* column(int x, int y) const { return &cells_[cellIndex(size_, x, y, 0)]; }
+        uint8_t* column(int x, int y){ return &cells_[cellIndex(size_, x, y, 0)]; }
+
+        /** @brief Number of live cells */
+        std::size_t population() const { return std::count(cells_.begin(), cells_.end(), ALIVE); }
+
+    private:
+        int size_;                  /**< Size of the side of the cube */
+        std::vector<uint8_t> cells_; /**< size^3 cell states */
+};
+
+#endif
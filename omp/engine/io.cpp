@@ -0,0 +1,133 @@
+/** @file io.cpp
+ *  @brief Input and output shared by the C++ engines
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "io.hpp"
+
+void parseArgs(int argc, char* argv[], std::string& file, int& generations,
+               std::string& rule, std::string& neighbourhood){
+    if (argc >= 3 && argc <= 5){
+        file = argv[1];
+        generations = atoi(argv[2]);
+        if (argc >= 4)
+            rule = argv[3];
+        if (argc == 5)
+            neighbourhood = argv[4];
+        if (generations > 0 && !file.empty())
+            return;
+    }
+    printf("Usage: %s [data_file.in] [number_generations] [rule] [neighbourhood]\n", argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+void parseFile(const std::string& file, int& cube_size, std::vector<CellKey>& cells){
+
+    int first = 0;
+    char line[BUFFER_SIZE];
+    int x, y, z;
+    FILE* fp = fopen(file.c_str(), "r");
+    if (fp == NULL){
+        err_print("Please input a valid file name");
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(line, sizeof(line), fp)){
+        if (!first){
+            if (sscanf(line, "%d\n", &cube_size) == 1)
+                first = 1;
+        }else{
+            if (sscanf(line, "%d %d %d\n", &x, &y, &z) == 3)
+                cells.push_back(packCell(x, y, z));
+        }
+    }
+    fclose(fp);
+
+    /* Drop repeated lines, so that every cell is counted once */
+    std::sort(cells.begin(), cells.end());
+    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+}
+
+bool parseFormat(const std::string& name, CellFormat& format){
+    if (name == "text") format = FORMAT_TEXT;
+    else if (name == "binary") format = FORMAT_BINARY;
+    else if (name == "count") format = FORMAT_COUNT;
+    else if (name == "none") format = FORMAT_NONE;
+    else return false;
+    return true;
+}
+
+/** @brief Reads a FORMAT_BINARY file */
+static void parseBinaryFile(const std::string& file, int& cube_size, std::vector<CellKey>& cells){
+
+    char magic[BINARY_MAGIC_SIZE];
+    int32_t size;
+    uint16_t xyz[3];
+    size_t n;
+    FILE* fp = fopen(file.c_str(), "rb");
+    if (fp == NULL){
+        err_print("Please input a valid file name");
+        exit(EXIT_FAILURE);
+    }
+    if (fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, BINARY_MAGIC, BINARY_MAGIC_SIZE) != 0
+        || fread(&size, sizeof(size), 1, fp) != 1 || size <= 0){
+        err_print("Invalid binary header in %s", file.c_str());
+        exit(EXIT_FAILURE);
+    }
+    cube_size = size;
+    while ((n = fread(xyz, sizeof(uint16_t), 3, fp)) == 3){
+        cells.push_back(packCell(xyz[0], xyz[1], xyz[2]));
+    }
+    if (n != 0){
+        err_print("Truncated binary file %s", file.c_str());
+        exit(EXIT_FAILURE);
+    }
+    fclose(fp);
+
+    std::sort(cells.begin(), cells.end());
+    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+}
+
+void readCells(const std::string& file, CellFormat format, int& cube_size, std::vector<CellKey>& cells){
+    if (format == FORMAT_BINARY)
+        parseBinaryFile(file, cube_size, cells);
+    else
+        parseFile(file, cube_size, cells);
+}
+
+void writeCells(const std::vector<CellKey>& cells, int cube_size, CellFormat format){
+#ifndef BENCHMARK
+    if (format == FORMAT_BINARY){
+        int32_t size = cube_size;
+        if (cube_size > BINARY_MAX_CUBE_SIZE){
+            err_print("Cube size %d does not fit the binary format, at most %d", cube_size, BINARY_MAX_CUBE_SIZE);
+            exit(EXIT_FAILURE);
+        }
+        fwrite(BINARY_MAGIC, BINARY_MAGIC_SIZE, 1, stdout);
+        fwrite(&size, sizeof(size), 1, stdout);
+        for (CellKey key : cells){
+            uint16_t xyz[3] = {uint16_t(cellX(key)), uint16_t(cellY(key)), uint16_t(cellZ(key))};
+            fwrite(xyz, sizeof(xyz), 1, stdout);
+        }
+        return;
+    }
+    for (CellKey key : cells){
+        printf("%d %d %d\n", cellX(key), cellY(key), cellZ(key));
+    }
+#endif
+}
+
+void printAndSortActive(std::vector<CellKey>& cells){
+    /* Packed keys sort in (x,y,z) order */
+    std::sort(cells.begin(), cells.end());
+    for (CellKey key : cells){
+        out_print("%d %d %d\n", cellX(key), cellY(key), cellZ(key));
+    }
+}
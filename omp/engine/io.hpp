@@ -0,0 +1,93 @@
+/** @file io.hpp
+ *  @brief Input and output shared by the C++ engines
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef IO_HPP
+#define IO_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "cell_set.hpp"
+#include "debug.h"
+
+#define BUFFER_SIZE 100     /**< Maximum length for a single infile line */
+#define BINARY_MAGIC "L3DB" /**< First bytes of a binary cell file, see README.md */
+#define BINARY_MAGIC_SIZE 4 /**< Length of BINARY_MAGIC */
+#define BINARY_MAX_CUBE_SIZE 65536  /**< Largest cube whose coordinates fit the 16-bit cells of a binary file */
+
+/** @brief Formats for reading and writing sets of cells
+ *
+ *  FORMAT_TEXT is the project's format: the cube size on the first line,
+ *  then one "x y z" line per cell. FORMAT_BINARY is the L3DB format the MPI
+ *  engines also read and write, described in README.md. Output may also be
+ *  reduced to the number of live cells (FORMAT_COUNT) or skipped (FORMAT_NONE).
+ */
+enum CellFormat{
+    FORMAT_TEXT,
+    FORMAT_BINARY,
+    FORMAT_COUNT,
+    FORMAT_NONE
+};
+
+/** @brief Parse command line arguments
+ *
+ *  Usage: [data_file.in] [number_generations] [rule] [neighbourhood],
+ *  where the last two are optional.
+ *
+ *  @param argc Number of arguments
+ *  @param argv Argument strings
+ *  @param file The name of the input file
+ *  @param generations The number of generations to be processed
+ *  @param rule The rule string, left untouched if not given
+ *  @param neighbourhood The neighbourhood name, left untouched if not given
+ */
+void parseArgs(int argc, char* argv[], std::string& file, int& generations,
+               std::string& rule, std::string& neighbourhood);
+
+/** @brief Parse input file contents
+ *
+ *  @param file Filename string
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param cells Filled with the initial live cells, without repetitions
+ */
+void parseFile(const std::string& file, int& cube_size, std::vector<CellKey>& cells);
+
+/** @brief Parses a format name: "text", "binary", "count" or "none"
+ *
+ *  @return Whether the name was valid.
+ */
+bool parseFormat(const std::string& name, CellFormat& format);
+
+/** @brief Reads a set of cells in the given format
+ *
+ *  @param file Filename string
+ *  @param format FORMAT_TEXT or FORMAT_BINARY
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param cells Filled with the live cells, without repetitions
+ */
+void readCells(const std::string& file, CellFormat format, int& cube_size, std::vector<CellKey>& cells);
+
+/** @brief Writes a set of cells to stdout in the given format
+ *
+ *  Nothing is written when compiled with BENCHMARK.
+ *
+ *  @param cells The live cells, in ascending (x,y,z) order
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param format FORMAT_TEXT or FORMAT_BINARY
+ */
+void writeCells(const std::vector<CellKey>& cells, int cube_size, CellFormat format);
+
+/** @brief Sorts the live cells and prints them in ascending (x,y,z) order
+ *
+ *  @param cells The live cells
+ */
+void printAndSortActive(std::vector<CellKey>& cells);
+
+#endif
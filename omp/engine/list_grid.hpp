@@ -0,0 +1,173 @@
+/** @file list_grid.hpp
+ *  @brief 2D grid of z-lists engine, templated on rule and neighbourhood
+ *
+ *  Port of par_grid: each (x,y) column holds a linked list of the cells
+ *  that are alive or have live neighbours. Live cells notify their
+ *  neighbours under a per-column lock, new nodes being pushed at the head
+ *  of the list so that concurrent traversals are never disturbed, and dead
+ *  nodes are removed every REMOVAL_PERIOD generations.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef LIST_GRID_HPP
+#define LIST_GRID_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <omp.h>
+
+#include "cell_set.hpp"
+#include "grid.hpp"
+#include "neighbourhood.hpp"
+#include "wrap.hpp"
+
+#define REMOVAL_PERIOD 5    /**< Number of generations between graph cleanup calls (removal of dead nodes) */
+
+/** @brief Engine over a 2D grid of z-lists */
+class ListGridEngine{
+    public:
+        ListGridEngine() = default;
+        ListGridEngine(const ListGridEngine&) = delete;
+        ListGridEngine& operator=(const ListGridEngine&) = delete;
+
+        ~ListGridEngine(){ release(); }
+
+        void load(int cube_size, const std::vector<CellKey>& cells){
+            release();
+            cube_size_ = cube_size;
+            graph_.assign(static_cast<std::size_t>(cube_size) * cube_size, NULL);
+            locks_.resize(graph_.size());
+            for (omp_lock_t& lock : locks_)
+                omp_init_lock(&lock);
+            for (CellKey key : cells){
+                GraphNode*& head = column(cellX(key), cellY(key));
+                head = new GraphNode{cellZ(key), ALIVE, 0, head};
+            }
+        }
+
+        int cubeSize() const { return cube_size_; }
+
+        template <class N, class W, class R>
+        void run(int generations, const R& rule, const W& wrap){
+            const int size = cube_size_;
+
+            #pragma omp parallel
+            for (int g = 1; g <= generations; g++){
+
+                /* First passage in the graph - notify neighbours */
+                #pragma omp for collapse(2) schedule(runtime)
+                for (int x = 0; x < size; x++){
+                    for (int y = 0; y < size; y++){
+                        for (GraphNode* it = column(x, y); it != NULL; it = it->next){
+                            if (it->state != ALIVE)
+                                continue;
+                            for (const Offset& o : N::offsets)
+                                addNeighbour(wrap(x + o.dx), wrap(y + o.dy), wrap(it->z + o.dz));
+                        }
+                    }
+                }
+
+                /* Second passage in the graph - decide next state */
+                #pragma omp for schedule(static)
+                for (std::size_t c = 0; c < graph_.size(); c++){
+                    for (GraphNode* it = graph_[c]; it != NULL; it = it->next){
+                        it->state = rule.next(it->state, it->neighbours);
+                        it->neighbours = 0;
+                    }
+                }
+
+                /* Remove dead nodes from the graph every REMOVAL_PERIOD generations */
+                if (g % REMOVAL_PERIOD == 0){
+                    #pragma omp for schedule(static)
+                    for (std::size_t c = 0; c < graph_.size(); c++)
+                        cleanup(graph_[c]);
+                }
+            }
+        }
+
+        std::size_t population() const {
+            std::size_t population = 0;
+            for (GraphNode* head : graph_){
+                for (GraphNode* it = head; it != NULL; it = it->next)
+                    population += (it->state == ALIVE);
+            }
+            return population;
+        }
+
+        /** @brief Live cells, in ascending (x,y,z) order */
+        std::vector<CellKey> cells() const {
+            std::vector<CellKey> cells;
+            for (int x = 0; x < cube_size_; x++){
+                for (int y = 0; y < cube_size_; y++){
+                    for (GraphNode* it = graph_[index(x, y)]; it != NULL; it = it->next){
+                        if (it->state == ALIVE)
+                            cells.push_back(packCell(x, y, it->z));
+                    }
+                }
+            }
+            std::sort(cells.begin(), cells.end());
+            return cells;
+        }
+
+    private:
+        /** @brief Node of a z-list */
+        struct GraphNode{
+            int z;                  /**< Coordinate z */
+            uint8_t state;          /**< Current state */
+            uint8_t neighbours;     /**< Live neighbour counter */
+            GraphNode* next;        /**< Next node in the column */
+        };
+
+        std::size_t index(int x, int y) const { return static_cast<std::size_t>(x) * cube_size_ + y; }
+        GraphNode*& column(int x, int y){ return graph_[index(x, y)]; }
+
+        /** @brief Increments the counter of (x,y,z), inserting it if needed */
+        void addNeighbour(int x, int y, int z){
+            std::size_t c = index(x, y);
+            omp_set_lock(&locks_[c]);
+            GraphNode* it;
+            for (it = graph_[c]; it != NULL && it->z != z; it = it->next);
+            if (it != NULL)
+                it->neighbours++;
+            else
+                graph_[c] = new GraphNode{z, DEAD, 1, graph_[c]};
+            omp_unset_lock(&locks_[c]);
+        }
+
+        /** @brief Removes the dead nodes of a column */
+        static void cleanup(GraphNode*& head){
+            GraphNode** cur = &head;
+            while (*cur != NULL){
+                GraphNode* entry = *cur;
+                if (entry->state == DEAD){
+                    *cur = entry->next;
+                    delete entry;
+                }else{
+                    cur = &entry->next;
+                }
+            }
+        }
+
+        void release(){
+            for (GraphNode*& head : graph_){
+                while (head != NULL){
+                    GraphNode* next = head->next;
+                    delete head;
+                    head = next;
+                }
+            }
+            for (omp_lock_t& lock : locks_)
+                omp_destroy_lock(&lock);
+            locks_.clear();
+        }
+
+        int cube_size_ = 0;                 /**< Size of the side of the cube */
+        std::vector<GraphNode*> graph_;     /**< Head of the z-list of each (x,y) column */
+        std::vector<omp_lock_t> locks_;     /**< One lock per column */
+};
+
+#endif
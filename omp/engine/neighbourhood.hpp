@@ -0,0 +1,59 @@
+/** @file neighbourhood.hpp
+ *  @brief Neighbourhoods as compile-time offset tables
+ *
+ *  A neighbourhood is any type with a `static constexpr` array `offsets`
+ *  of relative (dx,dy,dz) positions, each component in [-1,1], and a
+ *  `name`. Kernels iterate over `offsets`, which the compiler unrolls.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef NEIGHBOURHOOD_HPP
+#define NEIGHBOURHOOD_HPP
+
+#include <array>
+
+/** @brief Relative position of a neighbour */
+struct Offset{
+    int dx;
+    int dy;
+    int dz;
+};
+
+/** @brief Wraps a coordinate that is at most one step outside [0,size) */
+constexpr int wrapCoord(int v, int size){
+    return (v < 0) ? v + size : ((v >= size) ? v - size : v);
+}
+
+/** @brief The six face neighbours (the project's original neighbourhood) */
+struct VonNeumann{
+    static constexpr const char* name = "vn6";
+    static constexpr std::array<Offset, 6> offsets = {{
+        {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+    }};
+};
+
+/** @brief Builds the 26 cells of the 3x3x3 cube around the origin */
+constexpr std::array<Offset, 26> mooreOffsets(){
+    std::array<Offset, 26> offsets{};
+    int i = 0;
+    for (int dx = -1; dx <= 1; dx++){
+        for (int dy = -1; dy <= 1; dy++){
+            for (int dz = -1; dz <= 1; dz++){
+                if (dx != 0 || dy != 0 || dz != 0)
+                    offsets[i++] = Offset{dx, dy, dz};
+            }
+        }
+    }
+    return offsets;
+}
+
+/** @brief Face, edge and corner neighbours */
+struct Moore{
+    static constexpr const char* name = "moore26";
+    static constexpr std::array<Offset, 26> offsets = mooreOffsets();
+};
+
+#endif
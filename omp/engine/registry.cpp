@@ -0,0 +1,69 @@
+/** @file registry.cpp
+ *  @brief Table of the engines that can be selected by name
+ *
+ *  Every kernel instantiation is compiled here, once, so the drivers
+ *  only ever see the Engine interface.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#include "c_engine.hpp"
+#include "column_grid.hpp"
+#include "dense.hpp"
+#include "list_grid.hpp"
+#include "registry.hpp"
+#include "sparse.hpp"
+
+template <class E>
+std::unique_ptr<Engine> create(int, const RuntimeRule& rule, const std::string& neighbourhood){
+    return std::unique_ptr<Engine>(new EngineAdapter<E>(rule, neighbourhood));
+}
+
+template <class E>
+std::unique_ptr<Engine> createThreaded(int n_threads, const RuntimeRule& rule, const std::string& neighbourhood){
+    return std::unique_ptr<Engine>(new EngineAdapter<E>(rule, neighbourhood, n_threads));
+}
+
+template <CEngineRun Run>
+std::unique_ptr<Engine> createC(int, const RuntimeRule& rule, const std::string& neighbourhood){
+    return std::unique_ptr<Engine>(new CEngineAdapter<Run>(rule, neighbourhood));
+}
+
+const std::vector<EngineInfo>& engineRegistry(){
+    static const std::vector<EngineInfo> registry = {
+        {"dense",   "dense cube with double buffering (seq_3d_matrix_swap)", true, DENSE_MAX_CUBE_SIZE, false, create<DenseEngine>},
+        {"grid",    "2D grid of z-lists with per-column locks (par_grid)", true, 0, false, create<ListGridEngine>},
+        {"columns", "2D grid of z-columns stored as inline arrays, vectors or bitmaps", true, 0, false, create<ColumnGridEngine>},
+        {"sparse",  "sequential hash set of live cells (seq_sets)", false, 0, false, create<SparseEngine>},
+        {"sharded", "hash set of live cells, sharded across threads (seq_sets)", true, 0, false, createThreaded<ShardedSparseEngine>},
+        {"par_grid",      "C engine: 2D grid of pooled z-lists, with tasks", true, C_ENGINE_MAX_CUBE_SIZE, true, createC<parGridRun>},
+        {"par_grid_list", "C engine: 2D grid of z-lists, with a frontier of live cells", true, 0, true, createC<parGridListRun>},
+        {"par_grid_hash", "C engine: 2D grid of z-lists, with a hashtable of live cells", true, C_ENGINE_MAX_CUBE_SIZE, true, createC<parGridHashRun>},
+        {"g13omp",        "C engine: 2D grid of z-lists, as delivered (delivery/g13omp)", true, 0, true, createC<g13ompRun>},
+    };
+    return registry;
+}
+
+const EngineInfo* findEngine(const std::string& name){
+    for (const EngineInfo& info : engineRegistry()){
+        if (name == info.name)
+            return &info;
+    }
+    return NULL;
+}
+
+bool engineSupports(const EngineInfo& info, int cube_size, const RuntimeRule& rule, const std::string& neighbourhood){
+    if (info.max_cube_size != 0 && cube_size > info.max_cube_size)
+        return false;
+    return !info.project_rule_only || cEngineSupports(rule, neighbourhood);
+}
+
+std::unique_ptr<Engine> createEngine(const std::string& name, int n_threads,
+                                     const RuntimeRule& rule, const std::string& neighbourhood){
+    const EngineInfo* info = findEngine(name);
+    if (info == NULL)
+        return NULL;
+    return info->create(n_threads, rule, neighbourhood);
+}
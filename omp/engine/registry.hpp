@@ -0,0 +1,66 @@
+/** @file registry.hpp
+ *  @brief Table of the engines that can be selected by name
+ *
+ *  Both the C++ engines and the C engines (par_grid, par_grid_list,
+ *  par_grid_hash and delivery/g13omp) are registered; grid is the C++
+ *  port of par_grid.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef REGISTRY_HPP
+#define REGISTRY_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine.hpp"
+
+#define DEFAULT_ENGINE "sharded"    /**< Engine used when none is requested */
+#define DENSE_MAX_CUBE_SIZE 1024    /**< Two 1024^3 byte buffers, 2GB */
+
+/** @brief A registered engine */
+struct EngineInfo{
+    const char* name;           /**< Name given to --engine */
+    const char* description;    /**< One line summary, for the usage message */
+    bool parallel;              /**< Whether the engine uses more than one thread */
+    int max_cube_size;          /**< Largest cube the engine can hold in memory, 0 if unbounded */
+    bool project_rule_only;     /**< Whether the engine only runs the project rule and neighbourhood */
+    std::unique_ptr<Engine> (*create)(int n_threads, const RuntimeRule& rule, const std::string& neighbourhood);
+};
+
+/** @brief All the registered engines */
+const std::vector<EngineInfo>& engineRegistry();
+
+/** @brief Finds a registered engine
+ *
+ *  @param name The engine name
+ *  @return The engine, or NULL if the name is unknown.
+ */
+const EngineInfo* findEngine(const std::string& name);
+
+/** @brief Whether an engine can run a cube, rule and neighbourhood
+ *
+ *  @param info The engine
+ *  @param cube_size The size of the side of the cube
+ *  @param rule The rule
+ *  @param neighbourhood The neighbourhood name
+ *  @return Whether the cube fits in max_cube_size and the engine implements the rule.
+ */
+bool engineSupports(const EngineInfo& info, int cube_size, const RuntimeRule& rule, const std::string& neighbourhood);
+
+/** @brief Creates an engine by name
+ *
+ *  @param name The engine name
+ *  @param n_threads The number of threads the engine may use
+ *  @param rule The rule
+ *  @param neighbourhood The neighbourhood name
+ *  @return The engine, or NULL if the name is unknown.
+ */
+std::unique_ptr<Engine> createEngine(const std::string& name, int n_threads,
+                                     const RuntimeRule& rule, const std::string& neighbourhood);
+
+#endif
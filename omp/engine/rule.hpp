@@ -0,0 +1,109 @@
+/** @file rule.hpp
+ *  @brief Birth/survival rules as neighbour-count bitmasks
+ *
+ *  Bit n of `birth` (resp. `survive`) is set when a dead (resp. live) cell
+ *  with n live neighbours is alive in the next generation. Both masks are
+ *  packed into a single 64-bit table, so deciding a cell is one shift.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef RULE_HPP
+#define RULE_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#define MAX_NEIGHBOURS 31   /**< Largest neighbour count a rule can refer to */
+
+/** @brief Mask with the bits lo..hi (inclusive) set */
+constexpr uint32_t countRange(int lo, int hi){
+    return (hi < lo) ? 0 : ((1u << lo) | countRange(lo + 1, hi));
+}
+
+/** @brief Packs birth and survival masks into a lookup table */
+constexpr uint64_t ruleTable(uint32_t birth, uint32_t survive){
+    return uint64_t(birth) | (uint64_t(survive) << 32);
+}
+
+/** @brief Rule fixed at compile time */
+template <uint32_t Birth, uint32_t Survive>
+struct Rule{
+    static constexpr uint64_t table = ruleTable(Birth, Survive);
+
+    static constexpr uint8_t next(uint8_t alive, int live_neighbours){
+        return (table >> (live_neighbours + (alive << 5))) & 1;
+    }
+};
+
+/** @brief Rule chosen at run time, for rules without a compiled preset */
+struct RuntimeRule{
+    uint64_t table;
+
+    uint8_t next(uint8_t alive, int live_neighbours) const {
+        return (table >> (live_neighbours + (alive << 5))) & 1;
+    }
+};
+
+/** Born with 2 or 3 live neighbours, survives with 2 to 4 (the project rule) */
+typedef Rule<countRange(2, 3), countRange(2, 4)> DefaultRule;
+/** Bays' 4555: born with 5, survives with 4 or 5 (Moore neighbourhood) */
+typedef Rule<countRange(5, 5), countRange(4, 5)> Bays4555Rule;
+/** Bays' 5766: born with 6, survives with 5 to 7 (Moore neighbourhood) */
+typedef Rule<countRange(6, 6), countRange(5, 7)> Bays5766Rule;
+
+/** @brief Parses a count list such as "2-4" or "2,3,5" into a mask
+ *
+ *  @return Whether the list was valid.
+ */
+inline bool parseCounts(const std::string& list, uint32_t& mask){
+    std::size_t pos = 0;
+    mask = 0;
+    while (pos < list.size()){
+        char* end;
+        long lo = strtol(list.c_str() + pos, &end, 10), hi = lo;
+        if (end == list.c_str() + pos)
+            return false;
+        if (*end == '-'){
+            const char* start = end + 1;
+            hi = strtol(start, &end, 10);
+            if (end == start)
+                return false;
+        }
+        if (lo < 0 || hi > MAX_NEIGHBOURS || hi < lo)
+            return false;
+        mask |= countRange(lo, hi);
+        pos = end - list.c_str();
+        if (pos < list.size() && list[pos++] != ',')
+            return false;
+    }
+    return true;
+}
+
+/** @brief Parses a rule of the form "B<counts>/S<counts>", e.g. "B2-3/S2-4"
+ *
+ *  Rules that give birth to, or keep, cells without live neighbours are
+ *  rejected: every engine but dense only decides the cells next to live
+ *  ones, so they would silently disagree.
+ *
+ *  @param spec The rule string
+ *  @param rule The parsed rule
+ *  @return Whether the rule was valid.
+ */
+inline bool parseRule(const std::string& spec, RuntimeRule& rule){
+    std::size_t slash = spec.find('/');
+    if (slash == std::string::npos || spec[0] != 'B' || spec[slash + 1] != 'S')
+        return false;
+    uint32_t birth, survive;
+    if (!parseCounts(spec.substr(1, slash - 1), birth) || !parseCounts(spec.substr(slash + 2), survive))
+        return false;
+    if ((birth | survive) & countRange(0, 0))
+        return false;
+    rule.table = ruleTable(birth, survive);
+    return true;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/** @file schedule.hpp
+ *  @brief OpenMP loop schedules chosen at run time
+ *
+ *  The main loop of each engine is declared schedule(runtime), so the
+ *  schedule is whatever was set with setSchedule() before running it.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef SCHEDULE_HPP
+#define SCHEDULE_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <omp.h>
+
+/** @brief An OpenMP schedule kind with its chunk size (0 for the default) */
+struct Schedule{
+    omp_sched_t kind = omp_sched_static;
+    int chunk = 0;
+};
+
+/** @brief Sets the schedule of the schedule(runtime) loops that follow */
+inline void setSchedule(const Schedule& schedule){
+    omp_set_schedule(schedule.kind, schedule.chunk);
+}
+
+/** @brief Parses "static", "dynamic", "guided" or "auto", optionally followed by ",chunk"
+ *
+ *  @return Whether the schedule was valid.
+ */
+inline bool parseSchedule(const std::string& spec, Schedule& schedule){
+    std::size_t comma = spec.find(',');
+    std::string kind = spec.substr(0, comma);
+    if (kind == "static") schedule.kind = omp_sched_static;
+    else if (kind == "dynamic") schedule.kind = omp_sched_dynamic;
+    else if (kind == "guided") schedule.kind = omp_sched_guided;
+    else if (kind == "auto") schedule.kind = omp_sched_auto;
+    else return false;
+    schedule.chunk = 0;
+    if (comma != std::string::npos){
+        char* end;
+        schedule.chunk = strtol(spec.c_str() + comma + 1, &end, 10);
+        if (*end != '\0' || schedule.chunk <= 0)
+            return false;
+    }
+    return true;
+}
+
+/** @brief Formats a schedule as accepted by parseSchedule() */
+inline std::string scheduleName(const Schedule& schedule){
+    const char* kind = "static";
+    if (schedule.kind == omp_sched_dynamic) kind = "dynamic";
+    else if (schedule.kind == omp_sched_guided) kind = "guided";
+    else if (schedule.kind == omp_sched_auto) kind = "auto";
+    if (schedule.chunk == 0)
+        return kind;
+    return std::string(kind) + "," + std::to_string(schedule.chunk);
+}
+
+#endif
@@ -0,0 +1,220 @@
+/** @file sparse.hpp
+ *  @brief Sparse hash set engines, templated on rule and neighbourhood
+ *
+ *  Each generation, every live cell adds one to the counter of each of its
+ *  neighbours, and the counters are then checked against the live set.
+ *  Live cells without live neighbours never get a counter, so they die,
+ *  which holds for every rule with bit 0 of the survival mask unset.
+ *  Work is proportional to the number of live cells, as in par_grid_hash.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef SPARSE_HPP
+#define SPARSE_HPP
+
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+
+#include "cell_set.hpp"
+#include "neighbourhood.hpp"
+#include "wrap.hpp"
+
+#define SHARDS_PER_THREAD 4 /**< Number of shards per thread, for balancing the merge */
+
+/** @brief Adds one to the counter of every neighbour of `key`
+ *
+ *  Interior cells reach their neighbours by adding a constant to the key.
+ */
+template <class N, class W, class Map>
+inline void notifyNeighbours(CellKey key, const W& wrap, Map& counts){
+    int x = cellX(key), y = cellY(key), z = cellZ(key);
+    if (wrap.isInterior(x, y, z)){
+        for (const Offset& o : N::offsets){
+            counts.add(key + cellDelta(o.dx, o.dy, o.dz));
+        }
+        return;
+    }
+    for (const Offset& o : N::offsets){
+        counts.add(packCell(wrap(x + o.dx), wrap(y + o.dy), wrap(z + o.dz)));
+    }
+}
+
+/** @brief Sequential sparse engine */
+class SparseEngine{
+    public:
+        void load(int cube_size, const std::vector<CellKey>& cells){
+            cube_size_ = cube_size;
+            cells_ = cells;
+            live_.clear();
+            live_.reserve(cells_.size());
+            for (CellKey key : cells_)
+                live_.insert(key);
+        }
+
+        int cubeSize() const { return cube_size_; }
+
+        template <class N, class W, class R>
+        void run(int generations, const R& rule, const W& wrap){
+            for (int g = 1; g <= generations; g++){
+
+                /* Notify the neighbours of every live cell */
+                counts_.clear();
+                counts_.reserve(N::offsets.size() * cells_.size());
+                for (CellKey key : cells_)
+                    notifyNeighbours<N>(key, wrap, counts_);
+
+                /* Decide the next state of every notified cell */
+                next_.clear();
+                counts_.forEach([&](CellKey key, uint8_t live_neighbours){
+                    if (rule.next(live_.contains(key), live_neighbours))
+                        next_.push_back(key);
+                });
+
+                live_.clear();
+                live_.reserve(next_.size());
+                for (CellKey key : next_)
+                    live_.insert(key);
+                cells_.swap(next_);
+            }
+        }
+
+        std::size_t population() const { return cells_.size(); }
+
+        /** @brief Live cells, in ascending (x,y,z) order */
+        std::vector<CellKey> cells() const {
+            std::vector<CellKey> cells = cells_;
+            std::sort(cells.begin(), cells.end());
+            return cells;
+        }
+
+    private:
+        int cube_size_ = 0;             /**< Size of the side of the cube */
+        std::vector<CellKey> cells_;    /**< The live cells of the current generation */
+        std::vector<CellKey> next_;     /**< The live cells of the next generation */
+        CellSet live_;                  /**< Set view of `cells_`, for membership tests */
+        CountMap counts_;               /**< Live neighbour counters of the candidate cells */
+};
+
+/** @brief Parallel sparse engine
+ *
+ *  Cells are split into shards by hash: each thread counts neighbours into
+ *  its own per-shard maps, and then each shard is merged, decided and
+ *  rebuilt by a single thread, so no locks are needed.
+ */
+class ShardedSparseEngine{
+    public:
+        explicit ShardedSparseEngine(int n_threads = omp_get_max_threads())
+            : n_threads_(n_threads), n_shards_(n_threads * SHARDS_PER_THREAD),
+              live_(n_shards_), counts_(n_shards_), next_(n_shards_), offsets_(n_shards_ + 1, 0) {}
+
+        void load(int cube_size, const std::vector<CellKey>& cells){
+            cube_size_ = cube_size;
+            cells_ = cells;
+            for (CellSet& shard : live_)
+                shard.clear();
+            for (CellKey key : cells_)
+                live_[shardOf(key)].insert(key);
+        }
+
+        int cubeSize() const { return cube_size_; }
+
+        template <class N, class W, class R>
+        void run(int generations, const R& rule, const W& wrap){
+            int team = 0;   /**< Threads actually in the team, which may be fewer than asked for */
+
+            #pragma omp parallel num_threads(n_threads_)
+            {
+                #pragma omp single
+                {
+                    team = omp_get_num_threads();
+                    local_.resize(team, std::vector<CountMap>(n_shards_));
+                }
+                std::vector<CountMap>& mine = local_[omp_get_thread_num()];
+                ShardRouter router{*this, mine};
+
+                for (int g = 1; g <= generations; g++){
+
+                    /* Notify the neighbours of every live cell, into thread-local maps */
+                    std::size_t expected = N::offsets.size() * cells_.size() / (team * n_shards_) + 1;
+                    for (CountMap& shard : mine){
+                        shard.clear();
+                        shard.reserve(expected);
+                    }
+                    #pragma omp for schedule(runtime)
+                    for (std::size_t i = 0; i < cells_.size(); i++){
+                        notifyNeighbours<N>(cells_[i], wrap, router);
+                    }
+
+                    /* Merge each shard, decide its cells and rebuild its live set */
+                    #pragma omp for schedule(dynamic, 1)
+                    for (int s = 0; s < n_shards_; s++){
+                        CountMap& counts = counts_[s];
+                        counts.clear();
+                        counts.reserve(live_[s].size() * 2);
+                        for (int u = 0; u < team; u++){
+                            local_[u][s].forEach([&](CellKey key, uint8_t c){ counts.add(key, c); });
+                        }
+                        next_[s].clear();
+                        counts.forEach([&](CellKey key, uint8_t live_neighbours){
+                            if (rule.next(live_[s].contains(key), live_neighbours))
+                                next_[s].push_back(key);
+                        });
+                        live_[s].clear();
+                        live_[s].reserve(next_[s].size());
+                        for (CellKey key : next_[s])
+                            live_[s].insert(key);
+                    }
+
+                    /* Concatenate the shards into the new live cell array */
+                    #pragma omp single
+                    {
+                        for (int s = 0; s < n_shards_; s++)
+                            offsets_[s + 1] = offsets_[s] + next_[s].size();
+                        cells_.resize(offsets_[n_shards_]);
+                    }
+                    #pragma omp for schedule(dynamic, 1)
+                    for (int s = 0; s < n_shards_; s++){
+                        std::copy(next_[s].begin(), next_[s].end(), cells_.begin() + offsets_[s]);
+                    }
+                }
+            }
+        }
+
+        std::size_t population() const { return cells_.size(); }
+
+        /** @brief Live cells, in ascending (x,y,z) order */
+        std::vector<CellKey> cells() const {
+            std::vector<CellKey> cells = cells_;
+            std::sort(cells.begin(), cells.end());
+            return cells;
+        }
+
+    private:
+        /** @brief Routes a counter increment to the thread-local map of the shard of `key` */
+        struct ShardRouter{
+            const ShardedSparseEngine& engine;
+            std::vector<CountMap>& shards;
+            void add(CellKey key){ shards[engine.shardOf(key)].add(key); }
+        };
+
+        /** @brief Returns the shard a cell belongs to */
+        int shardOf(CellKey key) const {
+            return (int)((hashCell(key) >> 32) % n_shards_);
+        }
+
+        int n_threads_;                                 /**< Size of the thread team asked for */
+        int n_shards_;                                  /**< Number of shards */
+        int cube_size_ = 0;                             /**< Size of the side of the cube */
+        std::vector<CellKey> cells_;                    /**< The live cells of the current generation */
+        std::vector<CellSet> live_;                     /**< Live cells, per shard */
+        std::vector<CountMap> counts_;                  /**< Merged neighbour counters, per shard */
+        std::vector<std::vector<CellKey> > next_;       /**< Next generation live cells, per shard */
+        std::vector<std::vector<CountMap> > local_;     /**< Thread-local neighbour counters, per shard, one entry per thread of the team */
+        std::vector<std::size_t> offsets_;              /**< Position of each shard in `cells_` */
+};
+
+#endif
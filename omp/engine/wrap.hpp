@@ -0,0 +1,52 @@
+/** @file wrap.hpp
+ *  @brief Toroidal wrap policies
+ *
+ *  Kernels are instantiated once per policy and the policy is picked from
+ *  the cube size at dispatch: power-of-two cubes wrap with a bitmask and
+ *  never branch, other sizes wrap with a compare and split the cube in an
+ *  interior, where no wrap is needed at all, and a boundary.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef WRAP_HPP
+#define WRAP_HPP
+
+#include "neighbourhood.hpp"
+
+/** @brief Whether `size` is a power of two */
+constexpr bool isPowerOfTwo(int size){
+    return size > 0 && (size & (size - 1)) == 0;
+}
+
+/** @brief Wrap for power-of-two cubes: -1 & mask == size - 1 and size & mask == 0 */
+struct MaskWrap{
+    int mask;
+
+    explicit MaskWrap(int size) : mask(size - 1) {}
+
+    int operator()(int v) const { return v & mask; }
+
+    /** @brief Wrapping is free, so no cell needs the unwrapped path */
+    bool isInterior(int, int, int) const { return false; }
+};
+
+/** @brief Wrap for any cube size */
+struct CompareWrap{
+    int size;
+
+    explicit CompareWrap(int cube_size) : size(cube_size) {}
+
+    int operator()(int v) const { return wrapCoord(v, size); }
+
+    /** @brief Whether every neighbour of (x,y,z) is inside the cube without wrapping */
+    bool isInterior(int x, int y, int z) const {
+        return (unsigned)(x - 1) < (unsigned)(size - 2) &&
+               (unsigned)(y - 1) < (unsigned)(size - 2) &&
+               (unsigned)(z - 1) < (unsigned)(size - 2);
+    }
+};
+
+#endif
@@ -0,0 +1,167 @@
+/** @file life3d.cpp
+ *  @brief Single driver for all the engines
+ *
+ *  The engine is picked at run time from the registry, so every engine
+ *  shares the same argument parsing, input and output code.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#include <algorithm>
+#include <getopt.h>
+
+#include "life3d.hpp"
+
+int main(int argc, char* argv[]){
+
+    Options options;
+    int cube_size = 0;              /**< Size of the 3D space */
+    std::vector<CellKey> cells;     /**< Initial live cells */
+    RuntimeRule rule;
+
+    parseOptions(argc, argv, options);
+    debug_print("ARGS: file: %s generations: %d engine: %s.", options.file.c_str(), options.generations, options.engine.c_str());
+
+    if (options.n_threads > 0)
+        omp_set_num_threads(options.n_threads);
+    else
+        options.n_threads = omp_get_max_threads();
+
+    if (!parseRule(options.rule, rule)){
+        err_print("Invalid rule %s, expected e.g. %s, without 0 in B or S", options.rule.c_str(), DEFAULT_RULE);
+        exit(EXIT_FAILURE);
+    }
+    if (options.neighbourhood != VonNeumann::name && options.neighbourhood != Moore::name){
+        err_print("Unknown neighbourhood %s, expected %s or %s", options.neighbourhood.c_str(), VonNeumann::name, Moore::name);
+        exit(EXIT_FAILURE);
+    }
+
+    readCells(options.file, options.input, cube_size, cells);
+    if (options.autotune)
+        autotune(options, cube_size, cells, rule);
+
+    const EngineInfo* info = findEngine(options.engine);
+    if (info == NULL){
+        err_print("Unknown engine %s", options.engine.c_str());
+        usage(argv[0]);
+    }
+    if (!engineSupports(*info, cube_size, rule, options.neighbourhood)){
+        if (info->max_cube_size != 0 && cube_size > info->max_cube_size)
+            err_print("Engine %s holds cubes of size up to %d, not %d", info->name, info->max_cube_size, cube_size);
+        else
+            err_print("Engine %s only runs rule %s with the %s neighbourhood", info->name, DEFAULT_RULE, DEFAULT_NEIGHBOURHOOD);
+        exit(EXIT_FAILURE);
+    }
+
+    std::unique_ptr<Engine> engine = info->create(options.n_threads, rule, options.neighbourhood);
+    engine->setSchedule(options.schedule);
+    engine->load(cube_size, cells);
+
+    double start = omp_get_wtime();  // Start Timer
+
+    engine->step(options.generations);
+
+    double end = omp_get_wtime();   // Stop Timer
+
+    /* Print the final set of live cells */
+    if (options.output == FORMAT_COUNT)
+        out_print("%zu\n", engine->population());
+    else if (options.output != FORMAT_NONE)
+        writeCells(engine->cells(), cube_size, options.output);
+
+    time_print("%f\n", end - start);
+
+    return 0;
+}
+
+void autotune(Options& options, int cube_size, const std::vector<CellKey>& cells, const RuntimeRule& rule){
+
+    TuneConfig config;
+    TuneKey key = tuneKey(cube_size, cells.size(), options.n_threads, rule, options.neighbourhood);
+    if (!lookupTuneCache(options.tune_cache, key, config)){
+        int generations = std::min(options.generations, CALIBRATION_GENERATIONS);
+        config = calibrate(cube_size, cells, generations, options.n_threads, rule, options.neighbourhood);
+        storeTuneCache(options.tune_cache, key, config);
+    }
+    debug_print("TUNE: engine %s threads %d schedule %s", config.engine.c_str(), config.n_threads,
+                scheduleName(config.schedule).c_str());
+
+    options.engine = config.engine;
+    options.n_threads = config.n_threads;
+    options.schedule = config.schedule;
+    omp_set_num_threads(options.n_threads);
+}
+
+void usage(const char* name){
+    printf("Usage: %s [options] [data_file.in] [number_generations]\n"
+           "  --engine NAME          engine to run (default %s)\n"
+           "  --threads N            number of threads (default: OpenMP default)\n"
+           "  --rule B../S..         birth/survival rule (default %s)\n"
+           "  --neighbourhood NAME   %s or %s (default %s)\n"
+           "  --input FORMAT         text or binary (default text)\n"
+           "  --output FORMAT        text, binary, count or none (default text)\n"
+           "  --schedule KIND[,N]    static, dynamic, guided or auto (default static)\n"
+           "  --autotune             pick engine, threads and schedule by timing %d generations\n"
+           "  --tune-cache FILE      cache of tuning decisions (default %s)\n"
+           "Engines:\n", name, DEFAULT_ENGINE, DEFAULT_RULE, VonNeumann::name, Moore::name, DEFAULT_NEIGHBOURHOOD,
+           CALIBRATION_GENERATIONS, DEFAULT_TUNE_CACHE);
+    for (const EngineInfo& info : engineRegistry())
+        printf("  %-13s %s\n", info.name, info.description);
+    exit(EXIT_FAILURE);
+}
+
+void parseOptions(int argc, char* argv[], Options& options){
+
+    static const struct option long_options[] = {
+        {"engine",        required_argument, NULL, 'e'},
+        {"threads",       required_argument, NULL, 't'},
+        {"rule",          required_argument, NULL, 'r'},
+        {"neighbourhood", required_argument, NULL, 'n'},
+        {"input",         required_argument, NULL, 'i'},
+        {"output",        required_argument, NULL, 'o'},
+        {"schedule",      required_argument, NULL, 's'},
+        {"autotune",      no_argument,       NULL, 'a'},
+        {"tune-cache",    required_argument, NULL, 'c'},
+        {"help",          no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "e:t:r:n:i:o:s:ac:h", long_options, NULL)) != -1){
+        switch (opt){
+            case 'e': options.engine = optarg; break;
+            case 't': options.n_threads = atoi(optarg); break;
+            case 'r': options.rule = optarg; break;
+            case 'n': options.neighbourhood = optarg; break;
+            case 'i':
+                if (!parseFormat(optarg, options.input) || options.input > FORMAT_BINARY){
+                    err_print("Invalid input format %s", optarg);
+                    usage(argv[0]);
+                }
+                break;
+            case 'o':
+                if (!parseFormat(optarg, options.output)){
+                    err_print("Invalid output format %s", optarg);
+                    usage(argv[0]);
+                }
+                break;
+            case 's':
+                if (!parseSchedule(optarg, options.schedule)){
+                    err_print("Invalid schedule %s", optarg);
+                    usage(argv[0]);
+                }
+                break;
+            case 'a': options.autotune = true; break;
+            case 'c': options.tune_cache = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2 || options.n_threads < 0)
+        usage(argv[0]);
+    options.file = argv[optind];
+    options.generations = atoi(argv[optind + 1]);
+    if (options.generations <= 0)
+        usage(argv[0]);
+}
@@ -0,0 +1,63 @@
+/** @file life3d.hpp
+ *  @brief Single driver for all the engines
+ *
+ *  Usage: life3d [options] [data_file.in] [number_generations]
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef LIFE3D_HPP
+#define LIFE3D_HPP
+
+#include <string>
+#include <omp.h>
+
+#include "autotune.hpp"
+#include "dispatch.hpp"
+#include "io.hpp"
+#include "registry.hpp"
+
+/** @brief Command line options */
+struct Options{
+    std::string file;                                   /**< Input data file name */
+    int generations = 0;                                /**< Number of generations to proccess */
+    std::string engine = DEFAULT_ENGINE;                /**< Engine name */
+    int n_threads = 0;                                  /**< Number of threads, 0 for the OpenMP default */
+    Schedule schedule;                                  /**< Schedule of the main loop of each generation */
+    bool autotune = false;                              /**< Whether to pick engine, threads and schedule by calibration */
+    std::string tune_cache = DEFAULT_TUNE_CACHE;        /**< File with the cached tuning decisions */
+    std::string rule = DEFAULT_RULE;                    /**< Birth/survival rule */
+    std::string neighbourhood = DEFAULT_NEIGHBOURHOOD;  /**< Neighbourhood name */
+    CellFormat input = FORMAT_TEXT;                     /**< Input file format */
+    CellFormat output = FORMAT_TEXT;                    /**< Output format */
+};
+
+/** @brief Prints the usage message, with the registered engines, and exits
+ *
+ *  @param name The program name
+ */
+void usage(const char* name);
+
+/** @brief Replaces engine, threads and schedule by the tuned configuration
+ *
+ *  The cached decision for the input is used when there is one, otherwise
+ *  the candidates are calibrated and the decision is cached.
+ *
+ *  @param options The options, updated in place
+ *  @param cube_size The size of the side of the cube
+ *  @param cells The initial live cells
+ *  @param rule The parsed rule
+ */
+void autotune(Options& options, int cube_size, const std::vector<CellKey>& cells, const RuntimeRule& rule);
+
+/** @brief Parse command line arguments, exiting on invalid input
+ *
+ *  @param argc Number of arguments
+ *  @param argv Argument strings
+ *  @param options The parsed options
+ */
+void parseOptions(int argc, char* argv[], Options& options);
+
+#endif
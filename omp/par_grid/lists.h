@@ -4,8 +4,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <omp.h>
 
+/* Prefixed with the engine name, see par_grid.h */
+#define node_chunks par_grid_node_chunks
+#define nodePoolInit par_grid_nodePoolInit
+#define nodePoolDestroy par_grid_nodePoolDestroy
+#define graphNodeAlloc par_grid_graphNodeAlloc
+#define graphNodeFree par_grid_graphNodeFree
+#define columnInit par_grid_columnInit
+#define columnLock par_grid_columnLock
+#define columnUnlock par_grid_columnUnlock
+#define columnPush par_grid_columnPush
+#define graphNodeInsert par_grid_graphNodeInsert
+#define graphNodeRemove par_grid_graphNodeRemove
+#define graphNodeDelete par_grid_graphNodeDelete
+#define graphNodeAddNeighbour par_grid_graphNodeAddNeighbour
+#define graphNodeSort par_grid_graphNodeSort
+#define graphListCleanup par_grid_graphListCleanup
+
 #define true 1
 #define false 0
 
@@ -18,14 +36,152 @@
 typedef unsigned char bool;
 typedef int coordinate;
 
-/** @brief Structure for storing a node of the graph */
-typedef struct Graph_Node_Struct{
-    coordinate z;                   /**< z coordinate, x and y are implicitly mapped */
-    bool state;                     /**< State of a node cell (DEAD or ALIVE) */
-    unsigned char neighbours;       /**< Neighbour counter */
-    struct Graph_Node_Struct* next; /**< Pointer to the next entry in the list */
+#ifndef COORD_BITS
+#define COORD_BITS 16   /**< Bits of a stored coordinate z, set with -DCOORD_BITS for very large cubes */
+#endif
+
+#define STATE_MASK 0x1          /**< State bit of a cell word */
+#define NEIGHBOUR_SHIFT 1       /**< Position of the neighbour counter in a cell word */
+#define NEIGHBOUR_MASK 0x7F     /**< Neighbour counter, after shifting */
+#define Z_SHIFT 8               /**< Position of z in a cell word */
+
+/** Cell word: z in the upper COORD_BITS bits, then the neighbour counter and the state */
+#if COORD_BITS + Z_SHIFT > 32
+typedef uint64_t cell_word;
+#else
+typedef uint32_t cell_word;
+#endif
+
+typedef uint32_t node_index;    /**< Position of a GraphNode in the node pool */
+
+#define NO_NODE ((node_index) 0xFFFFFFFF)   /**< Null node index */
+
+/** @brief Structure for storing a node of the graph
+ *
+ *  8 bytes with the default COORD_BITS, against 16 with an int z and a
+ *  next pointer.
+ */
+typedef struct{
+    cell_word cell;                 /**< z coordinate, neighbour counter and state, x and y are implicitly mapped */
+    node_index next;                /**< Index of the next entry in the list */
 }GraphNode;
 
+#define POOL_SHIFT 12                               /**< log2 of POOL_CHUNK */
+#define POOL_CHUNK (1 << POOL_SHIFT)                /**< Number of GraphNodes a thread claims at a time */
+#define MAX_CHUNKS ((1L << (32 - POOL_SHIFT)) - 1)  /**< Chunks addressable by a node_index, short of NO_NODE */
+
+extern GraphNode** node_chunks;
+
+/** @brief Returns the node at an index of the pool */
+static inline GraphNode* graphNode(node_index index){
+    return node_chunks[index >> POOL_SHIFT] + (index & (POOL_CHUNK - 1));
+}
+
+static inline coordinate nodeZ(const GraphNode* node){
+    return (coordinate) (node->cell >> Z_SHIFT);
+}
+
+static inline bool nodeState(const GraphNode* node){
+    return node->cell & STATE_MASK;
+}
+
+static inline int nodeNeighbours(const GraphNode* node){
+    return (node->cell >> NEIGHBOUR_SHIFT) & NEIGHBOUR_MASK;
+}
+
+/** @brief Sets the state of a node and clears its neighbour counter */
+static inline void nodeSetState(GraphNode* node, bool state){
+    node->cell = (node->cell >> Z_SHIFT << Z_SHIFT) | state;
+}
+
+static inline void nodeAddNeighbour(GraphNode* node){
+    node->cell += (cell_word) 1 << NEIGHBOUR_SHIFT;
+}
+
+#define CACHE_LINE 64   /**< Size of a cache line, in bytes */
+#define SPIN_LIMIT 64   /**< Failed attempts at a column lock before yielding the processor */
+
+/** @brief Header of an (x,y) column, 12 bytes
+ *
+ *  Replaces a separate head pointer and omp_lock_t per column: the head,
+ *  a one byte spinlock, the live count and the sorted flag of a column
+ *  are all fetched with a single cache line.
+ */
+typedef struct{
+    node_index head;                /**< First node of the z-list */
+    unsigned int live;              /**< Live cells in the column, as of the last decide pass */
+    volatile char lock;             /**< Spinlock guarding insertions in the list */
+    bool sorted;                    /**< Whether the list is in ascending order of z */
+}Column;
+
+
+/* Node pool related functions */
+
+/** @brief Creates the table of chunks of the node pool
+ *
+ *  Chunks are allocated as threads claim them, so the pool only takes
+ *  the memory the graph needs, and a node is found through the table.
+ *
+ *  @return Void.
+ */
+void nodePoolInit();
+
+/** @brief Takes a GraphNode from the pool of the calling thread
+ *
+ *  Each thread claims and first-touches its own chunks of nodes, so the
+ *  nodes it inserts are placed on the NUMA node it runs on.
+ *
+ *  @return The index of the node.
+ */
+node_index graphNodeAlloc();
+
+/** @brief Returns a GraphNode to the pool of the calling thread
+ *
+ *  @param index The index of the node
+ *  @return Void.
+ */
+void graphNodeFree(node_index index);
+
+/** @brief Releases the node pool
+ *
+ *  @attention Must be called outside of parallel regions, once no node is in use
+ *
+ *  @return Void.
+ */
+void nodePoolDestroy();
+
+/* Column related functions */
+
+/** @brief Initialises an empty column
+ *
+ *  @param column The column header
+ *  @return Void.
+ */
+void columnInit(Column* column);
+
+/** @brief Acquires the lock of a column, spinning and then yielding while it is taken
+ *
+ *  @param column The column header
+ *  @return Void.
+ */
+void columnLock(Column* column);
+
+/** @brief Releases the lock of a column
+ *
+ *  @param column The column header
+ *  @return Void.
+ */
+void columnUnlock(Column* column);
+
+/** @brief Pushes a node with value z at the head of a column, keeping track of its order
+ *
+ *  @param column The column header
+ *  @param z Value of the node to be inserted
+ *  @param state State of the node
+ *  @return The new node.
+ */
+GraphNode* columnPush(Column* column, coordinate z, bool state);
+
 /* NodeGraph Lists related functions */
 
 /** @brief Inserts a GraphNode in the list with value z
@@ -34,7 +190,7 @@ typedef struct Graph_Node_Struct{
  *  @param z Value of the node to be inserted
  *  @return The head of the updated list.
  */
-GraphNode* graphNodeInsert(GraphNode* first, coordinate z, bool state);
+node_index graphNodeInsert(node_index first, coordinate z, bool state);
 
 /** @brief Removes a GraphNode from the list with value z
  *
@@ -42,33 +198,35 @@ GraphNode* graphNodeInsert(GraphNode* first, coordinate z, bool state);
  *  @param z Value of the node to be removed
  *  @return The head of the updated list.
  */
-void graphNodeRemove(GraphNode** first_ptr, coordinate z);
+void graphNodeRemove(node_index* first_ptr, coordinate z);
 
 /** @brief Deletes a list of GraphNodes
  *
  *  @param first The first node of the list
  *  @return Void.
  */
-void graphNodeDelete(GraphNode* first);
+void graphNodeDelete(node_index first);
 
 /** @brief Inserts a cell if not yet present and increments its number of live nighbours
  *
+ *  @param column The header of the column of the cell
+ *  @param z Z coordinate of the cell
  *  @return Whether the cell was inserted in the graph or not
  */
-bool graphNodeAddNeighbour(GraphNode** first, coordinate z, omp_lock_t* lock_ptr);
+bool graphNodeAddNeighbour(Column* column, coordinate z);
 
 /** @brief Sorts a GraphNode list by ascending order of coordinate z
  *
  *  @param first_ptr A pointer to the pointer to the first GraphNode of the list
  *  @return Void.
  */
-void graphNodeSort(GraphNode** first_ptr);
+void graphNodeSort(node_index* first_ptr);
 
 /** @brief Cleans up a graph list
  *
  *  @param head A pointer to the pointer of the graph list we want to clean up
  *  @return Void.
  */
-void graphListCleanup(GraphNode** head);
+void graphListCleanup(node_index* head);
 
 #endif
\ No newline at end of file
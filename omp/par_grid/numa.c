@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include <sched.h>
+
+#include "numa.h"
+
+/** @brief Reads a single integer from a /sys file, or returns `fallback` */
+static int readSysInt(const char* path, int fallback){
+    int value;
+    FILE* fp = fopen(path, "r");
+    if(fp == NULL)
+        return fallback;
+    if(fscanf(fp, "%d", &value) != 1)
+        value = fallback;
+    fclose(fp);
+    return value;
+}
+
+/** @brief Marks the processors of a /sys cpulist ("0-3,8-11") with `node` */
+static int readCpuList(const char* path, int* node_of, int max_cpu, int node){
+    char line[SYS_BUFFER_SIZE];
+    char* it;
+    int lo, hi, cpu, n;
+    FILE* fp = fopen(path, "r");
+    if(fp == NULL)
+        return 0;
+    if(fgets(line, sizeof(line), fp) != NULL){
+        for(it = line; sscanf(it, "%d%n", &lo, &n) == 1; ){
+            it += n;
+            hi = lo;
+            if(*it == '-' && sscanf(it + 1, "%d%n", &hi, &n) == 1)
+                it += n + 1;
+            for(cpu = lo; cpu <= hi && cpu < max_cpu; cpu++)
+                node_of[cpu] = node;
+            if(*it != ',')
+                break;
+            it++;
+        }
+    }
+    fclose(fp);
+    return 1;
+}
+
+Topology* discoverTopology(){
+
+    char path[SYS_BUFFER_SIZE];
+    cpu_set_t mask;
+    int cpu, node, sibling, other, i, max_rank = 0;
+    int max_cpu = CPU_SETSIZE;
+
+    Topology* topology = (Topology*) malloc(sizeof(Topology));
+    int* node_of = (int*) calloc(max_cpu, sizeof(int));
+    int* core_of = (int*) malloc(max_cpu * sizeof(int));
+    int* package_of = (int*) malloc(max_cpu * sizeof(int));
+    int* rank = (int*) calloc(max_cpu, sizeof(int));
+
+    CPU_ZERO(&mask);
+    if(sched_getaffinity(0, sizeof(mask), &mask) != 0){
+        for(cpu = 0; cpu < omp_get_num_procs() && cpu < max_cpu; cpu++)
+            CPU_SET(cpu, &mask);
+    }
+
+    /* NUMA node of each processor */
+    topology->n_nodes = 0;
+    for(node = 0; node < MAX_NODES; node++){
+        sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+        if(readCpuList(path, node_of, max_cpu, node))
+            topology->n_nodes = node + 1;
+    }
+    if(topology->n_nodes == 0)
+        topology->n_nodes = 1;
+
+    /* Core of each processor, and its rank among the hyperthreads of that core */
+    for(cpu = 0; cpu < max_cpu; cpu++){
+        if(!CPU_ISSET(cpu, &mask))
+            continue;
+        sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        core_of[cpu] = readSysInt(path, cpu);
+        sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        package_of[cpu] = readSysInt(path, 0);
+        for(other = 0; other < cpu; other++){
+            if(CPU_ISSET(other, &mask) && core_of[other] == core_of[cpu] && package_of[other] == package_of[cpu])
+                rank[cpu]++;
+        }
+        if(rank[cpu] > max_rank)
+            max_rank = rank[cpu];
+    }
+
+    /* Order: by node, then first hyperthread of every core, then the second, ... */
+    topology->n_cpus = CPU_COUNT(&mask);
+    topology->cpu = (int*) malloc(topology->n_cpus * sizeof(int));
+    topology->node = (int*) malloc(topology->n_cpus * sizeof(int));
+    i = 0;
+    for(node = 0; node < topology->n_nodes; node++){
+        for(sibling = 0; sibling <= max_rank; sibling++){
+            for(cpu = 0; cpu < max_cpu && i < topology->n_cpus; cpu++){
+                if(CPU_ISSET(cpu, &mask) && node_of[cpu] == node && rank[cpu] == sibling){
+                    topology->cpu[i] = cpu;
+                    topology->node[i++] = node;
+                }
+            }
+        }
+    }
+    topology->n_cpus = i;
+
+    debug_print("Topology: %d processors on %d NUMA nodes", topology->n_cpus, topology->n_nodes);
+
+    free(node_of);
+    free(core_of);
+    free(package_of);
+    free(rank);
+    return topology;
+}
+
+int pinningEnabled(){
+    const char* pin = getenv(PIN_SWITCH);
+    if(getenv("OMP_PROC_BIND") != NULL || getenv("OMP_PLACES") != NULL){
+        fprintf(stderr, "Thread pinning disabled: OpenMP binding set by OMP_PROC_BIND or OMP_PLACES\n");
+        return 0;
+    }
+    if(pin != NULL && atoi(pin) == 0){
+        fprintf(stderr, "Thread pinning disabled: %s=%s\n", PIN_SWITCH, pin);
+        return 0;
+    }
+    return 1;
+}
+
+void printPinning(const Topology* topology, int n_threads){
+    int tid, i;
+    fprintf(stderr, "Thread pinning on %d processors, %d NUMA nodes (thread:cpu/node):", topology->n_cpus, topology->n_nodes);
+    for(tid = 0; tid < n_threads && topology->n_cpus > 0; tid++){
+        i = tid % topology->n_cpus;
+        fprintf(stderr, " %d:%d/%d", tid, topology->cpu[i], topology->node[i]);
+    }
+    fprintf(stderr, "\n");
+}
+
+void freeTopology(Topology* topology){
+    if(topology == NULL)
+        return;
+    free(topology->cpu);
+    free(topology->node);
+    free(topology);
+}
+
+int pinThread(const Topology* topology){
+    cpu_set_t mask;
+    int tid = omp_get_thread_num();
+    int i;
+
+    if(topology->n_cpus == 0)
+        return -1;
+    i = tid % topology->n_cpus;
+    CPU_ZERO(&mask);
+    CPU_SET(topology->cpu[i], &mask);
+    if(sched_setaffinity(0, sizeof(mask), &mask) != 0){
+        debug_print("Thread %d could not be pinned to processor %d", tid, topology->cpu[i]);
+        return -1;
+    }
+    debug_print("Thread %d pinned to processor %d on node %d", tid, topology->cpu[i], topology->node[i]);
+    return topology->node[i];
+}
@@ -0,0 +1,76 @@
+/** @file numa.h
+ *  @brief Processor topology discovery and thread pinning
+ *
+ *  The topology is read from /sys: the NUMA node of each processor from
+ *  /sys/devices/system/node/node<N>/cpulist, and its core from
+ *  /sys/devices/system/cpu/cpu<N>/topology. Threads are pinned in node
+ *  order, one per core before using hyperthread siblings, so that
+ *  consecutive threads, which own consecutive rows, share a node.
+ *
+ *  Pinning is skipped when the OpenMP runtime is already told where to
+ *  place threads (OMP_PROC_BIND or OMP_PLACES), or when PAR_GRID_PIN=0,
+ *  so that external bindings such as taskset are left alone.
+ *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "debug.h"
+
+#define MAX_NODES 64        /**< Largest NUMA node number that is looked for */
+#define SYS_BUFFER_SIZE 256 /**< Maximum length of a /sys path or line */
+#define PIN_SWITCH "PAR_GRID_PIN"   /**< Environment variable that disables pinning when set to 0 */
+
+/** @brief The processors this process may run on, in pinning order */
+typedef struct{
+    int n_cpus;     /**< Number of usable processors */
+    int n_nodes;    /**< Number of NUMA nodes with usable processors */
+    int* cpu;       /**< Processor ids, grouped by node */
+    int* node;      /**< NUMA node of each entry of cpu */
+}Topology;
+
+/** @brief Discovers the topology from /sys, restricted to the affinity mask of the process
+ *
+ *  Missing /sys entries are read as node 0 and one core per processor.
+ *
+ *  @return The topology, to be freed with freeTopology().
+ */
+Topology* discoverTopology();
+
+/** @brief Decides whether threads are to be pinned, and says why not on stderr
+ *
+ *  @return 0 if OMP_PROC_BIND or OMP_PLACES is set, or PIN_SWITCH is 0; 1 otherwise.
+ */
+int pinningEnabled();
+
+/** @brief Prints on stderr the processor and node each thread is pinned to
+ *
+ *  @param topology The topology
+ *  @param n_threads The number of threads in the team
+ */
+void printPinning(const Topology* topology, int n_threads);
+
+/** @brief Frees a topology
+ *
+ *  @param topology The topology, may be NULL
+ */
+void freeTopology(Topology* topology);
+
+/** @brief Pins the calling OpenMP thread to its processor in the topology
+ *
+ *  Thread t is pinned to the processor t modulo the number of processors.
+ *
+ *  @param topology The topology
+ *  @return The NUMA node the thread was pinned to, -1 on failure.
+ */
+int pinThread(const Topology* topology);
+
+#endif
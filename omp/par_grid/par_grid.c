@@ -1,135 +1,302 @@
 #include "par_grid.h"
 
+#ifndef LIFE3D_ENGINE
 int main(int argc, char* argv[]){
 
     char* file;             /**< Input data file name */
     int generations = 0;    /**< Number of generations to proccess */
     int cube_size = 0;      /**< Size of the 3D space */
 
-    GraphNode*** graph;     /**< Graph representation - 2D array of lists */
+    Column** graph;         /**< Graph representation - 2D array of column headers */
 
-    /* Lock variables */
-    omp_lock_t** graph_lock;
+    Cell* cells;            /**< Initial live cells */
+    long n_cells = 0;       /**< Number of initial live cells */
+    Topology* topology;     /**< Processors threads are pinned to, NULL if they are not pinned */
 
-    int g, i, j;
-    GraphNode* it;
-    int live_neighbours;
+    /* Load balancing */
+    long* row_live;         /**< Live cells in each row x, updated while deciding the next state */
+    int* bounds = (int*) malloc((omp_get_max_threads() + 1) * sizeof(int));
 
     parseArgs(argc, argv, &file, &generations);
     debug_print("ARGS: file: %s generations: %d.", file, generations);
 
-    graph = parseFile(file, &cube_size);
+    cells = parseFile(file, &cube_size, &n_cells);
 
-    /* Initialize lock variables */
-    graph_lock = (omp_lock_t**)malloc(cube_size * sizeof(omp_lock_t*));
-    for(i = 0; i < cube_size; i++){
-        graph_lock[i] = (omp_lock_t*) malloc(cube_size * sizeof(omp_lock_t));
-        for(j = 0; j < cube_size; j++){
-            omp_init_lock(&(graph_lock[i][j]));
-        }
-    }
+    /* Pin the threads and let each one build the rows it owns, so that they are placed on its NUMA node */
+    topology = pinningEnabled() ? discoverTopology() : NULL;
+    nodePoolInit();
+    row_live = (long*) calloc(cube_size, sizeof(long));
+    graph = buildGraph(cells, n_cells, cube_size, row_live, bounds, topology);
+    free(cells);
     double start = omp_get_wtime();  // Start Timer
+
+    runGenerations(graph, cube_size, generations, row_live, bounds);
+
+    double end = omp_get_wtime();   // Stop Timer
+
+    /* Print the final set of live cells */
+    printAndSortActive(graph, cube_size);
+
+    time_print("%f\n", end - start);
+
+    free(row_live);
+    free(bounds);
+    freeGraph(graph, cube_size);
+    nodePoolDestroy();
+    freeTopology(topology);
+    free(file);
+}
+#endif
+
+long parGridRun(int cube_size, const int* cells, long n_cells, int generations, int** live){
+
+    long c, n_live = 0;
+    Cell* initial = (Cell*) malloc(n_cells * sizeof(Cell));
+    long* row_live = (long*) calloc(cube_size, sizeof(long));
+    int* bounds = (int*) malloc((omp_get_max_threads() + 1) * sizeof(int));
+    Topology* topology;
+    Column** graph;
+
+    if((long) cube_size > (1L << COORD_BITS)){
+        err_print("Cube size %d needs more than %d bits per coordinate, rebuild with FLAG=-DCOORD_BITS=n", cube_size, COORD_BITS);
+        exit(EXIT_FAILURE);
+    }
+    for(c = 0; c < n_cells; c++){
+        initial[c].x = cells[3 * c];
+        initial[c].y = cells[3 * c + 1];
+        initial[c].z = cells[3 * c + 2];
+    }
+
+    topology = pinningEnabled() ? discoverTopology() : NULL;
+    nodePoolInit();
+    graph = buildGraph(initial, n_cells, cube_size, row_live, bounds, topology);
+    free(initial);
+
+    runGenerations(graph, cube_size, generations, row_live, bounds);
+
+    for(c = 0; c < cube_size; c++)
+        n_live += row_live[c];
+    *live = (int*) malloc(3 * n_live * sizeof(int));
+    collectActive(graph, cube_size, *live);
+
+    free(row_live);
+    free(bounds);
+    freeGraph(graph, cube_size);
+    nodePoolDestroy();
+    freeTopology(topology);
+    return n_live;
+}
+
+void runGenerations(Column** graph, int cube_size, int generations, long* row_live, int* bounds){
+
+    int g, i, j;
+    GraphNode* it;
+    node_index n;
+    int live_neighbours;
+    long row;
+#ifdef VERBOSE
+    int n_stats = omp_get_max_threads();
+    StealStats* stats = (StealStats*) aligned_alloc(CACHE_LINE, n_stats * sizeof(StealStats));
+    memset(stats, 0, n_stats * sizeof(StealStats));
+#endif
+
     for(g = 1; g <= generations; g++){
         
-        #pragma omp parallel
+        #pragma omp parallel private(i, j, it, live_neighbours, row)
         {
-            /* First passage in the graph - notify neighbours */
-            #pragma omp for private(i, j, it)   
-            for(i = 0; i < cube_size; i++){
-                for(j = 0; j < cube_size; j++){
-                    for(it = graph[i][j]; it != NULL; it = it->next){
-                        if(it->state == ALIVE)
-                            visitNeighbours(graph, graph_lock, cube_size, i, j, it->z);
+            int tid = omp_get_thread_num();
+
+            /* Split rows into ranges with the same number of live cells */
+            #pragma omp single
+            partitionRows(row_live, cube_size, omp_get_num_threads(), bounds);
+
+            /* First passage in the graph - notify neighbours.
+             * Each thread creates the tasks of its own range, idle threads steal the rest */
+            for(i = bounds[tid]; i < bounds[tid + 1]; i++){
+                if(row_live[i] == 0)
+                    continue;
+                for(j = 0; j < cube_size; j += TASK_COLUMNS){
+                    #pragma omp task firstprivate(i, j)
+                    {
+                        count_task(stats, tid);
+                        for(int y = j; y < j + TASK_COLUMNS && y < cube_size; y++)
+                            visitColumn(graph, cube_size, i, y);
                     }
                 }
             }
-            /* Second passage in the graph - decide next state */
-            #pragma omp for private(i, j, it, live_neighbours)
-            for(i = 0; i < cube_size; i++){
-                for(j = 0; j < cube_size; j++){
-                    for (it = graph[i][j]; it != NULL; it = it->next){
-                        live_neighbours = it->neighbours;
-                        it->neighbours = 0;
-                        if(it->state == ALIVE){
-                            if(live_neighbours < 2 || live_neighbours > 4){
-                                it->state = DEAD;
-                            }  
-                        }else{
-                            if(live_neighbours == 2 || live_neighbours == 3){
-                                it->state = ALIVE; 
+            #pragma omp barrier
+
+            /* Second passage in the graph - decide next state, one task per row */
+            for(i = bounds[tid]; i < bounds[tid + 1]; i++){
+                #pragma omp task firstprivate(i) private(j, it, n, live_neighbours, row)
+                {
+                    count_task(stats, tid);
+                    row = 0;
+                    for(j = 0; j < cube_size; j++){
+                        unsigned int live = 0;
+                        for (n = graph[i][j].head; n != NO_NODE; n = it->next){
+                            it = graphNode(n);
+                            live_neighbours = nodeNeighbours(it);
+                            if(nodeState(it) == ALIVE){
+                                nodeSetState(it, live_neighbours >= 2 && live_neighbours <= 4);
+                            }else{
+                                nodeSetState(it, live_neighbours == 2 || live_neighbours == 3);
                             }
+                            live += nodeState(it);
                         }
+                        graph[i][j].live = live;
+                        row += live;
                     }
+                    row_live[i] = row;
                 }
             }
+            #pragma omp barrier
+
             /* Remove dead nodes from the graph once in a while (like g%5) */
             if(g % REMOVAL_PERIOD == 0){
                 #pragma omp for private(i, j)
                 for(i = 0; i < cube_size; i++){
                     for(j = 0; j < cube_size; j++){
-                        GraphNode ** list = &graph[i][j];
-                        graphListCleanup(list);
+                        graphListCleanup(&graph[i][j].head);
                     }
                 }
             }
         }/*pragma end*/
     } /*generations loop end*/
 
-    double end = omp_get_wtime();   // Stop Timer
+#ifdef VERBOSE
+    for(i = 0; i < n_stats; i++){
+        debug_print("Thread %d: %ld tasks, %ld stolen", i, stats[i].tasks, stats[i].stolen);
+    }
+    free(stats);
+#endif
+}
 
-    /* Print the final set of live cells */
-    printAndSortActive(graph, cube_size);
+double partitionRows(const long* weight, int n_rows, int n_parts, int* bounds){
 
-    time_print("%f\n", end - start);
+    int i, part = 1;
+    long total = 0, acc = 0, heaviest = 0;
 
-    for(i = 0; i < cube_size; i++){
-        for(j = 0; j<cube_size; j++){
-            omp_destroy_lock(&(graph_lock[i][j]));
-        }
-        free(graph_lock[i]);
+    for(i = 0; i < n_rows; i++)
+        total += weight[i];
+
+    /* Part p ends after the first row where the prefix sum reaches p/n_parts of the total */
+    bounds[0] = 0;
+    for(i = 0; i < n_rows && part < n_parts; i++){
+        acc += weight[i];
+        while(part < n_parts && acc * n_parts >= total * part)
+            bounds[part++] = i + 1;
     }
-    free(graph_lock);
-    freeGraph(graph, cube_size);
-    free(file);
+    while(part <= n_parts)
+        bounds[part++] = n_rows;
+
+    if(total == 0)
+        return 1.0;
+    for(part = 0; part < n_parts; part++){
+        acc = 0;
+        for(i = bounds[part]; i < bounds[part + 1]; i++)
+            acc += weight[i];
+        if(acc > heaviest)
+            heaviest = acc;
+    }
+    return (double) heaviest * n_parts / total;
 }
 
-void visitNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, coordinate x, coordinate y, coordinate z){
+#ifdef VERBOSE
+void countTask(StealStats* stats, int creator){
+    int tid = omp_get_thread_num();
+    stats[tid].tasks++;
+    if(tid != creator)
+        stats[tid].stolen++;
+}
+#endif
+
+void visitColumn(Column** graph, int cube_size, coordinate x, coordinate y){
+
+    GraphNode* it;
+    node_index n;
+    if(graph[x][y].live == 0)
+        return;
+    for(n = graph[x][y].head; n != NO_NODE; n = it->next){
+        it = graphNode(n);
+        if(nodeState(it) == ALIVE)
+            visitNeighbours(graph, cube_size, x, y, nodeZ(it));
+    }
+}
+
+void visitNeighbours(Column** graph, int cube_size, coordinate x, coordinate y, coordinate z){
 
-    GraphNode* ptr;
     coordinate x1, x2, y1, y2, z1, z2;
     x1 = (x+1)%cube_size; x2 = (x-1) < 0 ? (cube_size-1) : (x-1);
     y1 = (y+1)%cube_size; y2 = (y-1) < 0 ? (cube_size-1) : (y-1);
     z1 = (z+1)%cube_size; z2 = (z-1) < 0 ? (cube_size-1) : (z-1);
     /* If a cell is visited for the first time, add it to the update list, for fast access */
-    graphNodeAddNeighbour(&(graph[x1][y]), z, &(graph_lock[x1][y]));
-    graphNodeAddNeighbour(&(graph[x2][y]), z, &(graph_lock[x2][y]));
-    graphNodeAddNeighbour(&(graph[x][y1]), z, &(graph_lock[x][y1]));
-    graphNodeAddNeighbour(&(graph[x][y2]), z, &(graph_lock[x][y2]));
-    graphNodeAddNeighbour(&(graph[x][y]), z1, &(graph_lock[x][y]));
-    graphNodeAddNeighbour(&(graph[x][y]), z2, &(graph_lock[x][y]));
+    graphNodeAddNeighbour(&(graph[x1][y]), z);
+    graphNodeAddNeighbour(&(graph[x2][y]), z);
+    graphNodeAddNeighbour(&(graph[x][y1]), z);
+    graphNodeAddNeighbour(&(graph[x][y2]), z);
+    graphNodeAddNeighbour(&(graph[x][y]), z1);
+    graphNodeAddNeighbour(&(graph[x][y]), z2);
 }
 
-GraphNode*** initGraph(int size){
+Column** buildGraph(Cell* cells, long n_cells, int cube_size, long* row_live, int* bounds, const Topology* topology){
+
+    long c, i;
+    long* offset = (long*) calloc(cube_size + 1, sizeof(long));
+    Cell* sorted = (Cell*) malloc(n_cells * sizeof(Cell));
+    Column** graph = (Column**) malloc(sizeof(Column*) * cube_size);
+    /* Rows start on a cache line, so the columns of a thread never share one with another thread's */
+    size_t row_size = (sizeof(Column) * cube_size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+
+    /* Bucket the cells by row x */
+    for(c = 0; c < n_cells; c++)
+        row_live[cells[c].x]++;
+    for(i = 0; i < cube_size; i++)
+        offset[i + 1] = offset[i] + row_live[i];
+    for(c = 0; c < n_cells; c++)
+        sorted[offset[cells[c].x]++] = cells[c];
+    for(i = cube_size; i > 0; i--)
+        offset[i] = offset[i - 1];
+    offset[0] = 0;
 
-    int i,j;
-    GraphNode*** graph = (GraphNode***) malloc(sizeof(GraphNode**) * size);
+    #pragma omp parallel private(c, i)
+    {
+        int tid = omp_get_thread_num();
+        int y;
+        if(topology != NULL)
+            pinThread(topology);
 
-    for (i = 0; i < size; i++){
-        graph[i] = (GraphNode**) malloc(sizeof(GraphNode*) * size);
-        for (j = 0; j < size; j++){
-            graph[i][j] = NULL;
+        #pragma omp single
+        {
+            if(topology != NULL)
+                printPinning(topology, omp_get_num_threads());
+            partitionRows(row_live, cube_size, omp_get_num_threads(), bounds);
+        }
+
+        for(i = bounds[tid]; i < bounds[tid + 1]; i++){
+            graph[i] = (Column*) aligned_alloc(CACHE_LINE, row_size);
+            for(y = 0; y < cube_size; y++)
+                columnInit(&graph[i][y]);
+            for(c = offset[i]; c < offset[i + 1]; c++){
+                Column* column = &graph[i][sorted[c].y];
+                columnPush(column, sorted[c].z, ALIVE);
+                column->live++;
+            }
         }
     }
+
+    free(offset);
+    free(sorted);
     return graph;
 }
 
-void freeGraph(GraphNode*** graph, int size){
+void freeGraph(Column** graph, int size){
 
     int i, j;
     if (graph != NULL){
         for (i = 0; i < size; i++){
             for (j = 0; j < size; j++){
-                graphNodeDelete(graph[i][j]);
+                graphNodeDelete(graph[i][j].head);
             }
             free(graph[i]);
         }
@@ -137,19 +304,49 @@ void freeGraph(GraphNode*** graph, int size){
     }
 }
 
-void printAndSortActive(GraphNode*** graph, int cube_size){
+void printAndSortActive(Column** graph, int cube_size){
+    int x,y;
+    GraphNode* it;
+    node_index n;
+    for (x = 0; x < cube_size; ++x){
+        for (y = 0; y < cube_size; ++y){
+            /* Sort the list by ascending coordinate z, unless it already is */
+            if (!graph[x][y].sorted){
+                graphNodeSort(&(graph[x][y].head));
+                graph[x][y].sorted = true;
+            }
+            for (n = graph[x][y].head; n != NO_NODE; n = it->next){
+                it = graphNode(n);
+                if (nodeState(it) == ALIVE)
+                    out_print("%d %d %d\n", x, y, nodeZ(it));
+            }
+        }
+    }
+}
+
+long collectActive(Column** graph, int cube_size, int* live){
     int x,y;
+    long n_live = 0;
     GraphNode* it;
+    node_index n;
     for (x = 0; x < cube_size; ++x){
         for (y = 0; y < cube_size; ++y){
-            /* Sort the list by ascending coordinate z */
-            graphNodeSort(&(graph[x][y]));
-            for (it = graph[x][y]; it != NULL; it = it->next){    
-                if (it->state == ALIVE)
-                    out_print("%d %d %d\n", x, y, it->z);
+            if (!graph[x][y].sorted){
+                graphNodeSort(&(graph[x][y].head));
+                graph[x][y].sorted = true;
+            }
+            for (n = graph[x][y].head; n != NO_NODE; n = it->next){
+                it = graphNode(n);
+                if (nodeState(it) == ALIVE){
+                    live[3 * n_live] = x;
+                    live[3 * n_live + 1] = y;
+                    live[3 * n_live + 2] = nodeZ(it);
+                    n_live++;
+                }
             }
         }
     }
+    return n_live;
 }
 
 void parseArgs(int argc, char* argv[], char** file, int* generations){
@@ -166,34 +363,43 @@ void parseArgs(int argc, char* argv[], char** file, int* generations){
     exit(EXIT_FAILURE);
 }
 
-GraphNode*** parseFile(char* file, int* cube_size){
+Cell* parseFile(char* file, int* cube_size, long* n_cells){
     
     int first = 0;
     char line[BUFFER_SIZE];
     int x, y, z;
+    long capacity = BUFFER_SIZE;
+    Cell* cells = (Cell*) malloc(capacity * sizeof(Cell));
     FILE* fp = fopen(file, "r");
     if(fp == NULL){
         err_print("Please input a valid file name");
         exit(EXIT_FAILURE);
     }
 
-
-    GraphNode*** graph;
-
+    *n_cells = 0;
     while(fgets(line, sizeof(line), fp)){
         if(!first){
             if(sscanf(line, "%d\n", cube_size) == 1){
                 first = 1;
-                graph = initGraph(*cube_size);
+                if((long) *cube_size > (1L << COORD_BITS)){
+                    err_print("Cube size %d needs more than %d bits per coordinate, rebuild with FLAG=-DCOORD_BITS=n", *cube_size, COORD_BITS);
+                    exit(EXIT_FAILURE);
+                }
             }    
         }else{
             if(sscanf(line, "%d %d %d\n", &x, &y, &z) == 3){
-                /* Insert live nodes in the graph and the update set */
-                graph[x][y] = graphNodeInsert(graph[x][y], z, ALIVE);
+                if(*n_cells == capacity){
+                    capacity *= 2;
+                    cells = (Cell*) realloc(cells, capacity * sizeof(Cell));
+                }
+                cells[*n_cells].x = x;
+                cells[*n_cells].y = y;
+                cells[*n_cells].z = z;
+                (*n_cells)++;
             }
         }
     }
 
     fclose(fp);
-    return graph;
+    return cells;
 }
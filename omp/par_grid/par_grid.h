@@ -18,16 +18,84 @@
 #include <omp.h>
 
 #include "lists.h"
+#include "numa.h"
 #include "debug.h"
 
+/* omp/life3d links all the C engines into one binary, so the global symbols of each carry its name */
+#define partitionRows par_grid_partitionRows
+#define countTask par_grid_countTask
+#define visitColumn par_grid_visitColumn
+#define visitNeighbours par_grid_visitNeighbours
+#define buildGraph par_grid_buildGraph
+#define runGenerations par_grid_runGenerations
+#define freeGraph par_grid_freeGraph
+#define printAndSortActive par_grid_printAndSortActive
+#define collectActive par_grid_collectActive
+#define parseArgs par_grid_parseArgs
+#define parseFile par_grid_parseFile
+
 #define ALIVE 1             /**< Macro for representing a live cell */
 #define DEAD 0              /**< Macro for representing a dead cell */
 
 #define REMOVAL_PERIOD 5    /**< Number of generations between graph cleanup calls (removal of dead nodes) */
 #define BUFFER_SIZE 100     /**< Maximum length for a single infile line */
 
+#define TASK_COLUMNS 32    /**< Columns notified by each task */
+
 typedef unsigned char bool;
 
+/** @brief A cell read from the input file */
+typedef struct{
+    coordinate x;
+    coordinate y;
+    coordinate z;
+} Cell;
+
+#ifdef VERBOSE
+/** @brief Per-thread task counters, padded to a cache line so threads never share one */
+typedef struct{
+    long tasks;         /**< Tasks run by the thread */
+    long stolen;        /**< Tasks run by the thread that another thread created */
+    char pad[CACHE_LINE - 2 * sizeof(long)];
+} StealStats;
+
+/** @brief Records that the calling thread runs a task
+ *
+ *  @param stats The per-thread counters
+ *  @param creator The thread that created the task
+ */
+void countTask(StealStats* stats, int creator);
+
+#define count_task(stats, creator) countTask(stats, creator)
+#else
+/** The counters are only reported with `VERBOSE`, so otherwise they are not kept */
+#define count_task(stats, creator)
+#endif
+
+/** @brief Splits rows into ranges of about the same total weight
+ *
+ *  Part p gets rows bounds[p] to bounds[p+1]-1. The weights are the live
+ *  cells of each row, so the split follows from their prefix sum.
+ *
+ *  @param weight The weight of each row
+ *  @param n_rows Number of rows
+ *  @param n_parts Number of ranges
+ *  @param bounds Filled with the n_parts + 1 range bounds
+ *  @return The weight of the heaviest range over the fair share (1 is perfect balance).
+ */
+double partitionRows(const long* weight, int n_rows, int n_parts, int* bounds);
+
+/** @brief Notifies the neighbours of every live cell of the (x,y) column
+ *
+ *  Columns without live cells in the last decide pass are skipped.
+ *
+ *  @param graph The graph representation
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param x X coordinate
+ *  @param y Y coordinate
+ */
+void visitColumn(Column** graph, int cube_size, coordinate x, coordinate y);
+
 /** @brief Notifies the neighbours of (x,y,z) of its aliveness and adds them to list
  *
  *  @param graph The graph representation
@@ -37,19 +105,54 @@ typedef unsigned char bool;
  *  @param y Y coordinate
  *  @param z Z coordinate
  */
-void visitNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, coordinate x, coordinate y, coordinate z);
+void visitNeighbours(Column** graph, int cube_size, coordinate x, coordinate y, coordinate z);
 
-/** @brief Initializes the graph representation structure
- *  
+/** @brief Builds the graph representation structure in parallel
+ *
+ *  Every thread is pinned, and then allocates and fills the rows of its
+ *  equal-work range, so that the rows, their column headers and their nodes
+ *  are first touched on the NUMA node of the thread that will process them.
+ *  Each row starts on a cache line boundary.
+ *
+ *  @param cells The live cells
+ *  @param n_cells The number of live cells
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param row_live Filled with the live cells of each row
+ *  @param bounds Filled with the row range of each thread
+ *  @param topology The processors the threads are pinned to, NULL to leave them where they are
+ *  @return The filled `Column` graph representation.
+ */
+Column** buildGraph(Cell* cells, long n_cells, int cube_size, long* row_live, int* bounds, const Topology* topology);
+
+/** @brief Processes generations on the graph
+ *
+ *  @param graph The graph representation
  *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param generations Number of generations to process
+ *  @param row_live The live cells of each row, updated every generation
+ *  @param bounds Room for the row range of each thread
  */
-GraphNode*** initGraph(int cube_size);
+void runGenerations(Column** graph, int cube_size, int generations, long* row_live, int* bounds);
+
+/** @brief Runs the engine from a list of cells, for omp/life3d
+ *
+ *  Building with -DLIFE3D_ENGINE leaves out main(), so that omp/life3d can
+ *  link the engine and select it with --engine.
+ *
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param cells The live cells, as x y z triples, without repetitions
+ *  @param n_cells The number of live cells
+ *  @param generations Number of generations to process
+ *  @param live Set to the final live cells, as x y z triples in ascending order, to be freed by the caller
+ *  @return The number of final live cells.
+ */
+long parGridRun(int cube_size, const int* cells, long n_cells, int generations, int** live);
 
 /** @brief Frees the graph representation from memory
  *  
  *  @param cube_size The size of the side of the cube that represents the 3D space
  */
-void freeGraph(GraphNode*** graph, int cube_size);
+void freeGraph(Column** graph, int cube_size);
 
 /** @brief Prints the graph, and sorts each of the lists
  *
@@ -59,7 +162,16 @@ void freeGraph(GraphNode*** graph, int cube_size);
  *  @param graph The graph representation    
  *  @param size The size of the side of the cube that represents the 3D space
  */
-void printAndSortActive(GraphNode*** graph, int cube_size);
+void printAndSortActive(Column** graph, int cube_size);
+
+/** @brief Copies the live cells of the graph, and sorts each of the lists
+ *
+ *  @param graph The graph representation
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param live Filled with the live cells, as x y z triples in ascending order
+ *  @return The number of live cells.
+ */
+long collectActive(Column** graph, int cube_size, int* live);
 
 /** @brief Parse command line arguments
  *
@@ -73,13 +185,13 @@ void printAndSortActive(GraphNode*** graph, int cube_size);
  */
 void parseArgs(int argc, char* argv[], char** file, int* generations);
 
-/** @brief Parse input file contents to graph and hashtable 
+/** @brief Parse input file contents
  *
  *  @param file Filename string
- *  @param list List for keeping track of live cells and neighbours
  *  @param cube_size The size of the side of the cube that represents the 3D space
- *  @return The filled `GraphNode` graph representation.
+ *  @param n_cells The number of live cells read
+ *  @return The live cells, to be freed by the caller.
  */
-GraphNode*** parseFile(char* file, int* cube_size);    
+Cell* parseFile(char* file, int* cube_size, long* n_cells);    
 
 #endif
\ No newline at end of file
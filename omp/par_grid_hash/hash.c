@@ -25,7 +25,7 @@ int hash(int size, coordinate x, coordinate y, coordinate z){
 }
 
 /**************************************************************************/
-void hashtableWrite(Hashtable* hashtable, coordinate x, coordinate y, coordinate z, GraphNode* ptr){
+void hashtableWrite(Hashtable* hashtable, coordinate x, coordinate y, coordinate z, node_index ptr){
     int hashval = hash(hashtable->size, x, y, z);
     
     omp_set_lock(&(hashtable->table_locks[hashval]));
@@ -19,6 +19,14 @@
 
 #include "hash_lists.h"
 
+/* Prefixed with the engine name, see par_grid_hash.h */
+#define createHashtable par_grid_hash_createHashtable
+#define hash par_grid_hash_hash
+#define hashtableWrite par_grid_hash_hashtableWrite
+#define hashtableRemove par_grid_hash_hashtableRemove
+#define hashtableFree par_grid_hash_hashtableFree
+#define printHashtable par_grid_hash_printHashtable
+
 typedef int coordinate;
 
 /** @brief Structure for storing pointers to nodes for quick access */
@@ -54,7 +62,7 @@ int hash(int size, coordinate x, coordinate y, coordinate z);
  *  @param z Value of the node to be inserted
  *  @return The head of the updated list.
  */
-void hashtableWrite(Hashtable* hashtable, coordinate x, coordinate y, coordinate z, GraphNode* ptr);
+void hashtableWrite(Hashtable* hashtable, coordinate x, coordinate y, coordinate z, node_index ptr);
 
 /** @brief Inserts a GraphNode in the list with value z
  *
@@ -1,83 +1,159 @@
 #include "hash_lists.h"
 
-/* GraphNode Lists related functions */
+GraphNode** node_chunks;                /**< Node i of the pool is node_chunks[i >> POOL_SHIFT][i % POOL_CHUNK] */
+static long n_chunks = 0;               /**< Chunks claimed so far, by all threads */
 
-/**************************************************************************/
-GraphNode* graphNodeInsert(GraphNode* first, coordinate z, bool state){
+static int pool_epoch = 0;              /**< Pools destroyed so far */
 
-    GraphNode* new = (GraphNode*) malloc(sizeof(GraphNode));
-    if (new == NULL){
-        fprintf(stderr, "Malloc failed. Memory full");
+static node_index pool_free = NO_NODE;  /**< Free nodes of the thread, linked through `next` */
+static int free_epoch = 0;              /**< Pool the free nodes of the thread belong to */
+#pragma omp threadprivate(pool_free, free_epoch)
+
+/** @brief Drops the free nodes the thread kept from a destroyed pool
+ *
+ *  nodePoolDestroy can only reset its own thread, and omp/life3d creates
+ *  a pool per run, with any number of threads.
+ */
+static inline void poolRefresh(){
+    if(free_epoch != pool_epoch){
+        pool_free = NO_NODE;
+        free_epoch = pool_epoch;
+    }
+}
+
+/* Node pool related functions */
+
+/**************************************************************************/
+void nodePoolInit(){
+    node_chunks = (GraphNode**) calloc(MAX_CHUNKS, sizeof(GraphNode*));
+    if(node_chunks == NULL){
+        fprintf(stderr, "Malloc failed. Could not create the node pool\n");
         exit(EXIT_FAILURE);
     }
-    new->z = z;
-    new->state = state;
-    new->neighbours = 0;
+}
+
+/**************************************************************************/
+node_index graphNodeAlloc(){
+    node_index index, i;
+    long chunk;
+    GraphNode* nodes;
+    poolRefresh();
+    if(pool_free == NO_NODE){
+        chunk = __atomic_fetch_add(&n_chunks, 1, __ATOMIC_RELAXED);
+        if(chunk >= MAX_CHUNKS){
+            fprintf(stderr, "Node pool full. %ld chunks of %d nodes\n", MAX_CHUNKS, POOL_CHUNK);
+            exit(EXIT_FAILURE);
+        }
+        nodes = (GraphNode*) aligned_alloc(CACHE_LINE, POOL_CHUNK * sizeof(GraphNode));
+        if(nodes == NULL){
+            fprintf(stderr, "Malloc failed. Memory full\n");
+            exit(EXIT_FAILURE);
+        }
+        index = chunk << POOL_SHIFT;
+        for(i = 0; i < POOL_CHUNK - 1; i++)
+            nodes[i].next = index + i + 1;
+        nodes[POOL_CHUNK - 1].next = NO_NODE;
+        node_chunks[chunk] = nodes;
+        pool_free = index;
+    }
+    index = pool_free;
+    pool_free = graphNode(index)->next;
+    return index;
+}
+
+/**************************************************************************/
+void graphNodeFree(node_index index){
+    poolRefresh();
+    graphNode(index)->next = pool_free;
+    pool_free = index;
+}
+
+/**************************************************************************/
+void nodePoolDestroy(){
+    long chunk;
+    for(chunk = 0; chunk < n_chunks && chunk < MAX_CHUNKS; chunk++)
+        free(node_chunks[chunk]);
+    free(node_chunks);
+    n_chunks = 0;
+    pool_epoch++;
+}
+
+/* GraphNode Lists related functions */
+
+/**************************************************************************/
+node_index graphNodeInsert(node_index first, coordinate z, bool state){
+
+    node_index index = graphNodeAlloc();
+    GraphNode* new = graphNode(index);
+    new->cell = ((cell_word) z << Z_SHIFT) | state;
     new->next = first;
-    return new;
+    return index;
 }
 
 /**************************************************************************/
-void graphNodeRemove(GraphNode** first_ptr, coordinate z, omp_lock_t* lock_ptr){
-    GraphNode** cur;
+void graphNodeRemove(node_index* first_ptr, coordinate z, omp_lock_t* lock_ptr){
+    node_index* cur;
     omp_set_lock(lock_ptr);
-        for (cur = first_ptr; *cur; ){
-            GraphNode* entry = *cur;
-            if (entry->z == z){
-                *cur = entry->next;
-                free(entry);
+        for (cur = first_ptr; *cur != NO_NODE; ){
+            node_index entry = *cur;
+            if (nodeZ(graphNode(entry)) == z){
+                *cur = graphNode(entry)->next;
+                graphNodeFree(entry);
             }else{
-                cur = &entry->next;
+                cur = &graphNode(entry)->next;
             }
         }
     omp_unset_lock(lock_ptr);
 }
 
 /**************************************************************************/
-void graphNodeDelete(GraphNode* first){
-    GraphNode* it, *next;
-    for(it = first; it != NULL; it = next){
-        next = it->next;
-        free(it);
+void graphNodeDelete(node_index first){
+    node_index it, next;
+    for(it = first; it != NO_NODE; it = next){
+        next = graphNode(it)->next;
+        graphNodeFree(it);
     }
 }
 
 /**************************************************************************/
-bool graphNodeAddNeighbour(GraphNode** first, coordinate z, GraphNode** ptr, omp_lock_t* lock_ptr){
-    GraphNode* it;
+bool graphNodeAddNeighbour(node_index* first, coordinate z, node_index* ptr, omp_lock_t* lock_ptr){
+    node_index it;
+    GraphNode* node;
     omp_set_lock(lock_ptr);
     
     /* Search for the node */
-    for(it = *first; it != NULL; it = it->next){
-        if (it->z == z){
-            it->neighbours++;
-            *ptr = NULL; 
+    for(it = *first; it != NO_NODE; it = node->next){
+        node = graphNode(it);
+        if (nodeZ(node) == z){
+            *ptr = it;
             omp_unset_lock(lock_ptr);
-            return false;
+            return nodeAddNeighbour(node);
         }
     }
     
     /* Need to insert the node */
-    GraphNode* new = graphNodeInsert(*first, z, DEAD);
-    new->neighbours++;
-    *ptr = new;
-    *first = new;
+    *first = graphNodeInsert(*first, z, DEAD);
+    *ptr = *first;
+    nodeAddNeighbour(graphNode(*first));
 
     omp_unset_lock(lock_ptr);
     return true;
 }
 
 /**************************************************************************/
-void graphNodeSort(GraphNode** first_ptr){
-    GraphNode* i, *j;
-    if (*first_ptr != NULL){
-        for(i = *first_ptr; i->next != NULL; i = i->next){
-            for(j = i->next; j != NULL; j = j->next)
+void graphNodeSort(node_index* first_ptr){
+    node_index i, j;
+    GraphNode* a, *b;
+    if (*first_ptr != NO_NODE){
+        for(i = *first_ptr; graphNode(i)->next != NO_NODE; i = graphNode(i)->next){
+            a = graphNode(i);
+            for(j = a->next; j != NO_NODE; j = b->next)
             {
-                if(i->z > j->z){
-                    coordinate tmp_z = i->z; bool tmp_state = i->state;
-                    i->z = j->z; i->state = j->state;
-                    j->z = tmp_z; j->state = tmp_state;
+                b = graphNode(j);
+                if(nodeZ(a) > nodeZ(b)){
+                    cell_word tmp = a->cell;
+                    a->cell = b->cell;
+                    b->cell = tmp;
                 }
             }
         }
@@ -85,37 +161,24 @@ void graphNodeSort(GraphNode** first_ptr){
 }
 
 /**************************************************************************/
-void graphListCleanup(GraphNode** head){
-    GraphNode *temp, *prev;
-    if(*head != NULL){
-        temp = *head;
-        /* Delete from the beginning */
-        while(temp != NULL && temp->state == DEAD){
-            *head = temp->next;
-            free(temp);
-            temp = *head;
-        }
-        /* Delete from the middle */
-        while(temp != NULL){
-            while (temp != NULL && temp->state != DEAD){
-                prev = temp;
-                temp = temp->next;
-            }
-            if(temp == NULL)
-                return;
-
-            prev->next = temp->next;
-            free(temp);
-            temp = prev->next;
+void graphListCleanup(node_index* head){
+    node_index* cur = head;
+    node_index entry;
+    while(*cur != NO_NODE){
+        entry = *cur;
+        if(nodeState(graphNode(entry)) == DEAD){
+            *cur = graphNode(entry)->next;
+            graphNodeFree(entry);
+        }else{
+            cur = &graphNode(entry)->next;
         }
     }
-    
 }
 
 /* Node Lists related functions*/
 
 /**************************************************************************/
-Node* nodeInsert(Node* first, coordinate x, coordinate y, coordinate z, GraphNode* ptr){
+Node* nodeInsert(Node* first, coordinate x, coordinate y, coordinate z, node_index ptr){
     Node* new = (Node*) malloc(sizeof(Node));
     if (new == NULL){
         fprintf(stderr, "Malloc failed. Memory full");
@@ -125,6 +188,7 @@ Node* nodeInsert(Node* first, coordinate x, coordinate y, coordinate z, GraphNod
     new->y = y;
     new->z = z;
     new->ptr = ptr;
+    new->epoch = NO_EPOCH;
     new->next = first;
     return new;
 }
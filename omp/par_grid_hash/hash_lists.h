@@ -14,8 +14,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <omp.h>
 
+/* Prefixed with the engine name, see par_grid_hash.h */
+#define node_chunks par_grid_hash_node_chunks
+#define nodePoolInit par_grid_hash_nodePoolInit
+#define nodePoolDestroy par_grid_hash_nodePoolDestroy
+#define graphNodeAlloc par_grid_hash_graphNodeAlloc
+#define graphNodeFree par_grid_hash_graphNodeFree
+#define graphNodeInsert par_grid_hash_graphNodeInsert
+#define graphNodeRemove par_grid_hash_graphNodeRemove
+#define graphNodeDelete par_grid_hash_graphNodeDelete
+#define graphNodeAddNeighbour par_grid_hash_graphNodeAddNeighbour
+#define graphNodeSort par_grid_hash_graphNodeSort
+#define graphListCleanup par_grid_hash_graphListCleanup
+#define nodeInsert par_grid_hash_nodeInsert
+#define nodeRemove par_grid_hash_nodeRemove
+#define nodeListFree par_grid_hash_nodeListFree
+
 #define true 1
 #define false 0
 
@@ -28,20 +45,95 @@
 typedef unsigned char bool;
 typedef int coordinate;
 
-/** @brief Structure for storing a node of the graph */
-typedef struct Graph_Node_Struct{
-    coordinate z;                   /**< z coordinate, x and y are implicitly mapped */
-    bool state;                     /**< State of a node cell (DEAD or ALIVE) */
-    unsigned char neighbours;       /**< Neighbour counter */
-    struct Graph_Node_Struct* next; /**< Pointer to the next entry in the list */
+#ifndef COORD_BITS
+#define COORD_BITS 16   /**< Bits of a stored coordinate, set with -DCOORD_BITS for very large cubes */
+#endif
+
+#define STATE_MASK 0x1          /**< State bit of a cell word */
+#define NEIGHBOUR_SHIFT 1       /**< Position of the neighbour counter in a cell word */
+#define NEIGHBOUR_MASK 0x7F     /**< Neighbour counter, after shifting */
+#define Z_SHIFT 8               /**< Position of z in a cell word */
+
+/** Cell word: z in the upper COORD_BITS bits, then the neighbour counter and the state */
+#if COORD_BITS + Z_SHIFT > 32
+typedef uint64_t cell_word;
+#else
+typedef uint32_t cell_word;
+#endif
+
+/** A coordinate stored in a Node, COORD_BITS wide rounded up */
+#if COORD_BITS > 16
+typedef uint32_t stored_coordinate;
+#else
+typedef uint16_t stored_coordinate;
+#endif
+
+typedef uint32_t node_index;    /**< Position of a GraphNode in the node pool */
+
+#define NO_NODE ((node_index) 0xFFFFFFFF)   /**< Null node index */
+
+/** @brief Structure for storing a node of the graph
+ *
+ *  8 bytes with the default COORD_BITS, against 16 with an int z and a
+ *  next pointer.
+ */
+typedef struct{
+    cell_word cell;                 /**< z coordinate, neighbour counter and state, x and y are implicitly mapped */
+    node_index next;                /**< Index of the next entry in the list */
 }GraphNode;
 
-/** @brief Structure for storing cells */
+#define POOL_SHIFT 12                               /**< log2 of POOL_CHUNK */
+#define POOL_CHUNK (1 << POOL_SHIFT)                /**< Number of GraphNodes a thread claims at a time */
+#define MAX_CHUNKS ((1L << (32 - POOL_SHIFT)) - 1)  /**< Chunks addressable by a node_index, short of NO_NODE */
+#define CACHE_LINE 64                               /**< Size of a cache line, in bytes */
+
+extern GraphNode** node_chunks;
+
+/** @brief Returns the node at an index of the pool */
+static inline GraphNode* graphNode(node_index index){
+    return node_chunks[index >> POOL_SHIFT] + (index & (POOL_CHUNK - 1));
+}
+
+static inline coordinate nodeZ(const GraphNode* node){
+    return (coordinate) (node->cell >> Z_SHIFT);
+}
+
+static inline bool nodeState(const GraphNode* node){
+    return node->cell & STATE_MASK;
+}
+
+static inline int nodeNeighbours(const GraphNode* node){
+    return (node->cell >> NEIGHBOUR_SHIFT) & NEIGHBOUR_MASK;
+}
+
+/** @brief Sets the state of a node and clears its neighbour counter */
+static inline void nodeSetState(GraphNode* node, bool state){
+    node->cell = (node->cell >> Z_SHIFT << Z_SHIFT) | state;
+}
+
+/** @brief Increments the neighbour counter of a node atomically
+ *
+ *  @return Whether this is the first notification of a dead cell in this generation
+ */
+static inline bool nodeAddNeighbour(GraphNode* node){
+    cell_word old = __atomic_fetch_add(&node->cell, (cell_word) 1 << NEIGHBOUR_SHIFT, __ATOMIC_RELAXED);
+    return (old & ((NEIGHBOUR_MASK << NEIGHBOUR_SHIFT) | STATE_MASK)) == DEAD;
+}
+
+#define NO_EPOCH -1     /**< Epoch of a Node whose neighbour cache was never filled */
+
+/** @brief Structure for storing cells
+ *
+ *  48 bytes with the default COORD_BITS, against 88 with int coordinates
+ *  and GraphNode pointers.
+ */
 typedef struct Node_Struct{
-    coordinate x;
-    coordinate y;
-    coordinate z;
-    struct Graph_Node_Struct* ptr;
+    stored_coordinate x;
+    stored_coordinate y;
+    stored_coordinate z;
+    int epoch;                          /**< Cleanup epoch in which `cache` was filled */
+    node_index ptr;                     /**< The graph node of the cell */
+    node_index cache[6];                /**< The graph nodes of the 6 neighbours, valid during `epoch` */
     struct Node_Struct* next;
 }Node;
 
@@ -51,68 +143,105 @@ typedef struct List_Struct{
     Node* first;                /**< First node of the list */
 }List;
 
+/* Node pool related functions */
+
+/** @brief Creates the table of chunks of the node pool
+ *
+ *  Chunks are allocated as threads claim them, so the pool only takes
+ *  the memory the graph needs, and a node is found through the table.
+ *
+ *  @return Void.
+ */
+void nodePoolInit();
+
+/** @brief Takes a GraphNode from the pool of the calling thread
+ *
+ *  @return The index of the node.
+ */
+node_index graphNodeAlloc();
+
+/** @brief Returns a GraphNode to the pool of the calling thread
+ *
+ *  @param index The index of the node
+ *  @return Void.
+ */
+void graphNodeFree(node_index index);
+
+/** @brief Releases the node pool
+ *
+ *  @attention Must be called outside of parallel regions, once no node is in use
+ *
+ *  @return Void.
+ */
+void nodePoolDestroy();
+
 /* GraphNode Lists related functions */
 
 /** @brief Inserts a GraphNode in the list with value z
  *
  *  @param first The first node of the list
  *  @param z Value of the node to be inserted
+ *  @param state The state of the node
  *  @return The head of the updated list.
  */
-GraphNode* graphNodeInsert(GraphNode* first, coordinate z, bool state);
+node_index graphNodeInsert(node_index first, coordinate z, bool state);
 
 /** @brief Removes a GraphNode from the list with value z
  *
  *  @param first_ptr A pointer to the first node of the list
  *  @param z Value of the node to be removed
  *  @param lock_ptr A pointer to a lock object
- *  @return The head of the updated list.
+ *  @return Void.
  */
-void graphNodeRemove(GraphNode** first_ptr, coordinate z, omp_lock_t* lock_ptr);
+void graphNodeRemove(node_index* first_ptr, coordinate z, omp_lock_t* lock_ptr);
 
 /** @brief Deletes a list of GraphNodes
  *
  *  @param first The first node of the list
  *  @return Void.
  */
-void graphNodeDelete(GraphNode* first);
+void graphNodeDelete(node_index first);
 
 /** @brief Inserts a cell if not yet present and increments its number of live nighbours
+ *
+ *  The counter is incremented atomically, as it may also be reached
+ *  through a neighbour cache, without the lock.
  *
  *  @param first_ptr A pointer to the first element of the GraphNode list
  *  @param z The z coordinate of the cell
- *  @param ptr A pointer to the inserted cell if inserted, else set to NULL
+ *  @param ptr Set to the node of the cell
+ *  @param lock_ptr A pointer to the lock of the list
  *
- *  @return Whether the cell was inserted in the graph or not
+ *  @return Whether this is the first notification of a dead cell in this generation
  */
-bool graphNodeAddNeighbour(GraphNode** first, coordinate z, GraphNode** ptr, omp_lock_t* lock_ptr);
+bool graphNodeAddNeighbour(node_index* first_ptr, coordinate z, node_index* ptr, omp_lock_t* lock_ptr);
 
 /** @brief Sorts a GraphNode list by ascending order of coordinate z
  *
- *  @param first_ptr A pointer to the pointer to the first GraphNode of the list
+ *  @param first_ptr A pointer to the first GraphNode of the list
  *  @return Void.
  */
-void graphNodeSort(GraphNode** first_ptr);
+void graphNodeSort(node_index* first_ptr);
 
 /** @brief Removes dead nodes from a GraphNode list
  *
  *  @param first_ptr A pointer to the first node of the list
  *  @return Void.
  */
-void graphListCleanup(GraphNode** first_ptr);
+void graphListCleanup(node_index* first_ptr);
 
 /* Node Lists related functions*/
 
-/** @brief Inserts a Node in a Node list
+/** @brief Inserts a Node in a Node list, with an empty neighbour cache
  *
  *  @param first A pointer to the first element of the list
  *  @param x X coordinate
  *  @param y Y coordinate
  *  @param z Z coordinate
- *  @param ptr The GraphNode* corresponding to the cell to be inserted
- *  @return .
+ *  @param ptr The GraphNode corresponding to the cell to be inserted
+ *  @return The head of the updated list.
  */
-Node* nodeInsert(Node* first, coordinate x, coordinate y, coordinate z, GraphNode* ptr);
+Node* nodeInsert(Node* first, coordinate x, coordinate y, coordinate z, node_index ptr);
 
 /** @brief Removes a Node* from a given Node list
  *
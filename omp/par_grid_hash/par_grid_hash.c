@@ -1,23 +1,20 @@
 #include "par_grid_hash.h"
 
+#ifndef LIFE3D_ENGINE
 int main(int argc, char* argv[]){
 
     char* input_name;           /**< Input data file name */
     int generations = 0;        /**< Number of generations to proccess */
     int cube_size = 0;          /**< Size of the 3D space */
     
-    GraphNode*** graph;         /**< Graph representation - 2D array of lists */
+    node_index** graph;         /**< Graph representation - 2D array of lists */
     Hashtable* hashtable;       /**< Contains the information of nodes that are alive */
 
-    /* Iterator variables */
-    int g, i, j;
-    GraphNode* g_it = NULL;
-    Node* it = NULL;
-
     /* Lock variables */
     omp_lock_t** graph_lock;
 
     parseArgs(argc, argv, &input_name, &generations);
+    nodePoolInit();
     int initial_alive = getAlive(input_name);
 
     /* Create the hashtable */
@@ -26,17 +23,78 @@ int main(int argc, char* argv[]){
     graph = parseFile(input_name, hashtable, &cube_size);
     debug_print("Hashtable: Occupation %.1f, Average %.2f elements per bucket", (hashtable->occupied*1.0) / hashtable->size, (hashtable->elements*1.0) /  hashtable->occupied);
 
-    /* Initialize lock variables */
-    graph_lock = (omp_lock_t**)malloc(cube_size * sizeof(omp_lock_t*));
-    for(i = 0; i < cube_size; i++){
-        graph_lock[i] = (omp_lock_t*) malloc(cube_size * sizeof(omp_lock_t));
-        for(j = 0; j < cube_size; j++){
-            omp_init_lock(&(graph_lock[i][j]));
-        }
-    }
+    graph_lock = initLocks(cube_size);
 
     double start = omp_get_wtime();  // Start Timer
+
+    runGenerations(graph, graph_lock, cube_size, hashtable, generations);
+
+    double end = omp_get_wtime();   // Stop Timer
+    
+    /* Print the final set of live cells */
+    printAndSortActive(graph, cube_size);
+    time_print(" %f\n", end - start);
     
+    /* Free resources */
+    freeGraph(graph, cube_size);
+    nodePoolDestroy();
+    hashtableFree(hashtable);    
+    freeLocks(graph_lock, cube_size);
+    free(input_name);
+
+    return 0;
+}
+#endif
+
+long parGridHashRun(int cube_size, const int* cells, long n_cells, int generations, int** live){
+
+    long c, n_live;
+    coordinate x, y, z;
+    int size = HASH_RATIO * n_cells;
+    node_index** graph;
+    omp_lock_t** graph_lock;
+    Hashtable* hashtable;
+
+    if((long) cube_size > (1L << COORD_BITS)){
+        err_print("Cube size %d needs more than %d bits per coordinate, rebuild with FLAG=-DCOORD_BITS=n", cube_size, COORD_BITS);
+        exit(EXIT_FAILURE);
+    }
+    nodePoolInit();
+    hashtable = createHashtable(size > 0 ? size : 1);
+    graph = initGraph(cube_size);
+    graph_lock = initLocks(cube_size);
+    for(c = 0; c < n_cells; c++){
+        x = cells[3 * c];
+        y = cells[3 * c + 1];
+        z = cells[3 * c + 2];
+        graph[x][y] = graphNodeInsert(graph[x][y], z, ALIVE);
+        hashtableWrite(hashtable, x, y, z, graph[x][y]);
+    }
+
+    runGenerations(graph, graph_lock, cube_size, hashtable, generations);
+
+    n_live = hashtable->elements;
+    *live = (int*) malloc(3 * n_live * sizeof(int));
+    collectActive(graph, cube_size, *live);
+
+    freeGraph(graph, cube_size);
+    nodePoolDestroy();
+    hashtableFree(hashtable);
+    freeLocks(graph_lock, cube_size);
+    return n_live;
+}
+
+void runGenerations(node_index** graph, omp_lock_t** graph_lock, int cube_size, Hashtable* hashtable, int generations){
+
+    /* Iterator variables */
+    int g, i, j;
+    Node* it = NULL;
+
+    int epoch = 0;              /**< Bumped by every cleanup, which invalidates the neighbour caches */
+
+    /* Power-of-two cubes wrap with a bitmask, other sizes split interior and boundary cells */
+    int mask = IS_POWER_OF_TWO(cube_size) ? cube_size - 1 : 0;
+
     /* Generations */
     for(g = 1; g <= generations; g++){
         
@@ -60,34 +118,10 @@ int main(int argc, char* argv[]){
             }
         }
 
-        #pragma omp parallel for private(i, j)
+        #pragma omp parallel for private(i)
         /* Notify each of the neighbours, inserting them in the graph if needed */
         for (i = 0; i < num_alive; i++){
-            
-            /* Get the coordinates from the alive node */
-            coordinate x = vector[i]->x; 
-            coordinate y = vector[i]->y; 
-            coordinate z = vector[i]->z;
-            
-            /* Calculate the coordinates of the 6 neighbours */
-            coordinate x1, x2, y1, y2, z1, z2;
-            x1 = (x+1) % cube_size; x2 = (x-1) < 0 ? (cube_size-1) : (x-1);
-            y1 = (y+1) % cube_size; y2 = (y-1) < 0 ? (cube_size-1) : (y-1);
-            z1 = (z+1) % cube_size; z2 = (z-1) < 0 ? (cube_size-1) : (z-1);
-            
-            /* Auxiliary matrix of neighbour coordinates for simpler code */
-            coordinate c[6][3] = {{x1,y,z}, {x2,y,z}, {x,y1,z}, {x,y2,z}, {x,y,z1}, {x,y,z2}};
-
-            GraphNode* ptr; // Auxiliary GraphNode pointer to a newly inserted node
-
-            /* When a node is inserted in the graph, a pointer to it is stored in the hashtable */
-            for(j = 0; j < 6; j++){
-                if(graphNodeAddNeighbour( &(graph [c[j][X]] [c[j][Y]]), c[j][Z], &ptr, &(graph_lock [c[j][X]] [c[j][Y]]))){
-                    neighbour_vector[i][j] = nodeInsert(NULL, c[j][X], c[j][Y], c[j][Z], ptr);
-                }else{
-                    neighbour_vector[i][j] = NULL;
-                }
-            }
+            notifyNeighbours(vector[i], graph, graph_lock, cube_size, mask, epoch, neighbour_vector[i]);
         }
 
         #pragma omp parallel for private(it, i, j)
@@ -96,30 +130,29 @@ int main(int argc, char* argv[]){
             
             /* Process alive node in vector*/
             it = vector[i];
-            unsigned char live_neighbours = it->ptr->neighbours;
-            it->ptr->neighbours = 0;
-            if(it->ptr->state == ALIVE){
+            GraphNode* node = graphNode(it->ptr);
+            int live_neighbours = nodeNeighbours(node);
+            if(nodeState(node) == ALIVE){
                 if(live_neighbours < 2 || live_neighbours > 4){
-                    it->ptr->state = DEAD;
-                    graphNodeRemove(&(graph[it->x][it->y]), it->z, &(graph_lock[it->x][it->y]));
+                    /* The node stays in the graph until the next cleanup, so cached indices to it remain valid */
+                    nodeSetState(node, DEAD);
                     hashtableRemove(hashtable, it->x, it->y, it->z);
-                }                        
+                }else{
+                    nodeSetState(node, ALIVE);
+                }
             }
 
             /* Process its neighbours */
             for(j = 0; j < 6; j++){
                 it = neighbour_vector[i][j];
                 if(it != NULL){
-                    unsigned char live_neighbours = it->ptr->neighbours;
-                    it->ptr->neighbours = 0;
-                    if(it->ptr->state == DEAD){
-                        if(live_neighbours == 2 || live_neighbours == 3){
-                            it->ptr->state = ALIVE;
+                    GraphNode* node = graphNode(it->ptr);
+                    int live_neighbours = nodeNeighbours(node);
+                    if(nodeState(node) == DEAD){
+                        nodeSetState(node, live_neighbours == 2 || live_neighbours == 3);
+                        if(nodeState(node) == ALIVE){
                             hashtableWrite(hashtable, it->x, it->y, it->z, it->ptr);
                         }
-                        else{
-                            graphNodeRemove(&(graph[it->x][it->y]), it->z, &(graph_lock[it->x][it->y]));
-                        }
                     }
                 }
             }
@@ -134,43 +167,114 @@ int main(int argc, char* argv[]){
         }
         free(neighbour_vector);
         free(vector);
+
+        /* Remove dead nodes from the graph once in a while, starting a new epoch */
+        if(g % REMOVAL_PERIOD == 0){
+            #pragma omp parallel for private(i, j)
+            for(i = 0; i < cube_size; i++){
+                for(j = 0; j < cube_size; j++){
+                    graphListCleanup(&graph[i][j]);
+                }
+            }
+            epoch++;
+        }
     }
+}
 
-    double end = omp_get_wtime();   // Stop Timer
-    
-    /* Print the final set of live cells */
-    printAndSortActive(graph, cube_size);
-    time_print(" %f\n", end - start);
-    
-    /* Free resources */
-    freeGraph(graph, cube_size);
-    hashtableFree(hashtable);    
-    for(i = 0; i < cube_size; i++){
-        for(j=0; j<cube_size; j++){
-            omp_destroy_lock(&(graph_lock[i][j]));
+omp_lock_t** initLocks(int size){
+
+    int i, j;
+    omp_lock_t** graph_lock = (omp_lock_t**) malloc(size * sizeof(omp_lock_t*));
+    for(i = 0; i < size; i++){
+        graph_lock[i] = (omp_lock_t*) malloc(size * sizeof(omp_lock_t));
+        for(j = 0; j < size; j++){
+            omp_init_lock(&(graph_lock[i][j]));
         }
     }
-    free(input_name);
+    return graph_lock;
+}
 
-    return 0;
+void freeLocks(omp_lock_t** graph_lock, int size){
+
+    int i, j;
+    for(i = 0; i < size; i++){
+        for(j = 0; j < size; j++){
+            omp_destroy_lock(&(graph_lock[i][j]));
+        }
+        free(graph_lock[i]);
+    }
+    free(graph_lock);
 }
 
 /* Graph related functions */
-GraphNode*** initGraph(int size){
+void neighbourCoordinates(coordinate c[6][3], int cube_size, int mask, coordinate x, coordinate y, coordinate z){
+
+    coordinate x1, x2, y1, y2, z1, z2;
+    if(mask){
+        x1 = (x+1) & mask; x2 = (x-1) & mask;
+        y1 = (y+1) & mask; y2 = (y-1) & mask;
+        z1 = (z+1) & mask; z2 = (z-1) & mask;
+    }else if(x > 0 && x < cube_size-1 && y > 0 && y < cube_size-1 && z > 0 && z < cube_size-1){
+        x1 = x+1; x2 = x-1;
+        y1 = y+1; y2 = y-1;
+        z1 = z+1; z2 = z-1;
+    }else{
+        x1 = (x+1 == cube_size) ? 0 : (x+1); x2 = (x == 0) ? (cube_size-1) : (x-1);
+        y1 = (y+1 == cube_size) ? 0 : (y+1); y2 = (y == 0) ? (cube_size-1) : (y-1);
+        z1 = (z+1 == cube_size) ? 0 : (z+1); z2 = (z == 0) ? (cube_size-1) : (z-1);
+    }
+    c[0][X] = x1; c[0][Y] = y;  c[0][Z] = z;
+    c[1][X] = x2; c[1][Y] = y;  c[1][Z] = z;
+    c[2][X] = x;  c[2][Y] = y1; c[2][Z] = z;
+    c[3][X] = x;  c[3][Y] = y2; c[3][Z] = z;
+    c[4][X] = x;  c[4][Y] = y;  c[4][Z] = z1;
+    c[5][X] = x;  c[5][Y] = y;  c[5][Z] = z2;
+}
+
+void notifyNeighbours(Node* cell, node_index** graph, omp_lock_t** graph_lock, int cube_size, int mask, int epoch, Node** candidates){
+
+    int j;
+    coordinate c[6][3];
+
+    if(cell->epoch != epoch){
+        /* No node was unlinked since the cache was filled? Else search the columns and refill it */
+        neighbourCoordinates(c, cube_size, mask, cell->x, cell->y, cell->z);
+        for(j = 0; j < 6; j++){
+            if(graphNodeAddNeighbour(&(graph[c[j][X]][c[j][Y]]), c[j][Z], &(cell->cache[j]), &(graph_lock[c[j][X]][c[j][Y]])))
+                candidates[j] = nodeInsert(NULL, c[j][X], c[j][Y], c[j][Z], cell->cache[j]);
+        }
+        cell->epoch = epoch;
+        return;
+    }
+
+    /* Cached neighbours are incremented in place, coordinates are only needed for new candidates */
+    int computed = 0;
+    for(j = 0; j < 6; j++){
+        if(nodeAddNeighbour(graphNode(cell->cache[j]))){
+            if(!computed){
+                neighbourCoordinates(c, cube_size, mask, cell->x, cell->y, cell->z);
+                computed = 1;
+            }
+            candidates[j] = nodeInsert(NULL, c[j][X], c[j][Y], c[j][Z], cell->cache[j]);
+        }
+    }
+}
+
+node_index** initGraph(int size){
 
     int i,j;
-    GraphNode*** graph = (GraphNode***) malloc(sizeof(GraphNode**) * size);
+    node_index** graph = (node_index**) malloc(sizeof(node_index*) * size);
 
     for (i = 0; i < size; i++){
-        graph[i] = (GraphNode**) malloc(sizeof(GraphNode*) * size);
+        graph[i] = (node_index*) malloc(sizeof(node_index) * size);
         for (j = 0; j < size; j++){
-            graph[i][j] = NULL;
+            graph[i][j] = NO_NODE;
         }
     }
     return graph;
 }
 
-void freeGraph(GraphNode*** graph, int size){
+void freeGraph(node_index** graph, int size){
 
     int i, j;
     if (graph != NULL){
@@ -184,26 +288,45 @@ void freeGraph(GraphNode*** graph, int size){
     }
 }
 
-void printAndSortActive(GraphNode*** graph, int cube_size){
+void printAndSortActive(node_index** graph, int cube_size){
      int x,y;
-     GraphNode* it;
+     node_index it;
      for (x = 0; x < cube_size; ++x){
          for (y = 0; y < cube_size; ++y){
              /* Sort the list by ascending coordinate z */
              graphNodeSort(&(graph[x][y]));
-             for (it = graph[x][y]; it != NULL; it = it->next){
-                 if (it->state == ALIVE)
-                     out_print("%d %d %d\n", x, y, it->z);
+             for (it = graph[x][y]; it != NO_NODE; it = graphNode(it)->next){
+                 if (nodeState(graphNode(it)) == ALIVE)
+                     out_print("%d %d %d\n", x, y, nodeZ(graphNode(it)));
              }
          }
      }
 }
 
 
-void printSortedGraphToFile(GraphNode*** graph, int cube_size, char* input_name, int generations){
+void collectActive(node_index** graph, int cube_size, int* live){
+    int x,y;
+    long n_live = 0;
+    node_index it;
+    for (x = 0; x < cube_size; ++x){
+        for (y = 0; y < cube_size; ++y){
+            graphNodeSort(&(graph[x][y]));
+            for (it = graph[x][y]; it != NO_NODE; it = graphNode(it)->next){
+                if (nodeState(graphNode(it)) == ALIVE){
+                    live[3 * n_live] = x;
+                    live[3 * n_live + 1] = y;
+                    live[3 * n_live + 2] = nodeZ(graphNode(it));
+                    n_live++;
+                }
+            }
+        }
+    }
+}
+
+void printSortedGraphToFile(node_index** graph, int cube_size, char* input_name, int generations){
     
     int x,y;
-    GraphNode* it;
+    node_index it;
     char* output_name = generateOuputFilename(input_name, generations);
     FILE* output = fopen(output_name, "w");
     if (output == NULL){
@@ -214,8 +337,9 @@ void printSortedGraphToFile(GraphNode*** graph, int cube_size, char* input_name,
         for (y = 0; y < cube_size; ++y){
             /* Sort the list by ascending coordinate z */
             graphNodeSort(&(graph[x][y]));
-            for (it = graph[x][y]; it != NULL; it = it->next){    
-                fprintf(output, "%d %d %d\n", x, y, it->z);
+            for (it = graph[x][y]; it != NO_NODE; it = graphNode(it)->next){
+                if (nodeState(graphNode(it)) == ALIVE)
+                    fprintf(output, "%d %d %d\n", x, y, nodeZ(graphNode(it)));
             }
         }
     }
@@ -280,7 +404,7 @@ int getAlive(char* file){
     return alive_num - 1;
 }
 
-GraphNode*** parseFile(char* input_name, Hashtable* hashtable, int* cube_size){
+node_index** parseFile(char* input_name, Hashtable* hashtable, int* cube_size){
     
     int first = 0;
     char line[BUFFER_SIZE];
@@ -290,11 +414,15 @@ GraphNode*** parseFile(char* input_name, Hashtable* hashtable, int* cube_size){
         err_print("Please input a valid file name");
         exit(EXIT_FAILURE);
     }
-    GraphNode*** graph;
+    node_index** graph;
 
     while(fgets(line, sizeof(line), fp)){
         if(!first){
             if(sscanf(line, "%d\n", cube_size) == 1){
+                if((long) *cube_size > (1L << COORD_BITS)){
+                    err_print("Cube size %d needs more than %d bits per coordinate, rebuild with FLAG=-DCOORD_BITS=n", *cube_size, COORD_BITS);
+                    exit(EXIT_FAILURE);
+                }
                 first = 1;
                 graph = initGraph(*cube_size);
             }    
@@ -302,7 +430,7 @@ GraphNode*** parseFile(char* input_name, Hashtable* hashtable, int* cube_size){
             if(sscanf(line, "%d %d %d\n", &x, &y, &z) == 3){
                 /* Insert live nodes in the graph and the update set */
                 graph[x][y] = graphNodeInsert(graph[x][y], z, ALIVE);
-                hashtableWrite(hashtable, x, y, z, (GraphNode*)(graph[x][y]));                
+                hashtableWrite(hashtable, x, y, z, graph[x][y]);                
             }
         }
     }
@@ -20,9 +20,27 @@
 #include "hash.h"
 #include "debug.h"
 
+/* Engine name prefix, so that omp/life3d can link this engine next to the other C engines */
+#define neighbourCoordinates par_grid_hash_neighbourCoordinates
+#define notifyNeighbours par_grid_hash_notifyNeighbours
+#define runGenerations par_grid_hash_runGenerations
+#define initLocks par_grid_hash_initLocks
+#define freeLocks par_grid_hash_freeLocks
+#define initGraph par_grid_hash_initGraph
+#define freeGraph par_grid_hash_freeGraph
+#define printAndSortActive par_grid_hash_printAndSortActive
+#define collectActive par_grid_hash_collectActive
+#define printSortedGraphToFile par_grid_hash_printSortedGraphToFile
+#define generateOuputFilename par_grid_hash_generateOuputFilename
+#define findLastDot par_grid_hash_findLastDot
+#define parseArgs par_grid_hash_parseArgs
+#define parseFile par_grid_hash_parseFile
+#define getAlive par_grid_hash_getAlive
+
 #define ALIVE 1             /**< Macro for representing a live cell */
 #define DEAD 0              /**< Macro for representing a dead cell */
 #define HASH_RATIO 0.05     /**< HashTable_Size / #Initially_Live_Cells */
+#define REMOVAL_PERIOD 5    /**< Number of generations between graph cleanup calls (removal of dead nodes) */
 
 #define BUFFER_SIZE 100     /**< Maximum length for a single infile line */
 #define GEN_BUFFER_SIZE 20  /**< Maximum length for generation string */
@@ -32,21 +50,96 @@
 #define Y 1 /**< Macro for second coordinate (y) in an array of coordinates */
 #define Z 2 /**< Macro for third coordinate (z) in an array of coordinates */
 
+#define IS_POWER_OF_TWO(n) ((n) > 0 && ((n) & ((n) - 1)) == 0)  /**< Whether the cube can wrap with a bitmask */
+
 typedef unsigned char bool;
 
+/** @brief Computes the coordinates of the 6 neighbours of (x,y,z)
+ *
+ *  Power-of-two cubes wrap with a bitmask. Otherwise, interior cells
+ *  skip wrapping altogether and boundary cells wrap with a compare.
+ *
+ *  @param c The neighbour coordinates, indexed by X, Y and Z
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param mask cube_size - 1 if cube_size is a power of two, 0 otherwise
+ *  @param x X coordinate
+ *  @param y Y coordinate
+ *  @param z Z coordinate
+ *  @return Void.
+ */
+void neighbourCoordinates(coordinate c[6][3], int cube_size, int mask, coordinate x, coordinate y, coordinate z);
+
+/** @brief Notifies the 6 neighbours of a live cell
+ *
+ *  The first time in an epoch, the neighbour columns are searched and
+ *  the nodes found or inserted are cached in the cell. Until the next
+ *  cleanup unlinks nodes, the cached counters are incremented directly,
+ *  with no coordinates, locks or list searches.
+ *
+ *  @param cell The live cell
+ *  @param graph The graph representation
+ *  @param graph_lock The per-list locks
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param mask cube_size - 1 if cube_size is a power of two, 0 otherwise
+ *  @param epoch The current cleanup epoch
+ *  @param candidates Set, for each neighbour, to a new Node if it is a dead cell notified for the first time
+ *  @return Void.
+ */
+void notifyNeighbours(Node* cell, node_index** graph, omp_lock_t** graph_lock, int cube_size, int mask, int epoch, Node** candidates);
+
+/** @brief Processes generations on the graph
+ *
+ *  @param graph The graph representation
+ *  @param graph_lock The per-list locks
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param hashtable The live cells, updated every generation
+ *  @param generations Number of generations to process
+ *  @return Void.
+ */
+void runGenerations(node_index** graph, omp_lock_t** graph_lock, int cube_size, Hashtable* hashtable, int generations);
+
+/** @brief Runs the engine from a list of cells, for omp/life3d
+ *
+ *  Building with -DLIFE3D_ENGINE leaves out main(), so that omp/life3d can
+ *  link the engine and select it with --engine.
+ *
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param cells The live cells, as x y z triples, without repetitions
+ *  @param n_cells The number of live cells
+ *  @param generations Number of generations to process
+ *  @param live Set to the final live cells, as x y z triples in ascending order, to be freed by the caller
+ *  @return The number of final live cells.
+ */
+long parGridHashRun(int cube_size, const int* cells, long n_cells, int generations, int** live);
+
+/** @brief Creates a lock for each list of the graph
+ *
+ *  @param size The size of the side of the cube that represents the 3D space
+ *  @return The initialized locks.
+ */
+omp_lock_t** initLocks(int size);
+
+/** @brief Destroys and frees the locks of the lists
+ *
+ *  @param graph_lock The per-list locks
+ *  @param size The size of the side of the cube that represents the 3D space
+ *  @return Void.
+ */
+void freeLocks(omp_lock_t** graph_lock, int size);
+
 /** @brief Initializes the graph representation structure
  *  
  *  @param size The size of the side of the cube that represents the 3D space
  *  @return The initialized, yet empty, graph representation.
  */
-GraphNode*** initGraph(int size);
+node_index** initGraph(int size);
 
 /** @brief Frees the graph representation from memory
  *  
  *  @param size The size of the side of the cube that represents the 3D space
  *  @return Void.
  */
-void freeGraph(GraphNode*** graph, int size);
+void freeGraph(node_index** graph, int size);
 
 /** @brief Prints the graph, and sorts each of the lists
  *
@@ -56,7 +149,19 @@ void freeGraph(GraphNode*** graph, int size);
  *  @param graph The graph representation    
  *  @param size The size of the side of the cube that represents the 3D space
  */
-void printAndSortActive(GraphNode*** graph, int cube_size);
+void printAndSortActive(node_index** graph, int cube_size);
+
+/** @brief Copies the live cells of the graph, and sorts each of the lists
+ *
+ *  @attention Should not be called while processing generations,
+ *  as sorting breaks pointer logic with list
+ *
+ *  @param graph The graph representation
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param live Filled with the live cells, as x y z triples in ascending order
+ *  @return Void.
+ */
+void collectActive(node_index** graph, int cube_size, int* live);
 
 /** @brief Prints the graph to an output file
  *
@@ -69,7 +174,7 @@ void printAndSortActive(GraphNode*** graph, int cube_size);
  *  @param generations Number of processed generations
  *  @return Void.
  */
-void printSortedGraphToFile(GraphNode*** graph, int cube_size, char* input_name, int generations);
+void printSortedGraphToFile(node_index** graph, int cube_size, char* input_name, int generations);
 
 /** @brief Generates the output filename string
  *
@@ -109,7 +214,7 @@ void parseArgs(int argc, char* argv[], char** input_name, int* generations);
  *  @param cube_size The size of the side of the cube that represents the 3D space
  *  @return The filled `GraphNode` graph representation.
  */
-GraphNode*** parseFile(char* file, Hashtable* hashtable, int* cube_size); 
+node_index** parseFile(char* file, Hashtable* hashtable, int* cube_size); 
 
 /** @brief Returns the number of live cells at the start 
  *
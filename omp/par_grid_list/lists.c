@@ -83,125 +83,62 @@ void graphNodeSort(GraphNode** first_ptr){
     }
 }
 
-/* Node Lists related functions*/
+/* Frontier related functions */
+
 /**************************************************************************/
-List* listCreate(){
-    List* list = (List*) malloc(sizeof(List));
-    if (list == NULL){
+Frontier* frontierCreate(){
+    Frontier* frontier = (Frontier*) malloc(sizeof(Frontier));
+    if (frontier == NULL){
         fprintf(stderr, "Malloc failed. Memory full");
         exit(EXIT_FAILURE);
     }
-    list->size = 0;
-    list->first = NULL;
-    return list;
-}
-
-/**************************************************************************/
-Node* listFirst(List* list){
-    if (list != NULL){
-        return list->first;
-    }
-    return NULL;
+    frontierInit(frontier);
+    return frontier;
 }
 
 /**************************************************************************/
-void listInsert(List* list, coordinate x, coordinate y, coordinate z, GraphNode* ptr){
-    if(list != NULL){
-        list->first = nodeInsert(list->first, x, y, z, ptr);
-        list->size++;
-    }
+void frontierInit(Frontier* frontier){
+    frontier->size = 0;
+    frontier->capacity = 0;
+    frontier->cells = NULL;
 }
 
 /**************************************************************************/
-void listInsertLock(List* list, coordinate x, coordinate y, coordinate z, GraphNode* ptr, omp_lock_t* lock_ptr){
-    if(list != NULL){
-        omp_set_lock(lock_ptr);
-        list->first = nodeInsert(list->first, x, y, z, ptr);
-        list->size++;
-        omp_unset_lock(lock_ptr);
+void frontierReserve(Frontier* frontier, long capacity){
+    if (capacity > frontier->capacity){
+        if (capacity < 2 * frontier->capacity)
+            capacity = 2 * frontier->capacity;
+        frontier->cells = (Node*) realloc(frontier->cells, capacity * sizeof(Node));
+        if (frontier->cells == NULL){
+            fprintf(stderr, "Realloc failed. Memory full");
+            exit(EXIT_FAILURE);
+        }
+        frontier->capacity = capacity;
     }
 }
 
 /**************************************************************************/
-Node* nodeInsert(Node* first, coordinate x, coordinate y, coordinate z, GraphNode* ptr){
-    Node* new = (Node*) malloc(sizeof(Node));
-    if (new == NULL){
-        fprintf(stderr, "Malloc failed. Memory full");
-        exit(EXIT_FAILURE);
-    }
-    new->x = x;
-    new->y = y;
-    new->z = z;
-    new->ptr = ptr;
-    new->next = first;
-    return new;
+void frontierPush(Frontier* frontier, coordinate x, coordinate y, coordinate z, GraphNode* ptr){
+    Node* cell;
+    if (frontier->size == frontier->capacity)
+        frontierReserve(frontier, frontier->size + 1);
+    cell = &frontier->cells[frontier->size++];
+    cell->x = x;
+    cell->y = y;
+    cell->z = z;
+    cell->ptr = ptr;
 }
 
 /**************************************************************************/
-void listRemove(List* list, coordinate x, coordinate y, coordinate z){
-    if(list != NULL){
-        if(nodeRemove(&(list->first), x, y, z))
-            list->size--;
-    }   
+void frontierFree(Frontier* frontier){
+    free(frontier->cells);
+    frontierInit(frontier);
 }
 
 /**************************************************************************/
-bool nodeRemove(Node** first_ptr, coordinate x, coordinate y, coordinate z){
-    Node** cur;
-    for (cur = first_ptr; *cur; ){
-        Node* entry = *cur;
-        if (entry->x == x && entry->y == y && entry->z == z){
-            *cur = entry->next;
-            free(entry);
-            return true;
-        }else{
-            cur = &entry->next;
-        }
+void frontierDelete(Frontier* frontier){
+    if (frontier != NULL){
+        free(frontier->cells);
+        free(frontier);
     }
-    return false;
-}
-
-/**************************************************************************/
-void listDelete(List* list){
-    Node* it, *next;
-    if (list != NULL){
-        for(it = list->first; it != NULL; it = next){
-            next = it->next;
-            free(it);
-        }
-        free(list);
-    }    
 }
-
-/**************************************************************************/
-void listCleanup(List* list){
-    Node *temp, *prev;
-    if (list != NULL){
-        temp = list->first;
-        
-        /* Delete from the beginning */
-        while (temp != NULL && temp->x == REMOVE){
-            list->first = temp->next;   
-            free(temp);                 
-            list->size--;
-            temp = list->first;
-        }
-     
-        /* Delete from the middle */
-        while (temp != NULL){
-            while (temp != NULL && temp->x != REMOVE){
-                prev = temp;
-                temp = temp->next;
-            }
-        
-            /* No entries scheduled for removal found */
-            if (temp == NULL) return;
-     
-            prev->next = temp->next;
-            free(temp);
-            list->size--;
-
-            temp = prev->next;
-        }
-    }
-}
\ No newline at end of file
@@ -6,13 +6,25 @@
 #include <string.h>
 #include <omp.h>
 
+/* Prefixed with the engine name, see par_grid_list.h */
+#define graphNodeInsert par_grid_list_graphNodeInsert
+#define graphNodeRemove par_grid_list_graphNodeRemove
+#define graphNodeDelete par_grid_list_graphNodeDelete
+#define graphNodeAddNeighbour par_grid_list_graphNodeAddNeighbour
+#define graphNodeSort par_grid_list_graphNodeSort
+#define frontierCreate par_grid_list_frontierCreate
+#define frontierInit par_grid_list_frontierInit
+#define frontierReserve par_grid_list_frontierReserve
+#define frontierPush par_grid_list_frontierPush
+#define frontierFree par_grid_list_frontierFree
+#define frontierDelete par_grid_list_frontierDelete
+
 #define true 1
 #define false 0
 
 #define ALIVE 1
 #define DEAD 0
 
-#define REMOVE -1   /**< Used to signal that an entry in list should be removed */
 #define UPDATE 1    /**< Used to force a GraphNode insertion to simply update an existing node */
 
 typedef unsigned char bool;
@@ -32,14 +44,14 @@ typedef struct Node_Struct{
     coordinate y;
     coordinate z;
     struct Graph_Node_Struct* ptr;
-    struct Node_Struct* next;
 }Node;
 
-/** @brief List container structure */
-typedef struct List_Struct{
-    int size;                   /**< Number of elements in list */
-    Node* first;                /**< First node of the list */
-}List;
+/** @brief Growable contiguous array of cells */
+typedef struct Frontier_Struct{
+    long size;                  /**< Number of cells in the array */
+    long capacity;              /**< Number of allocated cells */
+    Node* cells;                /**< The cells */
+}Frontier;
 
 /* NodeGraph Lists related functions */
 
@@ -79,83 +91,52 @@ bool graphNodeAddNeighbour(GraphNode** first, coordinate z, GraphNode** ptr, omp
  */
 void graphNodeSort(GraphNode** first_ptr);
 
-/* Node Lists related functions*/
-
-/** @brief Creates a list structure
- *
- *  @return The resulting empty list structure, with size 0.
- */
-List* listCreate();
+/* Frontier related functions */
 
-/** @brief Returns the Node list of a given List structure
+/** @brief Creates an empty frontier
  *
- *  @param list The list structure pointer
- *  @return A pointer to the Node* list of list.
+ *  @return The frontier, with size 0.
  */
-Node* listFirst(List* list);
+Frontier* frontierCreate();
 
-/** @brief Inserts a Node* in a given list and updates size
+/** @brief Initializes an empty frontier in place
  *
- *  @param list The list we want to insert in
- *  @param x X coordinate of the cell to be inserted
- *  @param y Y coordinate of the cell to be inserted
- *  @param z Z coordinate of the cell to be inserted
- *  @param ptr The GraphNode* corresponding to the cell to be inserted
+ *  @param frontier The frontier
  *  @return Void.
  */
-void listInsert(List* list, coordinate x, coordinate y, coordinate z, GraphNode* ptr);
+void frontierInit(Frontier* frontier);
 
-
-/** @brief Inserts a Node* in a given list and updates size
+/** @brief Grows a frontier, if needed, to hold `capacity` cells
  *
+ *  @param frontier The frontier
+ *  @param capacity The number of cells
  *  @return Void.
  */
-void listInsertLock(List* list, coordinate x, coordinate y, coordinate z, GraphNode* ptr, omp_lock_t* lock_ptr);
+void frontierReserve(Frontier* frontier, long capacity);
 
-/** @brief Inserts a Node in a Node list
+/** @brief Appends a cell to a frontier
  *
- *  @param first A pointer to the first element of the list
- *  @param x X coordinate
- *  @param y Y coordinate
- *  @param z Z coordinate
- *  @param ptr The GraphNode* corresponding to the cell to be inserted
- *  @return .
- */
-Node* nodeInsert(Node* first, coordinate x, coordinate y, coordinate z, GraphNode* ptr);
-
-/** @brief Removes a Node* from a given list structure and updates size
- *
- *  @param x X coordinate
- *  @param y Y coordinate
- *  @param z Z coordinate
+ *  @param frontier The frontier
+ *  @param x X coordinate of the cell
+ *  @param y Y coordinate of the cell
+ *  @param z Z coordinate of the cell
+ *  @param ptr The GraphNode* corresponding to the cell
  *  @return Void.
  */
-void listRemove(List* list, coordinate x, coordinate y, coordinate z);
-
-/** @brief Removes a Node* from a given Node list
- *
- *  @param first_ptr A pointer to the first node of the list
- *  @param x X coordinate
- *  @param y Y coordinate
- *  @param z Z coordinate
- *  @return Whether the removal was successful or not.
- */
-bool nodeRemove(Node** first_ptr, coordinate x, coordinate y, coordinate z);
+void frontierPush(Frontier* frontier, coordinate x, coordinate y, coordinate z, GraphNode* ptr);
 
-/** @brief Deletes a List strucutre
+/** @brief Frees the cells of a frontier initialized in place
  *
- *  @param list The list to be deleted
+ *  @param frontier The frontier
  *  @return Void.
  */
-void listDelete(List* list);
+void frontierFree(Frontier* frontier);
 
-/** @brief Removes scheduled entries from a List structure
- *
- *  Removes entries in Node* list with x = REMOVE
+/** @brief Deletes a frontier created with frontierCreate
  *
- *  @param list The list to be cleaned
+ *  @param frontier The frontier
  *  @return Void.
  */
-void listCleanup(List* list);
+void frontierDelete(Frontier* frontier);
 
 #endif
\ No newline at end of file
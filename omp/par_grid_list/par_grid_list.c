@@ -1,5 +1,6 @@
 #include "par_grid_list.h"
 
+#ifndef LIFE3D_ENGINE
 int main(int argc, char* argv[]){
 
     char* file;                 /**< Input data file name */
@@ -7,142 +8,217 @@ int main(int argc, char* argv[]){
     int cube_size = 0;          /**< Size of the 3D space */
     
     GraphNode*** graph;         /**< Graph representation - 2D array of lists */
-    List* update;               /**< Contains the information of nodes that might change state */
-
-    /* Iterator variables */
-    int g, i, j;
-    GraphNode* g_it = NULL;
-    Node* it = NULL;
+    Frontier* frontier;         /**< The live cells */
 
     /* Lock variables */
-    omp_lock_t list_lock;
     omp_lock_t** graph_lock;
 
     parseArgs(argc, argv, &file, &generations);
 
-    /* Create an empty list, with size 0 */
-    update = listCreate();
+    frontier = frontierCreate();
+    graph = parseFile(file, frontier, &cube_size);
+    graph_lock = initLocks(cube_size);
+
+    double start = omp_get_wtime();  // Start Timer
+
+    runGenerations(graph, graph_lock, cube_size, frontier, generations);
 
-    graph = parseFile(file, update, &cube_size);
+    double end = omp_get_wtime();   // Stop Timer
     
-    /* Initialize lock variables */
-    omp_init_lock(&list_lock);
-    graph_lock = (omp_lock_t**)malloc(cube_size * sizeof(omp_lock_t*));
-    for(i = 0; i < cube_size; i++){
-        graph_lock[i] = (omp_lock_t*) malloc(cube_size * sizeof(omp_lock_t));
-        for(j = 0; j < cube_size; j++){
-            omp_init_lock(&(graph_lock[i][j]));
-        }
+    /* Print the final set of live cells */
+    printAndSortActive(graph, cube_size);
+    time_print("%f\n", end - start);
+    
+    /* Free resources */
+    freeGraph(graph, cube_size);
+    frontierDelete(frontier);
+    freeLocks(graph_lock, cube_size);
+    free(file);
+
+    return 0;
+}
+#endif
+
+/**************************************************************************/
+long parGridListRun(int cube_size, const int* cells, long n_cells, int generations, int** live){
+
+    long c, n_live;
+    coordinate x, y, z;
+    GraphNode*** graph = initGraph(cube_size);
+    omp_lock_t** graph_lock = initLocks(cube_size);
+    Frontier* frontier = frontierCreate();
+
+    for(c = 0; c < n_cells; c++){
+        x = cells[3 * c];
+        y = cells[3 * c + 1];
+        z = cells[3 * c + 2];
+        graph[x][y] = graphNodeInsert(graph[x][y], z, ALIVE);
+        frontierPush(frontier, x, y, z, graph[x][y]);
     }
-    double start = omp_get_wtime();  // Start Timer
+
+    runGenerations(graph, graph_lock, cube_size, frontier, generations);
+
+    n_live = frontier->size;
+    *live = (int*) malloc(3 * n_live * sizeof(int));
+    collectActive(graph, cube_size, *live);
+
+    freeGraph(graph, cube_size);
+    frontierDelete(frontier);
+    freeLocks(graph_lock, cube_size);
+    return n_live;
+}
+
+/**************************************************************************/
+void runGenerations(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, Frontier* frontier, int generations){
+
+    Frontier* next = frontierCreate();  /**< The live cells of the next generation */
+    Frontier swap;
+
+    /* Per-thread frontier of newly discovered neighbours, and the offsets of each thread in `next` */
+    int max_threads = omp_get_max_threads();
+    Frontier* local = (Frontier*) malloc(max_threads * sizeof(Frontier));
+    long* offset = (long*) malloc((max_threads + 1) * sizeof(long));
+
+    /* Iterator variables */
+    int g, i;
+
+    for(i = 0; i < max_threads; i++)
+        frontierInit(&local[i]);
+
     for(g = 1; g <= generations; g++){
         
-        /* Convert list to vector */
-        i = 0;
-        int size = update->size;
-        Node** vector = (Node**) malloc(sizeof(Node*) * size);
-        for (it = listFirst(update); it != NULL; it = it->next){
-            vector[i++] = it;
-        }
-        Node** proccessed;
-        /* For each live node, inform its neighbors */
         #pragma omp parallel
         {
+            int tid = omp_get_thread_num();
+            int n_threads = omp_get_num_threads();
+            long l;
+            Frontier* mine = &local[tid];
+            mine->size = 0;
+
+            /* For each live node, inform its neighbors. The column lists deduplicate new neighbours,
+             * so the thread that inserts one is the only one to append it to its frontier */
             #pragma omp for
-            for (i = 0; i < size; i++){
-                //printf("Neighbours processing by thread: %d\n", omp_get_thread_num());
-                visitNeighbours(graph, graph_lock, cube_size, update, &list_lock, vector[i]->x, vector[i]->y, vector[i]->z);
+            for (l = 0; l < frontier->size; l++){
+                Node* it = &frontier->cells[l];
+                visitNeighbours(graph, graph_lock, cube_size, mine, it->x, it->y, it->z);
             }
-            
-            /* Convert list to vector */
+
+            /* Update the graph, for a share of the live cells and the neighbours found by this thread,
+             * keeping the cells that will be alive at the front of each array */
+            long lo = frontier->size * tid / n_threads;
+            long hi = frontier->size * (tid + 1) / n_threads;
+            long kept_live = updateCells(graph, graph_lock, &frontier->cells[lo], hi - lo);
+            long kept_new = updateCells(graph, graph_lock, mine->cells, mine->size);
+            offset[tid + 1] = kept_live + kept_new;
+            #pragma omp barrier
+
+            /* Prefix sum of the kept cells gives each thread its place in the next frontier */
             #pragma omp single
             {
-                i = 0;
-                size = update->size;
-                proccessed = (Node**) malloc(sizeof(Node*) * size);
-                for (it = listFirst(update); it != NULL; it = it->next){
-                    proccessed[i++] = it;
-                }                
+                offset[0] = 0;
+                for (i = 0; i < n_threads; i++)
+                    offset[i + 1] += offset[i];
+                frontierReserve(next, offset[n_threads]);
+                next->size = offset[n_threads];
             }
 
-            /* Update graph and update set */         
-            #pragma omp for
-            for (i = 0; i < size; i++){
-                //printf("Update graph processing by thread: %d\n", omp_get_thread_num());
-                Node* it = proccessed[i];
-                unsigned char live_neighbours = it->ptr->neighbours;
-                it->ptr->neighbours = 0;
-                if(it->ptr->state == ALIVE){
-                    if(live_neighbours < 2 || live_neighbours > 4){
-                        graphNodeRemove(&(graph[it->x][it->y]), it->z, &(graph_lock[it->x][it->y]));
-                        it->x = REMOVE;
-                    }
-                }else{
-                    if(live_neighbours == 2 || live_neighbours == 3){
-                        it->ptr->state = ALIVE; 
-                    }
-                    else{
-                        graphNodeRemove(&(graph[it->x][it->y]), it->z, &(graph_lock[it->x][it->y]));
-                        it->x = REMOVE;
-                    }
-                }
-            }
+            memcpy(&next->cells[offset[tid]], &frontier->cells[lo], kept_live * sizeof(Node));
+            memcpy(&next->cells[offset[tid] + kept_live], mine->cells, kept_new * sizeof(Node));
         }
 
-        /* Clean dead cells from the set */
-        listCleanup(update);
-        free(proccessed);
-        free(vector);
+        swap = *frontier;
+        *frontier = *next;
+        *next = swap;
     }
 
-    double end = omp_get_wtime();   // Stop Timer
-    
-    /* Print the final set of live cells */
-    printAndSortActive(graph, cube_size);
-    time_print("%f\n", end - start);
-    
-    /* Free resources */
-    freeGraph(graph, cube_size);
-    listDelete(update);
-    omp_destroy_lock(&list_lock);
-    for(i = 0; i < cube_size; i++){
-        for(j=0; j<cube_size; j++){
+    frontierDelete(next);
+    for(i = 0; i < max_threads; i++)
+        frontierFree(&local[i]);
+    free(local);
+    free(offset);
+}
+
+/**************************************************************************/
+omp_lock_t** initLocks(int size){
+
+    int i, j;
+    omp_lock_t** graph_lock = (omp_lock_t**) malloc(size * sizeof(omp_lock_t*));
+    for(i = 0; i < size; i++){
+        graph_lock[i] = (omp_lock_t*) malloc(size * sizeof(omp_lock_t));
+        for(j = 0; j < size; j++){
+            omp_init_lock(&(graph_lock[i][j]));
+        }
+    }
+    return graph_lock;
+}
+
+/**************************************************************************/
+void freeLocks(omp_lock_t** graph_lock, int size){
+
+    int i, j;
+    for(i = 0; i < size; i++){
+        for(j = 0; j < size; j++){
             omp_destroy_lock(&(graph_lock[i][j]));
         }
+        free(graph_lock[i]);
     }
-    free(file);
+    free(graph_lock);
+}
 
-    return 0;
+/**************************************************************************/
+long updateCells(GraphNode*** graph, omp_lock_t** graph_lock, Node* cells, long n_cells){
+
+    long i, kept = 0;
+    for (i = 0; i < n_cells; i++){
+        Node* it = &cells[i];
+        unsigned char live_neighbours = it->ptr->neighbours;
+        it->ptr->neighbours = 0;
+        if(it->ptr->state == ALIVE){
+            if(live_neighbours < 2 || live_neighbours > 4){
+                graphNodeRemove(&(graph[it->x][it->y]), it->z, &(graph_lock[it->x][it->y]));
+                continue;
+            }
+        }else{
+            if(live_neighbours == 2 || live_neighbours == 3){
+                it->ptr->state = ALIVE; 
+            }
+            else{
+                graphNodeRemove(&(graph[it->x][it->y]), it->z, &(graph_lock[it->x][it->y]));
+                continue;
+            }
+        }
+        cells[kept++] = *it;
+    }
+    return kept;
 }
 
 /**************************************************************************/
 void visitNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size,
-                        List* list, omp_lock_t* list_lock,
-                        coordinate x, coordinate y, coordinate z){
+                        Frontier* found, coordinate x, coordinate y, coordinate z){
 
     GraphNode* ptr;
     coordinate x1, x2, y1, y2, z1, z2;
     x1 = (x+1)%cube_size; x2 = (x-1) < 0 ? (cube_size-1) : (x-1);
     y1 = (y+1)%cube_size; y2 = (y-1) < 0 ? (cube_size-1) : (y-1);
     z1 = (z+1)%cube_size; z2 = (z-1) < 0 ? (cube_size-1) : (z-1);
-    /* If a cell is visited for the first time, add it to the update list, for fast access */
+    /* If a cell is visited for the first time, add it to the frontier, for fast access */
     if(graphNodeAddNeighbour(&(graph[x1][y]), z, &ptr, &graph_lock[x1][y])){ 
-        listInsertLock(list, x1, y, z, ptr, list_lock);
+        frontierPush(found, x1, y, z, ptr);
     }
     if(graphNodeAddNeighbour(&(graph[x2][y]), z, &ptr, &graph_lock[x2][y])){ 
-        listInsertLock(list, x2, y, z, ptr, list_lock);
+        frontierPush(found, x2, y, z, ptr);
     }
     if(graphNodeAddNeighbour(&(graph[x][y1]), z, &ptr, &graph_lock[x][y1])){ 
-        listInsertLock(list, x, y1, z, ptr, list_lock);
+        frontierPush(found, x, y1, z, ptr);
     }
     if(graphNodeAddNeighbour(&(graph[x][y2]), z, &ptr, &graph_lock[x][y2])){ 
-        listInsertLock(list, x, y2, z, ptr, list_lock);
+        frontierPush(found, x, y2, z, ptr);
     }
     if(graphNodeAddNeighbour(&(graph[x][y]), z1, &ptr, &graph_lock[x][y])){ 
-        listInsertLock(list, x, y, z1, ptr, list_lock);
+        frontierPush(found, x, y, z1, ptr);
     }
     if(graphNodeAddNeighbour(&(graph[x][y]), z2, &ptr, &graph_lock[x][y])){ 
-        listInsertLock(list, x, y, z2, ptr, list_lock);
+        frontierPush(found, x, y, z2, ptr);
     }
 }
 
@@ -192,6 +268,24 @@ void printAndSortActive(GraphNode*** graph, int cube_size){
     }
 }
 
+/**************************************************************************/
+void collectActive(GraphNode*** graph, int cube_size, int* live){
+    int x,y;
+    long n_live = 0;
+    GraphNode* it;
+    for (x = 0; x < cube_size; ++x){
+        for (y = 0; y < cube_size; ++y){
+            graphNodeSort(&(graph[x][y]));
+            for (it = graph[x][y]; it != NULL; it = it->next){
+                live[3 * n_live] = x;
+                live[3 * n_live + 1] = y;
+                live[3 * n_live + 2] = it->z;
+                n_live++;
+            }
+        }
+    }
+}
+
 /**************************************************************************/
 void parseArgs(int argc, char* argv[], char** file, int* generations){
     if (argc == 3){
@@ -208,7 +302,7 @@ void parseArgs(int argc, char* argv[], char** file, int* generations){
 }
 
 /**************************************************************************/
-GraphNode*** parseFile(char* file, List* list, int* cube_size){
+GraphNode*** parseFile(char* file, Frontier* frontier, int* cube_size){
     
     int first = 0;
     char line[BUFFER_SIZE];
@@ -228,9 +322,9 @@ GraphNode*** parseFile(char* file, List* list, int* cube_size){
             }    
         }else{
             if(sscanf(line, "%d %d %d\n", &x, &y, &z) == 3){
-                /* Insert live nodes in the graph and the update set */
+                /* Insert live nodes in the graph and the frontier */
                 graph[x][y] = graphNodeInsert(graph[x][y], z, ALIVE);
-                listInsert(list, x, y, z, (GraphNode*) (graph[x][y]));                
+                frontierPush(frontier, x, y, z, graph[x][y]);
             }
         }
     }
@@ -3,8 +3,10 @@
  *
  *  Parallel OpenMP implementation of seq_grid_list  
  *  2D Matrix of lists is used as the graph representation.
- *  A separate list is used for keeping track of live cells and neighbours.
- *  This list provides fast direct access to the nodes, by storing pointers to them.
+ *  A contiguous frontier array keeps track of live cells, and provides fast
+ *  direct access to the nodes, by storing pointers to them. Each thread
+ *  collects the neighbours it discovers in its own frontier, and the next
+ *  frontier is compacted from them in parallel, with no global lock.
  *
  *  @author Pedro Abreu
  *  @author João Borrego
@@ -22,24 +24,87 @@
 #include "lists.h"
 #include "debug.h"
 
+/* Global symbols carry the engine name, as several C engines are linked into omp/life3d */
+#define visitNeighbours par_grid_list_visitNeighbours
+#define updateCells par_grid_list_updateCells
+#define runGenerations par_grid_list_runGenerations
+#define initLocks par_grid_list_initLocks
+#define freeLocks par_grid_list_freeLocks
+#define initGraph par_grid_list_initGraph
+#define freeGraph par_grid_list_freeGraph
+#define printAndSortActive par_grid_list_printAndSortActive
+#define collectActive par_grid_list_collectActive
+#define parseArgs par_grid_list_parseArgs
+#define parseFile par_grid_list_parseFile
+
 #define ALIVE 1
 #define DEAD 0
 #define BUFFER_SIZE 100
 
 typedef unsigned char bool;
 
-/** @brief Notifies the neighbours of (x,y,z) of its aliveness and adds them to list
+/** @brief Notifies the neighbours of (x,y,z) of its aliveness and adds the new ones to a frontier
  *
  *  @param graph The graph representation
+ *  @param graph_lock The per-list locks
  *  @param cube_size The size of the side of the cube that represents the 3D space
- *  @param list The list for keeping track of live cells and respective neighbours
+ *  @param found The frontier of the calling thread, for neighbours inserted in the graph
  *  @param x X coordinate
  *  @param y Y coordinate
  *  @param z Z coordinate
  */
 void visitNeighbours(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size,
-                        List* list, omp_lock_t* list_lock,
-                        coordinate x, coordinate y, coordinate z);
+                        Frontier* found, coordinate x, coordinate y, coordinate z);
+
+/** @brief Decides the next state of cells, removing the dead ones from the graph
+ *
+ *  The cells that will be alive are moved, in order, to the front of the array.
+ *
+ *  @param graph The graph representation
+ *  @param graph_lock The per-list locks
+ *  @param cells The cells
+ *  @param n_cells The number of cells
+ *  @return The number of cells that will be alive.
+ */
+long updateCells(GraphNode*** graph, omp_lock_t** graph_lock, Node* cells, long n_cells);
+
+/** @brief Processes generations on the graph
+ *
+ *  @param graph The graph representation
+ *  @param graph_lock The per-list locks
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param frontier The live cells, replaced by those of each generation
+ *  @param generations Number of generations to process
+ */
+void runGenerations(GraphNode*** graph, omp_lock_t** graph_lock, int cube_size, Frontier* frontier, int generations);
+
+/** @brief Runs the engine from a list of cells, for omp/life3d
+ *
+ *  Building with -DLIFE3D_ENGINE leaves out main(), so that omp/life3d can
+ *  link the engine and select it with --engine.
+ *
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param cells The live cells, as x y z triples, without repetitions
+ *  @param n_cells The number of live cells
+ *  @param generations Number of generations to process
+ *  @param live Set to the final live cells, as x y z triples in ascending order, to be freed by the caller
+ *  @return The number of final live cells.
+ */
+long parGridListRun(int cube_size, const int* cells, long n_cells, int generations, int** live);
+
+/** @brief Creates a lock for each list of the graph
+ *
+ *  @param size The size of the side of the cube that represents the 3D space
+ *  @return The initialized locks.
+ */
+omp_lock_t** initLocks(int size);
+
+/** @brief Destroys and frees the locks of the lists
+ *
+ *  @param graph_lock The per-list locks
+ *  @param size The size of the side of the cube that represents the 3D space
+ */
+void freeLocks(omp_lock_t** graph_lock, int size);
 
 /** @brief Initializes the graph representation structure
  *  
@@ -63,6 +128,16 @@ void freeGraph(GraphNode*** graph, int size);
  */
 void printAndSortActive(GraphNode*** graph, int cube_size);
 
+/** @brief Copies the cells of the graph, and sorts each of the lists
+ *
+ *  Like printAndSortActive, it relies on the graph only holding live cells.
+ *
+ *  @param graph The graph representation
+ *  @param cube_size The size of the side of the cube that represents the 3D space
+ *  @param live Filled with the cells, as x y z triples in ascending order
+ */
+void collectActive(GraphNode*** graph, int cube_size, int* live);
+
 /** @brief Parse command line arguments
  *
  *  @param argc Number of arguments
@@ -74,9 +149,9 @@ void parseArgs(int argc, char* argv[], char** file, int* generations);
 /** @brief Parse input file contents 
  *
  *  @param file Filename string
- *  @param list List for keeping track of live cells and neighbours
+ *  @param frontier Filled with the live cells
  *  @param cube_size The size of the side of the cube that represents the 3D space
  */
-GraphNode*** parseFile(char* file, List* list, int* cube_size);    
+GraphNode*** parseFile(char* file, Frontier* frontier, int* cube_size);    
 
 #endif
\ No newline at end of file
@@ -1,47 +1,23 @@
-#ifndef SEQUENTIAL_HPP
-#define SEQUENTIAL_HPP
-
-#include <fstream>
-#include <iostream>
-#include <sstream>
-#include <string>
-#include <stdlib.h>
-#include <vector>
-#include <list>
-#include <set>
-#include <sys/time.h>
-#include <omp.h>
-
-using namespace std;
-using std::string;
-using std::vector;
-
-#define ALIVE true
-#define DEAD false
-
-vector<vector<vector<bool> > > initGraph(int size);
-
-void printActive(vector<vector<vector<bool> > > graph, int cube_size);
-
-/* @brief
+/** @file seq_3d_cpp.hpp
+ *  @brief Dense 3D matrix engine with double buffering
  *
- */
-bool setNextState(vector<vector<vector<bool> > > graph, int cube_size, int x, int y, int z);
-
-/* @brief
+ *  The whole cube is kept in a single contiguous buffer, and two such
+ *  buffers are swapped at the end of each generation. The kernels live
+ *  in ../engine and are instantiated per rule and neighbourhood.
  *
+ *  @author Pedro Abreu
+ *  @author João Borrego
+ *  @author Miguel Cardoso
  */
-int liveNeighbors(vector<vector<vector<bool> > > graph, int cube_size, int x, int y, int z);
 
-/* @brief
- *
- */
-void parse_args(int argc, char* argv[], string &file, int &generations);
+#ifndef SEQ_3D_CPP_HPP
+#define SEQ_3D_CPP_HPP
 
-/* @ brief
- *
- */
-void parse_file(string file, int &cube_size, vector<vector<vector<bool> > > &graph);
-    
+#include <omp.h>
+
+#include "dense.hpp"
+#include "dispatch.hpp"
+#include "io.hpp"
+#include "schedule.hpp"
 
-#endif
\ No newline at end of file
+#endif